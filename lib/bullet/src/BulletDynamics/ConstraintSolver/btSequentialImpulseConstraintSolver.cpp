@@ -39,11 +39,12 @@ subject to the following restrictions:
 btSequentialImpulseConstraintSolver::btSequentialImpulseConstraintSolver()
 :m_btSeed2(0)
 {
-
+	m_fixedBody = new btRigidBody(0, 0, 0);
 }
 
 btSequentialImpulseConstraintSolver::~btSequentialImpulseConstraintSolver()
 {
+	delete m_fixedBody;
 }
 
 #ifdef USE_SIMD
@@ -1240,8 +1241,7 @@ void	btSequentialImpulseConstraintSolver::reset()
 
 btRigidBody& btSequentialImpulseConstraintSolver::getFixedBody()
 {
-	static btRigidBody s_fixed(0, 0,0);
-	s_fixed.setMassProps(btScalar(0.),btVector3(btScalar(0.),btScalar(0.),btScalar(0.)));
-	return s_fixed;
+	m_fixedBody->setMassProps(btScalar(0.),btVector3(btScalar(0.),btScalar(0.),btScalar(0.)));
+	return *m_fixedBody;
 }
 
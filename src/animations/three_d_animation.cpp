@@ -32,7 +32,9 @@
 #include "physics/physical_object.hpp"
 #include "physics/triangle_mesh.hpp"
 #include "tracks/bezier_curve.hpp"
+#include "tracks/track.hpp"
 #include "tracks/track_object.hpp"
+#include "tracks/track_object_manager.hpp"
 #include "utils/constants.hpp"
 #include <ISceneManager.h>
 #include <IMeshSceneNode.h>
@@ -120,6 +122,18 @@ void ThreeDAnimation::updateWithWorldTicks(bool has_physics)
     }
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Pauses or continues this animation. A paused animation is not updated
+ *  anymore, so the track object manager is told when it continues.
+ *  \param mode True to pause the animation.
+ */
+void ThreeDAnimation::setPaused(bool mode)
+{
+    m_is_paused = mode;
+    if (!mode && m_object && Track::getCurrentTrack())
+        Track::getCurrentTrack()->getTrackObjectManager()->wakeUp(m_object);
+}   // setPaused
+
 // ----------------------------------------------------------------------------
 /** Copying to child process of track object.
  */
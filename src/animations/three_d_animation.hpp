@@ -80,7 +80,10 @@ public:
     bool isCrashReset() const { return m_crash_reset; }
     bool isExplodeKartObject() const { return m_explode_kart; }
     bool isFlattenKartObject() const { return m_flatten_kart; }
-    void setPaused(bool mode){ m_is_paused = mode; }
+    void setPaused(bool mode);
+    // ------------------------------------------------------------------------
+    /** Returns true if the animation is paused by scripts. */
+    bool isPaused() const { return m_is_paused; }
     // ------------------------------------------------------------------------
     ThreeDAnimation* clone(TrackObject* obj);
 };   // ThreeDAnimation
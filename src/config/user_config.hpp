@@ -509,6 +509,12 @@ namespace UserConfigParams
     PARAM_PREFIX BoolUserConfigParam          m_random_player_pos
             PARAM_DEFAULT(  BoolUserConfigParam(false, "random-player-pos",
             &m_race_setup_group, "Randomize the position of the players at the start of a race. Doesn't apply to story mode.") );
+    PARAM_PREFIX IntUserConfigParam          m_simulation_threads
+            PARAM_DEFAULT(  IntUserConfigParam(0, "simulation-threads",
+            &m_race_setup_group, "Number of threads used to simulate a race, 0 to use one for each core (at most 8).") );
+    PARAM_PREFIX BoolUserConfigParam          m_parallel_physics
+            PARAM_DEFAULT(  BoolUserConfigParam(false, "parallel-physics",
+            &m_race_setup_group, "Solve independent groups of touching objects in parallel, using the simulation threads.") );
 
     // ---- Wiimote data
     PARAM_PREFIX GroupUserConfigParam        m_wiimote_group
@@ -786,6 +792,12 @@ namespace UserConfigParams
     /** If unit testing is enabled. */
     PARAM_PREFIX bool m_unit_testing PARAM_DEFAULT(false);
 
+    /** If micro benchmarks should be run. */
+    PARAM_PREFIX bool m_benchmark PARAM_DEFAULT(false);
+
+    /** If the server bundles of all tracks should be written. */
+    PARAM_PREFIX bool m_server_track_bundles PARAM_DEFAULT(false);
+
     /** If gamepad debugging is enabled. */
     PARAM_PREFIX bool m_gamepad_debug PARAM_DEFAULT( false );
 
@@ -832,6 +844,10 @@ namespace UserConfigParams
 
     PARAM_PREFIX bool m_no_start_screen   PARAM_DEFAULT( false );
 
+    /** Seed of the items and powerups in offline races, or -1 to use the
+     *  current time. */
+    PARAM_PREFIX int  m_item_seed         PARAM_DEFAULT( -1 );
+
     PARAM_PREFIX bool m_race_now          PARAM_DEFAULT( false );
 
     PARAM_PREFIX bool m_enforce_current_player PARAM_DEFAULT( false );
@@ -924,6 +940,10 @@ namespace UserConfigParams
         PARAM_DEFAULT(IntUserConfigParam(5, "timer-sync-difference-tolerance",
         &m_network_group, "Max time difference tolerance (in ms) to "
         "synchronize timer with server."));
+    PARAM_PREFIX BoolUserConfigParam m_skip_matching_rewind
+        PARAM_DEFAULT(BoolUserConfigParam(true, "skip-matching-rewind",
+        &m_network_group, "Skip a rewind if the game state from server "
+        "matches the local prediction within tolerance."));
     PARAM_PREFIX IntUserConfigParam m_default_ip_type
         PARAM_DEFAULT(IntUserConfigParam(0, "default-ip-type",
         &m_network_group, "Default IP type of this machine, "
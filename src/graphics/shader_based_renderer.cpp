@@ -739,8 +739,8 @@ void ShaderBasedRenderer::render(float dt, bool is_loading)
 
         std::ostringstream oss;
         oss << "drawAll() for kart " << cam;
-        PROFILER_PUSH_CPU_MARKER(oss.str().c_str(), (cam+1)*60,
-                                 0x00, 0x00);
+        PROFILER_PUSH_DYNAMIC_CPU_MARKER(oss.str().c_str(), (cam+1)*60,
+                                         0x00, 0x00);
         camera->activate(!CVS->isDeferredEnabled());
         rg->preRenderCallback(camera);   // adjusts start referee
         irr_driver->getSceneManager()->setActiveCamera(camnode);
@@ -796,7 +796,8 @@ void ShaderBasedRenderer::render(float dt, bool is_loading)
         std::ostringstream oss;
         oss << "renderPlayerView() for kart " << i;
 
-        PROFILER_PUSH_CPU_MARKER(oss.str().c_str(), 0x00, 0x00, (i+1)*60);
+        PROFILER_PUSH_DYNAMIC_CPU_MARKER(oss.str().c_str(), 0x00, 0x00,
+                                         (i+1)*60);
         rg->renderPlayerView(camera, dt);
 
         PROFILER_POP_CPU_MARKER();
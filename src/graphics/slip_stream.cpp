@@ -32,6 +32,7 @@
 #include "karts/controller/controller.hpp"
 #include "karts/kart_properties.hpp"
 #include "karts/max_speed.hpp"
+#include "modes/kart_proximity.hpp"
 #include "modes/world.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
@@ -39,6 +40,8 @@
 #include "utils/constants.hpp"
 #include "mini_glm.hpp"
 
+#include <algorithm>
+
 #include <IMeshCache.h>
 #include <ISceneManager.h>
 #include <SMeshBuffer.h>
@@ -846,6 +849,21 @@ void SlipStream::hideAllNodes()
 #endif
 }   // hideAllNodes
 
+//-----------------------------------------------------------------------------
+/** Returns how far from a kart another kart can be to get slipstream from
+ *  it, without half the length of the other kart: the length of the
+ *  slipstream (with the margin of the outer quad) at the current speed,
+ *  plus the length of the kart.
+ *  \param kart The kart giving slipstream.
+ */
+float SlipStream::getReach(const AbstractKart *kart)
+{
+    const KartProperties *kp = kart->getKartProperties();
+    float l = kp->getSlipstreamLength()*1.1f;//Outer quad margin
+    float speed_factor = kart->getSpeed()/kp->getSlipstreamBaseSpeed();
+    return l*speed_factor + kart->getKartLength();
+}   // getReach
+
 //-----------------------------------------------------------------------------
 /** Update, called once per timestep.
  *  \param dt Time step size.
@@ -918,15 +936,46 @@ void SlipStream::update(int ticks)
     bool is_inner_sstreaming = false;
     bool is_outer_sstreaming = false;
     m_target_kart            = NULL;
-    std::vector<float> target_value;
+    std::vector<float> target_value(num_karts, 0.0f);
 
     // Note that this loop can not be simply replaced with a shorter loop
     // using only the karts with a better position - since a kart might
-    // be a lap behind
-    for(unsigned int i=0; i<num_karts; i++)
+    // be a lap behind. Only karts which are close enough are tested, plus
+    // the previous target (which is reset below if it is too far away).
+    // With debug colors all karts are tested, since the colors are set for
+    // karts which are too far away too.
+    const bool debug_colors = UserConfigParams::m_slipstream_debug &&
+                              m_kart->getController()
+                                    ->isLocalPlayerController();
+    if (debug_colors)
+    {
+        m_candidate_karts.resize(num_karts);
+        for (unsigned int i = 0; i < num_karts; i++)
+            m_candidate_karts[i] = i;
+    }
+    else
+    {
+        const KartProximity *proximity = world->getKartProximity();
+        proximity->getKartsInRadius(m_kart->getXYZ(),
+                                    proximity->getMaxSlipstreamReach()
+                                    + 0.5f*m_kart->getKartLength(),
+                                    &m_candidate_karts);
+        if (m_previous_target_id >= 0 &&
+            !std::binary_search(m_candidate_karts.begin(),
+                                m_candidate_karts.end(),
+                                (unsigned int)m_previous_target_id))
+        {
+            m_candidate_karts.insert(
+                std::lower_bound(m_candidate_karts.begin(),
+                                 m_candidate_karts.end(),
+                                 (unsigned int)m_previous_target_id),
+                (unsigned int)m_previous_target_id);
+        }
+    }
+
+    for (unsigned int i : m_candidate_karts)
     {
         m_target_kart= world->getKart(i);
-        target_value.push_back(0);
 
         // Don't test for slipstream with itself, a kart that is being
         // rescued or exploding, a ghost kart or an eliminated kart
@@ -973,11 +1022,7 @@ void SlipStream::update(int ticks)
         // (additional target_kart_length because that kart's center
         // is not the center of rotation of the slipstreaming quad)
         Vec3 delta = m_kart->getXYZ() - m_target_kart->getXYZ();
-        float l    = kp_target->getSlipstreamLength()*1.1f;//Outer quad margin
-        float speed_factor = m_target_kart->getSpeed()
-                            /kp_target->getSlipstreamBaseSpeed();
-        l = l*speed_factor + m_target_kart->getKartLength()
-                           + 0.5f*m_kart->getKartLength();
+        float l    = getReach(m_target_kart) + 0.5f*m_kart->getKartLength();
         if(delta.length2() > l*l)
         {
             if (m_previous_target_id >= 0 && (int) i==m_previous_target_id)
@@ -1022,7 +1067,11 @@ void SlipStream::update(int ticks)
             is_outer_sstreaming     = true;
             continue;
         }
-    }   // for i < num_karts
+    }   // for i in m_candidate_karts
+
+    // The loop over all karts left the last kart as target if there is
+    // no better one, and the AI uses this target, so keep doing this
+    m_target_kart = num_karts > 0 ? world->getKart(num_karts - 1) : NULL;
 
     int best_target=-1;
     float best_target_value=0.0f;
@@ -36,6 +36,7 @@ namespace SP
 #include "graphics/moving_texture.hpp"
 #include "utils/no_copy.hpp"
 #include <memory>
+#include <vector>
 
 class AbstractKart;
 class Quad;
@@ -115,6 +116,9 @@ private:
      ** overtake the right kart. */
     AbstractKart* m_target_kart;
 
+    /** The world kart ids of the karts tested in update(). */
+    std::vector<unsigned int> m_candidate_karts;
+
     SP::SPMesh*  createMeshSP(unsigned material_id, bool bonus_mesh);
     scene::IAnimatedMesh* createMesh(unsigned material_id, bool bonus_mesh);
 
@@ -130,6 +134,7 @@ public:
     void         update(int ticks);
     bool         isSlipstreamReady() const;
     void         updateSpeedIncrease();
+    static float getReach(const AbstractKart *kart);
     // ------------------------------------------------------------------------
     /** Returns the quad in which slipstreaming is effective for
      *  this kart. */
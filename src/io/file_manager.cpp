@@ -266,6 +266,10 @@ FileManager::FileManager()
     checkAndCreateScreenshotDir();
     checkAndCreateReplayDir();
     checkAndCreateCachedTexturesDir();
+    checkAndCreateCachedBVHDir();
+    checkAndCreateCachedNavmeshDir();
+    checkAndCreateServerBundleDir();
+    checkAndCreateCachedScriptsDir();
     checkAndCreateGPDir();
 
     redirectOutput();
@@ -841,6 +845,38 @@ std::string FileManager::getCachedTexturesDir() const
     return m_cached_textures_dir;
 }   // getCachedTexturesDir
 
+//-----------------------------------------------------------------------------
+/** Returns the directory in which BVH trees of track meshes are cached.
+*/
+std::string FileManager::getCachedBVHDir() const
+{
+    return m_cached_bvh_dir;
+}   // getCachedBVHDir
+
+//-----------------------------------------------------------------------------
+/** Returns the directory in which path tables of arena navmeshes are cached.
+*/
+std::string FileManager::getCachedNavmeshDir() const
+{
+    return m_cached_navmesh_dir;
+}   // getCachedNavmeshDir
+
+//-----------------------------------------------------------------------------
+/** Returns the directory in which server bundles of tracks are stored.
+*/
+std::string FileManager::getServerBundleDir() const
+{
+    return m_server_bundle_dir;
+}   // getServerBundleDir
+
+//-----------------------------------------------------------------------------
+/** Returns the directory in which the bytecode of track scripts is cached.
+*/
+std::string FileManager::getCachedScriptsDir() const
+{
+    return m_cached_scripts_dir;
+}   // getCachedScriptsDir
+
 //-----------------------------------------------------------------------------
 /** Returns the directory in which user-defined grand prix should be stored.
  */
@@ -1209,6 +1245,79 @@ void FileManager::checkAndCreateCachedTexturesDir()
 
 }   // checkAndCreateCachedTexturesDir
 
+// ----------------------------------------------------------------------------
+/** Creates a directory for cached files, which are computed from the game
+ *  data and can be deleted at any time.
+ *  \param name Name of the directory in the cache directory, with slash.
+ *  \param apple_name Name of the directory on macOS, with slash.
+ *  \param description Describes what happens if the directory can't be
+ *         created, for the error message.
+ *  \return The path of the directory, or "" if it can't be created.
+ */
+std::string FileManager::checkAndCreateCacheDir(const std::string& name,
+                                                const std::string& apple_name,
+                                                const char* description)
+{
+#if defined(WIN32) || defined(__HAIKU__)
+    std::string dir = m_user_config_dir + name;
+#elif defined(__APPLE__)
+    std::string dir = getenv("HOME");
+    dir += "/Library/Application Support/SuperTuxKart/" + apple_name;
+#else
+    std::string dir = checkAndCreateLinuxDir("XDG_CACHE_HOME", "supertuxkart",
+                                             ".cache/", ".");
+    dir += name;
+#endif
+
+    if (!checkAndCreateDirectory(dir))
+    {
+        Log::error("FileManager", "Can not create cache directory '%s', %s.",
+                   dir.c_str(), description);
+        return "";
+    }
+    return dir;
+}   // checkAndCreateCacheDir
+
+// ----------------------------------------------------------------------------
+/** Creates the directories for cached BVH trees of track meshes. This will
+*  set m_cached_bvh_dir with the appropriate path.
+*/
+void FileManager::checkAndCreateCachedBVHDir()
+{
+    m_cached_bvh_dir = checkAndCreateCacheDir("cached-bvh/", "CachedBVH/",
+        "BVH trees will not be cached");
+}   // checkAndCreateCachedBVHDir
+
+// ----------------------------------------------------------------------------
+/** Creates the directories for cached path tables of arena navmeshes. This
+*  will set m_cached_navmesh_dir with the appropriate path.
+*/
+void FileManager::checkAndCreateCachedNavmeshDir()
+{
+    m_cached_navmesh_dir = checkAndCreateCacheDir("cached-navmesh/",
+        "CachedNavmesh/", "navmesh path tables will not be cached");
+}   // checkAndCreateCachedNavmeshDir
+
+// ----------------------------------------------------------------------------
+/** Creates the directory for server bundles of tracks. This will set
+*  m_server_bundle_dir with the appropriate path.
+*/
+void FileManager::checkAndCreateServerBundleDir()
+{
+    m_server_bundle_dir = checkAndCreateCacheDir("server-bundles/",
+        "ServerBundles/", "tracks will be loaded from their models");
+}   // checkAndCreateServerBundleDir
+
+// ----------------------------------------------------------------------------
+/** Creates the directory for the cached bytecode of track scripts. This
+*  will set m_cached_scripts_dir with the appropriate path.
+*/
+void FileManager::checkAndCreateCachedScriptsDir()
+{
+    m_cached_scripts_dir = checkAndCreateCacheDir("cached-scripts/",
+        "CachedScripts/", "scripts will be compiled each time");
+}   // checkAndCreateCachedScriptsDir
+
 // ----------------------------------------------------------------------------
 /** Creates the directories for user-defined grand prix. This will set m_gp_dir
  *  with the appropriate path.
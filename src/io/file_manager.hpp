@@ -98,6 +98,22 @@ private:
     /** Directory where resized textures are cached. */
     std::string       m_cached_textures_dir;
 
+    /** Directory where bullet BVH trees of track meshes are cached, empty
+     *  if it can't be created. */
+    std::string       m_cached_bvh_dir;
+
+    /** Directory where path tables of arena navmeshes are cached, empty if
+     *  it can't be created. */
+    std::string       m_cached_navmesh_dir;
+
+    /** Directory where server bundles of tracks are stored, empty if it
+     *  can't be created. */
+    std::string       m_server_bundle_dir;
+
+    /** Directory where the compiled bytecode of track scripts is cached,
+     *  empty if it can't be created. */
+    std::string       m_cached_scripts_dir;
+
     /** Directory where user-defined grand prix are stored. */
     std::string       m_gp_dir;
 
@@ -128,6 +144,13 @@ private:
     void              checkAndCreateScreenshotDir();
     void              checkAndCreateReplayDir();
     void              checkAndCreateCachedTexturesDir();
+    std::string       checkAndCreateCacheDir(const std::string& name,
+                                             const std::string& apple_name,
+                                             const char* description);
+    void              checkAndCreateCachedBVHDir();
+    void              checkAndCreateCachedNavmeshDir();
+    void              checkAndCreateServerBundleDir();
+    void              checkAndCreateCachedScriptsDir();
     void              checkAndCreateGPDir();
     void              discoverPaths();
     void              addAssetsSearchPath();
@@ -154,6 +177,10 @@ public:
     std::string       getScreenshotDir() const;
     std::string       getReplayDir() const;
     std::string       getCachedTexturesDir() const;
+    std::string       getCachedBVHDir() const;
+    std::string       getCachedNavmeshDir() const;
+    std::string       getServerBundleDir() const;
+    std::string       getCachedScriptsDir() const;
     std::string       getGPDir() const;
     std::string       getStdoutDir() const;
     bool              checkAndCreateDirectory(const std::string &path);
@@ -0,0 +1,102 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "io/mapped_file.hpp"
+
+#include "utils/file_utils.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef WIN32
+#  include <sys/mman.h>
+#endif
+
+// ----------------------------------------------------------------------------
+MappedFile::MappedFile()
+{
+    m_data   = NULL;
+    m_size   = 0;
+    m_mapped = false;
+}   // MappedFile
+
+// ----------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+    close();
+}   // ~MappedFile
+
+// ----------------------------------------------------------------------------
+/** Opens a file, closing the previously opened one.
+ *  \param filename Full path of the file.
+ *  \return False if the file can't be read or is empty.
+ */
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+    FILE* f = FileUtils::fopenU8Path(filename, "rb");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    if (size <= 0)
+    {
+        fclose(f);
+        return false;
+    }
+    m_size = (size_t)size;
+
+#ifndef WIN32
+    void* data = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    fclose(f);
+    if (data == MAP_FAILED)
+    {
+        m_size = 0;
+        return false;
+    }
+    m_data = data;
+    m_mapped = true;
+#else
+    m_data = malloc(m_size);
+    fseek(f, 0, SEEK_SET);
+    bool read = m_data && fread(m_data, m_size, 1, f) == 1;
+    fclose(f);
+    if (!read)
+    {
+        close();
+        return false;
+    }
+#endif
+    return true;
+}   // open
+
+// ----------------------------------------------------------------------------
+void MappedFile::close()
+{
+    if (m_data == NULL)
+        return;
+#ifndef WIN32
+    if (m_mapped)
+        munmap(m_data, m_size);
+    else
+#endif
+        free(m_data);
+    m_data   = NULL;
+    m_size   = 0;
+    m_mapped = false;
+}   // close
@@ -0,0 +1,60 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MAPPED_FILE_HPP
+#define HEADER_MAPPED_FILE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <cstddef>
+#include <string>
+
+/** A read-only file in memory. The file is memory mapped if possible, so
+ *  it's only read from disk when used, and the memory is shared by all
+ *  processes mapping the same file. Otherwise (on Windows) the whole file
+ *  is read into memory.
+ *  \ingroup io
+ */
+class MappedFile : public NoCopy
+{
+private:
+    void*  m_data;
+
+    size_t m_size;
+
+    /** True if m_data is mapped instead of allocated. */
+    bool   m_mapped;
+
+public:
+    MappedFile();
+    // ------------------------------------------------------------------------
+    ~MappedFile();
+    // ------------------------------------------------------------------------
+    bool open(const std::string& filename);
+    // ------------------------------------------------------------------------
+    void close();
+    // ------------------------------------------------------------------------
+    /** Returns the content of the file, NULL if not open. */
+    const void* getData() const                             { return m_data; }
+    // ------------------------------------------------------------------------
+    /** Returns the size of the file in bytes. */
+    size_t getSize() const                                  { return m_size; }
+
+};   // class MappedFile
+
+#endif
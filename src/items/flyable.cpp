@@ -21,6 +21,7 @@
 
 #include "items/flyable.hpp"
 
+#include <cfloat>
 #include <cmath>
 
 #include <IMeshManipulator.h>
@@ -40,6 +41,7 @@
 #include "karts/cannon_animation.hpp"
 #include "karts/controller/controller.hpp"
 #include "karts/explosion_animation.hpp"
+#include "modes/kart_proximity.hpp"
 #include "modes/linear_world.hpp"
 #include "network/compress_network_body.hpp"
 #include "network/network_config.hpp"
@@ -260,20 +262,26 @@ void Flyable::getClosestKart(const AbstractKart **minKart,
     *minKart = NULL;
 
     World *world = World::getWorld();
-    for(unsigned int i=0 ; i<world->getNumKarts(); i++ )
+    // Karts further away than 50 are ignored when aiming in front of a kart.
+    // The small margin covers rounding in the distance test below.
+    const float max_radius = inFrontOf != NULL ? 50.5f : FLT_MAX;
+    float distance2;
+    AbstractKart *nearest = world->getKartProximity()->getNearestKart(
+        trans_projectile.getOrigin(), max_radius, &distance2,
+        [this, world, &trans_projectile, inFrontOf, backwards]
+        (const AbstractKart *kart)
     {
-        AbstractKart *kart = world->getKart(i);
         // If a kart has star effect shown, the kart is immune, so
         // it is not considered a target anymore.
         if(kart->isEliminated() || kart == m_owner ||
             kart->isInvulnerable()                 ||
-            kart->getKartAnimation()                   ) continue;
+            kart->getKartAnimation()                   ) return FLT_MAX;
 
         // Don't hit teammates in team world
         if (world->hasTeam() &&
             world->getKartTeam(kart->getWorldKartId()) ==
             world->getKartTeam(m_owner->getWorldKartId()))
-            continue;
+            return FLT_MAX;
 
         btTransform t=kart->getTrans();
 
@@ -288,7 +296,7 @@ void Flyable::getClosestKart(const AbstractKart **minKart,
             // Ignore karts behind the current one
             Vec3 to_target       = kart->getXYZ() - inFrontOf->getXYZ();
             const float distance = to_target.length();
-            if(distance > 50) continue; // kart too far, don't aim at it
+            if(distance > 50) return FLT_MAX; // kart too far, don't aim at it
 
             btTransform trans = inFrontOf->getTrans();
             // get heading=trans.getBasis*(0,0,1) ... so save the multiplication:
@@ -302,16 +310,18 @@ void Flyable::getClosestKart(const AbstractKart **minKart,
             float c = to_target.dot(v)/s;
             // Original test was: fabsf(acos(c))>1,  which is the same as
             // c<cos(1) (acos returns values in [0, pi] anyway)
-            if(c<0.54) continue;
+            if(c<0.54) return FLT_MAX;
         }
+        return distance2;
+    });
 
-        if(distance2 < *minDistSquared)
-        {
-            *minDistSquared = distance2;
-            *minKart  = kart;
-            *minDelta = delta;
-        }
-    }  // for i<getNumKarts
+    if (nearest && distance2 < *minDistSquared)
+    {
+        *minDistSquared = distance2;
+        *minKart  = nearest;
+        *minDelta = nearest->getTrans().getOrigin()
+                  - trans_projectile.getOrigin();
+    }
 
 }   // getClosestKart
 
@@ -664,12 +674,12 @@ void Flyable::moveToInfinity(bool set_moveable_trans)
 }   // moveToInfinity
 
 // ----------------------------------------------------------------------------
-BareNetworkString* Flyable::saveState(std::vector<std::string>* ru)
+BareNetworkString* Flyable::saveState(std::vector<uint16_t>* ru)
 {
     if (m_has_hit_something)
         return NULL;
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
 
     BareNetworkString* buffer = new BareNetworkString();
     uint16_t ticks_since_thrown_animation = (m_ticks_since_thrown & 32767) |
@@ -688,6 +698,30 @@ BareNetworkString* Flyable::saveState(std::vector<std::string>* ru)
     return buffer;
 }   // saveState
 
+// ----------------------------------------------------------------------------
+BareNetworkString* Flyable::savePrediction(int* body_offset)
+{
+    *body_offset = -1;
+    if (m_has_hit_something)
+        return NULL;
+
+    BareNetworkString* buffer = new BareNetworkString();
+    uint16_t ticks_since_thrown_animation = (m_ticks_since_thrown & 32767) |
+        (hasAnimation() ? 32768 : 0);
+    buffer->addUInt16(ticks_since_thrown_animation);
+    if (m_do_terrain_info)
+        buffer->addUInt32(m_compressed_gravity_vector);
+
+    if (hasAnimation())
+        m_animation->saveState(buffer);
+    else
+    {
+        *body_offset = buffer->getTotalSize();
+        CompressNetworkBody::save(m_body.get(), buffer);
+    }
+    return buffer;
+}   // savePrediction
+
 // ----------------------------------------------------------------------------
 void Flyable::restoreState(BareNetworkString *buffer, int count)
 {
@@ -259,9 +259,11 @@ public:
     // ------------------------------------------------------------------------
     virtual void computeError() OVERRIDE;
     // ------------------------------------------------------------------------
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru)
         OVERRIDE;
     // ------------------------------------------------------------------------
+    virtual BareNetworkString* savePrediction(int* body_offset) OVERRIDE;
+    // ------------------------------------------------------------------------
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
     /* Return true if still in game state, or otherwise can be deleted. */
@@ -40,12 +40,19 @@
 #include <IMesh.h>
 #include <IAnimatedMesh.h>
 
+#include <algorithm>
 #include <assert.h>
+#include <cmath>
 #include <stdexcept>
 #include <sstream>
 #include <string>
 
 
+/** Size of the cells of the item grid. hitKart only accepts karts closer
+ *  than 2 * sqrt(m_distance_2) (about 2.2m) to an item, so the items which
+ *  can be hit are all in the cell of the kart and the 8 cells around it. */
+static const float ITEM_CELL_SIZE = 5.0f;
+
 std::vector<scene::IMesh *>  ItemManager::m_item_mesh;
 std::vector<scene::IMesh *>  ItemManager::m_item_lowres_mesh;
 std::vector<video::SColorf>  ItemManager::m_glow_color;
@@ -246,6 +253,7 @@ unsigned int ItemManager::insertItem(Item *item)
     }
     item->setItemId(index);
     insertItemInQuad(item);
+    insertItemInCell(item);
     // Now insert into the appropriate quad list, if there is a quad list
     // (i.e. race mode has a quad graph).
     return index;
@@ -270,6 +278,27 @@ void ItemManager::insertItemInQuad(Item *item)
     }   // if m_items_in_quads
 }   // insertItemInQuad
 
+//-----------------------------------------------------------------------------
+/** Returns the key of the cell of the item grid which contains xyz, or of a
+ *  neighbour of this cell.
+ *  \param xyz The position.
+ *  \param dx, dz Offset of the neighbour cell.
+ */
+uint64_t ItemManager::getCellKey(const Vec3 &xyz, int dx, int dz)
+{
+    const int32_t x = (int32_t)floorf(xyz.getX() / ITEM_CELL_SIZE) + dx;
+    const int32_t z = (int32_t)floorf(xyz.getZ() / ITEM_CELL_SIZE) + dz;
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+}   // getCellKey
+
+//-----------------------------------------------------------------------------
+/** Inserts an item into the item grid according to its position.
+ */
+void ItemManager::insertItemInCell(ItemState *item)
+{
+    m_items_in_cells[getCellKey(item->getXYZ())].push_back(item);
+}   // insertItemInCell
+
 //-----------------------------------------------------------------------------
 /** Creates a new item at the location of the kart (e.g. kart drops a
  *  bubblegum).
@@ -388,26 +417,41 @@ void ItemManager::collectedItem(ItemState *item, AbstractKart *kart)
  */
 void  ItemManager::checkItemHit(AbstractKart* kart)
 {
-    // We could use m_items_in_quads to to check for item hits: take the quad
-    // of the graph node of the kart, and only check items in that quad. But
-    // then we also need to check for any adjacent quads (since an item just
-    // on the order of one quad might get hit from an adjacent quad). Then
-    // it is possible that a quad is that short that we need to test adjacent
-    // of adjacent quads. And check for items outside of the track.
-    // Since at this stace item detection is by far not a bottle neck,
-    // the original, simple and stable algorithm is left in place.
-
     /** Disable item collection detection for debug purposes. */
     if(m_disable_item_collection) return;
 
     // Spare tire karts don't collect items
     if ( dynamic_cast<SpareTireAI*>(kart->getController()) ) return;
 
-    for(AllItemTypes::iterator i =m_all_items.begin();
-                               i!=m_all_items.end();  i++)
+    // Only items in the cell of the kart or the cells around can be hit.
+    // They are tested in the order of m_all_items (i.e. by item id), so
+    // that several items hit at the same time are collected in the same
+    // order on all clients and the server.
+    const Vec3 &xyz = kart->getXYZ();
+    AllItemTypes& items = m_hit_candidates;
+    items.clear();
+    for (int dz = -1; dz <= 1; dz++)
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            auto cell = m_items_in_cells.find(getCellKey(xyz, dx, dz));
+            if (cell != m_items_in_cells.end())
+            {
+                items.insert(items.end(), cell->second.begin(),
+                             cell->second.end());
+            }
+        }
+    }
+    std::sort(items.begin(), items.end(),
+        [](const ItemState *a, const ItemState *b)
+        {
+            return a->getItemId() < b->getItemId();
+        });
+
+    for(AllItemTypes::iterator i =items.begin(); i!=items.end();  i++)
     {
         // Ignore items that have been collected or are not available atm
-        if ((!*i) || !(*i)->isAvailable() || (*i)->isUsedUp()) continue;
+        if (!(*i)->isAvailable() || (*i)->isUsedUp()) continue;
 
         // Shielded karts can simply drive over bubble gums without any effect
         if ( kart->isShielded() &&
@@ -420,11 +464,11 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
 
         // To allow inlining and avoid including kart.hpp in item.hpp,
         // we pass the kart and the position separately.
-        if((*i)->hitKart(kart->getXYZ(), kart))
+        if((*i)->hitKart(xyz, kart))
         {
             collectedItem(*i, kart);
         }   // if hit
-    }   // for m_all_items
+    }   // for items
 }   // checkItemHit
 
 //-----------------------------------------------------------------------------
@@ -529,6 +573,7 @@ void ItemManager::deleteItem(ItemState *item)
 {
     // First check if the item needs to be removed from the items-in-quad list
     deleteItemInQuad(item);
+    deleteItemInCell(item);
     int index = item->getItemId();
     m_all_items[index] = NULL;
     delete item;
@@ -553,6 +598,25 @@ void ItemManager::deleteItemInQuad(ItemState* item)
     }   // if m_items_in_quads
 }   // deleteItemInQuad
 
+//-----------------------------------------------------------------------------
+/** Removes an item from the item grid, the item must be at the same position
+ *  as when it was inserted.
+ */
+void ItemManager::deleteItemInCell(ItemState *item)
+{
+    auto cell = m_items_in_cells.find(getCellKey(item->getXYZ()));
+    assert(cell != m_items_in_cells.end());
+    if (cell == m_items_in_cells.end())
+        return;
+    AllItemTypes &items = cell->second;
+    AllItemTypes::iterator it = std::find(items.begin(), items.end(), item);
+    assert(it != items.end());
+    if (it != items.end())
+        items.erase(it);
+    if (items.empty())
+        m_items_in_cells.erase(cell);
+}   // deleteItemInCell
+
 //-----------------------------------------------------------------------------
 /** Switches all items: boxes become bananas and vice versa for a certain
  *  amount of time (as defined in stk_config.xml).
@@ -35,6 +35,7 @@
 #include <memory>
 #include <random>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class Kart;
@@ -113,6 +114,15 @@ private:
      *  field is undefined if no Graph exist, e.g. arena without navmesh. */
     std::vector< AllItemTypes > *m_items_in_quads;
 
+    /** Stores which items are in which cell of a 2d grid (x/z plane), used
+     *  to find the items a kart can hit. The key is the cell index in x
+     *  and z, see getCellKey. */
+    std::unordered_map<uint64_t, AllItemTypes> m_items_in_cells;
+
+    /** Items near the kart in checkItemHit, only kept to avoid allocating
+     *  memory for each kart in each tick. */
+    AllItemTypes m_hit_candidates;
+
     /** Stores all item models. */
     static std::vector<scene::IMesh *> m_item_mesh;
 
@@ -132,6 +142,9 @@ protected:
     void setSwitchItems(const std::vector<int> &switch_items);
     void insertItemInQuad(Item *item);
     void deleteItemInQuad(ItemState *item);
+    void insertItemInCell(ItemState *item);
+    void deleteItemInCell(ItemState *item);
+    static uint64_t getCellKey(const Vec3 &xyz, int dx = 0, int dz = 0);
 public:
              ItemManager();
     virtual ~ItemManager();
@@ -219,9 +219,9 @@ void NetworkItemManager::setItemConfirmationTime(std::weak_ptr<STKPeer> peer,
  *  to save the initial state, which is the first confirmed state by all
  *  clients.
  */
-BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
+BareNetworkString* NetworkItemManager::saveState(std::vector<uint16_t>* ru)
 {
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
     // On the server:
     // ==============
     m_item_events.lock();
@@ -244,6 +244,15 @@ BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
     return s;
 }   // saveState
 
+//-----------------------------------------------------------------------------
+/** Client doesn't store any item events, so only a confirmed state without
+ *  item events matches the prediction.
+ */
+BareNetworkString* NetworkItemManager::savePrediction(int* body_offset)
+{
+    return new BareNetworkString();
+}   // savePrediction
+
 //-----------------------------------------------------------------------------
 /** Progresses the time for all item by the given number of ticks. Used
  *  when computing a new state from a confirmed state.
@@ -484,7 +493,15 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
         // ... will be copied from item state to item
         if (is && item)
         {
+            // The confirmed state can be another item than the predicted
+            // one, so it might be in another cell of the item grid
+            const bool moved = getCellKey(item->getXYZ()) !=
+                               getCellKey(is->getXYZ());
+            if (moved)
+                deleteItemInCell(item);
             *(ItemState*)item = *is;
+            if (moved)
+                insertItemInCell(item);
         }
         else if (is && !item)
         {
@@ -497,10 +514,12 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
             *((ItemState*)item_new) = *is;
             m_all_items[i] = item_new;
             insertItemInQuad(item_new);
+            insertItemInCell(item_new);
         }
         else if (!is && item)
         {
             deleteItemInQuad(item);
+            deleteItemInCell(item);
             delete item;
             m_all_items[i] = NULL;
         }
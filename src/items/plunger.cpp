@@ -254,19 +254,37 @@ void Plunger::hitTrack()
 }   // hitTrack
 
 // ----------------------------------------------------------------------------
-BareNetworkString* Plunger::saveState(std::vector<std::string>* ru)
+BareNetworkString* Plunger::saveState(std::vector<uint16_t>* ru)
 {
     BareNetworkString* buffer = Flyable::saveState(ru);
     if (!buffer)
         return NULL;
 
+    saveStateInternal(buffer);
+    return buffer;
+}   // saveState
+
+// ----------------------------------------------------------------------------
+BareNetworkString* Plunger::savePrediction(int* body_offset)
+{
+    BareNetworkString* buffer = Flyable::savePrediction(body_offset);
+    if (!buffer)
+        return NULL;
+
+    saveStateInternal(buffer);
+    return buffer;
+}   // savePrediction
+
+// ----------------------------------------------------------------------------
+/** Writes the plunger specific state after the flyable state. */
+void Plunger::saveStateInternal(BareNetworkString* buffer) const
+{
     buffer->addUInt16(m_keep_alive);
     if (m_rubber_band)
         buffer->addUInt8(m_rubber_band->get8BitState());
     else
         buffer->addUInt8(255);
-    return buffer;
-}   // saveState
+}   // saveStateInternal
 
 // ----------------------------------------------------------------------------
 void Plunger::restoreState(BareNetworkString *buffer, int count)
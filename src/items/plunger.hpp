@@ -48,6 +48,8 @@ private:
 
     bool m_reverse_mode, m_has_locally_played_sound, m_moved_to_infinity;
 
+    void saveStateInternal(BareNetworkString* buffer) const;
+
 public:
                  Plunger(AbstractKart *kart);
                 ~Plunger();
@@ -67,9 +69,11 @@ public:
     /** No hit effect when it ends. */
     virtual HitEffect *getHitEffect() const OVERRIDE           { return NULL; }
     // ------------------------------------------------------------------------
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru)
         OVERRIDE;
     // ------------------------------------------------------------------------
+    virtual BareNetworkString* savePrediction(int* body_offset) OVERRIDE;
+    // ------------------------------------------------------------------------
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
     virtual void onFireFlyable() OVERRIDE;
@@ -884,12 +884,31 @@ bool RubberBall::hit(AbstractKart* kart, PhysicalObject* object)
 }   // hit
 
 // ----------------------------------------------------------------------------
-BareNetworkString* RubberBall::saveState(std::vector<std::string>* ru)
+BareNetworkString* RubberBall::saveState(std::vector<uint16_t>* ru)
 {
     BareNetworkString* buffer = Flyable::saveState(ru);
     if (!buffer)
         return NULL;
 
+    saveStateInternal(buffer);
+    return buffer;
+}   // saveState
+
+// ----------------------------------------------------------------------------
+BareNetworkString* RubberBall::savePrediction(int* body_offset)
+{
+    BareNetworkString* buffer = Flyable::savePrediction(body_offset);
+    if (!buffer)
+        return NULL;
+
+    saveStateInternal(buffer);
+    return buffer;
+}   // savePrediction
+
+// ----------------------------------------------------------------------------
+/** Writes the rubber ball specific state after the flyable state. */
+void RubberBall::saveStateInternal(BareNetworkString* buffer)
+{
     buffer->addUInt16((int16_t)m_last_aimed_graph_node);
     buffer->add(m_control_points[0]);
     buffer->add(m_control_points[1]);
@@ -907,8 +926,7 @@ BareNetworkString* RubberBall::saveState(std::vector<std::string>* ru)
     buffer->addFloat(m_current_max_height);
     buffer->addUInt8(m_tunnel_count | (m_aiming_at_target ? (1 << 7) : 0));
     TrackSector::saveState(buffer);
-    return buffer;
-}   // saveState
+}   // saveStateInternal
 
 // ----------------------------------------------------------------------------
 void RubberBall::restoreState(BareNetworkString *buffer, int count)
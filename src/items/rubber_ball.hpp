@@ -209,6 +209,7 @@ private:
                                      const float vertical_offset) const;
     bool         checkTunneling();
     void removePingSFX();
+    void saveStateInternal(BareNetworkString* buffer);
 
 public:
                  RubberBall  (AbstractKart* kart);
@@ -222,9 +223,11 @@ public:
      *  karts are handled by this hit() function. */
     //virtual HitEffect *getHitEffect() const {return NULL; }
     // ------------------------------------------------------------------------
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru)
         OVERRIDE;
     // ------------------------------------------------------------------------
+    virtual BareNetworkString* savePrediction(int* body_offset) OVERRIDE;
+    // ------------------------------------------------------------------------
     virtual void restoreState(BareNetworkString *buffer, int count) OVERRIDE;
     // ------------------------------------------------------------------------
     virtual void onFireFlyable() OVERRIDE;
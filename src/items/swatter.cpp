@@ -40,6 +40,7 @@
 #include "karts/explosion_animation.hpp"
 #include "karts/kart_properties.hpp"
 #include "modes/capture_the_flag.hpp"
+#include "modes/kart_proximity.hpp"
 #include "network/network_string.hpp"
 #include "network/rewind_manager.hpp"
 
@@ -326,32 +327,27 @@ void Swatter::chooseTarget()
 {
     // TODO: for the moment, only handle karts...
     const World*  world         = World::getWorld();
-    AbstractKart* closest_kart  = NULL;
-    float         min_dist2     = FLT_MAX;
+    float         min_dist2;
 
-    for(unsigned int i=0; i<world->getNumKarts(); i++)
+    AbstractKart* closest_kart = world->getKartProximity()->getNearestKart(
+        m_kart->getXYZ(), FLT_MAX, &min_dist2,
+        [this, world](const AbstractKart *kart)
     {
-        AbstractKart *kart = world->getKart(i);
         // TODO: isSwatterReady(), isSquashable()?
         if(kart->isEliminated() || kart==m_kart || kart->getKartAnimation())
-            continue;
+            return FLT_MAX;
         // don't squash an already hurt kart
         if (kart->isInvulnerable() || kart->isSquashed())
-            continue;
+            return FLT_MAX;
 
         // Don't hit teammates in team world
         if (world->hasTeam() &&
             world->getKartTeam(kart->getWorldKartId()) ==
             world->getKartTeam(m_kart->getWorldKartId()))
-            continue;
+            return FLT_MAX;
 
-        float dist2 = (kart->getXYZ()-m_kart->getXYZ()).length2();
-        if(dist2<min_dist2)
-        {
-            min_dist2 = dist2;
-            closest_kart = kart;
-        }
-    }
+        return (kart->getXYZ()-m_kart->getXYZ()).length2();
+    });
     // Not larger than 2^5 - 1 for kart id for optimizing state saving
     if (closest_kart && closest_kart->getWorldKartId() < 31)
         m_closest_kart = closest_kart;
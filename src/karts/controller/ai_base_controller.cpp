@@ -42,6 +42,7 @@ AIBaseController::AIBaseController(AbstractKart *kart)
     m_kart_width    = m_kart->getKartWidth();
     m_ai_properties = m_kart->getKartProperties()
                             ->getAIPropertiesForDifficulty();
+    m_prepared_ticks = -1;
 }   // AIBaseController
 
 //-----------------------------------------------------------------------------
@@ -51,6 +52,7 @@ void AIBaseController::reset()
     m_enabled_network_ai = false;
     m_stuck = false;
     m_collision_ticks.clear();
+    m_prepared_ticks = -1;
 }   // reset
 
 //-----------------------------------------------------------------------------
@@ -58,8 +60,28 @@ void AIBaseController::reset()
 void AIBaseController::update(int ticks)
 {
     m_stuck = false;
+    m_prepared_ticks = -1;
 }
 
+//-----------------------------------------------------------------------------
+/** Called at the end of prepareUpdate() to indicate that update() in this
+ *  tick can use the decisions computed there.
+ */
+void AIBaseController::setPrepared()
+{
+    m_prepared_ticks = World::getWorld()->getTicksSinceStart();
+}   // setPrepared
+
+//-----------------------------------------------------------------------------
+/** Returns true if prepareUpdate() computed the decisions for the current
+ *  tick. Otherwise (e.g. if the controller is updated outside of
+ *  World::update) update() has to compute them itself.
+ */
+bool AIBaseController::isPrepared() const
+{
+    return m_prepared_ticks == World::getWorld()->getTicksSinceStart();
+}   // isPrepared
+
 //-----------------------------------------------------------------------------
 /** In debug mode when the user specified --ai-debug on the command line set
  *  the name of the controller as on-screen text, so that the different AI
@@ -42,6 +42,10 @@ private:
     *  this kart is stuck and needs to be rescued. */
     bool m_stuck;
 
+    /** The world tick in which prepareUpdate() computed the decisions of
+     *  this controller, or -1. */
+    int m_prepared_ticks;
+
 protected:
     bool m_enabled_network_ai;
 
@@ -80,6 +84,9 @@ protected:
     // ------------------------------------------------------------------------
     /** Return true if AI can skid now. */
     virtual bool canSkid(float steer_fraction) = 0;
+    // ------------------------------------------------------------------------
+    void         setPrepared();
+    bool         isPrepared() const;
 
 public:
              AIBaseController(AbstractKart *kart);
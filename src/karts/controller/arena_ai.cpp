@@ -71,6 +71,19 @@ void ArenaAI::reset()
     AIBaseController::reset();
 }   // reset
 
+//-----------------------------------------------------------------------------
+/** Finds the target of this AI from the state of the world at the start of
+ *  the tick, so that the targets of all AIs can be found in parallel.
+ *  \param ticks Number of physics time steps - should be 1.
+ */
+void ArenaAI::prepareUpdate(int ticks)
+{
+    if (!m_graph || m_kart->getKartAnimation() || isWaiting())
+        return;
+    findTarget();
+    setPrepared();
+}   // prepareUpdate
+
 //-----------------------------------------------------------------------------
 /** This is the main entry point for the AI.
  *  It is called once per frame for each AI and determines the behaviour of
@@ -127,7 +140,8 @@ void ArenaAI::update(int ticks)
     if (gettingUnstuck(ticks))
         return;
 
-    findTarget();
+    if (!isPrepared())
+        findTarget();
 
     // After found target, convert it to local coordinate, used for skidding or
     // u-turn
@@ -188,6 +188,8 @@ public:
     // ------------------------------------------------------------------------
     virtual void update(int ticks) OVERRIDE;
     // ------------------------------------------------------------------------
+    virtual void prepareUpdate(int ticks) OVERRIDE;
+    // ------------------------------------------------------------------------
     virtual void reset() OVERRIDE;
     // ------------------------------------------------------------------------
     virtual void newLap(int lap) OVERRIDE {}
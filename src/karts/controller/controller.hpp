@@ -62,6 +62,11 @@ public:
     virtual      ~Controller         () {};
     virtual void  reset              () = 0;
     virtual void  update             (int ticks) = 0;
+    /** Called before the karts are updated in each tick. It can compute
+     *  what update() needs from the state of the world, but must not
+     *  change anything but this controller, since it is called for all
+     *  karts at the same time in different threads. */
+    virtual void  prepareUpdate      (int ticks) {}
     virtual void  handleZipper       (bool play_sound) = 0;
     virtual void  collectedItem      (const ItemState &item,
                                       float previous_energy=0) = 0;
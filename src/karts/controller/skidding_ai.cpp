@@ -37,6 +37,7 @@
 #include "karts/max_speed.hpp"
 #include "karts/rescue_animation.hpp"
 #include "karts/skidding.hpp"
+#include "modes/kart_proximity.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/profile_world.hpp"
 #include "physics/triangle_mesh.hpp"
@@ -175,6 +176,8 @@ void SkiddingAI::reset()
     m_current_track_direction    = DriveNode::DIR_STRAIGHT;
     m_item_to_collect            = NULL;
     m_last_direction_node        = 0;
+    m_prepared_aim_point         = Vec3(0,0,0);
+    m_prepared_last_node         = Graph::UNKNOWN_SECTOR;
     m_avoid_item_close           = false;
     m_skid_probability_state     = SKID_PROBAB_NOT_YET;
     m_last_item_random           = NULL;
@@ -325,7 +328,8 @@ void SkiddingAI::update(int ticks)
     }
 
     // Get information that is needed by more than 1 of the handling funcs
-    computeNearestKarts();
+    if (!isPrepared())
+        computeNearestKarts();
 
     if (!m_enabled_network_ai)
     {
@@ -341,8 +345,11 @@ void SkiddingAI::update(int ticks)
     }
 
     //Detect if we are going to crash with the track and/or kart
-    checkCrashes(m_kart->getXYZ());
-    determineTrackDirection();
+    if (!isPrepared())
+    {
+        checkCrashes(m_kart->getXYZ());
+        determineTrackDirection();
+    }
 
     /*Response handling functions*/
     handleAccelerationAndBraking(ticks);
@@ -358,6 +365,43 @@ void SkiddingAI::update(int ticks)
     AIBaseLapController::update(ticks);
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Computes the information about the other karts, the track ahead and the
+ *  point to aim at before the karts are updated. This only depends on the
+ *  state of the world at the start of the tick, so it is done for all AI
+ *  karts in parallel, and the result doesn't depend on the order in which
+ *  the karts are updated.
+ *  \param ticks Number of physics time steps - should be 1.
+ */
+void SkiddingAI::prepareUpdate(int ticks)
+{
+    if (m_kart->getKartAnimation() || m_world->isStartPhase())
+        return;
+
+    computeNearestKarts();
+    checkCrashes(m_kart->getXYZ());
+    determineTrackDirection();
+    m_prepared_last_node = Graph::UNKNOWN_SECTOR;
+    findAimPoint(&m_prepared_aim_point, &m_prepared_last_node);
+    setPrepared();
+}   // prepareUpdate
+
+//-----------------------------------------------------------------------------
+/** Finds the point to aim at with the selected point selection algorithm.
+ *  \param result On exit contains the point the AI should aim at.
+ *  \param last_node On exit contains the graph node of that point.
+ */
+void SkiddingAI::findAimPoint(Vec3 *result, int *last_node)
+{
+    switch(m_point_selection_algorithm)
+    {
+    case PSA_NEW:    findNonCrashingPointNew(result, last_node);
+                     break;
+    case PSA_DEFAULT:findNonCrashingPoint(result, last_node);
+                     break;
+    }
+}   // findAimPoint
+
 //-----------------------------------------------------------------------------
 /** Decides in which direction to steer. If the kart is off track, it will
  *  steer towards the center of the track. Otherwise it will call one of
@@ -469,13 +513,13 @@ void SkiddingAI::handleSteering(float dt)
         Vec3 aim_point;
         int last_node = Graph::UNKNOWN_SECTOR;
 
-        switch(m_point_selection_algorithm)
+        if (isPrepared())
         {
-        case PSA_NEW:    findNonCrashingPointNew(&aim_point, &last_node);
-                         break;
-        case PSA_DEFAULT:findNonCrashingPoint(&aim_point, &last_node);
-                         break;
+            aim_point = m_prepared_aim_point;
+            last_node = m_prepared_last_node;
         }
+        else
+            findAimPoint(&aim_point, &last_node);
 #ifdef AI_DEBUG
         m_debug_sphere[m_point_selection_algorithm]->setPosition(aim_point.toIrrVector());
 #endif
@@ -1928,13 +1972,8 @@ void SkiddingAI::computeNearestKarts()
     std::sort(overall_distance.begin(), overall_distance.end(), std::greater<float>());
    
     // Get the AI's position (the position update may not be done, leading to crashes)
-    int curr_position = 1;
-    for(unsigned int i=0; i<m_world->getNumKarts(); i++)
-    {
-        if(   m_world->getOverallDistance(i) > own_overall_distance
-           && !m_world->getKart(i)->isEliminated())
-            curr_position++;
-    }
+    int curr_position = 1 +
+        m_world->getKartProximity()->getNumKartsAhead(own_overall_distance);
 
     for(unsigned int i=0; i<n; i++)
     {
@@ -2486,8 +2525,6 @@ void SkiddingAI::checkCrashes(const Vec3& pos )
         m_crashes.m_kart = slip->getSlipstreamTarget()->getWorldKartId();
     }
 
-    const size_t NUM_KARTS = m_world->getNumKarts();
-
     float speed = m_kart->getVelocity().length();
     // If the velocity is zero, no sense in checking for crashes in time
     if(speed==0) return;
@@ -2505,6 +2542,14 @@ void SkiddingAI::checkCrashes(const Vec3& pos )
                   steps, m_kart_length, m_kart->getVelocityLC().getZ());
         steps=1000;
     }
+
+    // Only the karts which can get closer than m_kart_length to any of the
+    // points tested below are candidates, the small margin covers rounding.
+    const KartProximity *proximity = m_world->getKartProximity();
+    float radius = m_kart_length * (steps + 1)
+                 + proximity->getMaxSpeed() * steps * dt;
+    proximity->getKartsInRadius(pos, radius * 1.01f + 1.0f, &m_nearby_karts);
+
     for(int i = 1; steps > i; ++i)
     {
         Vec3 step_coord = pos + vel_normal* m_kart_length * float(i);
@@ -2514,7 +2559,7 @@ void SkiddingAI::checkCrashes(const Vec3& pos )
          */
         if( m_crashes.m_kart == -1 )
         {
-            for( unsigned int j = 0; j < NUM_KARTS; ++j )
+            for (unsigned int j : m_nearby_karts)
             {
                 const AbstractKart* kart = m_world->getKart(j);
                 // Ignore eliminated karts
@@ -127,6 +127,9 @@ private:
         void clear() {m_road = false; m_kart = -1;}
     } m_crashes;
 
+    /** The karts which checkCrashes() tests, kept to avoid allocations. */
+    std::vector<unsigned int> m_nearby_karts;
+
     RaceManager::AISuperPower m_superpower;
 
     /*General purpose variables*/
@@ -235,6 +238,12 @@ private:
     enum {PSA_DEFAULT, PSA_NEW}
           m_point_selection_algorithm;
 
+    /** The point to aim at as computed in prepareUpdate(). */
+    Vec3  m_prepared_aim_point;
+
+    /** The graph node of m_prepared_aim_point. */
+    int   m_prepared_last_node;
+
     ItemManager* m_item_manager;
 #ifdef AI_DEBUG
     /** For skidding debugging: shows the estimated turn shape. */
@@ -289,6 +298,7 @@ private:
     void  checkCrashes(const Vec3& pos);
     void  findNonCrashingPointNew(Vec3 *result, int *last_node);
     void  findNonCrashingPoint(Vec3 *result, int *last_node);
+    void  findAimPoint(Vec3 *result, int *last_node);
 
     void  determineTrackDirection();
     virtual bool canSkid(float steer_fraction);
@@ -302,6 +312,7 @@ public:
                  SkiddingAI(AbstractKart *kart);
                 ~SkiddingAI();
     virtual void update      (int ticks);
+    virtual void prepareUpdate(int ticks);
     virtual void reset       ();
     virtual const irr::core::stringw& getNamePostfix() const;
 };
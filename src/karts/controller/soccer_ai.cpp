@@ -102,6 +102,22 @@ void SoccerAI::reset()
 
 }   // reset
 
+//-----------------------------------------------------------------------------
+/** Updates \ref m_front_transform and finds the target before the karts are
+ *  updated, see ArenaAI::prepareUpdate.
+ *  \param ticks Number of physics time steps - should be 1.
+ */
+void SoccerAI::prepareUpdate(int ticks)
+{
+    if (m_world->isGoalPhase())
+        return;
+    m_force_brake = false;
+    m_chasing_ball = false;
+    m_front_transform.setOrigin(m_kart->getFrontXYZ());
+    m_front_transform.setBasis(m_kart->getTrans().getBasis());
+    ArenaAI::prepareUpdate(ticks);
+}   // prepareUpdate
+
 //-----------------------------------------------------------------------------
 /** Update \ref m_front_transform for ball aiming functions, also make AI stop
  *  after goal.
@@ -115,10 +131,13 @@ void SoccerAI::update(int ticks)
     m_red_sphere->setPosition(red.toIrrVector());
     m_blue_sphere->setPosition(blue.toIrrVector());
 #endif
-    m_force_brake = false;
-    m_chasing_ball = false;
-    m_front_transform.setOrigin(m_kart->getFrontXYZ());
-    m_front_transform.setBasis(m_kart->getTrans().getBasis());
+    if (!isPrepared())
+    {
+        m_force_brake = false;
+        m_chasing_ball = false;
+        m_front_transform.setOrigin(m_kart->getFrontXYZ());
+        m_front_transform.setBasis(m_kart->getTrans().getBasis());
+    }
 
     if (m_world->isGoalPhase())
     {
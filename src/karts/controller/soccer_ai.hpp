@@ -102,6 +102,7 @@ public:
                  SoccerAI(AbstractKart *kart);
                 ~SoccerAI();
     virtual void update (int ticks) OVERRIDE;
+    virtual void prepareUpdate(int ticks) OVERRIDE;
     virtual void reset() OVERRIDE;
 
 };
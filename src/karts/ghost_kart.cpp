@@ -66,23 +66,56 @@ void GhostKart::addReplayEvent(float time,
     GhostController* gc = dynamic_cast<GhostController*>(getController());
     gc->addReplayTime(time);
 
-    m_all_transform.push_back(trans);
-    m_all_physic_info.push_back(pi);
-    m_all_bonus_info.push_back(bi);
-    m_all_replay_events.push_back(kre);
+    ReplayEvents::Event event;
+    event.m_transform         = trans;
+    event.m_physic_info       = pi;
+    event.m_bonus_info        = bi;
+    event.m_kart_replay_event = kre;
+    m_replay_events.add(event);
 
     // Use first frame of replay to calculate default suspension
-    if (m_all_physic_info.size() == 1)
-    {
-        float f = 0;
-        for (int i = 0; i < 4; i++)
-            f += m_all_physic_info[0].m_suspension_length[i];
-        m_graphical_y_offset = -f / 4 + getKartModel()->getLowestPoint();
-        m_kart_model->setDefaultSuspension();
-    }
+    if (m_replay_events.size() == 1)
+        setDefaultSuspension(event);
 
 }   // addReplayEvent
 
+// ----------------------------------------------------------------------------
+/** Uses the events of a binary replay file, which are decoded when they are
+ *  needed.
+ *  \param file The replay file.
+ *  \param body_offset Offset of the first chunk in the file.
+ *  \param chunks The chunks of this kart.
+ *  \return False if the chunks are invalid.
+ */
+bool GhostKart::loadReplayChunks(std::shared_ptr<const MappedFile> file,
+                                 size_t body_offset,
+                                 const std::vector<ReplayEvents::Chunk>& chunks)
+{
+    std::vector<float> times;
+    if (!m_replay_events.setChunks(file, body_offset, chunks, &times))
+        return false;
+
+    GhostController* gc = dynamic_cast<GhostController*>(getController());
+    for (float time : times)
+        gc->addReplayTime(time);
+
+    if (!m_replay_events.empty())
+        setDefaultSuspension(m_replay_events.get(0));
+    return true;
+}   // loadReplayChunks
+
+// ----------------------------------------------------------------------------
+/** Uses the first event of the replay to calculate the default suspension.
+ */
+void GhostKart::setDefaultSuspension(const ReplayEvents::Event& first)
+{
+    float f = 0;
+    for (int i = 0; i < 4; i++)
+        f += first.m_physic_info.m_suspension_length[i];
+    m_graphical_y_offset = -f / 4 + getKartModel()->getLowestPoint();
+    m_kart_model->setDefaultSuspension();
+}   // setDefaultSuspension
+
 // ----------------------------------------------------------------------------
 /** Called once per rendered frame. It is used to only update any graphical
  *  effects.
@@ -133,26 +166,30 @@ void GhostKart::update(int ticks)
     }
 
     const float rd         = gc->getReplayDelta();
-    assert(idx < m_all_transform.size());
+    assert(idx < m_replay_events.size());
 
-    if (idx >= m_all_transform.size() - 1)
+    const ReplayEvents::Event current = m_replay_events.get(idx);
+    // The last event is used again at the end of the replay
+    const ReplayEvents::Event next = idx + 1 < m_replay_events.size()
+                                   ? m_replay_events.get(idx + 1) : current;
+    if (idx >= m_replay_events.size() - 1)
     {
-        setXYZ(m_all_transform.back().getOrigin());
-        setRotation(m_all_transform.back().getRotation());
+        setXYZ(current.m_transform.getOrigin());
+        setRotation(current.m_transform.getRotation());
     }
     else
     {
-        setXYZ((1- rd)*m_all_transform[idx    ].getOrigin()
-               +  rd  *m_all_transform[idx + 1].getOrigin() );
-        const btQuaternion q = m_all_transform[idx].getRotation()
-            .slerp(m_all_transform[idx + 1].getRotation(), rd);
+        setXYZ((1- rd)*current.m_transform.getOrigin()
+               +  rd  *next.m_transform.getOrigin() );
+        const btQuaternion q = current.m_transform.getRotation()
+            .slerp(next.m_transform.getRotation(), rd);
         setRotation(q);
     }
 
     Moveable::updatePosition();
     float dt = stk_config->ticks2Time(ticks);
-    getKartModel()->update(dt, dt*(m_all_physic_info[idx].m_speed),
-        m_all_physic_info[idx].m_steer, m_all_physic_info[idx].m_speed,
+    getKartModel()->update(dt, dt*(current.m_physic_info.m_speed),
+        current.m_physic_info.m_steer, current.m_physic_info.m_speed,
         /*lean*/0.0f, idx);
 
     // Attachment management
@@ -163,7 +200,7 @@ void GhostKart::update(int ticks)
     // graphical effect only.
 
     Attachment::AttachmentType attach_type =
-        ReplayRecorder::codeToEnumAttach(m_all_bonus_info[idx].m_attachment);
+        ReplayRecorder::codeToEnumAttach(current.m_bonus_info.m_attachment);
     int16_t attach_ticks = 0;
     if (attach_type == Attachment::ATTACH_BUBBLEGUM_SHIELD)
         attach_ticks = (int16_t)stk_config->time2Ticks(10);
@@ -192,15 +229,15 @@ void GhostKart::update(int ticks)
 
     // Update item amount and type
     PowerupManager::PowerupType item_type =
-        ReplayRecorder::codeToEnumItem(m_all_bonus_info[idx].m_item_type); 
-    m_powerup->set(item_type, m_all_bonus_info[idx].m_item_amount);
+        ReplayRecorder::codeToEnumItem(current.m_bonus_info.m_item_type); 
+    m_powerup->set(item_type, current.m_bonus_info.m_item_amount);
 
     // Update special values in easter egg and battle modes
     if (RaceManager::get()->isEggHuntMode())
     {
         if (idx > m_last_egg_idx &&
-            m_all_bonus_info[idx].m_special_value >
-            m_all_bonus_info[m_last_egg_idx].m_special_value)
+            current.m_bonus_info.m_special_value >
+            m_replay_events.get(m_last_egg_idx).m_bonus_info.m_special_value)
         {
             EasterEggHunt *world = dynamic_cast<EasterEggHunt*>(World::getWorld());
             assert(world);
@@ -209,25 +246,25 @@ void GhostKart::update(int ticks)
         }
     }
 
-    m_collected_energy = (1- rd)*m_all_bonus_info[idx    ].m_nitro_amount
-                         +  rd  *m_all_bonus_info[idx + 1].m_nitro_amount;
+    m_collected_energy = (1- rd)*current.m_bonus_info.m_nitro_amount
+                         +  rd  *next.m_bonus_info.m_nitro_amount;
 
     // Graphical effects for nitro, zipper and skidding
-    getKartGFX()->setGFXFromReplay(m_all_replay_events[idx].m_nitro_usage,
-                                   m_all_replay_events[idx].m_zipper_usage,
-                                   m_all_replay_events[idx].m_skidding_effect,
-                                   m_all_replay_events[idx].m_red_skidding);
+    const ReplayBase::KartReplayEvent& kre = current.m_kart_replay_event;
+    getKartGFX()->setGFXFromReplay(kre.m_nitro_usage, kre.m_zipper_usage,
+                                   kre.m_skidding_effect,
+                                   kre.m_red_skidding);
     getKartGFX()->update(dt);
 
     Vec3 front(0, 0, getKartLength()*0.5f);
     m_xyz_front = getTrans()(front);
 
-    if (m_all_replay_events[idx].m_jumping && !m_is_jumping)
+    if (kre.m_jumping && !m_is_jumping)
     {
         m_is_jumping = true;
         getKartModel()->setAnimation(KartModel::AF_JUMP_START);
     }
-    else if (!m_all_replay_events[idx].m_jumping && m_is_jumping)
+    else if (!kre.m_jumping && m_is_jumping)
     {
         m_is_jumping = false;
         getKartModel()->setAnimation(KartModel::AF_DEFAULT);
@@ -245,13 +282,15 @@ float GhostKart::getSpeed() const
     unsigned int current_index = gc->getCurrentReplayIndex();
     const float rd             = gc->getReplayDelta();
 
-    assert(gc->getCurrentReplayIndex() < m_all_physic_info.size());
+    assert(gc->getCurrentReplayIndex() < m_replay_events.size());
 
-    if (current_index >= m_all_physic_info.size() - 1)
-        return m_all_physic_info.back().m_speed;
+    const float speed =
+        m_replay_events.get(current_index).m_physic_info.m_speed;
+    if (current_index >= m_replay_events.size() - 1)
+        return speed;
 
-    return (1-rd)*m_all_physic_info[current_index    ].m_speed
-           +  rd *m_all_physic_info[current_index + 1].m_speed;
+    return (1-rd)*speed
+           +  rd *m_replay_events.get(current_index + 1).m_physic_info.m_speed;
 }   // getSpeed
 
 // ----------------------------------------------------------------------------
@@ -296,7 +335,8 @@ float GhostKart::getTimeForDistance(float distance)
     int current_index = gc->getCurrentReplayIndex();
 
     // Second, get the current distance
-    float current_distance = m_all_replay_events[current_index].m_distance;
+    float current_distance =
+        m_replay_events.get(current_index).m_kart_replay_event.m_distance;
 
     // This determines in which direction we will search a matching frame
     bool search_forward = (current_distance < distance);
@@ -318,18 +358,20 @@ float GhostKart::getTimeForDistance(float distance)
     {
         // If we have reached the end of the replay file without finding the
         // searched distance, break
-        if (upper_frame_index >= m_all_replay_events.size() ||
+        if (upper_frame_index >= m_replay_events.size() ||
             lower_frame_index < 0 )
             break;
 
+        const float lower_distance = m_replay_events.get(lower_frame_index)
+                                         .m_kart_replay_event.m_distance;
+        const float upper_distance = m_replay_events.get(upper_frame_index)
+                                         .m_kart_replay_event.m_distance;
         // The target distance was reached between those two frames
-        if (m_all_replay_events[lower_frame_index].m_distance <= distance &&
-            m_all_replay_events[upper_frame_index].m_distance >= distance )
+        if (lower_distance <= distance &&
+            upper_distance >= distance )
         {
-            float lower_diff =
-                distance - m_all_replay_events[lower_frame_index].m_distance;
-            float upper_diff =
-                m_all_replay_events[upper_frame_index].m_distance - distance;
+            float lower_diff = distance - lower_distance;
+            float upper_diff = upper_distance - distance;
 
             if ((lower_diff + upper_diff) == 0)
                 upper_ratio = 0.0f;
@@ -353,7 +395,7 @@ float GhostKart::getTimeForDistance(float distance)
 
     float ghost_time;
 
-    if (upper_frame_index >= m_all_replay_events.size() ||
+    if (upper_frame_index >= m_replay_events.size() ||
         lower_frame_index < 0 )
         ghost_time = -1.0f;
     else
@@ -374,7 +416,8 @@ float GhostKart::getTimeForEggs(int egg_number)
     int current_index = gc->getCurrentReplayIndex();
 
     // Second, get the current egg number
-    int current_eggs = m_all_bonus_info[current_index].m_special_value;
+    int current_eggs =
+        m_replay_events.get(current_index).m_bonus_info.m_special_value;
 
     // This determines in which direction we will search a matching frame
     bool search_forward = (current_eggs < egg_number);
@@ -389,13 +432,15 @@ float GhostKart::getTimeForEggs(int egg_number)
     {
         // If we have reached the end of the replay file without finding the
         // searched distance, break
-        if (upper_frame_index >= m_all_bonus_info.size() ||
+        if (upper_frame_index >= m_replay_events.size() ||
             lower_frame_index < 0 )
             break;
 
         // The target distance was reached between those two frames
-        if (m_all_bonus_info[lower_frame_index].m_special_value <  egg_number &&
-            m_all_bonus_info[upper_frame_index].m_special_value == egg_number)
+        if (m_replay_events.get(lower_frame_index).m_bonus_info
+                                            .m_special_value <  egg_number &&
+            m_replay_events.get(upper_frame_index).m_bonus_info
+                                            .m_special_value == egg_number)
         {
             break;
         }
@@ -414,7 +459,7 @@ float GhostKart::getTimeForEggs(int egg_number)
 
     float ghost_time;
 
-    if (upper_frame_index >= m_all_bonus_info.size() ||
+    if (upper_frame_index >= m_replay_events.size() ||
         lower_frame_index < 0 )
         ghost_time = -1.0f;
     else
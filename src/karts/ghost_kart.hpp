@@ -20,11 +20,13 @@
 #define HEADER_GHOST_KART_HPP
 
 #include "karts/kart.hpp"
+#include "replay/replay_events.hpp"
 #include "replay/replay_play.hpp"
 #include "utils/cpp2011.hpp"
 
 #include "LinearMath/btTransform.h"
 
+#include <memory>
 #include <vector>
 
 /** \defgroup karts */
@@ -37,14 +39,8 @@
 class GhostKart : public Kart
 {
 private:
-    /** The transforms to assume at the corresponding time in m_all_times. */
-    std::vector<btTransform>                 m_all_transform;
-
-    std::vector<ReplayBase::PhysicInfo>      m_all_physic_info;
-
-    std::vector<ReplayBase::BonusInfo>       m_all_bonus_info;
-
-    std::vector<ReplayBase::KartReplayEvent> m_all_replay_events;
+    /** The events to assume at the corresponding time in the controller. */
+    ReplayEvents                             m_replay_events;
 
     ReplayPlay::ReplayData m_replay_data;
 
@@ -55,6 +51,8 @@ private:
     // ----------------------------------------------------------------------------
     /** Compute the time at which the ghost finished the race */
     void          computeFinishTime();
+    // ----------------------------------------------------------------------------
+    void          setDefaultSuspension(const ReplayEvents::Event& first);
 public:
                   GhostKart(const std::string& ident, unsigned int world_kart_id,
                             int position, float color_hue,
@@ -70,7 +68,10 @@ public:
     virtual void  createPhysics() OVERRIDE {};
     // ------------------------------------------------------------------------
     const float   getSuspensionLength(int index, int wheel) const
-               { return m_all_physic_info[index].m_suspension_length[wheel]; }
+    {
+        return m_replay_events.get(index).m_physic_info
+                                         .m_suspension_length[wheel];
+    }
     // ------------------------------------------------------------------------
     void          addReplayEvent(float time,
                                  const btTransform &trans,
@@ -78,6 +79,10 @@ public:
                                  const ReplayBase::BonusInfo &bi,
                                  const ReplayBase::KartReplayEvent &kre);
     // ------------------------------------------------------------------------
+    bool          loadReplayChunks(std::shared_ptr<const MappedFile> file,
+                                   size_t body_offset,
+                                   const std::vector<ReplayEvents::Chunk>& chunks);
+    // ------------------------------------------------------------------------
     /** Returns whether this kart is a ghost (replay) kart. */
     virtual bool  isGhostKart() const OVERRIDE { return true; }
     // ------------------------------------------------------------------------
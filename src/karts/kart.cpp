@@ -63,6 +63,7 @@
 #include "karts/skidding.hpp"
 #include "main_loop.hpp"
 #include "modes/capture_the_flag.hpp"
+#include "modes/kart_proximity.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/overworld.hpp"
 #include "modes/soccer_world.hpp"
@@ -1341,6 +1342,9 @@ void Kart::eliminate()
         m_engine_sound->stop();
 
     m_eliminated = true;
+    KartProximity *proximity = World::getWorld()->getKartProximity();
+    if (proximity)
+        proximity->removeKart(getWorldKartId());
 
 #ifndef SERVER_ONLY
     if (m_shadow)
@@ -162,12 +162,35 @@ void KartRewinder::computeError()
  *  \param[out] ru The unique identity of rewinder writing to.
  *  \return The address of the memory buffer with the state.
  */
-BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
+BareNetworkString* KartRewinder::saveState(std::vector<uint16_t>* ru)
 {
     if (m_eliminated)
         return nullptr;
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
+    return saveStateInternal(NULL);
+}   // saveState
+
+// ----------------------------------------------------------------------------
+/** Saves the predicted state of this kart on client, which is the same as
+ *  saveState except that the physics values are not rounded.
+ *  \param[out] body_offset Offset of the compressed body in the buffer.
+ */
+BareNetworkString* KartRewinder::savePrediction(int* body_offset)
+{
+    if (m_eliminated)
+        return nullptr;
+    *body_offset = -1;
+    return saveStateInternal(body_offset);
+}   // savePrediction
+
+// ----------------------------------------------------------------------------
+/** Writes the state of the kart for saveState and savePrediction.
+ *  \param body_offset If not NULL, the offset of the body is saved in it
+ *         and the physics values are not rounded.
+ */
+BareNetworkString* KartRewinder::saveStateInternal(int* body_offset)
+{
     const int MEMSIZE = 17*sizeof(float) + 9+3;
 
     BareNetworkString *buffer = new BareNetworkString(MEMSIZE);
@@ -229,8 +252,16 @@ BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
     }
     else
     {
-        CompressNetworkBody::compress(
-            m_body.get(), m_motion_state.get(), buffer);
+        if (body_offset)
+        {
+            *body_offset = buffer->getTotalSize();
+            CompressNetworkBody::save(m_body.get(), buffer);
+        }
+        else
+        {
+            CompressNetworkBody::compress(
+                m_body.get(), m_motion_state.get(), buffer);
+        }
 
         if (m_vehicle->getTimedRotationTicks() > 0)
         {
@@ -264,7 +295,7 @@ BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
     m_skidding->saveState(buffer);
 
     return buffer;
-}   // saveState
+}   // saveStateInternal
 
 // ----------------------------------------------------------------------------
 /** Actually rewind to the specified state. 
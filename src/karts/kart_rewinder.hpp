@@ -32,6 +32,8 @@ private:
     float m_prev_steering, m_steering_smoothing_dt, m_steering_smoothing_time;
 
     bool m_has_server_state;
+
+    BareNetworkString* saveStateInternal(int* body_offset);
 public:
     KartRewinder(const std::string& ident, unsigned int world_kart_id,
                  int position, const btTransform& init_transform,
@@ -40,8 +42,9 @@ public:
     ~KartRewinder() {}
     virtual void saveTransform() OVERRIDE;
     virtual void computeError() OVERRIDE;
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru)
         OVERRIDE;
+    virtual BareNetworkString* savePrediction(int* body_offset) OVERRIDE;
     void reset() OVERRIDE;
     virtual void restoreState(BareNetworkString *p, int count) OVERRIDE;
     virtual void rewindToEvent(BareNetworkString *p) OVERRIDE {}
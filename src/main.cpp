@@ -244,6 +244,7 @@ extern "C" {
 #include "karts/official_karts.hpp"
 #include "modes/cutscene_world.hpp"
 #include "modes/demo_world.hpp"
+#include "modes/kart_proximity.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
 #include "network/protocols/server_lobby.hpp"
@@ -252,6 +253,7 @@ extern "C" {
 #include "network/network_string.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "network/race_event_manager.hpp"
 #include "network/rewind_manager.hpp"
@@ -268,6 +270,8 @@ extern "C" {
 #include "race/highscore_manager.hpp"
 #include "race/history.hpp"
 #include "race/race_manager.hpp"
+#include "race/simulation_benchmark.hpp"
+#include "replay/replay_events.hpp"
 #include "replay/replay_play.hpp"
 #include "replay/replay_recorder.hpp"
 #include "states_screens/main_menu_screen.hpp"
@@ -284,13 +288,16 @@ extern "C" {
 #include "utils/command_line.hpp"
 #include "utils/constants.hpp"
 #include "utils/crash_reporting.hpp"
+#include "utils/interval_tree.hpp"
 #include "utils/leak_check.hpp"
 #include "utils/log.hpp"
+#include "utils/mpsc_queue.hpp"
 #include "mini_glm.hpp"
 #include "utils/profiler.hpp"
 #include "utils/stk_process.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/translation.hpp"
+#include "utils/worker_pool.hpp"
 #include "io/rich_presence.hpp"
 
 #include <IrrlichtDevice.h>
@@ -298,6 +305,7 @@ extern "C" {
 static void cleanSuperTuxKart();
 static void cleanUserConfig();
 void runUnitTests();
+void runBenchmarks();
 
 // ============================================================================
 //                        gamepad visualisation screen
@@ -725,6 +733,21 @@ void cmdDebugHelp()
     "       --gamepad-visuals           Debug gamepads by visualising their values.\n"
     "       --no-high-scores            Disable writing high scores.\n"
     "       --unit-testing              Run unit tests and exit.\n"
+    "       --benchmark                 Run micro benchmarks and exit.\n"
+    "       --server-track-bundles      Write the server bundles of all tracks and exit\n"
+    "                                   (implies --no-graphics).\n"
+    "       --sim-benchmark=file        Run AI only races without graphics and audio, write the\n"
+    "                                   ticks per second, time per subsystem and memory to a\n"
+    "                                   JSON file and exit.\n"
+    "       --sim-benchmark-cases=l     Comma separated mode:track list of the simulation\n"
+    "                                   benchmark, modes are race, battle, soccer and ctf.\n"
+    "       --sim-benchmark-ticks=n     Number of ticks simulated in each case.\n"
+    "       --sim-benchmark-karts=n     Number of AI karts in each case.\n"
+    "       --sim-benchmark-physics     Run each case with 8, 16 and 32 karts, with sequential\n"
+    "                                   and parallel physics, and compare the results.\n"
+    "       --trace=file                Record the profiler events in a trace file (for\n"
+    "                                   chrome://tracing or Perfetto), also with --no-graphics.\n"
+    "       --trace-time=s              Stop recording the trace after s seconds.\n"
     "       --gamepad-debug             Enable verbose logging of gamepad button presses.\n"
     "       --keyboard-debug            Enable verbose logging of keyboard key presses.\n"
     "       --wiimote-debug             Enable verbose logging of Wii Remote button presses.\n"
@@ -1001,6 +1024,7 @@ int handleCmdLinePreliminary()
     if (CommandLine::has("--seed", &n))
     {
         srand(n);
+        UserConfigParams::m_item_seed = n;
         Log::info("main", "STK using random seed (%d)", n);
     }
 
@@ -1028,6 +1052,10 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         UserConfigParams::m_no_high_scores=true;
     if (CommandLine::has("--unit-testing"))
         UserConfigParams::m_unit_testing = true;
+    if (CommandLine::has("--benchmark"))
+        UserConfigParams::m_benchmark = true;
+    if (CommandLine::has("--server-track-bundles"))
+        UserConfigParams::m_server_track_bundles = true;
     if (CommandLine::has("--gamepad-debug"))
         UserConfigParams::m_gamepad_debug=true;
     if (CommandLine::has("--keyboard-debug"))
@@ -1726,6 +1754,21 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         RaceManager::get()->setNumLaps(999999); // profile end depends on time
     }   // --profile-time
 
+    if (CommandLine::has("--sim-benchmark", &s))
+    {
+        std::string cases;
+        CommandLine::has("--sim-benchmark-cases", &cases);
+        SimulationBenchmark::enable(s, cases);
+        if (CommandLine::has("--sim-benchmark-ticks", &n) && n > 0)
+            SimulationBenchmark::setTicks(n);
+        if (CommandLine::has("--sim-benchmark-karts", &n) && n > 0)
+            SimulationBenchmark::setNumKarts(n);
+        if (CommandLine::has("--sim-benchmark-physics"))
+            SimulationBenchmark::enablePhysicsMode();
+        // This initialises the player structures like the profile mode
+        UserConfigParams::m_no_start_screen = true;
+    }   // --sim-benchmark
+
     if(CommandLine::has("--history"))
     {
         history->setReplayHistory(true);
@@ -2187,7 +2230,8 @@ int main(int argc, char *argv[])
             FileManager::setStdoutDir(s);
 
 #ifndef SERVER_ONLY
-        if(CommandLine::has("--no-graphics") || CommandLine::has("-l"))
+        if(CommandLine::has("--no-graphics") || CommandLine::has("-l") ||
+           CommandLine::has("--server-track-bundles"))
 #endif
             GUIEngine::disableGraphics();
 
@@ -2257,6 +2301,12 @@ int main(int argc, char *argv[])
 
         if (!GUIEngine::isNoGraphics())
             profiler.init();
+        if (CommandLine::has("--trace", &s))
+        {
+            float seconds = 0.0f;
+            CommandLine::has("--trace-time", &seconds);
+            profiler.startTrace(s, seconds);
+        }
         // Create the story mode timer with empty setting first, it will
         // be reset later after story mode status and player manager is loaded
         story_mode_timer = new StoryModeTimer();
@@ -2371,6 +2421,16 @@ int main(int argc, char *argv[])
             runUnitTests();
             exit(0);
         }
+        if(UserConfigParams::m_benchmark)
+        {
+            runBenchmarks();
+            exit(0);
+        }
+        if(UserConfigParams::m_server_track_bundles)
+        {
+            Track::createServerBundles();
+            exit(0);
+        }
 
 #ifndef SERVER_ONLY
         if (!GUIEngine::isNoGraphics())
@@ -2561,9 +2621,16 @@ int main(int argc, char *argv[])
             }   // if !online
         }
 
+        if (SimulationBenchmark::isEnabled())
+        {
+            // Simulation benchmark
+            // ====================
+            SimulationBenchmark::run();
+            main_loop->abort();
+        }
         // Not replaying
         // =============
-        if(!ProfileWorld::isProfileMode())
+        else if(!ProfileWorld::isProfileMode())
         {
             if(UserConfigParams::m_no_start_screen)
             {
@@ -2676,6 +2743,7 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
  */
 static void cleanSuperTuxKart()
 {
+    profiler.stopTrace();
 
     delete main_loop;
 
@@ -2723,6 +2791,7 @@ static void cleanSuperTuxKart()
     if(history)                 delete history;
     ReplayPlay::destroy();
     ReplayRecorder::destroy();
+    WorkerPool::destroy();
     delete ParticleKindManager::get();
     PlayerManager::destroy();
     if(unlock_manager)          delete unlock_manager;
@@ -2815,6 +2884,12 @@ void runUnitTests()
     Log::info("UnitTest", "StringUtils::versionToInt");
     StringUtils::unitTesting();
 
+    Log::info("UnitTest", "IntervalTree");
+    IntervalTree<int, int>::unitTesting();
+
+    Log::info("UnitTest", "MPSCQueue");
+    MPSCQueue<int>::unitTesting();
+
     Log::info("UnitTest", "Easter detection");
     // Test easter mode: in 2015 Easter is 5th of April - check with 0 days
     // before and after
@@ -2852,16 +2927,47 @@ void runUnitTests()
     Log::info("UnitTest", "Kart characteristics");
     CombinedCharacteristic::unitTesting();
 
+    Log::info("UnitTest", "KartProximity");
+    KartProximity::unitTesting();
+
     Log::info("UnitTest", "Arena Graph");
     ArenaGraph::unitTesting();
 
+    Log::info("UnitTest", "Track bundles");
+    Track::unitTesting();
+
     Log::info("UnitTest", "Fonts for translation");
     font_manager->unitTesting();
 
     Log::info("UnitTest", "RewindQueue");
     RewindQueue::unitTesting();
 
+    Log::info("UnitTest", "GameProtocol delta states");
+    GameProtocol::unitTesting();
+
+    Log::info("UnitTest", "ReplayEvents");
+    ReplayEvents::unitTesting();
+
     Log::info("UnitTest", "=====================");
     Log::info("UnitTest", "Testing successful   ");
     Log::info("UnitTest", "=====================");
 }   // runUnitTests
+
+//=============================================================================
+void runBenchmarks()
+{
+    Log::info("Benchmark", "Starting benchmarks");
+    Log::info("Benchmark", "=====================");
+    Log::info("Benchmark", "RewindQueue");
+    RewindQueue::benchmark();
+    Log::info("Benchmark", "STKHost");
+    STKHost::benchmark();
+    Log::info("Benchmark", "Track");
+    Track::benchmark();
+    Log::info("Benchmark", "Graph");
+    Graph::benchmark();
+    Log::info("Benchmark", "ArenaGraph");
+    ArenaGraph::benchmark();
+
+    Log::info("Benchmark", "=====================");
+}   // runBenchmarks
@@ -321,11 +321,21 @@ void MainLoop::updateRace(int ticks, bool fast_forward)
 {
     if (!World::getWorld())  return;   // No race on atm - i.e. we are in menu
 
+    auto start = std::chrono::steady_clock::now();
     // The race event manager will update world in case of an online race
     if (RaceEventManager::get() && RaceEventManager::get()->isRunning())
         RaceEventManager::get()->update(ticks, fast_forward);
     else
         World::getWorld()->updateWorld(ticks);
+
+    // Let the server scale the state frequency to keep up with the tick rate
+    if (NetworkConfig::get()->isNetworking() &&
+        NetworkConfig::get()->isServer() && STKHost::existHost())
+    {
+        STKHost::get()->updateTickCost(
+            std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::steady_clock::now() - start).count());
+    }
 }   // updateRace
 
 //-----------------------------------------------------------------------------
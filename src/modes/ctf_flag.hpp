@@ -89,7 +89,14 @@ public:
     // ------------------------------------------------------------------------
     virtual void computeError() {}
     // ------------------------------------------------------------------------
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru);
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru);
+    // ------------------------------------------------------------------------
+    virtual BareNetworkString* savePrediction(int* body_offset)
+    {
+        // The flag state has no side effect when saving
+        std::vector<uint16_t> ru;
+        return saveState(&ru);
+    }
     // ------------------------------------------------------------------------
     virtual void undoEvent(BareNetworkString* buffer) {}
     // ------------------------------------------------------------------------
@@ -0,0 +1,453 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "modes/kart_proximity.hpp"
+
+#include "graphics/slip_stream.hpp"
+#include "karts/abstract_kart.hpp"
+#include "modes/world.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    /** Size of a grid cell. Most queries have a radius of a few cells. */
+    const float CELL_SIZE = 32.0f;
+
+    /** Cell coordinates are limited to this value, so that they fit in 21
+     *  bits of a key. */
+    const int MAX_CELL = (1 << 20) - 1;
+
+    // ------------------------------------------------------------------------
+    uint64_t getCellKey(int x, int y, int z)
+    {
+        return   (uint64_t(x + MAX_CELL + 1) << 42)
+               | (uint64_t(y + MAX_CELL + 1) << 21)
+               |  uint64_t(z + MAX_CELL + 1);
+    }   // getCellKey
+}   // namespace
+
+// ----------------------------------------------------------------------------
+KartProximity::KartProximity(const World *world)
+{
+    m_world                = world;
+    m_max_speed            = 0.0f;
+    m_max_slipstream_reach = 0.0f;
+    m_distance_changed     = true;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        m_min_cell[i] = MAX_CELL;
+        m_max_cell[i] = -MAX_CELL;
+    }
+}   // KartProximity
+
+// ----------------------------------------------------------------------------
+/** Returns the cell coordinate of a position coordinate, which is limited
+ *  to +-MAX_CELL (also for NAN).
+ */
+int KartProximity::getCellCoordinate(float f)
+{
+    float c = std::floor(f / CELL_SIZE);
+    if (!(c > -MAX_CELL)) return -MAX_CELL;
+    if (!(c <  MAX_CELL)) return  MAX_CELL;
+    return (int)c;
+}   // getCellCoordinate
+
+// ----------------------------------------------------------------------------
+/** Stores the position of a kart and its cell. Does not change m_cells.
+ */
+void KartProximity::setPosition(unsigned int kart_id, const Vec3 &xyz)
+{
+    m_xyz[kart_id] = xyz;
+    int cell[3];
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        cell[i] = getCellCoordinate(xyz[i]);
+        m_min_cell[i] = std::min(m_min_cell[i], cell[i]);
+        m_max_cell[i] = std::max(m_max_cell[i], cell[i]);
+    }
+    m_cell[kart_id] = getCellKey(cell[0], cell[1], cell[2]);
+}   // setPosition
+
+// ----------------------------------------------------------------------------
+/** Stores the position of a kart and its cell, and the values for which
+ *  the largest value of all karts is kept. Does not change m_cells.
+ */
+void KartProximity::setKart(unsigned int kart_id)
+{
+    const AbstractKart *kart = m_world->getKart(kart_id);
+    setPosition(kart_id, kart->getXYZ());
+
+    // Ghost karts have no physics, and the queries using these values
+    // ignore them anyway
+    if (kart->isGhostKart())
+        return;
+    float speed = std::max(std::fabs(kart->getSpeed()),
+                           kart->getVelocity().length());
+    m_max_speed = std::max(m_max_speed, speed);
+    m_max_slipstream_reach = std::max(m_max_slipstream_reach,
+                                      SlipStream::getReach(kart));
+}   // setKart
+
+// ----------------------------------------------------------------------------
+/** Rebuilds the grid from the current positions of all karts.
+ */
+void KartProximity::rebuild()
+{
+    const unsigned int num_karts = m_world->getNumKarts();
+    m_xyz.resize(num_karts);
+    m_cell.resize(num_karts);
+    m_cells.clear();
+    m_max_speed            = 0.0f;
+    m_max_slipstream_reach = 0.0f;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        m_min_cell[i] = MAX_CELL;
+        m_max_cell[i] = -MAX_CELL;
+    }
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        setKart(i);
+        m_cells.push_back(std::make_pair(m_cell[i], i));
+    }
+    std::sort(m_cells.begin(), m_cells.end());
+}   // rebuild
+
+// ----------------------------------------------------------------------------
+/** Updates the entry of a kart after the kart was moved.
+ *  \param kart_id World kart id of the kart.
+ */
+void KartProximity::updateKart(unsigned int kart_id)
+{
+    if (kart_id >= m_cell.size())
+        return;
+    const uint64_t old_cell = m_cell[kart_id];
+    setKart(kart_id);
+    moveInGrid(kart_id, old_cell);
+}   // updateKart
+
+// ----------------------------------------------------------------------------
+/** Moves the entry of a kart in m_cells to its new cell.
+ *  \param old_cell The cell of the kart before it was moved.
+ */
+void KartProximity::moveInGrid(unsigned int kart_id, uint64_t old_cell)
+{
+    if (m_cell[kart_id] == old_cell)
+        return;
+
+    std::pair<uint64_t, unsigned int> old_entry(old_cell, kart_id);
+    auto old_pos = std::lower_bound(m_cells.begin(), m_cells.end(),
+                                    old_entry);
+    m_cells.erase(old_pos);
+    std::pair<uint64_t, unsigned int> new_entry(m_cell[kart_id], kart_id);
+    m_cells.insert(std::lower_bound(m_cells.begin(), m_cells.end(),
+                                    new_entry), new_entry);
+}   // moveInGrid
+
+// ----------------------------------------------------------------------------
+/** Returns the world kart ids (in increasing order) of all karts which are
+ *  not further away from a point than the given radius. Eliminated and
+ *  ghost karts are included.
+ *  \param center The point.
+ *  \param radius The radius.
+ *  \param karts On return the kart ids.
+ */
+void KartProximity::getKartsInRadius(const Vec3 &center, float radius,
+                                     std::vector<unsigned int> *karts) const
+{
+    karts->clear();
+    if (m_cells.empty())
+        return;
+
+    int min_cell[3], max_cell[3];
+    uint64_t num_cells = 1;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        min_cell[i] = std::max(getCellCoordinate(center[i] - radius),
+                               m_min_cell[i]);
+        max_cell[i] = std::min(getCellCoordinate(center[i] + radius),
+                               m_max_cell[i]);
+        if (min_cell[i] > max_cell[i])
+            return;
+        num_cells *= uint64_t(max_cell[i] - min_cell[i] + 1);
+    }
+
+    const float radius2 = radius * radius;
+    if (num_cells >= m_cells.size())
+    {
+        // Testing all karts is faster than looking up all cells
+        for (unsigned int i = 0; i < m_xyz.size(); i++)
+        {
+            if ((m_xyz[i] - center).length2() <= radius2)
+                karts->push_back(i);
+        }
+        return;
+    }
+
+    for (int x = min_cell[0]; x <= max_cell[0]; x++)
+    {
+        for (int y = min_cell[1]; y <= max_cell[1]; y++)
+        {
+            for (int z = min_cell[2]; z <= max_cell[2]; z++)
+            {
+                const uint64_t key = getCellKey(x, y, z);
+                auto entry = std::lower_bound(m_cells.begin(), m_cells.end(),
+                                              std::make_pair(key, 0u));
+                for (; entry != m_cells.end() && entry->first == key; entry++)
+                {
+                    if ((m_xyz[entry->second] - center).length2() <= radius2)
+                        karts->push_back(entry->second);
+                }
+            }
+        }
+    }
+    std::sort(karts->begin(), karts->end());
+}   // getKartsInRadius
+
+// ----------------------------------------------------------------------------
+/** Returns the kart for which a distance function returns the smallest
+ *  value, with the same result as testing all karts in the order of their
+ *  world kart id. The search starts with the karts close to the point, and
+ *  ends once no kart further away can be closer.
+ *  \param center The point to which the distance is measured.
+ *  \param max_radius Karts further away are never returned.
+ *  \param min_distance2 On return the value of the returned kart, FLT_MAX
+ *         if no kart is returned.
+ *  \param distance2 Returns for a kart a value which is at least the
+ *         squared distance of the kart to center, or FLT_MAX if the kart
+ *         should be ignored.
+ *  \return The kart with the smallest value, or NULL if all karts are
+ *          ignored.
+ */
+AbstractKart *KartProximity::getNearestKart(const Vec3 &center,
+               float max_radius, float *min_distance2,
+               const std::function<float(const AbstractKart*)> &distance2)
+                                                                        const
+{
+    std::vector<unsigned int> karts;
+    float radius = CELL_SIZE;
+    while (true)
+    {
+        getKartsInRadius(center, std::min(radius, max_radius), &karts);
+        AbstractKart *nearest = NULL;
+        *min_distance2 = FLT_MAX;
+        for (unsigned int id : karts)
+        {
+            AbstractKart *kart = m_world->getKart(id);
+            float d2 = distance2(kart);
+            if (d2 < *min_distance2)
+            {
+                *min_distance2 = d2;
+                nearest        = kart;
+            }
+        }
+        if (*min_distance2 <= radius * radius || radius >= max_radius ||
+            karts.size() == m_xyz.size())
+            return nearest;
+        radius *= 2.0f;
+    }
+}   // getNearestKart
+
+// ----------------------------------------------------------------------------
+/** Sets the overall distance of a kart, which is used in the next call of
+ *  sortByDistance().
+ */
+void KartProximity::setOverallDistance(unsigned int kart_id, float distance)
+{
+    if (kart_id >= m_distance.size())
+        m_distance.resize(kart_id + 1, 0.0f);
+    // Sorting needs distances which can be compared
+    if (std::isnan(distance))
+        distance = -FLT_MAX;
+    if (m_distance[kart_id] != distance)
+    {
+        m_distance[kart_id] = distance;
+        m_distance_changed = true;
+    }
+}   // setOverallDistance
+
+// ----------------------------------------------------------------------------
+/** Sorts the karts which are not eliminated by overall distance. For the
+ *  same distance the kart which started further ahead comes first. The
+ *  karts are only sorted again if a distance was changed or a kart is not
+ *  eliminated anymore (eliminated karts are removed by removeKart), so
+ *  calling this several times in a tick is cheap.
+ */
+void KartProximity::sortByDistance()
+{
+    const unsigned int num_karts = m_world->getNumKarts();
+    unsigned int num_not_eliminated = 0;
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        if (!m_world->getKart(i)->isEliminated())
+            num_not_eliminated++;
+    }
+    if (!m_distance_changed && m_distance.size() == num_karts &&
+        m_by_distance.size() == num_not_eliminated)
+        return;
+
+    m_distance_changed = false;
+    m_distance.resize(num_karts, 0.0f);
+    m_by_distance.clear();
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        if (!m_world->getKart(i)->isEliminated())
+            m_by_distance.push_back(i);
+    }
+    std::sort(m_by_distance.begin(), m_by_distance.end(),
+        [this](unsigned int a, unsigned int b)
+    {
+        if (m_distance[a] != m_distance[b])
+            return m_distance[a] > m_distance[b];
+        return m_world->getKart(a)->getInitialPosition() <
+               m_world->getKart(b)->getInitialPosition();
+    });
+    updateRanks();
+}   // sortByDistance
+
+// ----------------------------------------------------------------------------
+void KartProximity::updateRanks()
+{
+    m_rank.assign(m_world->getNumKarts(), -1);
+    for (unsigned int i = 0; i < m_by_distance.size(); i++)
+        m_rank[m_by_distance[i]] = i;
+}   // updateRanks
+
+// ----------------------------------------------------------------------------
+/** Removes an eliminated kart from the karts sorted by distance.
+ */
+void KartProximity::removeKart(unsigned int kart_id)
+{
+    if (getRank(kart_id) < 0)
+        return;
+    m_by_distance.erase(m_by_distance.begin() + m_rank[kart_id]);
+    updateRanks();
+}   // removeKart
+
+// ----------------------------------------------------------------------------
+/** Returns the number of karts which are not eliminated and have a larger
+ *  overall distance than the given distance.
+ */
+unsigned int KartProximity::getNumKartsAhead(float distance) const
+{
+    auto first_not_ahead = std::partition_point(m_by_distance.begin(),
+                                                m_by_distance.end(),
+        [this, distance](unsigned int id)
+    {
+        return m_distance[id] > distance;
+    });
+    return (unsigned int)(first_not_ahead - m_by_distance.begin());
+}   // getNumKartsAhead
+
+// ----------------------------------------------------------------------------
+/** Returns the kart directly ahead of a kart by overall distance, or NULL
+ *  if there is none.
+ */
+AbstractKart *KartProximity::getKartAhead(unsigned int kart_id) const
+{
+    int rank = getRank(kart_id);
+    if (rank <= 0)
+        return NULL;
+    return m_world->getKart(m_by_distance[rank - 1]);
+}   // getKartAhead
+
+// ----------------------------------------------------------------------------
+/** Returns the kart directly behind a kart by overall distance, or NULL if
+ *  there is none.
+ */
+AbstractKart *KartProximity::getKartBehind(unsigned int kart_id) const
+{
+    int rank = getRank(kart_id);
+    if (rank < 0 || rank + 1 >= (int)m_by_distance.size())
+        return NULL;
+    return m_world->getKart(m_by_distance[rank + 1]);
+}   // getKartBehind
+
+// ----------------------------------------------------------------------------
+/** Compares the karts found in the grid with testing all karts, for karts
+ *  in clusters and spread out, with small and large radii.
+ */
+void KartProximity::unitTesting()
+{
+    unsigned int seed = 1;
+    auto random = [&seed](float min, float max)
+    {
+        seed = seed * 1103515245u + 12345u;
+        return min + (max - min) * float((seed >> 8) & 0xffff) / 65535.0f;
+    };
+
+    KartProximity proximity(NULL);
+    const unsigned int num_karts = 100;
+    proximity.m_xyz.resize(num_karts);
+    proximity.m_cell.resize(num_karts);
+    for (unsigned int i = 0; i < num_karts; i++)
+    {
+        // Half of the karts close together
+        const float range = i % 2 == 0 ? 40.0f : 1000.0f;
+        proximity.setPosition(i, Vec3(random(-range, range),
+            random(-range, range) * 0.1f, random(-range, range)));
+        proximity.m_cells.push_back(
+            std::make_pair(proximity.m_cell[i], i));
+    }
+    // A kart exactly on a cell border, and one outside of the grid limits
+    proximity.setPosition(0, Vec3(CELL_SIZE, 0.0f, -CELL_SIZE));
+    proximity.setPosition(1, Vec3(1e9f, 0.0f, 0.0f));
+    proximity.m_cells[0].first = proximity.m_cell[0];
+    proximity.m_cells[1].first = proximity.m_cell[1];
+    std::sort(proximity.m_cells.begin(), proximity.m_cells.end());
+
+    std::vector<unsigned int> found, expected;
+    auto check = [&](const Vec3 &center, float radius)
+    {
+        proximity.getKartsInRadius(center, radius, &found);
+        expected.clear();
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            if ((proximity.m_xyz[i] - center).length2() <= radius * radius)
+                expected.push_back(i);
+        }
+        assert(found == expected);
+    };
+
+    for (unsigned int i = 0; i < 1000; i++)
+    {
+        // Mostly small radii which use the grid, some which test all karts
+        const float range = i % 3 == 0 ? 1000.0f : 60.0f;
+        const float radius = i % 10 == 0 ? random(200.0f, 2000.0f)
+                                         : random(0.0f, 50.0f);
+        check(Vec3(random(-range, range), 0.0f, random(-range, range)),
+              radius);
+
+        // Move a kart to another cell, the grid must stay sorted
+        const unsigned int kart_id = 2 + i % (num_karts - 2);
+        const uint64_t old_cell = proximity.m_cell[kart_id];
+        proximity.setPosition(kart_id, Vec3(random(-range, range), 0.0f,
+                                            random(-range, range)));
+        proximity.moveInGrid(kart_id, old_cell);
+        assert(std::is_sorted(proximity.m_cells.begin(),
+                              proximity.m_cells.end()));
+    }
+    check(Vec3(CELL_SIZE, 0.0f, -CELL_SIZE), 0.0f);
+    assert(found.size() == 1 && found[0] == 0);
+    check(Vec3(1e9f, 0.0f, 0.0f), 1.0f);
+    assert(found.size() == 1 && found[0] == 1);
+    check(Vec3(0.0f, 1e6f, 0.0f), 10.0f);
+    assert(found.empty());
+}   // unitTesting
@@ -0,0 +1,149 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_KART_PROXIMITY_HPP
+#define HEADER_KART_PROXIMITY_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/vec3.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+class AbstractKart;
+class World;
+
+/** An index of the karts of a world, so that the karts near a kart can be
+ *  found without testing all karts. It stores:
+ *  - The karts sorted by their overall distance along the track, which is
+ *    set by LinearWorld. This gives the karts ahead of and behind a kart,
+ *    and the number of karts ahead of a distance.
+ *  - A coarse 3d grid with the position of each kart, which gives the
+ *    karts within a radius.
+ *
+ *  The grid is rebuilt at the start of each tick (see World::update()),
+ *  and the entry of a kart is updated right after the kart was updated, so
+ *  it has the position of each kart during the kart updates. The queries
+ *  only return the karts which can be close enough, the caller still has
+ *  to do its exact test.
+ *  \ingroup modes
+ */
+class KartProximity : public NoCopy
+{
+private:
+    const World *m_world;
+
+    /** The position of each kart in the grid. */
+    std::vector<Vec3> m_xyz;
+
+    /** The key of the grid cell of each kart. */
+    std::vector<uint64_t> m_cell;
+
+    /** The grid: the cell key and the world kart id of each kart, sorted
+     *  by cell. */
+    std::vector<std::pair<uint64_t, unsigned int> > m_cells;
+
+    /** Smallest and largest cell coordinates of all karts since the last
+     *  rebuild. */
+    int m_min_cell[3];
+    int m_max_cell[3];
+
+    /** The largest speed of any kart since the last rebuild. */
+    float m_max_speed;
+
+    /** The largest slipstream reach (see SlipStream::getReach()) of any
+     *  kart since the last rebuild. */
+    float m_max_slipstream_reach;
+
+    /** The overall distance of each kart, as set by LinearWorld. */
+    std::vector<float> m_distance;
+
+    /** World kart ids of the karts which are not eliminated, sorted by
+     *  overall distance, largest first. */
+    std::vector<unsigned int> m_by_distance;
+
+    /** Index of each kart in m_by_distance, -1 if it is not included. */
+    std::vector<int> m_rank;
+
+    /** If an overall distance was changed since the last sort. */
+    bool m_distance_changed;
+
+    // ------------------------------------------------------------------------
+    static int getCellCoordinate(float f);
+    // ------------------------------------------------------------------------
+    void setPosition(unsigned int kart_id, const Vec3 &xyz);
+    // ------------------------------------------------------------------------
+    void setKart(unsigned int kart_id);
+    // ------------------------------------------------------------------------
+    void moveInGrid(unsigned int kart_id, uint64_t old_cell);
+    // ------------------------------------------------------------------------
+    void updateRanks();
+
+public:
+    KartProximity(const World *world);
+    // ------------------------------------------------------------------------
+    void rebuild();
+    // ------------------------------------------------------------------------
+    void updateKart(unsigned int kart_id);
+    // ------------------------------------------------------------------------
+    void getKartsInRadius(const Vec3 &center, float radius,
+                          std::vector<unsigned int> *karts) const;
+    // ------------------------------------------------------------------------
+    AbstractKart *getNearestKart(const Vec3 &center, float max_radius,
+                   float *min_distance2,
+                   const std::function<float(const AbstractKart*)> &distance2)
+                                                                        const;
+    // ------------------------------------------------------------------------
+    void setOverallDistance(unsigned int kart_id, float distance);
+    // ------------------------------------------------------------------------
+    void sortByDistance();
+    // ------------------------------------------------------------------------
+    void removeKart(unsigned int kart_id);
+    // ------------------------------------------------------------------------
+    unsigned int getNumKartsAhead(float distance) const;
+    // ------------------------------------------------------------------------
+    AbstractKart *getKartAhead(unsigned int kart_id) const;
+    // ------------------------------------------------------------------------
+    AbstractKart *getKartBehind(unsigned int kart_id) const;
+    // ------------------------------------------------------------------------
+    /** Returns the world kart ids of the karts which are not eliminated,
+     *  sorted by overall distance (largest first), and by start position
+     *  for the same distance. */
+    const std::vector<unsigned int> &getKartsByDistance() const
+                                                      { return m_by_distance; }
+    // ------------------------------------------------------------------------
+    /** Returns the index of a kart in getKartsByDistance(), or -1 if the
+     *  kart is eliminated. */
+    int getRank(unsigned int kart_id) const
+    {
+        return kart_id < m_rank.size() ? m_rank[kart_id] : -1;
+    }   // getRank
+    // ------------------------------------------------------------------------
+    /** Returns the largest speed of any kart in this tick. */
+    float getMaxSpeed() const                       { return m_max_speed; }
+    // ------------------------------------------------------------------------
+    /** Returns the largest slipstream reach of any kart in this tick. */
+    float getMaxSlipstreamReach() const   { return m_max_slipstream_reach; }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // KartProximity
+
+#endif
@@ -30,6 +30,7 @@
 #include "karts/kart_properties.hpp"
 #include "graphics/material.hpp"
 #include "guiengine/modaldialog.hpp"
+#include "modes/kart_proximity.hpp"
 #include "physics/physics.hpp"
 #include "network/network_config.hpp"
 #include "network/network_player_profile.hpp"
@@ -294,8 +295,24 @@ void LinearWorld::updateTrackSectors()
                                      * Track::getCurrentTrack()->getTrackLength()
                         + getDistanceDownTrackForKart(kart->getWorldKartId(), true);
     }   // for n
+    sortKartsByDistance();
 }   // updateTrackSectors
 
+//-----------------------------------------------------------------------------
+/** Sorts the karts in the kart proximity index by their overall distance.
+ *  This must be done each time the distances are changed, since e.g. the
+ *  AI uses the index to get its position from its distance. The karts are
+ *  only sorted again if a distance changed, so in a tick the order sorted
+ *  in updateTrackSectors is usually reused by updateRacePosition.
+ */
+void LinearWorld::sortKartsByDistance()
+{
+    KartProximity *proximity = getKartProximity();
+    for (unsigned int i = 0; i < m_kart_info.size(); i++)
+        proximity->setOverallDistance(i, m_kart_info[i].m_overall_distance);
+    proximity->sortByDistance();
+}   // sortKartsByDistance
+
 //-----------------------------------------------------------------------------
 /** This updates all only graphical elements.It is only called once per
 *  rendered frame, not once per time step.
@@ -870,6 +887,28 @@ void LinearWorld::updateRacePosition()
     beginSetKartPositions();
     const unsigned int kart_amount = (unsigned int) m_karts.size();
 
+    // The karts ahead of a kart are the karts that are already finished,
+    // and the karts before it when sorted by overall distance (and by
+    // start position for the same distance), ignoring eliminated karts.
+    sortKartsByDistance();
+    const std::vector<unsigned int>& by_distance =
+        getKartProximity()->getKartsByDistance();
+    unsigned int num_finished = 0;
+    for (unsigned int id : by_distance)
+    {
+        if (m_karts[id]->hasFinishedRace())
+            num_finished++;
+    }
+    std::vector<int> position(kart_amount, 0);
+    unsigned int num_racing_ahead = 0;
+    for (unsigned int id : by_distance)
+    {
+        if (m_karts[id]->hasFinishedRace())
+            continue;
+        position[id] = 1 + num_finished + num_racing_ahead;
+        num_racing_ahead++;
+    }
+
 #ifdef DEBUG
     bool rank_changed = false;
 #endif
@@ -894,33 +933,7 @@ void LinearWorld::updateRacePosition()
         }
         KartInfo& kart_info = m_kart_info[i];
 
-        int p = 1 ;
-
-        const unsigned int my_id = kart->getWorldKartId();
-        const float my_distance  = m_kart_info[my_id].m_overall_distance;
-
-        // Count karts ahead of the current kart, i.e. kart that are
-        // already finished or have covered a larger overall distance.
-        for (unsigned int j = 0 ; j < kart_amount ; j++)
-        {
-            // don't compare a kart with itself and ignore eliminated karts
-            if(j == my_id || m_karts[j]->isEliminated())
-                continue;
-
-            // If the other kart has:
-            // - finished the race (but this kart hasn't)
-            // - or is ahead
-            // - or has the same distance (very unlikely) but started earlier
-            // it is ahead --> increase position
-            if((!kart->hasFinishedRace() && m_karts[j]->hasFinishedRace()) ||
-                m_kart_info[j].m_overall_distance > my_distance            ||
-               (m_kart_info[j].m_overall_distance == my_distance &&
-                m_karts[j]->getInitialPosition()<kart->getInitialPosition() ) )
-            {
-                p++;
-            }
-
-        } //next kart
+        const int p = position[kart->getWorldKartId()];
 
 #ifndef DEBUG
         setKartPosition(i, p);
@@ -1197,6 +1210,7 @@ void LinearWorld::restoreCompleteState(const BareNetworkString& b)
     }
     for (KartInfo& ki : m_kart_info)
         ki.restoreCompleteState(b);
+    sortKartsByDistance();
     for (TrackSector* ts : m_kart_track_sector)
         ts->restoreCompleteState(b);
 
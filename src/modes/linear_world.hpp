@@ -134,6 +134,7 @@ protected:
 
     virtual void  checkForWrongDirection(unsigned int i, float dt);
     virtual float estimateFinishTimeForKart(AbstractKart* kart) OVERRIDE;
+    void          sortKartsByDistance();
 
 public:
                   LinearWorld();
@@ -40,6 +40,10 @@ bool StandardRace::isRaceOver()
         return dynamic_cast<GhostController*>
             (m_karts[0]->getController())->isReplayEnd();
     }
+    // An AI only race (see SimulationBenchmark) is over when all karts
+    // have finished
+    if (RaceManager::get()->getNumPlayers() == 0)
+        return RaceManager::get()->getFinishedKarts() == getNumKarts();
     // The race is over if all players have finished the race. Remaining
     // times for AI opponents will be estimated in enterRaceOverState
     return RaceManager::get()->allPlayerFinished();
@@ -51,6 +51,7 @@
 #include "karts/kart_properties_manager.hpp"
 #include "karts/kart_rewinder.hpp"
 #include "main_loop.hpp"
+#include "modes/kart_proximity.hpp"
 #include "modes/overworld.hpp"
 #include "network/child_loop.hpp"
 #include "network/protocols/client_lobby.hpp"
@@ -81,6 +82,7 @@
 #include "utils/profiler.hpp"
 #include "utils/translation.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <algorithm>
 #include <assert.h>
@@ -197,6 +199,7 @@ void World::init()
     main_loop->renderGUI(1200);
     // Create the physics
     Physics::create();
+    m_kart_proximity.reset(new KartProximity(this));
     main_loop->renderGUI(1300);
     unsigned int num_karts = RaceManager::get()->getNumberOfKarts();
     //assert(num_karts > 0);
@@ -218,6 +221,13 @@ void World::init()
         if (!child_loop->isAborted())
             child_track->initChildTrack();
     }
+    // The physics world is created when the track is loaded
+    if (UserConfigParams::m_parallel_physics &&
+        Physics::get()->getPhysicsWorld() &&
+        WorkerPool::get()->getNumThreads() > 1)
+    {
+        Physics::get()->getPhysicsWorld()->setWorkerPool(WorkerPool::get());
+    }
 
     // Shuffles the start transforms with playing 3-strikes or free for all battles.
     if ((RaceManager::get()->getMinorMode() == RaceManager::MINOR_MODE_3_STRIKES ||
@@ -228,12 +238,18 @@ void World::init()
     }
 
     main_loop->renderGUI(6998);
-    if (gk > 0)
-    {
-        ReplayPlay::get()->load();
-        for (unsigned int k = 0; k < gk; k++)
-            m_karts.push_back(ReplayPlay::get()->getGhostKart(k));
-    }
+    if (gk > 0 && !ReplayPlay::get()->load())
+    {
+        // The replay files were checked when they were listed, so they were
+        // changed or removed since then
+        if (RaceManager::get()->isWatchingReplay())
+            throw std::runtime_error("Replay can't be read anymore.");
+        RaceManager::get()->removeGhostKarts();
+        gk = 0;
+        num_karts = RaceManager::get()->getNumberOfKarts();
+    }
+    for (unsigned int k = 0; k < gk; k++)
+        m_karts.push_back(ReplayPlay::get()->getGhostKart(k));
     main_loop->renderGUI(6999);
 
     // Assign team of AIs for team mode before createKart
@@ -575,8 +591,9 @@ Controller* World::loadAIController(AbstractKart* kart)
     Controller *controller;
     int turn=0;
 
-    if(RaceManager::get()->getMinorMode()==RaceManager::MINOR_MODE_3_STRIKES
-        || RaceManager::get()->getMinorMode()==RaceManager::MINOR_MODE_FREE_FOR_ALL)
+    // Capture the flag uses the battle AI as well, the race AI needs a
+    // drive graph which arenas don't have
+    if(RaceManager::get()->isBattleMode())
         turn=1;
     else if(RaceManager::get()->getMinorMode()==RaceManager::MINOR_MODE_SOCCER)
         turn=2;
@@ -1201,19 +1218,30 @@ void World::update(int ticks)
 
     PROFILER_PUSH_CPU_MARKER("World::update (Kart::upate)", 0x40, 0x7F, 0x00);
 
+    // First let all controllers decide what to do in parallel. They only
+    // read the state of the world, so each decision is based on the state
+    // at the start of this tick, independent of the number of threads and
+    // of the order in which the karts are updated below.
+    const int kart_amount = (int)m_karts.size();
+    m_kart_proximity->rebuild();
+    PROFILER_PUSH_CPU_MARKER("World::update (AI decisions)", 0x40, 0x7F, 0x40);
+    WorkerPool::get()->parallelFor(kart_amount, [this, ticks](unsigned int i)
+    {
+        if (isKartUpdated(m_karts[i].get()))
+            m_karts[i]->getController()->prepareUpdate(ticks);
+    });
+    PROFILER_POP_CPU_MARKER();
+
     // Update all the karts. This in turn will also update the controller,
     // which causes all AI steering commands set. So in the following
     // physics update the new steering is taken into account.
-    const int kart_amount = (int)m_karts.size();
     for (int i = 0 ; i < kart_amount; ++i)
     {
-        SpareTireAI* sta =
-            dynamic_cast<SpareTireAI*>(m_karts[i]->getController());
-        // Update all karts that are not eliminated
-        if(!m_karts[i]->isEliminated() || (sta && sta->isMoving()))
+        if (isKartUpdated(m_karts[i].get()))
             m_karts[i]->update(ticks);
         if (isStartPhase())
             m_karts[i]->makeKartRest();
+        m_kart_proximity->updateKart(i);
     }
     PROFILER_POP_CPU_MARKER();
     if(RaceManager::get()->isRecordingRace()) ReplayRecorder::get()->update(ticks);
@@ -1234,6 +1262,17 @@ void World::update(int ticks)
 #endif
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Returns true if the kart is updated in this tick: all karts that are not
+ *  eliminated, and spare tire karts which are moving.
+ */
+bool World::isKartUpdated(const AbstractKart* kart) const
+{
+    const SpareTireAI* sta =
+        dynamic_cast<const SpareTireAI*>(kart->getController());
+    return !kart->isEliminated() || (sta && sta->isMoving());
+}   // isKartUpdated
+
 // ----------------------------------------------------------------------------
 /** Only updates the track. The order in which the various parts of STK are
  *  updated is quite important (i.e. the track can't be updated as part of
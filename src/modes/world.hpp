@@ -47,6 +47,7 @@ class BareNetworkString;
 class btRigidBody;
 class Controller;
 class ItemState;
+class KartProximity;
 class PhysicalObject;
 class STKPeer;
 
@@ -115,6 +116,9 @@ protected:
     KartList                  m_karts;
     RandomGenerator           m_random;
 
+    /** Finds the karts near a kart without testing all karts. */
+    std::unique_ptr<KartProximity> m_kart_proximity;
+
     AbstractKart* m_fastest_kart;
     /** Number of eliminated karts. */
     int         m_eliminated_karts;
@@ -190,6 +194,7 @@ protected:
     virtual void  update(int ticks) OVERRIDE;
     virtual void  createRaceGUI();
             void  updateTrack(int ticks);
+            bool  isKartUpdated(const AbstractKart* kart) const;
     // ------------------------------------------------------------------------
     /** Used for AI karts that are still racing when all player kart finished.
      *  Generally it should estimate the arrival time for those karts, but as
@@ -346,6 +351,10 @@ public:
     /** Returns all karts. */
     const KartList & getKarts() const { return m_karts; }
     // ------------------------------------------------------------------------
+    /** Returns the index to find the karts near a kart. */
+    KartProximity  *getKartProximity() const
+                                           { return m_kart_proximity.get(); }
+    // ------------------------------------------------------------------------
     /** Returns the number of currently active (i.e.non-elikminated) karts. */
     unsigned int    getCurrentNumKarts() const { return (int)m_karts.size() -
                                                          m_eliminated_karts; }
@@ -33,6 +33,8 @@
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
 
+#include <chrono>
+
 // ----------------------------------------------------------------------------
 float ChildLoop::getLimitedDt()
 {
@@ -148,11 +150,18 @@ void ChildLoop::run()
 
             if (w)
             {
+                auto start = std::chrono::steady_clock::now();
                 auto rem = RaceEventManager::get();
                 if (rem && rem->isRunning())
                     RaceEventManager::get()->update(1, false/*fast_forward*/);
                 else
                     w->updateWorld(1);
+                if (STKHost::existHost())
+                {
+                    STKHost::get()->updateTickCost(
+                        std::chrono::duration_cast<std::chrono::microseconds>
+                        (std::chrono::steady_clock::now() - start).count());
+                }
                 w->updateTime(1);
             }
             if (m_abort)
@@ -84,6 +84,57 @@ namespace CompressNetworkBody
             .addUInt16(avx).addUInt16(avy).addUInt16(avz);
     }   // compress
     // ------------------------------------------------------------------------
+    /** Size in bytes of a compressed body in network string. */
+    const unsigned COMPRESSED_SIZE = 3 * sizeof(float) + 4 + 6 * 2;
+    // ------------------------------------------------------------------------
+    /** Writes the same values as compress, but without rounding the values
+     *  in body, used by client to save its predicted state which is later
+     *  compared to the confirmed state from server.
+     */
+    inline void save(const btRigidBody* body, BareNetworkString* bns)
+    {
+        const btTransform& t = body->getWorldTransform();
+        bns->addFloat(t.getOrigin().x()).addFloat(t.getOrigin().y())
+            .addFloat(t.getOrigin().z())
+            .addUInt32(compressQuaternion(t.getRotation()));
+        bns->addUInt16(toFloat16(body->getLinearVelocity().x()))
+            .addUInt16(toFloat16(body->getLinearVelocity().y()))
+            .addUInt16(toFloat16(body->getLinearVelocity().z()))
+            .addUInt16(toFloat16(body->getAngularVelocity().x()))
+            .addUInt16(toFloat16(body->getAngularVelocity().y()))
+            .addUInt16(toFloat16(body->getAngularVelocity().z()));
+    }   // save
+    // ------------------------------------------------------------------------
+    /** Returns true if the two compressed bodies in a and b differ less than
+     *  the given tolerances.
+     *  \param max_distance Maximum distance of the positions.
+     *  \param max_angle Maximum angle (in radians) between the rotations.
+     *  \param max_velocity Maximum difference of linear and angular
+     *         velocities.
+     */
+    inline bool isNear(const BareNetworkString* a, const BareNetworkString* b,
+                       float max_distance, float max_angle,
+                       float max_velocity)
+    {
+        btVector3 xyz_a = a->getVec3();
+        btVector3 xyz_b = b->getVec3();
+        if ((xyz_a - xyz_b).length2() > max_distance * max_distance)
+            return false;
+        btQuaternion q_a = decompressbtQuaternion(a->getUInt32());
+        btQuaternion q_b = decompressbtQuaternion(b->getUInt32());
+        // Angle between the rotations is 2 * acos(|dot|)
+        if (fabsf(q_a.dot(q_b)) < cosf(max_angle * 0.5f))
+            return false;
+        for (unsigned i = 0; i < 6; i++)
+        {
+            float v_a = toFloat32(a->getUInt16());
+            float v_b = toFloat32(b->getUInt16());
+            if (fabsf(v_a - v_b) > max_velocity)
+                return false;
+        }
+        return true;
+    }   // isNear
+    // ------------------------------------------------------------------------
     /* Called during rewind when restoring data from game state. */
     inline void decompress(const BareNetworkString* bns,
                            btRigidBody* body, btMotionState* ms)
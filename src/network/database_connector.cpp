@@ -0,0 +1,643 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifdef ENABLE_SQLITE3
+
+#include "network/database_connector.hpp"
+
+#include "network/server_config.hpp"
+#include "network/socket_address.hpp"
+#include "network/stk_ipv6.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+#include "utils/vs.hpp"
+
+#include <limits>
+
+// ----------------------------------------------------------------------------
+static void upperIPv6SQL(sqlite3_context* context, int argc,
+                         sqlite3_value** argv)
+{
+    if (argc != 1)
+    {
+        sqlite3_result_int64(context, 0);
+        return;
+    }
+
+    char* ipv6 = (char*)sqlite3_value_text(argv[0]);
+    if (ipv6 == NULL)
+    {
+        sqlite3_result_int64(context, 0);
+        return;
+    }
+    sqlite3_result_int64(context, upperIPv6(ipv6));
+}
+
+// ----------------------------------------------------------------------------
+void insideIPv6CIDRSQL(sqlite3_context* context, int argc,
+                       sqlite3_value** argv)
+{
+    if (argc != 2)
+    {
+        sqlite3_result_int(context, 0);
+        return;
+    }
+
+    char* ipv6_cidr = (char*)sqlite3_value_text(argv[0]);
+    char* ipv6_in = (char*)sqlite3_value_text(argv[1]);
+    if (ipv6_cidr == NULL || ipv6_in == NULL)
+    {
+        sqlite3_result_int(context, 0);
+        return;
+    }
+    sqlite3_result_int(context, insideIPv6CIDR(ipv6_cidr, ipv6_in));
+}   // insideIPv6CIDRSQL
+
+// ----------------------------------------------------------------------------
+/*
+Copy below code so it can be use as loadable extension to be used in sqlite3
+command interface (together with andIPv6 and insideIPv6CIDR from stk_ipv6)
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT1
+// ----------------------------------------------------------------------------
+sqlite3_extension_init(sqlite3* db, char** pzErrMsg,
+                       const sqlite3_api_routines* pApi)
+{
+    SQLITE_EXTENSION_INIT2(pApi)
+    sqlite3_create_function(db, "insideIPv6CIDR", 2, SQLITE_UTF8, NULL,
+        insideIPv6CIDRSQL, NULL, NULL);
+    sqlite3_create_function(db, "upperIPv6", 1, SQLITE_UTF8,  0, upperIPv6SQL,
+        0, 0);
+    return 0;
+}   // sqlite3_extension_init
+*/
+
+// ----------------------------------------------------------------------------
+static std::string columnText(sqlite3_stmt* stmt, int column)
+{
+    const char* text = (const char*)sqlite3_column_text(stmt, column);
+    return text ? text : "";
+}   // columnText
+
+// ----------------------------------------------------------------------------
+/** Returns the integer of a column, or a default value if it is NULL. */
+static int64_t columnInt64(sqlite3_stmt* stmt, int column,
+                           int64_t null_value)
+{
+    if (sqlite3_column_type(stmt, column) == SQLITE_NULL)
+        return null_value;
+    return sqlite3_column_int64(stmt, column);
+}   // columnInt64
+
+// ----------------------------------------------------------------------------
+DatabaseConnector::DatabaseConnector()
+{
+    m_db = NULL;
+    m_exit = false;
+    m_ban_cache_updated.store(false);
+    m_data_version = -1;
+    m_ban_cache = std::make_shared<BanCache>();
+    m_country_cache = std::make_shared<CountryCache>();
+}   // DatabaseConnector
+
+// ----------------------------------------------------------------------------
+DatabaseConnector::~DatabaseConnector()
+{
+    stop();
+    clearStatements();
+    if (m_db != NULL)
+        sqlite3_close(m_db);
+}   // ~DatabaseConnector
+
+// ----------------------------------------------------------------------------
+/** Opens the database, must be called before start().
+ *  \return True if successful.
+ */
+bool DatabaseConnector::open(const std::string& path)
+{
+    int ret = sqlite3_open_v2(path.c_str(), &m_db,
+        SQLITE_OPEN_SHAREDCACHE | SQLITE_OPEN_FULLMUTEX |
+        SQLITE_OPEN_READWRITE, NULL);
+    if (ret != SQLITE_OK)
+    {
+        Log::error("DatabaseConnector", "Cannot open database: %s.",
+            sqlite3_errmsg(m_db));
+        sqlite3_close(m_db);
+        m_db = NULL;
+        return false;
+    }
+    sqlite3_busy_handler(m_db, [](void* data, int retry)
+        {
+            int retry_count = ServerConfig::m_database_timeout / 100;
+            if (retry < retry_count)
+            {
+                sqlite3_sleep(100);
+                // Return non-zero to let caller retry again
+                return 1;
+            }
+            // Return zero to let caller return SQLITE_BUSY immediately
+            return 0;
+        }, NULL);
+    sqlite3_create_function(m_db, "insideIPv6CIDR", 2, SQLITE_UTF8, NULL,
+        &insideIPv6CIDRSQL, NULL, NULL);
+    sqlite3_create_function(m_db, "upperIPv6", 1, SQLITE_UTF8, NULL,
+        &upperIPv6SQL, NULL, NULL);
+    return true;
+}   // open
+
+// ----------------------------------------------------------------------------
+/** Returns true if the table name exists in database, must be called before
+ *  start() or in the worker thread. */
+bool DatabaseConnector::tableExists(const std::string& table)
+{
+    if (!m_db || table.empty())
+        return false;
+    bool result = false;
+    std::string query = StringUtils::insertValues(
+        "SELECT count(type) FROM sqlite_master "
+        "WHERE type='table' AND name='%s';", table.c_str());
+    selectRows(query, [&result](sqlite3_stmt* stmt)
+        {
+            result = sqlite3_column_int(stmt, 0) == 1;
+        });
+    if (result)
+        Log::info("DatabaseConnector", "Table named %s will used.",
+            table.c_str());
+    else
+    {
+        Log::warn("DatabaseConnector", "Table named %s not found in database.",
+            table.c_str());
+    }
+    return result;
+}   // tableExists
+
+// ----------------------------------------------------------------------------
+/** Sets the ban tables to be cached, empty if not exists. */
+void DatabaseConnector::setBanTables(const std::string& ip,
+                                     const std::string& ipv6,
+                                     const std::string& online_id)
+{
+    m_ip_ban_table = ip;
+    m_ipv6_ban_table = ipv6;
+    m_online_id_ban_table = online_id;
+}   // setBanTables
+
+// ----------------------------------------------------------------------------
+/** Sets the geolocation tables to be cached, empty if not exists. */
+void DatabaseConnector::setGeolocationTables(const std::string& ip,
+                                             const std::string& ipv6)
+{
+    m_ip_geolocation_table = ip;
+    m_ipv6_geolocation_table = ipv6;
+}   // setGeolocationTables
+
+// ----------------------------------------------------------------------------
+/** Loads the ban lists so they are used by the first connection, then starts
+ *  the worker thread which loads the geolocation tables.
+ */
+void DatabaseConnector::start()
+{
+    if (!m_db || m_thread.joinable())
+        return;
+    loadBanCache();
+    m_ban_cache_updated.store(false);
+    m_exit = false;
+    m_thread = std::thread(std::bind(&DatabaseConnector::mainLoop, this));
+    updateCache();
+}   // start
+
+// ----------------------------------------------------------------------------
+/** Finishes all queued queries and stops the worker thread. */
+void DatabaseConnector::stop()
+{
+    if (!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_tasks_mutex);
+        m_exit = true;
+    }
+    m_tasks_cv.notify_one();
+    m_thread.join();
+}   // stop
+
+// ----------------------------------------------------------------------------
+void DatabaseConnector::mainLoop()
+{
+    VS::setThreadName("DatabaseConnector");
+    while (true)
+    {
+        std::vector<Task> tasks;
+        {
+            std::unique_lock<std::mutex> ul(m_tasks_mutex);
+            m_tasks_cv.wait(ul, [this]()
+                {
+                    return m_exit || !m_tasks.empty();
+                });
+            // Only exit after all queued tasks are done
+            if (m_tasks.empty())
+                break;
+            std::swap(tasks, m_tasks);
+        }
+
+        unsigned writes = 0;
+        for (Task& task : tasks)
+        {
+            if (!task.m_function)
+                writes++;
+        }
+        // One transaction for all writes, so they are synced to disk once
+        bool transaction = writes > 1 &&
+            sqlite3_exec(m_db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+        for (Task& task : tasks)
+        {
+            if (task.m_function)
+                task.m_function();
+            else
+                easySQLQuery(task.m_query, task.m_bind_function);
+        }
+        if (transaction &&
+            sqlite3_exec(m_db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK)
+        {
+            Log::error("DatabaseConnector", "Error committing %d queries: %s",
+                writes, sqlite3_errmsg(m_db));
+            sqlite3_exec(m_db, "ROLLBACK;", NULL, NULL, NULL);
+        }
+    }
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+/** Queues a task for the worker, or does it now if the worker isn't running
+ *  (before start or after stop). */
+void DatabaseConnector::pushTask(Task&& task)
+{
+    if (!m_db)
+        return;
+    if (!m_thread.joinable())
+    {
+        if (task.m_function)
+            task.m_function();
+        else
+            easySQLQuery(task.m_query, task.m_bind_function);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_tasks_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_tasks_cv.notify_one();
+}   // pushTask
+
+// ----------------------------------------------------------------------------
+/** Returns the prepared statement of a query, prepared once and reset after
+ *  each use. */
+sqlite3_stmt* DatabaseConnector::getStatement(const std::string& query)
+{
+    auto it = m_statements.find(query);
+    if (it != m_statements.end())
+        return it->second;
+    // Avoid keeping too many statements if queries contain values
+    if (m_statements.size() >= 64)
+        clearStatements();
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        Log::error("DatabaseConnector",
+            "Error preparing database for query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+    m_statements[query] = stmt;
+    return stmt;
+}   // getStatement
+
+// ----------------------------------------------------------------------------
+void DatabaseConnector::clearStatements()
+{
+    for (auto& p : m_statements)
+        sqlite3_finalize(p.second);
+    m_statements.clear();
+}   // clearStatements
+
+// ----------------------------------------------------------------------------
+/** Runs simple query with optional function to bind parameters, must be
+ *  called before start() or in the worker thread. This function has no
+ *  callback for the return (if any) by the query. Queries with a bind
+ *  function are kept as prepared statements, so values should be bound
+ *  instead of written in the query.
+ *  \return True if no error occurs.
+ */
+bool DatabaseConnector::easySQLQuery(const std::string& query,
+                                     BindFunction bind_function)
+{
+    if (!m_db)
+        return false;
+    if (!bind_function)
+    {
+        char* error = NULL;
+        if (sqlite3_exec(m_db, query.c_str(), NULL, NULL, &error) !=
+            SQLITE_OK)
+        {
+            Log::error("DatabaseConnector",
+                "Error in database for easy query %s: %s",
+                query.c_str(), error ? error : "");
+            sqlite3_free(error);
+            return false;
+        }
+        return true;
+    }
+
+    sqlite3_stmt* stmt = getStatement(query);
+    if (stmt == NULL)
+        return false;
+    bind_function(stmt);
+    int ret = sqlite3_step(stmt);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+    {
+        Log::error("DatabaseConnector",
+            "Error in database for easy query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return ret == SQLITE_DONE || ret == SQLITE_ROW;
+}   // easySQLQuery
+
+// ----------------------------------------------------------------------------
+/** Runs a query and calls the function for each row returned.
+ *  \return True if no error occurs.
+ */
+bool DatabaseConnector::selectRows(const std::string& query,
+                          std::function<void(sqlite3_stmt* stmt)> row_function)
+{
+    sqlite3_stmt* stmt = NULL;
+    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
+    if (ret != SQLITE_OK)
+    {
+        Log::error("DatabaseConnector",
+            "Error preparing database for query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+        row_function(stmt);
+    if (ret != SQLITE_DONE)
+    {
+        Log::error("DatabaseConnector", "Error in database for query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+    }
+    sqlite3_finalize(stmt);
+    return ret == SQLITE_DONE;
+}   // selectRows
+
+// ----------------------------------------------------------------------------
+/** Queues a write query, see easySQLQuery. */
+void DatabaseConnector::writeAsync(const std::string& query,
+                                   BindFunction bind_function)
+{
+    Task task;
+    task.m_query = query;
+    task.m_bind_function = bind_function;
+    pushTask(std::move(task));
+}   // writeAsync
+
+// ----------------------------------------------------------------------------
+/** Queues a function to be run in the worker thread after all queries queued
+ *  before. */
+void DatabaseConnector::runAsync(std::function<void()> function)
+{
+    Task task;
+    task.m_function = function;
+    pushTask(std::move(task));
+}   // runAsync
+
+// ----------------------------------------------------------------------------
+/** Queues loading of the ban lists, and the geolocation tables if they were
+ *  changed by another process. Writes queued before are done first. */
+void DatabaseConnector::updateCache()
+{
+    runAsync([this]()
+        {
+            loadBanCache();
+            int64_t data_version = -1;
+            selectRows("PRAGMA data_version;",
+                [&data_version](sqlite3_stmt* stmt)
+                {
+                    data_version = sqlite3_column_int64(stmt, 0);
+                });
+            if (data_version == -1 || data_version != m_data_version)
+            {
+                m_data_version = data_version;
+                loadCountryCache();
+            }
+        });
+}   // updateCache
+
+// ----------------------------------------------------------------------------
+void DatabaseConnector::loadBanCache()
+{
+    if (m_ip_ban_table.empty() && m_ipv6_ban_table.empty() &&
+        m_online_id_ban_table.empty())
+        return;
+
+    // Time in seconds since epoch, so bans can be checked without database
+    const std::string time_columns =
+        "CAST(strftime('%s', starting_time) AS INTEGER), "
+        "CASE WHEN expired_days IS NULL THEN -1 ELSE "
+        "CAST(strftime('%s', starting_time, '+'||expired_days||' days') "
+        "AS INTEGER) END, reason, description FROM ";
+    auto read_ban = [](sqlite3_stmt* stmt, int column, BanInfo* ban)
+        {
+            ban->m_row_id = sqlite3_column_int64(stmt, 0);
+            // No starting time means never active
+            ban->m_starting_time = columnInt64(stmt, column,
+                std::numeric_limits<int64_t>::max());
+            ban->m_expired_time = columnInt64(stmt, column + 1, 0);
+            ban->m_reason = columnText(stmt, column + 2);
+            ban->m_description = columnText(stmt, column + 3);
+        };
+
+    auto cache = std::make_shared<BanCache>();
+    if (!m_ip_ban_table.empty())
+    {
+        selectRows("SELECT rowid, ip_start, ip_end, " + time_columns +
+            m_ip_ban_table + ";", [&cache, read_ban](sqlite3_stmt* stmt)
+            {
+                BanInfo ban;
+                read_ban(stmt, 3, &ban);
+                cache->m_ip_bans.add(
+                    (uint32_t)sqlite3_column_int64(stmt, 1),
+                    (uint32_t)sqlite3_column_int64(stmt, 2), ban);
+            });
+        cache->m_ip_bans.build();
+    }
+    if (!m_ipv6_ban_table.empty())
+    {
+        selectRows("SELECT rowid, ipv6_cidr, " + time_columns +
+            m_ipv6_ban_table + ";", [&cache, read_ban](sqlite3_stmt* stmt)
+            {
+                BanInfo ban;
+                read_ban(stmt, 2, &ban);
+                cache->m_ipv6_bans.emplace_back(columnText(stmt, 1), ban);
+            });
+    }
+    if (!m_online_id_ban_table.empty())
+    {
+        selectRows("SELECT rowid, online_id, " + time_columns +
+            m_online_id_ban_table + ";",
+            [&cache, read_ban](sqlite3_stmt* stmt)
+            {
+                BanInfo ban;
+                read_ban(stmt, 2, &ban);
+                cache->m_online_id_bans.emplace(
+                    (uint32_t)sqlite3_column_int64(stmt, 1), ban);
+            });
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_cache_mutex);
+        m_ban_cache = cache;
+    }
+    m_ban_cache_updated.store(true);
+}   // loadBanCache
+
+// ----------------------------------------------------------------------------
+void DatabaseConnector::loadCountryCache()
+{
+    if (m_ip_geolocation_table.empty() && m_ipv6_geolocation_table.empty())
+        return;
+
+    auto cache = std::make_shared<CountryCache>();
+    if (!m_ip_geolocation_table.empty())
+    {
+        selectRows("SELECT ip_start, ip_end, country_code FROM " +
+            m_ip_geolocation_table + ";", [&cache](sqlite3_stmt* stmt)
+            {
+                int64_t ip_start = sqlite3_column_int64(stmt, 0);
+                int64_t ip_end = sqlite3_column_int64(stmt, 1);
+                if (ip_start < 0 || ip_end > 0xffffffffLL)
+                    return;
+                cache->m_ip.add((uint32_t)ip_start, (uint32_t)ip_end,
+                    columnText(stmt, 2));
+            });
+        cache->m_ip.build();
+    }
+    if (!m_ipv6_geolocation_table.empty())
+    {
+        selectRows("SELECT ip_start, ip_end, country_code FROM " +
+            m_ipv6_geolocation_table + ";", [&cache](sqlite3_stmt* stmt)
+            {
+                cache->m_ipv6.add(sqlite3_column_int64(stmt, 0),
+                    sqlite3_column_int64(stmt, 1), columnText(stmt, 2));
+            });
+        cache->m_ipv6.build();
+    }
+    Log::info("DatabaseConnector", "Loaded %d IPv4 and %d IPv6 geolocation "
+        "ranges.", (int)cache->m_ip.size(), (int)cache->m_ipv6.size());
+    std::lock_guard<std::mutex> lock(m_cache_mutex);
+    m_country_cache = cache;
+}   // loadCountryCache
+
+// ----------------------------------------------------------------------------
+/** Returns the ban lists loaded last, can be called by any thread. */
+std::shared_ptr<const DatabaseConnector::BanCache>
+    DatabaseConnector::getBanCache() const
+{
+    std::lock_guard<std::mutex> lock(m_cache_mutex);
+    return m_ban_cache;
+}   // getBanCache
+
+// ----------------------------------------------------------------------------
+/** Returns an active ban of an IPv4 address, or NULL if none.
+ *  \param now Current time in seconds since epoch.
+ */
+const DatabaseConnector::BanInfo*
+    DatabaseConnector::BanCache::findIPBan(uint32_t ip, int64_t now) const
+{
+    const BanInfo* ban = NULL;
+    m_ip_bans.forEachContaining(ip, [now, &ban](const BanInfo& info)
+        {
+            if (!info.isActive(now))
+                return false;
+            ban = &info;
+            return true;
+        });
+    return ban;
+}   // findIPBan
+
+// ----------------------------------------------------------------------------
+/** Returns an active ban of an IPv6 address (without port), or NULL if none.
+ */
+const DatabaseConnector::BanInfo*
+    DatabaseConnector::BanCache::findIPv6Ban(const std::string& ipv6,
+                                             int64_t now) const
+{
+    for (auto& cidr_ban : m_ipv6_bans)
+    {
+        if (cidr_ban.second.isActive(now) &&
+            insideIPv6CIDR(cidr_ban.first.c_str(), ipv6.c_str()) == 1)
+            return &cidr_ban.second;
+    }
+    return NULL;
+}   // findIPv6Ban
+
+// ----------------------------------------------------------------------------
+/** Returns an active ban of an online id, or NULL if none. */
+const DatabaseConnector::BanInfo*
+    DatabaseConnector::BanCache::findOnlineIdBan(uint32_t online_id,
+                                                 int64_t now) const
+{
+    auto bans = m_online_id_bans.equal_range(online_id);
+    for (auto it = bans.first; it != bans.second; it++)
+    {
+        if (it->second.isActive(now))
+            return &it->second;
+    }
+    return NULL;
+}   // findOnlineIdBan
+
+// ----------------------------------------------------------------------------
+std::string DatabaseConnector::ip2Country(const SocketAddress& addr) const
+{
+    if (addr.isLAN())
+        return "";
+    std::shared_ptr<const CountryCache> cache;
+    {
+        std::lock_guard<std::mutex> lock(m_cache_mutex);
+        cache = m_country_cache;
+    }
+    const std::string* cc_code = cache->m_ip.find(addr.getIP());
+    return cc_code ? *cc_code : "";
+}   // ip2Country
+
+// ----------------------------------------------------------------------------
+std::string DatabaseConnector::ipv62Country(const SocketAddress& addr) const
+{
+    std::shared_ptr<const CountryCache> cache;
+    {
+        std::lock_guard<std::mutex> lock(m_cache_mutex);
+        cache = m_country_cache;
+    }
+    const std::string& ipv6 = addr.toString(false/*show_port*/);
+    const std::string* cc_code = cache->m_ipv6.find(upperIPv6(ipv6.c_str()));
+    return cc_code ? *cc_code : "";
+}   // ipv62Country
+
+#endif // ENABLE_SQLITE3
@@ -0,0 +1,206 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file database_connector.hpp
+ *  \brief Runs all sqlite work of the server in a separate thread.
+ */
+#ifndef HEADER_DATABASE_CONNECTOR_HPP
+#define HEADER_DATABASE_CONNECTOR_HPP
+
+#ifdef ENABLE_SQLITE3
+
+#include "utils/interval_tree.hpp"
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sqlite3.h>
+
+class SocketAddress;
+
+/** \class DatabaseConnector
+ *  Owns the sqlite database of a server and a worker thread which does all
+ *  queries after start(), so the lobby never waits for the disk or for
+ *  another process locking the database.
+ *  Writes are queued and all writes queued while the worker was busy are
+ *  done in one transaction, using prepared statements which are kept for
+ *  queries with bound parameters.
+ *  Ban lists and geolocation tables are copied into memory by the worker
+ *  (see updateCache), so checking a connecting player is only a lookup.
+ *  \ingroup network
+ */
+class DatabaseConnector : public NoCopy
+{
+public:
+    typedef std::function<void(sqlite3_stmt* stmt)> BindFunction;
+
+    /** A row of a ban table. */
+    struct BanInfo
+    {
+        int64_t m_row_id;
+        /** Seconds since epoch when the ban starts. */
+        int64_t m_starting_time;
+        /** Seconds since epoch when the ban expires, -1 if never. */
+        int64_t m_expired_time;
+        std::string m_reason;
+        std::string m_description;
+        // --------------------------------------------------------------------
+        bool isActive(int64_t now) const
+        {
+            return now > m_starting_time &&
+                (m_expired_time == -1 || m_expired_time > now);
+        }
+    };
+
+    /** All rows of the ban tables, replaced as a whole when updated. */
+    struct BanCache
+    {
+        IntervalTree<uint32_t, BanInfo> m_ip_bans;
+        /** IPv6 CIDR with its ban, checked one by one as they are few. */
+        std::vector<std::pair<std::string, BanInfo> > m_ipv6_bans;
+        std::multimap<uint32_t, BanInfo> m_online_id_bans;
+        // --------------------------------------------------------------------
+        const BanInfo* findIPBan(uint32_t ip, int64_t now) const;
+        // --------------------------------------------------------------------
+        const BanInfo* findIPv6Ban(const std::string& ipv6,
+                                   int64_t now) const;
+        // --------------------------------------------------------------------
+        const BanInfo* findOnlineIdBan(uint32_t online_id,
+                                       int64_t now) const;
+    };
+
+private:
+    /** Country code of IP ranges, IPv6 uses the upper 64 bits of address. */
+    struct CountryCache
+    {
+        IntervalTree<uint32_t, std::string> m_ip;
+        IntervalTree<int64_t, std::string> m_ipv6;
+    };
+
+    /** A queued query, either a write with optional bound parameters, or a
+     *  function to be run in the worker thread. */
+    struct Task
+    {
+        std::string m_query;
+        BindFunction m_bind_function;
+        std::function<void()> m_function;
+    };
+
+    sqlite3* m_db;
+
+    std::thread m_thread;
+
+    std::mutex m_tasks_mutex;
+
+    std::condition_variable m_tasks_cv;
+
+    std::vector<Task> m_tasks;
+
+    bool m_exit;
+
+    /** Prepared statements by query, only used in the worker thread. */
+    std::map<std::string, sqlite3_stmt*> m_statements;
+
+    /** Protects the cache pointers, the caches themselves are constant. */
+    mutable std::mutex m_cache_mutex;
+
+    std::shared_ptr<const BanCache> m_ban_cache;
+
+    std::shared_ptr<const CountryCache> m_country_cache;
+
+    /** Set when the worker loaded new ban lists. */
+    std::atomic_bool m_ban_cache_updated;
+
+    /** Value of PRAGMA data_version when the geolocation tables were loaded,
+     *  it changes when another process writes to the database. */
+    int64_t m_data_version;
+
+    std::string m_ip_ban_table, m_ipv6_ban_table, m_online_id_ban_table;
+
+    std::string m_ip_geolocation_table, m_ipv6_geolocation_table;
+
+    // ------------------------------------------------------------------------
+    void mainLoop();
+    // ------------------------------------------------------------------------
+    void pushTask(Task&& task);
+    // ------------------------------------------------------------------------
+    sqlite3_stmt* getStatement(const std::string& query);
+    // ------------------------------------------------------------------------
+    void clearStatements();
+    // ------------------------------------------------------------------------
+    void loadBanCache();
+    // ------------------------------------------------------------------------
+    void loadCountryCache();
+    // ------------------------------------------------------------------------
+    bool selectRows(const std::string& query,
+                    std::function<void(sqlite3_stmt* stmt)> row_function);
+
+public:
+    DatabaseConnector();
+    // ------------------------------------------------------------------------
+    ~DatabaseConnector();
+    // ------------------------------------------------------------------------
+    bool open(const std::string& path);
+    // ------------------------------------------------------------------------
+    bool tableExists(const std::string& table);
+    // ------------------------------------------------------------------------
+    void setBanTables(const std::string& ip, const std::string& ipv6,
+                      const std::string& online_id);
+    // ------------------------------------------------------------------------
+    void setGeolocationTables(const std::string& ip,
+                              const std::string& ipv6);
+    // ------------------------------------------------------------------------
+    void start();
+    // ------------------------------------------------------------------------
+    void stop();
+    // ------------------------------------------------------------------------
+    bool easySQLQuery(const std::string& query,
+                      BindFunction bind_function = nullptr);
+    // ------------------------------------------------------------------------
+    void writeAsync(const std::string& query,
+                    BindFunction bind_function = nullptr);
+    // ------------------------------------------------------------------------
+    void runAsync(std::function<void()> function);
+    // ------------------------------------------------------------------------
+    void updateCache();
+    // ------------------------------------------------------------------------
+    std::shared_ptr<const BanCache> getBanCache() const;
+    // ------------------------------------------------------------------------
+    std::string ip2Country(const SocketAddress& addr) const;
+    // ------------------------------------------------------------------------
+    std::string ipv62Country(const SocketAddress& addr) const;
+    // ------------------------------------------------------------------------
+    /** Returns true once after the ban lists were loaded again. */
+    bool isBanCacheUpdated()     { return m_ban_cache_updated.exchange(false); }
+    // ------------------------------------------------------------------------
+    /** The database, only to be used in functions run by the worker. */
+    sqlite3* getDatabase() const                             { return m_db; }
+
+};   // class DatabaseConnector
+
+#endif // ENABLE_SQLITE3
+
+#endif // HEADER_DATABASE_CONNECTOR_HPP
@@ -275,11 +275,16 @@ void NetworkConfig::clearActivePlayersForClient() const
 
 // ----------------------------------------------------------------------------
 /** True when client needs to round the bodies phyiscal info for current
- *  ticks, server doesn't as it will be done implictly in save state. */
+ *  ticks, server doesn't as it will be done implictly in save state, unless
+ *  it skips sending the state at current ticks. */
 bool NetworkConfig::roundValuesNow() const
 {
-    return isNetworking() && !isServer() && RewindManager::get()
-        ->shouldSaveState(World::getWorld()->getTicksSinceStart());
+    if (!isNetworking())
+        return false;
+    const int ticks = World::getWorld()->getTicksSinceStart();
+    RewindManager* rm = RewindManager::get();
+    return rm->shouldSaveState(ticks) &&
+        (!isServer() || !rm->shouldSendState(ticks));
 }   // roundValuesNow
 
 // ----------------------------------------------------------------------------
@@ -16,12 +16,14 @@
 //  along with this program; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include "config/stk_config.hpp"
 #include "network/network_config.hpp"
 #include "network/network_player_profile.hpp"
 #include "network/server_config.hpp"
 #include "network/socket_address.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
@@ -53,6 +55,8 @@ void showHelp()
     std::cout << "listpeers, List all peers with host ID and IP." << std::endl;
     std::cout << "listban, List IP ban list of server." << std::endl;
     std::cout << "speedstats, Show upload and download speed." << std::endl;
+    std::cout << "tickstats, Show tick cost and state sending of server."
+        << std::endl;
 }   // showHelp
 
 // ----------------------------------------------------------------------------
@@ -177,6 +181,33 @@ void mainLoop(STKHost* host)
                 (float)host->getUploadSpeed() / 1024.0f <<
                 "   Download speed (KBps): " <<
                 (float)host->getDownloadSpeed() / 1024.0f  << std::endl;
+            auto gp = GameProtocol::lock();
+            if (gp && gp->getFullStateBytes() > 0)
+            {
+                std::cout << "Game states sent (KB): " <<
+                    (float)gp->getSentStateBytes() / 1024.0f <<
+                    "   Full states (KB): " <<
+                    (float)gp->getFullStateBytes() / 1024.0f << std::endl;
+            }
+        }
+        else if (str == "tickstats" && NetworkConfig::get()->isServer())
+        {
+            const int state_frequency =
+                NetworkConfig::get()->getStateFrequency();
+            const int scale = host->getStateIntervalScale();
+            std::cout << "Tick cost (us): " << host->getTickCost() <<
+                " of " << 1000000 / stk_config->getPhysicsFPS() <<
+                "   States per second: " <<
+                (float)state_frequency / (float)scale << " (scale " <<
+                scale << ")" << std::endl;
+            for (auto& peer : host->getPeers())
+            {
+                std::cout << peer->getHostId() << ": " <<
+                    peer->getAddress().toString() << " upload (KBps): " <<
+                    (float)peer->getUploadSpeed() / 1024.0f <<
+                    (peer->hasReducedState() ? " reduced states" : "") <<
+                    std::endl;
+            }
         }
         else
         {
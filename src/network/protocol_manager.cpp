@@ -23,6 +23,7 @@
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "network/socket_address.hpp"
+#include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
 #include "utils/profiler.hpp"
@@ -31,6 +32,7 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <chrono>
 #include <cstdlib>
 #include <errno.h>
 #include <functional>
@@ -62,7 +64,7 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
             {
                 pm->asynchronousUpdate();
                 PROFILER_PUSH_CPU_MARKER("sleep", 0, 255, 255);
-                StkTime::sleep(2);
+                pm->waitForAsyncEvents();
                 PROFILER_POP_CPU_MARKER();
             }
         });
@@ -110,6 +112,7 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
 ProtocolManager::ProtocolManager()
 {
     m_exit.store(false);
+    m_async_event_pending = false;
 }   // ProtocolManager
 
 // ----------------------------------------------------------------------------
@@ -160,6 +163,9 @@ void ProtocolManager::OneProtocolType::abort()
 void ProtocolManager::abort()
 {
     m_exit.store(true);
+    std::unique_lock<std::mutex> async_lock(m_async_mutex);
+    m_async_cv.notify_one();
+    async_lock.unlock();
     if (NetworkConfig::get()->isServer())
     {
         std::unique_lock<std::mutex> ul(m_game_protocol_mutex);
@@ -200,9 +206,31 @@ void ProtocolManager::propagateEvent(Event* event)
         m_async_events_to_process.lock();
         m_async_events_to_process.getData().push_back(event);
         m_async_events_to_process.unlock();
+        std::lock_guard<std::mutex> lock(m_async_mutex);
+        m_async_event_pending = true;
+        m_async_cv.notify_one();
     }
 }   // propagateEvent
 
+// ----------------------------------------------------------------------------
+/** Sleeps in the asynchronous update thread until a new asynchronous event
+ *  arrives, or at most 2ms for the asynchronous update of protocols. A
+ *  server without any peer only needs its lobby to be updated every 50ms.
+ */
+void ProtocolManager::waitForAsyncEvents()
+{
+    int timeout = 2;
+    if (NetworkConfig::get()->isServer() && STKHost::existHost() &&
+        STKHost::get()->getPeerCount() == 0)
+        timeout = 50;
+    std::unique_lock<std::mutex> ul(m_async_mutex);
+    m_async_cv.wait_for(ul, std::chrono::milliseconds(timeout), [this]
+        {
+            return m_async_event_pending || m_exit.load();
+        });
+    m_async_event_pending = false;
+}   // waitForAsyncEvents
+
 // ----------------------------------------------------------------------------
 /** \brief Asks the manager to start a protocol.
  *  Add the protocol to the protocols vector.
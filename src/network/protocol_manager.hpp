@@ -174,6 +174,15 @@ private:
 
     EventList m_controller_events_list;
 
+    /** Wakes up the asynchronous update thread for new asynchronous events,
+     *  see waitForAsyncEvents. */
+    std::condition_variable m_async_cv;
+
+    std::mutex m_async_mutex;
+
+    /** Set when an asynchronous event arrived during the last wait. */
+    bool m_async_event_pending;
+
     /*! Single instance of protocol manager.*/
     static std::weak_ptr<ProtocolManager> m_protocol_manager[PT_COUNT];
 
@@ -182,6 +191,8 @@ private:
 
     void asynchronousUpdate();
 
+    void waitForAsyncEvents();
+
 public:
     // ===========================================
     // Public constructor is required for shared_ptr
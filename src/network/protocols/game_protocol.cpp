@@ -21,7 +21,7 @@
 #include "items/network_item_manager.hpp"
 #include "karts/abstract_kart.hpp"
 #include "karts/controller/player_controller.hpp"
-#include "modes/world.hpp"
+#include "modes/linear_world.hpp"
 #include "network/event.hpp"
 #include "network/network_config.hpp"
 #include "network/game_setup.hpp"
@@ -31,14 +31,19 @@
 #include "network/protocol_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/rewinder.hpp"
+#include "network/server_config.hpp"
 #include "network/socket_address.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
+#include "tracks/drive_graph.hpp"
 #include "tracks/track.hpp"
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 #include "main_loop.hpp"
 
+#include <cmath>
+
 // ============================================================================
 std::weak_ptr<GameProtocol> GameProtocol::m_game_protocol[PT_COUNT];
 // ============================================================================
@@ -60,9 +65,20 @@ std::shared_ptr<GameProtocol> GameProtocol::createInstance()
 GameProtocol::GameProtocol()
             : Protocol(PROTOCOL_CONTROLLER_EVENTS)
 {
-    m_network_item_manager = static_cast<NetworkItemManager*>
-        (Track::getCurrentTrack()->getItemManager());
+    // No track is loaded in unit testing
+    Track* track = Track::getCurrentTrack();
+    m_network_item_manager = track ?
+        static_cast<NetworkItemManager*>(track->getItemManager()) : NULL;
     m_data_to_send = getNetworkString();
+    m_full_state_bytes.store(0);
+    m_sent_state_bytes.store(0);
+    m_sent_states = 0;
+    // Baselines of previous race cannot be used for delta states anymore
+    if (NetworkConfig::get()->isServer() && STKHost::existHost())
+    {
+        for (auto& peer : STKHost::get()->getPeers())
+            peer->setAckedStateTicks(-1);
+    }
 }   // GameProtocol
 
 //-----------------------------------------------------------------------------
@@ -130,7 +146,9 @@ bool GameProtocol::notifyEventAsynchronous(Event* event)
     switch (message_type)
     {
     case GP_CONTROLLER_ACTION: handleControllerAction(event); break;
-    case GP_STATE:             handleState(event);            break;
+    case GP_STATE:             handleState(event, /*delta*/false); break;
+    case GP_DELTA_STATE:       handleState(event, /*delta*/true); break;
+    case GP_STATE_ACK:         handleStateAck(event);         break;
     case GP_ITEM_CONFIRMATION: handleItemEventConfirmation(event); break;
     case GP_ADJUST_TIME:
     case GP_ITEM_UPDATE:
@@ -285,9 +303,10 @@ void GameProtocol::handleItemEventConfirmation(Event *event)
 void GameProtocol::startNewState()
 {
     assert(NetworkConfig::get()->isServer());
-    m_data_to_send->clear();
-    m_data_to_send->addUInt8(GP_STATE)
-        .addUInt32(World::getWorld()->getTicksSinceStart());
+    m_new_snapshot.m_ticks = World::getWorld()->getTicksSinceStart();
+    m_new_snapshot.m_rewinder_using.clear();
+    m_new_snapshot.m_states.clear();
+    m_new_snapshot.m_rewinder_index.clear();
 }   // startNewState
 
 // ----------------------------------------------------------------------------
@@ -298,70 +317,617 @@ void GameProtocol::startNewState()
 void GameProtocol::addState(BareNetworkString *buffer)
 {
     assert(NetworkConfig::get()->isServer());
-    m_data_to_send->addUInt16(buffer->size());
-    (*m_data_to_send) += *buffer;
+    m_new_snapshot.m_states.emplace_back(
+        buffer->getBuffer().begin() + buffer->getCurrentOffset(),
+        buffer->getBuffer().end());
 }   // addState
 
 // ----------------------------------------------------------------------------
-/** Called by a server to finalize the current state, which add updated
- *  names of rewinder using to the beginning of state buffer
+/** Called by a server to finalize the current state with the ids of
+ *  rewinder using, the state will then be stored for sendState.
  *  \param cur_rewinder List of current rewinder using.
  */
-void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
+void GameProtocol::finalizeState(std::vector<uint16_t>& cur_rewinder)
 {
     assert(NetworkConfig::get()->isServer());
-    auto& buffer = m_data_to_send->getBuffer();
-    auto pos = buffer.begin() + 1/*protocol type*/ + 1 /*gp event type*/+
-        4/*time*/;
-
-    m_data_to_send->reset();
-    std::vector<uint8_t> names;
-    names.push_back((uint8_t)cur_rewinder.size());
-    for (std::string& name : cur_rewinder)
-    {
-        names.push_back((uint8_t)name.size());
-        std::vector<uint8_t> rewinder(name.begin(), name.end());
-        names.insert(names.end(), rewinder.begin(), rewinder.end());
-    }
-    buffer.insert(pos, names.begin(), names.end());
+    std::swap(m_new_snapshot.m_rewinder_using, cur_rewinder);
+    addStateSnapshot(m_new_snapshot);
 }   // finalizeState
 
 // ----------------------------------------------------------------------------
 /** Called when the last state information has been added and the message
- *  can be sent to the clients.
+ *  can be sent to the clients. Clients which acknowledged a state still
+ *  stored in m_state_snapshots receive a delta state against it, all other
+ *  clients receive the full state. Clients which don't support rewinder ids
+ *  receive the state with rewinder names, as do all clients if delta states
+ *  are disabled, because without baseline the names of all rewinders would
+ *  be sent in each delta state anyway.
+ *  Moving objects far away from all karts of a client are only sent every
+ *  irrelevant-state-interval states to it, the client keeps its local
+ *  prediction for them in between.
  */
 void GameProtocol::sendState()
 {
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    if (m_state_snapshots.empty())
+        return;
+    const StateSnapshot& cur = m_state_snapshots.back();
+
+    // Size of the full state without rewinder names for statistics
+    unsigned full_size = 1/*protocol type*/ + 1/*gp event type*/ +
+        4/*time*/ + 4/*baseline time*/ + 1/*new rewinders*/ +
+        1/*rewinder count*/;
+    for (unsigned i = 0; i < cur.m_states.size(); i++)
+        full_size += 2/*id*/ + 1/*type*/ + 2/*size*/ + cur.m_states[i].size();
+
+    std::vector<RelevancePosition> positions;
+    if (ServerConfig::m_delta_state &&
+        ServerConfig::m_state_relevance_distance > 0.0f)
+        getRelevancePositions(cur, &positions);
+
+    // Peers which acknowledged the same state and have the same relevant
+    // states share the delta state, which is sent in one shared packet
+    typedef std::tuple<int, std::vector<uint8_t>,
+        std::vector<uint16_t> > DeltaKey;
+    std::map<DeltaKey, std::pair<NetworkString*, std::vector<STKPeer*> > >
+        delta_states;
+    NetworkString* legacy_state = NULL;
+    std::vector<STKPeer*> legacy_peers;
+    uint64_t full_bytes = 0;
+    uint64_t sent_bytes = 0;
+    const unsigned state_count = m_sent_states++;
+    // Peers with too much upload speed only get every second state
+    const bool send_reduced = state_count % 2 == 0;
+    const bool send_all = ServerConfig::m_irrelevant_state_interval <= 1 ||
+        state_count % ServerConfig::m_irrelevant_state_interval == 0;
+    std::set<uint32_t> host_ids;
+    std::vector<uint8_t> relevant;
+    std::vector<std::pair<uint16_t, const std::vector<uint8_t>*> > outdated;
+    auto peers = STKHost::get()->getPeers();
+    for (auto& peer : peers)
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame() ||
+            (peer->hasReducedState() && !send_reduced))
+        {
+            host_ids.insert(peer->getHostId());
+            continue;
+        }
+        full_bytes += full_size;
+
+        if (!ServerConfig::m_delta_state ||
+            peer->getClientCapabilities().find("delta_state") ==
+            peer->getClientCapabilities().end())
+        {
+            if (!legacy_state)
+            {
+                legacy_state = getNetworkString();
+                encodeLegacyState(legacy_state, cur);
+            }
+            legacy_peers.push_back(peer.get());
+            sent_bytes += legacy_state->getTotalSize();
+            continue;
+        }
+
+        host_ids.insert(peer->getHostId());
+        const StateSnapshot* baseline =
+            findStateSnapshot(peer->getAckedStateTicks());
+        getRelevantStates(peer.get(), cur, baseline, positions, send_all,
+            &relevant, &outdated);
+        DeltaKey key(baseline ? baseline->m_ticks : -1, relevant,
+            std::vector<uint16_t>());
+        for (auto& o : outdated)
+            std::get<2>(key).push_back(o.first);
+        auto& delta = delta_states[key];
+        if (!delta.first)
+        {
+            delta.first = getNetworkString();
+            encodeDeltaState(delta.first, cur, baseline, relevant, outdated);
+        }
+        delta.second.push_back(peer.get());
+        sent_bytes += delta.first->getTotalSize();
+    }
+    for (auto& p : delta_states)
+    {
+        STKHost::get()->sendPacketToPeers(p.second.second, p.second.first,
+            /*reliable*/false);
+        delete p.second.first;
+    }
+    if (legacy_state)
+    {
+        STKHost::get()->sendPacketToPeers(legacy_peers, legacy_state,
+            /*reliable*/false);
+        delete legacy_state;
+    }
+    m_full_state_bytes.fetch_add(full_bytes);
+    m_sent_state_bytes.fetch_add(sent_bytes);
+
+    // Remove skipped states of disconnected peers
+    for (auto it = m_skipped_states.begin(); it != m_skipped_states.end();)
+    {
+        if (host_ids.find(it->first) == host_ids.end())
+            it = m_skipped_states.erase(it);
+        else
+            it++;
+    }
 }   // sendState
 
 // ----------------------------------------------------------------------------
-/** Called when a new full state is received form the server.
+/** Finds the rewinders in cur whose state can be skipped for clients far
+ *  away from them (see Rewinder::getRelevancePosition), with their distance
+ *  down the driveline in linear races.
  */
-void GameProtocol::handleState(Event *event)
+void GameProtocol::getRelevancePositions(const StateSnapshot& cur,
+                                     std::vector<RelevancePosition>* out) const
 {
-    if (!NetworkConfig::get()->isClient())
+    LinearWorld* lw = dynamic_cast<LinearWorld*>(World::getWorld());
+    DriveGraph* dg = DriveGraph::get();
+    for (unsigned i = 0; i < cur.m_rewinder_using.size(); i++)
+    {
+        std::shared_ptr<Rewinder> r =
+            RewindManager::get()->getRewinder(cur.m_rewinder_using[i]);
+        RelevancePosition rp;
+        if (!r || !r->getRelevancePosition(&rp.m_xyz))
+            continue;
+        rp.m_index = i;
+        rp.m_distance = -1.0f;
+        if (lw && dg)
+        {
+            int sector = Graph::UNKNOWN_SECTOR;
+            dg->findRoadSector(rp.m_xyz, &sector);
+            if (sector != Graph::UNKNOWN_SECTOR)
+                rp.m_distance = dg->getDistanceFromStart(sector);
+        }
+        out->push_back(rp);
+    }
+}   // getRelevancePositions
+
+// ----------------------------------------------------------------------------
+/** Returns if a rewinder is near any kart of a peer, along the driveline if
+ *  it's on it in linear races, otherwise the direct distance is used.
+ *  Spectators have no karts, so nothing is relevant to them.
+ */
+bool GameProtocol::isRelevant(const STKPeer* peer,
+                              const RelevancePosition& rp) const
+{
+    World* w = World::getWorld();
+    LinearWorld* lw = dynamic_cast<LinearWorld*>(w);
+    DriveGraph* dg = DriveGraph::get();
+    const float max_distance = ServerConfig::m_state_relevance_distance;
+    for (unsigned kart_id : peer->getAvailableKartIDs())
+    {
+        if (kart_id >= w->getNumKarts())
+            continue;
+        if (lw && dg && rp.m_distance >= 0.0f)
+        {
+            const float lap_length = dg->getLapLength();
+            float distance = fmodf(fabsf(rp.m_distance -
+                lw->getDistanceDownTrackForKart(kart_id, false)), lap_length);
+            distance = std::min(distance, lap_length - distance);
+            if (distance < max_distance)
+                return true;
+        }
+        else if ((w->getKart(kart_id)->getXYZ() - rp.m_xyz).length() <
+            max_distance)
+            return true;
+    }
+    return false;
+}   // isRelevant
+
+// ----------------------------------------------------------------------------
+/** Decides how each state in cur is sent to a peer and updates the skipped
+ *  states of the peer.
+ *  \param send_all If true states which are not relevant are sent too.
+ *  \param[out] relevant RelevantState for each state in cur.
+ *  \param[out] outdated Rewinders not in cur whose latest state was skipped
+ *         for this peer, with their latest state which needs to be sent now.
+ */
+void GameProtocol::getRelevantStates(const STKPeer* peer,
+    const StateSnapshot& cur, const StateSnapshot* baseline,
+    const std::vector<RelevancePosition>& positions, bool send_all,
+    std::vector<uint8_t>* relevant,
+    std::vector<std::pair<uint16_t, const std::vector<uint8_t>*> >* outdated)
+{
+    relevant->assign(cur.m_states.size(), RS_SEND);
+    outdated->clear();
+    auto ss_it = m_skipped_states.find(peer->getHostId());
+    if (positions.empty() && ss_it == m_skipped_states.end())
         return;
-    NetworkString &data = event->data();
-    int ticks          = data.getUInt32();
+    SkippedStates& ss = m_skipped_states[peer->getHostId()];
 
-    // Check for updated rewinder using
-    unsigned rewinder_size = data.getUInt8();
-    std::vector<std::string> rewinder_using;
-    for (unsigned i = 0; i < rewinder_size; i++)
+    std::vector<uint16_t> skipped;
+    for (const RelevancePosition& rp : positions)
+    {
+        if (send_all || isRelevant(peer, rp))
+            continue;
+        (*relevant)[rp.m_index] = RS_SKIP;
+        skipped.push_back(cur.m_rewinder_using[rp.m_index]);
+    }
+
+    // Clients don't have the states skipped in baseline
+    auto baseline_skipped = baseline ?
+        ss.m_skipped.find(baseline->m_ticks) : ss.m_skipped.end();
+    if (baseline_skipped != ss.m_skipped.end())
+    {
+        const std::vector<uint16_t>& ids = baseline_skipped->second;
+        for (unsigned i = 0; i < cur.m_rewinder_using.size(); i++)
+        {
+            if ((*relevant)[i] == RS_SEND &&
+                std::binary_search(ids.begin(), ids.end(),
+                cur.m_rewinder_using[i]))
+                (*relevant)[i] = RS_FULL;
+        }
+    }
+
+    for (unsigned i = 0; i < cur.m_rewinder_using.size(); i++)
+    {
+        if ((*relevant)[i] == RS_SKIP)
+            ss.m_outdated.insert(cur.m_rewinder_using[i]);
+        else
+            ss.m_outdated.erase(cur.m_rewinder_using[i]);
+    }
+
+    // Objects which stopped moving are not in cur anymore, so send their
+    // latest state which the client missed
+    for (auto it = ss.m_outdated.begin(); it != ss.m_outdated.end();)
+    {
+        if (cur.findRewinder(*it) != -1)
+        {
+            it++;
+            continue;
+        }
+        for (auto s = m_state_snapshots.rbegin();
+            s != m_state_snapshots.rend(); s++)
+        {
+            const int idx = s->findRewinder(*it);
+            if (idx == -1)
+                continue;
+            outdated->emplace_back(*it, &s->m_states[idx]);
+            break;
+        }
+        it = ss.m_outdated.erase(it);
+    }
+
+    std::sort(skipped.begin(), skipped.end());
+    if (!skipped.empty())
+        ss.m_skipped[cur.m_ticks] = std::move(skipped);
+    // Only skipped states which can be baseline are needed
+    const int oldest_ticks = m_state_snapshots.front().m_ticks;
+    while (!ss.m_skipped.empty() &&
+        ss.m_skipped.begin()->first < oldest_ticks)
+        ss.m_skipped.erase(ss.m_skipped.begin());
+}   // getRelevantStates
+
+// ----------------------------------------------------------------------------
+/** Stores a snapshot for delta states, the content of snapshot will be moved.
+ *  Only the latest MAX_STATE_SNAPSHOTS snapshots are kept.
+ */
+void GameProtocol::addStateSnapshot(StateSnapshot& snapshot)
+{
+    snapshot.m_rewinder_index.clear();
+    for (unsigned i = 0; i < snapshot.m_rewinder_using.size(); i++)
+    {
+        snapshot.m_rewinder_index.emplace_back(
+            snapshot.m_rewinder_using[i], i);
+    }
+    std::sort(snapshot.m_rewinder_index.begin(),
+        snapshot.m_rewinder_index.end());
+    m_state_snapshots.push_back(std::move(snapshot));
+    while (m_state_snapshots.size() > MAX_STATE_SNAPSHOTS)
+        m_state_snapshots.pop_front();
+}   // addStateSnapshot
+
+// ----------------------------------------------------------------------------
+/** Returns the stored snapshot at the given ticks, or NULL if it's not
+ *  available (anymore).
+ */
+const GameProtocol::StateSnapshot*
+                              GameProtocol::findStateSnapshot(int ticks) const
+{
+    if (ticks < 0)
+        return NULL;
+    for (auto it = m_state_snapshots.rbegin(); it != m_state_snapshots.rend();
+        it++)
+    {
+        if (it->m_ticks == ticks)
+            return &(*it);
+    }
+    return NULL;
+}   // findStateSnapshot
+
+// ----------------------------------------------------------------------------
+/** Writes the state cur to ns, as delta against baseline if given. The names
+ *  of rewinders not in baseline are sent first, so clients only need to
+ *  receive the name of each rewinder id once.
+ *  For each rewinder the state is either unchanged, or a bitmask of changed
+ *  bytes followed by the new values of those bytes, or the full state if
+ *  it's a new rewinder or the delta would not be smaller. Positions are
+ *  stored as big endian floats, so for moving objects usually only the low
+ *  mantissa bytes are sent.
+ *  \param relevant RelevantState of each rewinder in cur.
+ *  \param outdated Rewinders not in cur whose state is sent in full too.
+ */
+void GameProtocol::encodeDeltaState(NetworkString* ns,
+                                    const StateSnapshot& cur,
+                                    const StateSnapshot* baseline,
+                                    const std::vector<uint8_t>& relevant,
+                                    const std::vector<std::pair<uint16_t,
+                                    const std::vector<uint8_t>*> >& outdated)
+                                                                          const
+{
+    ns->addUInt8(GP_DELTA_STATE).addUInt32(cur.m_ticks)
+        .addUInt32(baseline ? baseline->m_ticks : -1);
+
+    std::vector<uint8_t>& buffer = ns->getBuffer();
+    const unsigned new_rewinder_offset = buffer.size();
+    uint8_t new_rewinder = 0;
+    ns->addUInt8(new_rewinder);
+    std::vector<uint16_t> rewinder_using = cur.m_rewinder_using;
+    for (auto& o : outdated)
+        rewinder_using.push_back(o.first);
+    for (uint16_t id : rewinder_using)
     {
+        if (baseline && baseline->findRewinder(id) != -1)
+            continue;
+        new_rewinder++;
+        ns->addUInt16(id);
+        RewindManager::get()->encodeRewinderName(id, &buffer);
+    }
+    buffer[new_rewinder_offset] = new_rewinder;
+
+    ns->addUInt8((uint8_t)rewinder_using.size());
+    for (uint16_t id : rewinder_using)
+        ns->addUInt16(id);
+
+    std::vector<uint8_t> mask;
+    std::vector<uint8_t> changed;
+    for (unsigned i = 0; i < cur.m_states.size(); i++)
+    {
+        const std::vector<uint8_t>& state = cur.m_states[i];
+        if (relevant[i] == RS_SKIP)
+        {
+            ns->addUInt8(DST_SKIPPED);
+            continue;
+        }
+        const int idx = baseline && relevant[i] == RS_SEND ?
+            baseline->findRewinder(cur.m_rewinder_using[i]) : -1;
+        if (idx != -1 && baseline->m_states[idx].size() == state.size())
+        {
+            const std::vector<uint8_t>& old = baseline->m_states[idx];
+            mask.assign((state.size() + 7) / 8, 0);
+            changed.clear();
+            for (unsigned j = 0; j < state.size(); j++)
+            {
+                if (state[j] == old[j])
+                    continue;
+                mask[j / 8] |= (uint8_t)(1 << (j % 8));
+                changed.push_back(state[j]);
+            }
+            if (changed.empty())
+            {
+                ns->addUInt8(DST_UNCHANGED);
+                continue;
+            }
+            if (mask.size() + changed.size() < state.size())
+            {
+                ns->addUInt8(DST_CHANGED);
+                buffer.insert(buffer.end(), mask.begin(), mask.end());
+                buffer.insert(buffer.end(), changed.begin(), changed.end());
+                continue;
+            }
+        }
+        ns->addUInt8(DST_FULL).addUInt16((uint16_t)state.size());
+        buffer.insert(buffer.end(), state.begin(), state.end());
+    }
+    for (auto& o : outdated)
+    {
+        ns->addUInt8(DST_FULL).addUInt16((uint16_t)o.second->size());
+        buffer.insert(buffer.end(), o.second->begin(), o.second->end());
+    }
+}   // encodeDeltaState
+
+// ----------------------------------------------------------------------------
+/** Writes the full state cur to ns with rewinder names, for clients which
+ *  don't support rewinder ids.
+ */
+void GameProtocol::encodeLegacyState(NetworkString* ns,
+                                     const StateSnapshot& cur) const
+{
+    ns->addUInt8(GP_STATE).addUInt32(cur.m_ticks)
+        .addUInt8((uint8_t)cur.m_rewinder_using.size());
+    std::vector<uint8_t>& buffer = ns->getBuffer();
+    for (uint16_t id : cur.m_rewinder_using)
+        RewindManager::get()->encodeRewinderName(id, &buffer);
+    for (const std::vector<uint8_t>& state : cur.m_states)
+    {
+        ns->addUInt16((uint16_t)state.size());
+        buffer.insert(buffer.end(), state.begin(), state.end());
+    }
+}   // encodeLegacyState
+
+// ----------------------------------------------------------------------------
+/** Reconstructs the full state from a (delta) state sent by server, the
+ *  names of new rewinders will be added to the rewinder id table.
+ *  \param data The state, after the GP_DELTA_STATE byte.
+ *  \param out The full state.
+ *  \param skipped If the state of each rewinder in out was skipped by
+ *         server, those states are empty.
+ *  \return False if the baseline of the delta state is not available.
+ */
+bool GameProtocol::decodeDeltaState(NetworkString& data, StateSnapshot* out,
+                                    std::vector<bool>* skipped) const
+{
+    out->m_ticks = data.getUInt32();
+    const int baseline_ticks = (int)data.getUInt32();
+    const StateSnapshot* baseline = findStateSnapshot(baseline_ticks);
+    if (baseline_ticks != -1 && !baseline)
+        return false;
+
+    unsigned new_rewinder = data.getUInt8();
+    for (unsigned i = 0; i < new_rewinder; i++)
+    {
+        uint16_t id = data.getUInt16();
         std::string name;
         data.decodeString(&name);
-        rewinder_using.push_back(name);
+        RewindManager::get()->setRewinderName(id, name);
+    }
+
+    unsigned rewinder_size = data.getUInt8();
+    out->m_rewinder_using.resize(rewinder_size);
+    for (unsigned i = 0; i < rewinder_size; i++)
+        out->m_rewinder_using[i] = data.getUInt16();
+
+    out->m_states.resize(rewinder_size);
+    skipped->assign(rewinder_size, false);
+    for (unsigned i = 0; i < rewinder_size; i++)
+    {
+        std::vector<uint8_t>& state = out->m_states[i];
+        uint8_t type = data.getUInt8();
+        if (type == DST_SKIPPED)
+        {
+            (*skipped)[i] = true;
+            state.clear();
+            continue;
+        }
+        if (type == DST_FULL)
+        {
+            unsigned size = data.getUInt16();
+            if (data.size() < size)
+                throw std::out_of_range("Delta state out of range.");
+            const uint8_t* p = (const uint8_t*)data.getCurrentData();
+            state.assign(p, p + size);
+            data.skip(size);
+            continue;
+        }
+
+        const int idx = baseline ?
+            baseline->findRewinder(out->m_rewinder_using[i]) : -1;
+        if (idx == -1)
+        {
+            Log::warn("GameProtocol", "Missing rewinder %d in baseline state.",
+                out->m_rewinder_using[i]);
+            return false;
+        }
+        state = baseline->m_states[idx];
+        if (type == DST_UNCHANGED)
+            continue;
+
+        const unsigned mask_size = ((unsigned)state.size() + 7) / 8;
+        if (data.size() < mask_size)
+            throw std::out_of_range("Delta state out of range.");
+        const uint8_t* mask = (const uint8_t*)data.getCurrentData();
+        data.skip(mask_size);
+        for (unsigned j = 0; j < state.size(); j++)
+        {
+            if ((mask[j / 8] >> (j % 8)) & 1)
+                state[j] = data.getUInt8();
+        }
+    }
+    return true;
+}   // decodeDeltaState
+
+// ----------------------------------------------------------------------------
+/** Called when a new state is received form the server, a delta state will
+ *  be reconstructed to full state first.
+ *  \param delta If the state is a delta state with rewinder ids, otherwise
+ *  it's a full state with rewinder names from a server without rewinder ids
+ *  support.
+ */
+void GameProtocol::handleState(Event *event, bool delta)
+{
+    if (!NetworkConfig::get()->isClient())
+        return;
+    NetworkString &data = event->data();
+
+    if (!delta)
+    {
+        int ticks = data.getUInt32();
+
+        // Check for updated rewinder using
+        unsigned rewinder_size = data.getUInt8();
+        std::vector<uint16_t> rewinder_using;
+        for (unsigned i = 0; i < rewinder_size; i++)
+        {
+            std::string name;
+            data.decodeString(&name);
+            rewinder_using.push_back(
+                RewindManager::get()->addRewinderName(name));
+        }
+
+        // The memory for bns will be handled in the RewindInfoState object
+        RewindInfoState* ris = new RewindInfoState(ticks,
+            data.getCurrentOffset(), rewinder_using, data.getBuffer());
+        RewindManager::get()->addNetworkRewindInfo(ris);
+        return;
+    }
+
+    StateSnapshot snapshot;
+    std::vector<bool> skipped;
+    if (!decodeDeltaState(data, &snapshot, &skipped))
+    {
+        // Ask server for a full state
+        sendStateAck(-1);
+        return;
+    }
+
+    std::vector<uint8_t> buffer;
+    for (unsigned i = 0; i < snapshot.m_states.size(); i++)
+    {
+        const std::vector<uint8_t>& state = snapshot.m_states[i];
+        const uint16_t size = skipped[i] ?
+            RewindInfoState::SKIPPED_STATE : (uint16_t)state.size();
+        buffer.push_back((uint8_t)((size >> 8) & 0xff));
+        buffer.push_back((uint8_t)(size & 0xff));
+        buffer.insert(buffer.end(), state.begin(), state.end());
+    }
+    std::vector<uint16_t> rewinder_using = snapshot.m_rewinder_using;
+    // Skipped states can't be used as baseline
+    for (int i = (int)skipped.size() - 1; i >= 0; i--)
+    {
+        if (!skipped[i])
+            continue;
+        snapshot.m_rewinder_using.erase(snapshot.m_rewinder_using.begin() + i);
+        snapshot.m_states.erase(snapshot.m_states.begin() + i);
     }
+    const int ticks = snapshot.m_ticks;
+    addStateSnapshot(snapshot);
+    sendStateAck(ticks);
 
-    // The memory for bns will be handled in the RewindInfoState object
-    RewindInfoState* ris = new RewindInfoState(ticks, data.getCurrentOffset(),
-        rewinder_using, data.getBuffer());
+    RewindInfoState* ris = new RewindInfoState(ticks, 0, rewinder_using,
+        buffer);
     RewindManager::get()->addNetworkRewindInfo(ris);
 }   // handleState
 
+// ----------------------------------------------------------------------------
+/** Tells the server the latest state received, so it can be used as baseline
+ *  for delta states.
+ *  \param ticks Ticks of the state received, or -1 to request full states.
+ */
+void GameProtocol::sendStateAck(int ticks)
+{
+    assert(NetworkConfig::get()->isClient());
+    NetworkString *ns = getNetworkString(5);
+    ns->addUInt8(GP_STATE_ACK).addUInt32(ticks);
+    // Unreliable is fine, as the server will keep sending full states or
+    // deltas against an older baseline till a newer ack arrives
+    sendToServer(ns, /*reliable*/false);
+    delete ns;
+}   // sendStateAck
+
+// ----------------------------------------------------------------------------
+/** Handles a state acknowledgement from a client, the acknowledged state
+ *  will be used as baseline for its delta states.
+ */
+void GameProtocol::handleStateAck(Event *event)
+{
+    if (!NetworkConfig::get()->isServer() || !checkDataSize(event, 4))
+        return;
+    const int ticks = (int)event->data().getUInt32();
+    STKPeer* peer = event->getPeer();
+    // Acks are unsequenced, so only keep the latest one
+    if (ticks == -1 || ticks > peer->getAckedStateTicks())
+        peer->setAckedStateTicks(ticks);
+}   // handleStateAck
+
 // ----------------------------------------------------------------------------
 /** Called from the RewindManager when rolling back.
  *  \param buffer Pointer to the saved state information.
@@ -400,3 +966,122 @@ void GameProtocol::update(int ticks)
     if (!World::getWorld())
         ProtocolManager::lock()->findAndTerminate(PROTOCOL_CONTROLLER_EVENTS);
 }   // update
+
+// ----------------------------------------------------------------------------
+/** Encodes states as a server would send them to a client and checks that
+ *  the client reconstructs the same full states.
+ */
+void GameProtocol::unitTesting()
+{
+    if (!RewindManager::exists())
+        RewindManager::create();
+    RewindManager* rm = RewindManager::get();
+    const uint16_t a = rm->addRewinderName("unit_test_a");
+    const uint16_t b = rm->addRewinderName("unit_test_b");
+    const uint16_t c = rm->addRewinderName("unit_test_c");
+
+    GameProtocol server, client;
+    std::vector<std::pair<uint16_t, const std::vector<uint8_t>*> > outdated;
+
+    // Encodes cur (which the server keeps as snapshot) against the server
+    // snapshot at baseline_ticks, and decodes it in client
+    auto round_trip = [&](StateSnapshot cur, int baseline_ticks,
+                          const std::vector<uint8_t>& relevant,
+                          StateSnapshot* out, std::vector<bool>* skipped,
+                          unsigned* size)->bool
+    {
+        server.addStateSnapshot(cur);
+        NetworkString ns(PROTOCOL_CONTROLLER_EVENTS);
+        server.encodeDeltaState(&ns, server.m_state_snapshots.back(),
+            server.findStateSnapshot(baseline_ticks), relevant, outdated);
+        *size = ns.size();
+        if (ns.getUInt8() != PROTOCOL_CONTROLLER_EVENTS ||
+            ns.getUInt8() != GP_DELTA_STATE ||
+            !client.decodeDeltaState(ns, out, skipped))
+            return false;
+        assert(ns.size() == 0);
+        // Like handleState, skipped states can't be used as baseline
+        StateSnapshot baseline = *out;
+        for (int i = (int)skipped->size() - 1; i >= 0; i--)
+        {
+            if (!(*skipped)[i])
+                continue;
+            baseline.m_rewinder_using.erase(
+                baseline.m_rewinder_using.begin() + i);
+            baseline.m_states.erase(baseline.m_states.begin() + i);
+        }
+        client.addStateSnapshot(baseline);
+        return true;
+    };
+    auto make_state = [](uint8_t value, unsigned size)
+    {
+        std::vector<uint8_t> state(size);
+        for (unsigned i = 0; i < size; i++)
+            state[i] = (uint8_t)(value + i);
+        return state;
+    };
+
+    // 1) No baseline: all states are sent in full
+    StateSnapshot s1;
+    s1.m_ticks = 10;
+    s1.m_rewinder_using = { a, b };
+    s1.m_states = { make_state(1, 40), make_state(2, 20) };
+    StateSnapshot out;
+    std::vector<bool> skipped;
+    unsigned full_size, size;
+    bool ok = round_trip(s1, -1, { RS_SEND, RS_SEND }, &out, &skipped,
+                         &full_size);
+    assert(ok);
+    assert(out.m_ticks == 10);
+    assert(out.m_rewinder_using == s1.m_rewinder_using);
+    assert(out.m_states == s1.m_states);
+    assert(skipped == std::vector<bool>(2, false));
+    assert(rm->getRewinderName(a) == "unit_test_a");
+
+    // 2) Unchanged rewinders, and one with a single byte changed
+    StateSnapshot s2 = s1;
+    s2.m_ticks = 20;
+    ok = round_trip(s2, 10, { RS_SEND, RS_SEND }, &out, &skipped, &size);
+    assert(ok);
+    assert(out.m_states == s1.m_states);
+    assert(size < full_size / 4);
+    s2.m_ticks = 30;
+    s2.m_states[0][17] = 99;
+    ok = round_trip(s2, 20, { RS_SEND, RS_SEND }, &out, &skipped, &size);
+    assert(ok);
+    assert(out.m_rewinder_using == s2.m_rewinder_using);
+    assert(out.m_states == s2.m_states);
+    assert(size < full_size / 2);
+    Log::verbose("GameProtocol", "Full state %u bytes, delta state %u "
+                 "bytes.", full_size, size);
+
+    // 3) Rewinder a removed, c added (with its name) and b skipped
+    StateSnapshot s3;
+    s3.m_ticks = 40;
+    s3.m_rewinder_using = { b, c };
+    s3.m_states = { make_state(3, 20), make_state(4, 8) };
+    ok = round_trip(s3, 30, { RS_SKIP, RS_SEND }, &out, &skipped, &size);
+    assert(ok);
+    assert(out.m_rewinder_using == s3.m_rewinder_using);
+    assert(skipped[0] && !skipped[1]);
+    assert(out.m_states[0].empty());
+    assert(out.m_states[1] == s3.m_states[1]);
+    assert(rm->getRewinderName(c) == "unit_test_c");
+
+    // A skipped state in baseline is sent in full again
+    StateSnapshot s4 = s3;
+    s4.m_ticks = 50;
+    ok = round_trip(s4, 40, { RS_FULL, RS_SEND }, &out, &skipped, &size);
+    assert(ok);
+    assert(!skipped[0] && !skipped[1]);
+    assert(out.m_states == s4.m_states);
+
+    // 4) Baseline which the client doesn't have
+    StateSnapshot s5 = s4;
+    s5.m_ticks = 60;
+    server.addStateSnapshot(s5);
+    s5.m_ticks = 70;
+    ok = round_trip(s5, 60, { RS_SEND, RS_SEND }, &out, &skipped, &size);
+    assert(!ok);
+    (void)ok;
+}   // unitTesting
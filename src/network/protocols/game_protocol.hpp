@@ -25,9 +25,15 @@
 #include "input/input.hpp"                // for PlayerAction
 #include "utils/cpp2011.hpp"
 #include "utils/stk_process.hpp"
+#include "utils/vec3.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <deque>
+#include <map>
 #include <mutex>
+#include <set>
 #include <vector>
 #include <tuple>
 
@@ -49,9 +55,95 @@ private:
            GP_STATE,
            GP_ITEM_UPDATE,
            GP_ITEM_CONFIRMATION,
-           GP_ADJUST_TIME
+           GP_ADJUST_TIME,
+           GP_DELTA_STATE,
+           GP_STATE_ACK
     };
 
+    /** How each rewinder state is encoded in a delta state. */
+    enum DeltaStateType : uint8_t
+    {
+        DST_FULL = 0, //!< Full state follows (new rewinder or size changed)
+        DST_UNCHANGED = 1, //!< Same as in baseline state
+        DST_CHANGED = 2, //!< Bitmask of changed bytes and their values follow
+        DST_SKIPPED = 3, //!< Not relevant to the client, no data follows
+    };
+
+    /** How each rewinder state is sent to a client, see sendState. */
+    enum RelevantState : uint8_t
+    {
+        RS_SEND = 0, //!< Sent as delta against baseline if possible
+        RS_FULL = 1, //!< Sent as full state, it was skipped in baseline
+        RS_SKIP = 2, //!< Skipped, too far away from the karts of the client
+    };
+
+    /** A full state as seen by the clients, stored by the server for delta
+     *  encoding against the state a client acknowledged, and by a client to
+     *  reconstruct the full state from a delta state. */
+    struct StateSnapshot
+    {
+        int m_ticks;
+        /** Rewinder ids (see RewindManager::getRewinder) of m_states. */
+        std::vector<uint16_t> m_rewinder_using;
+        std::vector<std::vector<uint8_t> > m_states;
+        /** Pairs of rewinder id and index in m_states sorted by id. */
+        std::vector<std::pair<uint16_t, unsigned> > m_rewinder_index;
+        // --------------------------------------------------------------------
+        /** Returns the index of rewinder id in m_states, or -1 if this
+         *  snapshot doesn't have a state for it. */
+        int findRewinder(uint16_t id) const
+        {
+            auto it = std::lower_bound(m_rewinder_index.begin(),
+                m_rewinder_index.end(), std::make_pair(id, 0u));
+            if (it == m_rewinder_index.end() || it->first != id)
+                return -1;
+            return (int)it->second;
+        }
+    };
+
+    /** Maximum number of snapshots kept for delta states, at least the
+     *  number of states sent in the round trip time of a client. */
+    static const unsigned MAX_STATE_SNAPSHOTS = 32;
+
+    /** Snapshots of recent states, oldest first. */
+    std::deque<StateSnapshot> m_state_snapshots;
+
+    /** Position of a rewinder in the latest state whose state can be skipped
+     *  for clients far away from it. */
+    struct RelevancePosition
+    {
+        /** Index of the rewinder in the state. */
+        unsigned m_index;
+        Vec3 m_xyz;
+        /** Distance down the driveline, or -1 if not on the driveline. */
+        float m_distance;
+    };
+
+    /** States not sent to a peer as they were not relevant to it. */
+    struct SkippedStates
+    {
+        /** Sorted ids of rewinders skipped, for each ticks of the states
+         *  still in m_state_snapshots. */
+        std::map<int, std::vector<uint16_t> > m_skipped;
+        /** Ids of rewinders whose latest state was not sent to the peer. */
+        std::set<uint16_t> m_outdated;
+    };
+
+    /** Skipped states of each peer by host id, only used by server. */
+    std::map<uint32_t, SkippedStates> m_skipped_states;
+
+    /** Snapshot of the state currently being assembled by the server. */
+    StateSnapshot m_new_snapshot;
+
+    /** Overall size of the full states and the actual size of states sent
+     *  (with delta states), for bandwidth statistics in server. */
+    std::atomic<uint64_t> m_full_state_bytes, m_sent_state_bytes;
+
+    /** Number of states sent by server, used for peers which only get every
+     *  second state (see STKPeer::hasReducedState), and for rewinders which
+     *  are not relevant to a peer. */
+    unsigned m_sent_states;
+
     /** A network string that collects all information from the server to be sent
      *  next. */
     NetworkString *m_data_to_send;
@@ -75,9 +167,31 @@ private:
     std::vector<Action> m_all_actions;
 
     void handleControllerAction(Event *event);
-    void handleState(Event *event);
+    void handleState(Event *event, bool delta);
     void handleAdjustTime(Event *event);
     void handleItemEventConfirmation(Event *event);
+    void handleStateAck(Event *event);
+    void addStateSnapshot(StateSnapshot& snapshot);
+    const StateSnapshot* findStateSnapshot(int ticks) const;
+    void encodeDeltaState(NetworkString* ns, const StateSnapshot& cur,
+                          const StateSnapshot* baseline,
+                          const std::vector<uint8_t>& relevant,
+                          const std::vector<std::pair<uint16_t,
+                          const std::vector<uint8_t>*> >& outdated) const;
+    void encodeLegacyState(NetworkString* ns,
+                           const StateSnapshot& cur) const;
+    bool decodeDeltaState(NetworkString& data, StateSnapshot* out,
+                          std::vector<bool>* skipped) const;
+    void getRelevancePositions(const StateSnapshot& cur,
+                               std::vector<RelevancePosition>* out) const;
+    bool isRelevant(const STKPeer* peer, const RelevancePosition& rp) const;
+    void getRelevantStates(const STKPeer* peer, const StateSnapshot& cur,
+        const StateSnapshot* baseline,
+        const std::vector<RelevancePosition>& positions, bool send_all,
+        std::vector<uint8_t>* relevant,
+        std::vector<std::pair<uint16_t, const std::vector<uint8_t>*> >*
+        outdated);
+    void sendStateAck(int ticks);
     static std::weak_ptr<GameProtocol> m_game_protocol[PT_COUNT];
     NetworkItemManager* m_network_item_manager;
     // Maximum value of values are only 32768
@@ -114,7 +228,7 @@ public:
     void startNewState();
     void addState(BareNetworkString *buffer);
     void sendState();
-    void finalizeState(std::vector<std::string>& cur_rewinder);
+    void finalizeState(std::vector<uint16_t>& cur_rewinder);
     void sendItemEventConfirmation(int ticks);
 
     virtual void undo(BareNetworkString *buffer) OVERRIDE;
@@ -143,6 +257,14 @@ public:
     // ------------------------------------------------------------------------
     std::unique_lock<std::mutex> acquireWorldDeletingMutex() const
                { return std::unique_lock<std::mutex>(m_world_deleting_mutex); }
+    // ------------------------------------------------------------------------
+    /** Returns the overall size of full states generated by server. */
+    uint64_t getFullStateBytes() const    { return m_full_state_bytes.load(); }
+    // ------------------------------------------------------------------------
+    /** Returns the overall size of states sent to all clients by server. */
+    uint64_t getSentStateBytes() const    { return m_sent_state_bytes.load(); }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
 };   // class GameProtocol
 
 #endif // GAME_PROTOCOL_HPP
@@ -30,6 +30,7 @@
 #include "modes/capture_the_flag.hpp"
 #include "modes/linear_world.hpp"
 #include "network/crypto.hpp"
+#include "network/database_connector.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
 #include "network/network.hpp"
@@ -102,69 +103,6 @@ public:
 // We use max priority for all server requests to avoid downloading of addons
 // icons blocking the poll request in all-in-one graphical client server
 
-#ifdef ENABLE_SQLITE3
-
-// ----------------------------------------------------------------------------
-static void upperIPv6SQL(sqlite3_context* context, int argc,
-                         sqlite3_value** argv)
-{
-    if (argc != 1)
-    {
-        sqlite3_result_int64(context, 0);
-        return;
-    }
-
-    char* ipv6 = (char*)sqlite3_value_text(argv[0]);
-    if (ipv6 == NULL)
-    {
-        sqlite3_result_int64(context, 0);
-        return;
-    }
-    sqlite3_result_int64(context, upperIPv6(ipv6));
-}
-
-// ----------------------------------------------------------------------------
-void insideIPv6CIDRSQL(sqlite3_context* context, int argc,
-                       sqlite3_value** argv)
-{
-    if (argc != 2)
-    {
-        sqlite3_result_int(context, 0);
-        return;
-    }
-
-    char* ipv6_cidr = (char*)sqlite3_value_text(argv[0]);
-    char* ipv6_in = (char*)sqlite3_value_text(argv[1]);
-    if (ipv6_cidr == NULL || ipv6_in == NULL)
-    {
-        sqlite3_result_int(context, 0);
-        return;
-    }
-    sqlite3_result_int(context, insideIPv6CIDR(ipv6_cidr, ipv6_in));
-}   // insideIPv6CIDRSQL
-
-// ----------------------------------------------------------------------------
-/*
-Copy below code so it can be use as loadable extension to be used in sqlite3
-command interface (together with andIPv6 and insideIPv6CIDR from stk_ipv6)
-
-#include "sqlite3ext.h"
-SQLITE_EXTENSION_INIT1
-// ----------------------------------------------------------------------------
-sqlite3_extension_init(sqlite3* db, char** pzErrMsg,
-                       const sqlite3_api_routines* pApi)
-{
-    SQLITE_EXTENSION_INIT2(pApi)
-    sqlite3_create_function(db, "insideIPv6CIDR", 2, SQLITE_UTF8, NULL,
-        insideIPv6CIDRSQL, NULL, NULL);
-    sqlite3_create_function(db, "upperIPv6", 1, SQLITE_UTF8,  0, upperIPv6SQL,
-        0, 0);
-    return 0;
-}   // sqlite3_extension_init
-*/
-
-#endif
-
 /** This is the central game setup protocol running in the server. It is
  *  mostly a finite state machine. Note that all nodes in ellipses and light
  *  grey background are actual states; nodes in boxes and white background 
@@ -275,7 +213,7 @@ void ServerLobby::initDatabase()
 {
 #ifdef ENABLE_SQLITE3
     m_last_poll_db_time = StkTime::getMonoTimeMs();
-    m_db = NULL;
+    m_db_connector = NULL;
     m_ip_ban_table_exists = false;
     m_ipv6_ban_table_exists = false;
     m_online_id_ban_table_exists = false;
@@ -285,52 +223,57 @@ void ServerLobby::initDatabase()
         return;
     const std::string& path = ServerConfig::getConfigDirectory() + "/" +
         ServerConfig::m_database_file.c_str();
-    int ret = sqlite3_open_v2(path.c_str(), &m_db,
-        SQLITE_OPEN_SHAREDCACHE | SQLITE_OPEN_FULLMUTEX |
-        SQLITE_OPEN_READWRITE, NULL);
-    if (ret != SQLITE_OK)
-    {
-        Log::error("ServerLobby", "Cannot open database: %s.",
-            sqlite3_errmsg(m_db));
-        sqlite3_close(m_db);
-        m_db = NULL;
+    m_db_connector = new DatabaseConnector();
+    if (!m_db_connector->open(path))
+    {
+        delete m_db_connector;
+        m_db_connector = NULL;
         return;
     }
-    sqlite3_busy_handler(m_db, [](void* data, int retry)
-        {
-            int retry_count = ServerConfig::m_database_timeout / 100;
-            if (retry < retry_count)
-            {
-                sqlite3_sleep(100);
-                // Return non-zero to let caller retry again
-                return 1;
-            }
-            // Return zero to let caller return SQLITE_BUSY immediately
-            return 0;
-        }, NULL);
-    sqlite3_create_function(m_db, "insideIPv6CIDR", 2, SQLITE_UTF8, NULL,
-        &insideIPv6CIDRSQL, NULL, NULL);
-    sqlite3_create_function(m_db, "upperIPv6", 1, SQLITE_UTF8, NULL,
-        &upperIPv6SQL, NULL, NULL);
-    checkTableExists(ServerConfig::m_ip_ban_table, m_ip_ban_table_exists);
-    checkTableExists(ServerConfig::m_ipv6_ban_table, m_ipv6_ban_table_exists);
-    checkTableExists(ServerConfig::m_online_id_ban_table,
-        m_online_id_ban_table_exists);
-    checkTableExists(ServerConfig::m_player_reports_table,
-        m_player_reports_table_exists);
-    checkTableExists(ServerConfig::m_ip_geolocation_table,
-        m_ip_geolocation_table_exists);
-    checkTableExists(ServerConfig::m_ipv6_geolocation_table,
-        m_ipv6_geolocation_table_exists);
+    m_ip_ban_table_exists =
+        m_db_connector->tableExists(ServerConfig::m_ip_ban_table);
+    m_ipv6_ban_table_exists =
+        m_db_connector->tableExists(ServerConfig::m_ipv6_ban_table);
+    m_online_id_ban_table_exists =
+        m_db_connector->tableExists(ServerConfig::m_online_id_ban_table);
+    m_player_reports_table_exists =
+        m_db_connector->tableExists(ServerConfig::m_player_reports_table);
+    m_ip_geolocation_table_exists =
+        m_db_connector->tableExists(ServerConfig::m_ip_geolocation_table);
+    m_ipv6_geolocation_table_exists =
+        m_db_connector->tableExists(ServerConfig::m_ipv6_geolocation_table);
+    m_db_connector->setBanTables(
+        m_ip_ban_table_exists ? ServerConfig::m_ip_ban_table.c_str() : "",
+        m_ipv6_ban_table_exists ? ServerConfig::m_ipv6_ban_table.c_str() : "",
+        m_online_id_ban_table_exists ?
+        ServerConfig::m_online_id_ban_table.c_str() : "");
+    m_db_connector->setGeolocationTables(
+        m_ip_geolocation_table_exists ?
+        ServerConfig::m_ip_geolocation_table.c_str() : "",
+        m_ipv6_geolocation_table_exists ?
+        ServerConfig::m_ipv6_geolocation_table.c_str() : "");
 #endif
 }   // initDatabase
 
 //-----------------------------------------------------------------------------
+/** Creates the stats table and views, then starts the database worker which
+ *  does all queries from now on, so the lobby never waits for sqlite.
+ */
 void ServerLobby::initServerStatsTable()
 {
 #ifdef ENABLE_SQLITE3
-    if (!ServerConfig::m_sql_management || !m_db)
+    if (!m_db_connector)
         return;
+    createServerStatsTable();
+    m_db_connector->start();
+#endif
+}   // initServerStatsTable
+
+#ifdef ENABLE_SQLITE3
+//-----------------------------------------------------------------------------
+void ServerLobby::createServerStatsTable()
+{
+    sqlite3* db = m_db_connector->getDatabase();
     std::string table_name = std::string("v") +
         StringUtils::toString(ServerConfig::m_server_db_version) + "_" +
         ServerConfig::m_server_uid + "_stats";
@@ -355,7 +298,7 @@ void ServerLobby::initServerStatsTable()
         ") WITHOUT ROWID;";
     std::string query = oss.str();
     sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
+    int ret = sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, 0);
     if (ret == SQLITE_OK)
     {
         ret = sqlite3_step(stmt);
@@ -366,13 +309,13 @@ void ServerLobby::initServerStatsTable()
         {
             Log::error("ServerLobby",
                 "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
+                query.c_str(), sqlite3_errmsg(db));
         }
     }
     else
     {
         Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
+            query.c_str(), sqlite3_errmsg(db));
     }
     if (m_server_stats_table.empty())
         return;
@@ -387,7 +330,7 @@ void ServerLobby::initServerStatsTable()
         "    country_flag TEXT NOT NULL, -- Unicode country flag representation of 2-letter country code\n"
         "    country_name TEXT NOT NULL -- Readable name of this country\n"
         ") WITHOUT ROWID;", country_table_name.c_str());
-    easySQLQuery(query);
+    m_db_connector->easySQLQuery(query);
 
     // Default views:
     // _full_stats
@@ -410,7 +353,7 @@ void ServerLobby::initServerStatsTable()
         <<      country_table_name << ".country_code = " << m_server_stats_table << ".country_code\n"
         << "    ORDER BY connected_time DESC;";
     query = oss.str();
-    easySQLQuery(query);
+    m_db_connector->easySQLQuery(query);
 
     // _current_players
     // Current players in server with ip in human readable format and time
@@ -433,7 +376,7 @@ void ServerLobby::initServerStatsTable()
         <<      country_table_name << ".country_code = " << m_server_stats_table << ".country_code\n"
         << "    WHERE connected_time = disconnected_time;";
     query = oss.str();
-    easySQLQuery(query);
+    m_db_connector->easySQLQuery(query);
 
     // _player_stats
     // All players with online id and username with their time played stats
@@ -494,12 +437,12 @@ void ServerLobby::initServerStatsTable()
             << "    WHERE RowNum = 1 ORDER BY num_connections DESC;\n";
     }
     query = oss.str();
-    easySQLQuery(query);
+    m_db_connector->easySQLQuery(query);
 
     uint32_t last_host_id = 0;
     query = StringUtils::insertValues("SELECT MAX(host_id) FROM %s;",
         m_server_stats_table.c_str());
-    ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
+    ret = sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, 0);
     if (ret == SQLITE_OK)
     {
         ret = sqlite3_step(stmt);
@@ -514,14 +457,14 @@ void ServerLobby::initServerStatsTable()
         {
             Log::error("ServerLobby",
                 "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
+                query.c_str(), sqlite3_errmsg(db));
             m_server_stats_table = "";
         }
     }
     else
     {
         Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
+            query.c_str(), sqlite3_errmsg(db));
         m_server_stats_table = "";
     }
     STKHost::get()->setNextHostId(last_host_id);
@@ -531,19 +474,22 @@ void ServerLobby::initServerStatsTable()
         "UPDATE %s SET disconnected_time = datetime('now') "
         "WHERE connected_time = disconnected_time;",
         m_server_stats_table.c_str());
-    easySQLQuery(query);
+    m_db_connector->easySQLQuery(query);
+}   // createServerStatsTable
 #endif
-}   // initServerStatsTable
 
 //-----------------------------------------------------------------------------
 void ServerLobby::destroyDatabase()
 {
 #ifdef ENABLE_SQLITE3
+    if (!m_db_connector)
+        return;
     auto peers = STKHost::get()->getPeers();
     for (auto& peer : peers)
         writeDisconnectInfoTable(peer.get());
-    if (m_db != NULL)
-        sqlite3_close(m_db);
+    // Waits for all queued queries to be written
+    delete m_db_connector;
+    m_db_connector = NULL;
 #endif
 }   // destroyDatabase
 
@@ -555,11 +501,18 @@ void ServerLobby::writeDisconnectInfoTable(STKPeer* peer)
         return;
     std::string query = StringUtils::insertValues(
         "UPDATE %s SET disconnected_time = datetime('now'), "
-        "ping = %d, packet_loss = %d "
-        "WHERE host_id = %u;", m_server_stats_table.c_str(),
-        peer->getAveragePing(), peer->getPacketLoss(),
-        peer->getHostId());
-    easySQLQuery(query);
+        "ping = ?, packet_loss = ? "
+        "WHERE host_id = ?;", m_server_stats_table.c_str());
+    const uint32_t ping = peer->getAveragePing();
+    const int packet_loss = peer->getPacketLoss();
+    const uint32_t host_id = peer->getHostId();
+    m_db_connector->writeAsync(query, [ping, packet_loss, host_id]
+        (sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, ping);
+            sqlite3_bind_int(stmt, 2, packet_loss);
+            sqlite3_bind_int64(stmt, 3, host_id);
+        });
 #endif
 }   // writeDisconnectInfoTable
 
@@ -960,129 +913,23 @@ bool ServerLobby::notifyEventAsynchronous(Event* event)
 /* Every 1 minute STK will poll database:
  * 1. Set disconnected time to now for non-exists host.
  * 2. Clear expired player reports if necessary
- * 3. Kick active peer from ban list
+ * 3. Reload ban lists (and geolocation tables if changed by others)
+ * All queries are done by the database worker, active peers in the ban lists
+ * are kicked here once the worker has reloaded them.
  */
 void ServerLobby::pollDatabase()
 {
-    if (!ServerConfig::m_sql_management || !m_db)
+    if (!m_db_connector)
         return;
 
+    if (m_db_connector->isBanCacheUpdated())
+        kickBannedPeers();
+
     if (StkTime::getMonoTimeMs() < m_last_poll_db_time + 60000)
         return;
 
     m_last_poll_db_time = StkTime::getMonoTimeMs();
 
-    if (m_ip_ban_table_exists)
-    {
-        std::string query =
-            "SELECT ip_start, ip_end, reason, description FROM ";
-        query += ServerConfig::m_ip_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
-            {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
-                {
-                    // IPv4 ban list atm
-                    if (p->isAIPeer() || p->getAddress().isIPv6())
-                        continue;
-
-                    uint32_t ip_start = 0;
-                    uint32_t ip_end = 0;
-                    if (!StringUtils::fromString(data[0], ip_start))
-                        continue;
-                    if (!StringUtils::fromString(data[1], ip_end))
-                        continue;
-                    uint32_t peer_addr = p->getAddress().getIP();
-                    if (ip_start <= peer_addr && ip_end >= peer_addr)
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            p->getAddress().toString().c_str(),
-                            data[2], data[3]);
-                        p->kick();
-                    }
-                }
-                return 0;
-            }, &peers, NULL);
-    }
-
-    if (m_ipv6_ban_table_exists)
-    {
-        std::string query =
-            "SELECT ipv6_cidr, reason, description FROM ";
-        query += ServerConfig::m_ipv6_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
-            {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
-                {
-                    std::string ipv6;
-                    if (p->getAddress().isIPv6())
-                        ipv6 = p->getAddress().toString(false);
-                    // IPv6 ban list atm
-                    if (p->isAIPeer() || ipv6.empty())
-                        continue;
-
-                    char* ipv6_cidr = data[0];
-                    if (insideIPv6CIDR(ipv6_cidr, ipv6.c_str()) == 1)
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            ipv6.c_str(), data[1], data[2]);
-                        p->kick();
-                    }
-                }
-                return 0;
-            }, &peers, NULL);
-    }
-
-    if (m_online_id_ban_table_exists)
-    {
-        std::string query = "SELECT online_id, reason, description FROM ";
-        query += ServerConfig::m_online_id_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
-            {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
-                {
-                    if (p->isAIPeer()
-                        || p->getPlayerProfiles().empty())
-                        continue;
-
-                    uint32_t online_id = 0;
-                    if (!StringUtils::fromString(data[0], online_id))
-                        continue;
-                    if (online_id == p->getPlayerProfiles()[0]->getOnlineId())
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            p->getAddress().toString().c_str(),
-                            data[1], data[2]);
-                        p->kick();
-                    }
-                }
-                return 0;
-            }, &peers, NULL);
-    }
-
     if (m_player_reports_table_exists &&
         ServerConfig::m_player_reports_expired_days != 0.0f)
     {
@@ -1092,210 +939,84 @@ void ServerLobby::pollDatabase()
             "(reported_time, '+%f days') < datetime('now');",
             ServerConfig::m_player_reports_table.c_str(),
             ServerConfig::m_player_reports_expired_days);
-        easySQLQuery(query);
+        m_db_connector->writeAsync(query);
     }
-    if (m_server_stats_table.empty())
-        return;
 
-    std::string query;
-    auto peers = STKHost::get()->getPeers();
-    std::vector<uint32_t> exist_hosts;
-    if (!peers.empty())
+    if (!m_server_stats_table.empty())
     {
-        for (auto& peer : peers)
+        std::string query;
+        auto peers = STKHost::get()->getPeers();
+        std::vector<uint32_t> exist_hosts;
+        if (!peers.empty())
         {
-            if (!peer->isValidated())
-                continue;
-            exist_hosts.push_back(peer->getHostId());
+            for (auto& peer : peers)
+            {
+                if (!peer->isValidated())
+                    continue;
+                exist_hosts.push_back(peer->getHostId());
+            }
         }
-    }
-    if (peers.empty() || exist_hosts.empty())
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET disconnected_time = datetime('now') "
-            "WHERE connected_time = disconnected_time;",
-            m_server_stats_table.c_str());
-    }
-    else
-    {
-        std::ostringstream oss;
-        oss << "UPDATE " << m_server_stats_table
-            << "    SET disconnected_time = datetime('now')"
-            << "    WHERE connected_time = disconnected_time AND"
-            << "    host_id NOT IN (";
-        for (unsigned i = 0; i < exist_hosts.size(); i++)
+        if (peers.empty() || exist_hosts.empty())
         {
-            oss << exist_hosts[i];
-            if (i != (exist_hosts.size() - 1))
-                oss << ",";
+            query = StringUtils::insertValues(
+                "UPDATE %s SET disconnected_time = datetime('now') "
+                "WHERE connected_time = disconnected_time;",
+                m_server_stats_table.c_str());
         }
-        oss << ");";
-        query = oss.str();
-    }
-    easySQLQuery(query);
-}   // pollDatabase
-
-//-----------------------------------------------------------------------------
-/** Run simple query with write lock waiting and optional function, this
- *  function has no callback for the return (if any) by the query.
- *  Return true if no error occurs
- */
-bool ServerLobby::easySQLQuery(const std::string& query,
-                   std::function<void(sqlite3_stmt* stmt)> bind_function) const
-{
-    if (!m_db)
-        return false;
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        if (bind_function)
-            bind_function(stmt);
-        ret = sqlite3_step(stmt);
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for easy query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-            return false;
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby",
-            "Error preparing database for easy query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return false;
-    }
-    return true;
-}   // easySQLQuery
-
-//-----------------------------------------------------------------------------
-/* Write true to result if table name exists in database. */
-void ServerLobby::checkTableExists(const std::string& table, bool& result)
-{
-    if (!m_db)
-        return;
-    sqlite3_stmt* stmt = NULL;
-    if (!table.empty())
-    {
-        std::string query = StringUtils::insertValues(
-            "SELECT count(type) FROM sqlite_master "
-            "WHERE type='table' AND name='%s';", table.c_str());
-
-        int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-        if (ret == SQLITE_OK)
+        else
         {
-            ret = sqlite3_step(stmt);
-            if (ret == SQLITE_ROW)
+            std::ostringstream oss;
+            oss << "UPDATE " << m_server_stats_table
+                << "    SET disconnected_time = datetime('now')"
+                << "    WHERE connected_time = disconnected_time AND"
+                << "    host_id NOT IN (";
+            for (unsigned i = 0; i < exist_hosts.size(); i++)
             {
-                int number = sqlite3_column_int(stmt, 0);
-                if (number == 1)
-                {
-                    Log::info("ServerLobby", "Table named %s will used.",
-                        table.c_str());
-                    result = true;
-                }
-            }
-            ret = sqlite3_finalize(stmt);
-            if (ret != SQLITE_OK)
-            {
-                Log::error("ServerLobby",
-                    "Error finalize database for query %s: %s",
-                    query.c_str(), sqlite3_errmsg(m_db));
+                oss << exist_hosts[i];
+                if (i != (exist_hosts.size() - 1))
+                    oss << ",";
             }
+            oss << ");";
+            query = oss.str();
         }
+        m_db_connector->writeAsync(query);
     }
-    if (!result && !table.empty())
-    {
-        Log::warn("ServerLobby", "Table named %s not found in database.",
-            table.c_str());
-    }
-}   // checkTableExists
+    m_db_connector->updateCache();
+}   // pollDatabase
 
 //-----------------------------------------------------------------------------
-std::string ServerLobby::ip2Country(const SocketAddress& addr) const
+/** Kicks all peers which are in the ban lists loaded last. */
+void ServerLobby::kickBannedPeers()
 {
-    if (!m_db || !m_ip_geolocation_table_exists || addr.isLAN())
-        return "";
-
-    std::string cc_code;
-    std::string query = StringUtils::insertValues(
-        "SELECT country_code FROM %s "
-        "WHERE `ip_start` <= %d AND `ip_end` >= %d "
-        "ORDER BY `ip_start` DESC LIMIT 1;",
-        ServerConfig::m_ip_geolocation_table.c_str(), addr.getIP(),
-        addr.getIP());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
+    auto ban_cache = m_db_connector->getBanCache();
+    const int64_t now = StkTime::getTimeSinceEpoch();
+    auto peers = STKHost::get()->getPeers();
+    for (std::shared_ptr<STKPeer>& p : peers)
     {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            const char* country_code = (char*)sqlite3_column_text(stmt, 0);
-            cc_code = country_code;
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+        if (p->isAIPeer())
+            continue;
+        const DatabaseConnector::BanInfo* ban = NULL;
+        if (p->getAddress().isIPv6())
         {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
+            ban = ban_cache->findIPv6Ban(p->getAddress().toString(false),
+                now);
         }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return "";
-    }
-    return cc_code;
-}   // ip2Country
-
-//-----------------------------------------------------------------------------
-std::string ServerLobby::ipv62Country(const SocketAddress& addr) const
-{
-    if (!m_db || !m_ipv6_geolocation_table_exists)
-        return "";
-
-    std::string cc_code;
-    const std::string& ipv6 = addr.toString(false/*show_port*/);
-    std::string query = StringUtils::insertValues(
-        "SELECT country_code FROM %s "
-        "WHERE `ip_start` <= upperIPv6(\"%s\") AND `ip_end` >= upperIPv6(\"%s\") "
-        "ORDER BY `ip_start` DESC LIMIT 1;",
-        ServerConfig::m_ipv6_geolocation_table.c_str(), ipv6.c_str(),
-        ipv6.c_str());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+        else
+            ban = ban_cache->findIPBan(p->getAddress().getIP(), now);
+        if (ban == NULL && !p->getPlayerProfiles().empty())
         {
-            const char* country_code = (char*)sqlite3_column_text(stmt, 0);
-            cc_code = country_code;
+            ban = ban_cache->findOnlineIdBan(
+                p->getPlayerProfiles()[0]->getOnlineId(), now);
         }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+        if (ban != NULL)
         {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
+            Log::info("ServerLobby", "Kick %s, reason: %s, description: %s",
+                p->getAddress().toString().c_str(), ban->m_reason.c_str(),
+                ban->m_description.c_str());
+            p->kick();
         }
     }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return "";
-    }
-    return cc_code;
-}   // ipv62Country
+}   // kickBannedPeers
 
 #endif
 
@@ -1303,9 +1024,9 @@ std::string ServerLobby::ipv62Country(const SocketAddress& addr) const
 void ServerLobby::writePlayerReport(Event* event)
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_player_reports_table_exists)
+    if (!m_db_connector || !m_player_reports_table_exists)
         return;
-    STKPeer* reporter = event->getPeer();
+    std::shared_ptr<STKPeer> reporter = event->getPeerSP();
     if (!reporter->hasPlayerProfiles())
         return;
     auto reporter_npp = reporter->getPlayerProfiles()[0];
@@ -1348,47 +1069,55 @@ void ServerLobby::writePlayerReport(Event* event)
             reporter->getAddress().getIP(), reporter_npp->getOnlineId(),
             reporting_peer->getAddress().getIP(), reporting_npp->getOnlineId());
     }
-    bool written = easySQLQuery(query,
-        [reporter_npp, reporting_npp, info](sqlite3_stmt* stmt)
+    const std::string server_uid = ServerConfig::m_server_uid;
+    const std::string reporter_name =
+        StringUtils::wideToUtf8(reporter_npp->getName());
+    const std::string info_utf8 = StringUtils::wideToUtf8(info);
+    const core::stringw reporting_name = reporting_npp->getName();
+    const std::string reporting_name_utf8 =
+        StringUtils::wideToUtf8(reporting_name);
+    auto bind_function = [server_uid, reporter_name, info_utf8,
+        reporting_name_utf8](sqlite3_stmt* stmt)
         {
             // SQLITE_TRANSIENT to copy string
-            if (sqlite3_bind_text(stmt, 1, ServerConfig::m_server_uid.c_str(),
+            if (sqlite3_bind_text(stmt, 1, server_uid.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    ServerConfig::m_server_uid.c_str());
+                    server_uid.c_str());
             }
-            if (sqlite3_bind_text(stmt, 2,
-                StringUtils::wideToUtf8(reporter_npp->getName()).c_str(),
+            if (sqlite3_bind_text(stmt, 2, reporter_name.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(reporter_npp->getName()).c_str());
+                    reporter_name.c_str());
             }
-            if (sqlite3_bind_text(stmt, 3,
-                StringUtils::wideToUtf8(info).c_str(),
+            if (sqlite3_bind_text(stmt, 3, info_utf8.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(info).c_str());
+                    info_utf8.c_str());
             }
-            if (sqlite3_bind_text(stmt, 4,
-                StringUtils::wideToUtf8(reporting_npp->getName()).c_str(),
+            if (sqlite3_bind_text(stmt, 4, reporting_name_utf8.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(reporting_npp->getName()).c_str());
+                    reporting_name_utf8.c_str());
             }
+        };
+    // The reporter is told after the worker has written the report
+    m_db_connector->runAsync([this, query, bind_function, reporter,
+        reporting_name]()
+        {
+            if (!m_db_connector->easySQLQuery(query, bind_function))
+                return;
+            NetworkString* success = getNetworkString();
+            success->setSynchronous(true);
+            success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
+                .encodeString(reporting_name);
+            reporter->sendPacket(success, true/*reliable*/);
+            delete success;
         });
-    if (written)
-    {
-        NetworkString* success = getNetworkString();
-        success->setSynchronous(true);
-        success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
-            .encodeString(reporting_npp->getName());
-        event->getPeer()->sendPacket(success, true/*reliable*/);
-        delete success;
-    }
 #endif
 }   // writePlayerReport
 
@@ -3402,14 +3131,16 @@ void ServerLobby::kickPlayerWithReason(STKPeer* peer, const char* reason) const
 void ServerLobby::saveIPBanTable(const SocketAddress& addr)
 {
 #ifdef ENABLE_SQLITE3
-    if (addr.isIPv6() || !m_db || !m_ip_ban_table_exists)
+    if (addr.isIPv6() || !m_db_connector || !m_ip_ban_table_exists)
         return;
 
     std::string query = StringUtils::insertValues(
         "INSERT INTO %s (ip_start, ip_end) "
         "VALUES (%u, %u);",
         ServerConfig::m_ip_ban_table.c_str(), addr.getIP(), addr.getIP());
-    easySQLQuery(query);
+    m_db_connector->writeAsync(query);
+    // Reload ban lists after the insert so the new ban is used
+    m_db_connector->updateCache();
 #endif
 }   // saveIPBanTable
 
@@ -3753,10 +3484,13 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
     }
 
 #ifdef ENABLE_SQLITE3
-    if (country_code.empty() && !peer->getAddress().isIPv6())
-        country_code = ip2Country(peer->getAddress());
-    if (country_code.empty() && peer->getAddress().isIPv6())
-        country_code = ipv62Country(peer->getAddress());
+    // Looked up in the geolocation ranges cached by the database worker
+    if (m_db_connector && country_code.empty() &&
+        !peer->getAddress().isIPv6())
+        country_code = m_db_connector->ip2Country(peer->getAddress());
+    if (m_db_connector && country_code.empty() &&
+        peer->getAddress().isIPv6())
+        country_code = m_db_connector->ipv62Country(peer->getAddress());
 #endif
 
     auto red_blue = STKHost::get()->getAllPlayersTeamInfo();
@@ -3891,17 +3625,18 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
 #ifdef ENABLE_SQLITE3
     if (m_server_stats_table.empty() || peer->isAIPeer())
         return;
+    // All values are bound so the worker reuses the prepared statement
+    const bool use_ipv6 = ServerConfig::m_ipv6_connection &&
+        peer->getAddress().isIPv6();
     std::string query;
-    if (ServerConfig::m_ipv6_connection && peer->getAddress().isIPv6())
+    if (use_ipv6)
     {
         query = StringUtils::insertValues(
             "INSERT INTO %s "
-            "(host_id, ip, ipv6 ,port, online_id, username, player_num, "
+            "(host_id, ip, ipv6, port, online_id, username, player_num, "
             "country_code, version, os, ping) "
-            "VALUES (%u, 0, \"%s\" ,%u, %u, ?, %u, ?, ?, ?, %u);",
-            m_server_stats_table.c_str(), peer->getHostId(),
-            peer->getAddress().toString(false), peer->getAddress().getPort(),
-            online_id, player_count, peer->getAveragePing());
+            "VALUES (?, 0, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+            m_server_stats_table.c_str());
     }
     else
     {
@@ -3909,54 +3644,53 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
             "INSERT INTO %s "
             "(host_id, ip, port, online_id, username, player_num, "
             "country_code, version, os, ping) "
-            "VALUES (%u, %u, %u, %u, ?, %u, ?, ?, ?, %u);",
-            m_server_stats_table.c_str(), peer->getHostId(),
-            peer->getAddress().getIP(), peer->getAddress().getPort(),
-            online_id, player_count, peer->getAveragePing());
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+            m_server_stats_table.c_str());
     }
-    easySQLQuery(query, [peer, country_code](sqlite3_stmt* stmt)
-        {
-            if (sqlite3_bind_text(stmt, 1, StringUtils::wideToUtf8(
-                peer->getPlayerProfiles()[0]->getName()).c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
+    const uint32_t host_id = peer->getHostId();
+    const uint32_t ip = peer->getAddress().getIP();
+    const std::string ipv6 =
+        use_ipv6 ? peer->getAddress().toString(false) : "";
+    const uint16_t port = peer->getAddress().getPort();
+    const std::string username =
+        StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
+    const uint32_t ping = peer->getAveragePing();
+    auto version_os = StringUtils::extractVersionOS(peer->getUserVersion());
+    m_db_connector->writeAsync(query, [use_ipv6, host_id, ip, ipv6, port,
+        online_id, username, player_count, country_code, version_os, ping]
+        (sqlite3_stmt* stmt)
+        {
+            bool bound = sqlite3_bind_int64(stmt, 1, host_id) == SQLITE_OK;
+            if (use_ipv6)
             {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(
-                    peer->getPlayerProfiles()[0]->getName()).c_str());
+                bound &= sqlite3_bind_text(stmt, 2, ipv6.c_str(), -1,
+                    SQLITE_TRANSIENT) == SQLITE_OK;
             }
+            else
+                bound &= sqlite3_bind_int64(stmt, 2, ip) == SQLITE_OK;
+            bound &= sqlite3_bind_int(stmt, 3, port) == SQLITE_OK;
+            bound &= sqlite3_bind_int64(stmt, 4, online_id) == SQLITE_OK;
+            bound &= sqlite3_bind_text(stmt, 5, username.c_str(), -1,
+                SQLITE_TRANSIENT) == SQLITE_OK;
+            bound &= sqlite3_bind_int(stmt, 6, player_count) == SQLITE_OK;
             if (country_code.empty())
-            {
-                if (sqlite3_bind_null(stmt, 2) != SQLITE_OK)
-                {
-                    Log::error("easySQLQuery",
-                        "Failed to bind NULL for country code.");
-                }
-            }
+                bound &= sqlite3_bind_null(stmt, 7) == SQLITE_OK;
             else
             {
-                if (sqlite3_bind_text(stmt, 2, country_code.c_str(),
-                    -1, SQLITE_TRANSIENT) != SQLITE_OK)
-                {
-                    Log::error("easySQLQuery", "Failed to bind country: %s.",
-                        country_code.c_str());
-                }
+                bound &= sqlite3_bind_text(stmt, 7, country_code.c_str(), -1,
+                    SQLITE_TRANSIENT) == SQLITE_OK;
             }
-            auto version_os =
-                StringUtils::extractVersionOS(peer->getUserVersion());
-            if (sqlite3_bind_text(stmt, 3, version_os.first.c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
+            bound &= sqlite3_bind_text(stmt, 8, version_os.first.c_str(), -1,
+                SQLITE_TRANSIENT) == SQLITE_OK;
+            bound &= sqlite3_bind_text(stmt, 9, version_os.second.c_str(),
+                -1, SQLITE_TRANSIENT) == SQLITE_OK;
+            bound &= sqlite3_bind_int64(stmt, 10, ping) == SQLITE_OK;
+            if (!bound)
             {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    version_os.first.c_str());
+                Log::error("ServerLobby", "Failed to bind stats of %s.",
+                    username.c_str());
             }
-            if (sqlite3_bind_text(stmt, 4, version_os.second.c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
-            {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    version_os.second.c_str());
-            }
-        }
-    );
+        });
 #endif
 }   // handleUnencryptedConnection
 
@@ -4796,66 +4530,35 @@ void ServerLobby::resetServer()
 void ServerLobby::testBannedForIP(STKPeer* peer) const
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_ip_ban_table_exists)
+    if (!m_db_connector || !m_ip_ban_table_exists)
         return;
 
     // Test for IPv4
     if (peer->getAddress().isIPv6())
         return;
 
-    int row_id = -1;
-    unsigned ip_start = 0;
-    unsigned ip_end = 0;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, ip_start, ip_end, reason, description FROM %s "
-        "WHERE ip_start <= %u AND ip_end >= %u "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_ip_ban_table.c_str(),
-        peer->getAddress().getIP(), peer->getAddress().getIP());
+    // Ban lists are cached by the database worker, so no query here
+    auto ban_cache = m_db_connector->getBanCache();
+    const DatabaseConnector::BanInfo* ban = ban_cache->findIPBan(
+        peer->getAddress().getIP(), StkTime::getTimeSinceEpoch());
+    if (ban == NULL)
+        return;
 
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            ip_start = (unsigned)sqlite3_column_int64(stmt, 1);
-            ip_end = (unsigned)sqlite3_column_int64(stmt, 2);
-            const char* reason = (char*)sqlite3_column_text(stmt, 3);
-            const char* desc = (char*)sqlite3_column_text(stmt, 4);
-            Log::info("ServerLobby", "%s banned by IP: %s "
-                "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+    Log::info("ServerLobby", "%s banned by IP: %s "
+        "(rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+        (int)ban->m_row_id, ban->m_description.c_str());
+    kickPlayerWithReason(peer, ban->m_reason.c_str());
+
+    std::string query = StringUtils::insertValues(
+        "UPDATE %s SET trigger_count = trigger_count + 1, "
+        "last_trigger = datetime('now') "
+        "WHERE rowid = ?;", ServerConfig::m_ip_ban_table.c_str());
+    int64_t row_id = ban->m_row_id;
+    m_db_connector->writeAsync(query, [row_id](sqlite3_stmt* stmt)
         {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ip_start = %u AND ip_end = %u;",
-            ServerConfig::m_ip_ban_table.c_str(), ip_start, ip_end);
-        easySQLQuery(query);
-    }
+            sqlite3_bind_int64(stmt, 1, row_id);
+        });
 #endif
 }   // testBannedForIP
 
@@ -4863,78 +4566,34 @@ void ServerLobby::testBannedForIP(STKPeer* peer) const
 void ServerLobby::testBannedForIPv6(STKPeer* peer) const
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_ipv6_ban_table_exists)
+    if (!m_db_connector || !m_ipv6_ban_table_exists)
         return;
 
     // Test for IPv6
     if (!peer->getAddress().isIPv6())
         return;
 
-    int row_id = -1;
-    std::string ipv6_cidr;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, ipv6_cidr, reason, description FROM %s "
-        "WHERE insideIPv6CIDR(ipv6_cidr, ?) = 1 "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_ipv6_ban_table.c_str());
+    auto ban_cache = m_db_connector->getBanCache();
+    const DatabaseConnector::BanInfo* ban = ban_cache->findIPv6Ban(
+        peer->getAddress().toString(false), StkTime::getTimeSinceEpoch());
+    if (ban == NULL)
+        return;
 
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        if (sqlite3_bind_text(stmt, 1,
-            peer->getAddress().toString(false).c_str(), -1, SQLITE_TRANSIENT)
-            != SQLITE_OK)
-        {
-            Log::error("ServerLobby", "Error binding ipv6 addr for query: %s",
-                sqlite3_errmsg(m_db));
-        }
+    Log::info("ServerLobby", "%s banned by IP: %s "
+        "(rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+        (int)ban->m_row_id, ban->m_description.c_str());
+    kickPlayerWithReason(peer, ban->m_reason.c_str());
 
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            ipv6_cidr = (char*)sqlite3_column_text(stmt, 1);
-            const char* reason = (char*)sqlite3_column_text(stmt, 2);
-            const char* desc = (char*)sqlite3_column_text(stmt, 3);
-            Log::info("ServerLobby", "%s banned by IP: %s "
-                "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+    std::string query = StringUtils::insertValues(
+        "UPDATE %s SET trigger_count = trigger_count + 1, "
+        "last_trigger = datetime('now') "
+        "WHERE rowid = ?;", ServerConfig::m_ipv6_ban_table.c_str());
+    int64_t row_id = ban->m_row_id;
+    m_db_connector->writeAsync(query, [row_id](sqlite3_stmt* stmt)
         {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ipv6_cidr = ?;", ServerConfig::m_ipv6_ban_table.c_str());
-        easySQLQuery(query, [ipv6_cidr](sqlite3_stmt* stmt)
-            {
-                if (sqlite3_bind_text(stmt, 1, ipv6_cidr.c_str(),
-                    -1, SQLITE_TRANSIENT) != SQLITE_OK)
-                {
-                    Log::error("easySQLQuery", "Failed to bind %s.",
-                        ipv6_cidr.c_str());
-                }
-            });
-    }
+            sqlite3_bind_int64(stmt, 1, row_id);
+        });
 #endif
 }   // testBannedForIPv6
 
@@ -4943,57 +4602,30 @@ void ServerLobby::testBannedForOnlineId(STKPeer* peer,
                                         uint32_t online_id) const
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_online_id_ban_table_exists)
+    if (!m_db_connector || !m_online_id_ban_table_exists)
         return;
 
-    int row_id = -1;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, reason, description FROM %s "
-        "WHERE online_id = %u "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_online_id_ban_table.c_str(), online_id);
+    auto ban_cache = m_db_connector->getBanCache();
+    const DatabaseConnector::BanInfo* ban = ban_cache->findOnlineIdBan(
+        online_id, StkTime::getTimeSinceEpoch());
+    if (ban == NULL)
+        return;
 
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            const char* reason = (char*)sqlite3_column_text(stmt, 1);
-            const char* desc = (char*)sqlite3_column_text(stmt, 2);
-            Log::info("ServerLobby", "%s banned by online id: %s "
-                "(online id: %u rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, online_id,
-                row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+    Log::info("ServerLobby", "%s banned by online id: %s "
+        "(online id: %u rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+        online_id, (int)ban->m_row_id, ban->m_description.c_str());
+    kickPlayerWithReason(peer, ban->m_reason.c_str());
+
+    std::string query = StringUtils::insertValues(
+        "UPDATE %s SET trigger_count = trigger_count + 1, "
+        "last_trigger = datetime('now') "
+        "WHERE rowid = ?;", ServerConfig::m_online_id_ban_table.c_str());
+    int64_t row_id = ban->m_row_id;
+    m_db_connector->writeAsync(query, [row_id](sqlite3_stmt* stmt)
         {
-            Log::error("ServerLobby", "Error finalize database: %s",
-                sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database: %s",
-            sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE online_id = %u;",
-            ServerConfig::m_online_id_ban_table.c_str(), online_id);
-        easySQLQuery(query);
-    }
+            sqlite3_bind_int64(stmt, 1, row_id);
+        });
 #endif
 }   // testBannedForOnlineId
 
@@ -5001,34 +4633,43 @@ void ServerLobby::testBannedForOnlineId(STKPeer* peer,
 void ServerLobby::listBanTable()
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db)
+    if (!m_db_connector)
         return;
-    auto printer = [](void* data, int argc, char** argv, char** name)
-        {
-            for (int i = 0; i < argc; i++)
+    bool ip_ban_table_exists = m_ip_ban_table_exists;
+    bool online_id_ban_table_exists = m_online_id_ban_table_exists;
+    DatabaseConnector* db_connector = m_db_connector;
+    // Printed by the worker after queued writes, so new bans are included
+    m_db_connector->runAsync([db_connector, ip_ban_table_exists,
+        online_id_ban_table_exists]()
+        {
+            auto printer = [](void* data, int argc, char** argv, char** name)
+                {
+                    for (int i = 0; i < argc; i++)
+                    {
+                        std::cout << name[i] << " = "
+                            << (argv[i] ? argv[i] : "NULL") << "\n";
+                    }
+                    std::cout << "\n";
+                    return 0;
+                };
+            sqlite3* db = db_connector->getDatabase();
+            if (ip_ban_table_exists)
             {
-                std::cout << name[i] << " = " << (argv[i] ? argv[i] : "NULL")
-                    << "\n";
+                std::string query = "SELECT * FROM ";
+                query += ServerConfig::m_ip_ban_table;
+                query += ";";
+                std::cout << "IP ban list:\n";
+                sqlite3_exec(db, query.c_str(), printer, NULL, NULL);
             }
-            std::cout << "\n";
-            return 0;
-        };
-    if (m_ip_ban_table_exists)
-    {
-        std::string query = "SELECT * FROM ";
-        query += ServerConfig::m_ip_ban_table;
-        query += ";";
-        std::cout << "IP ban list:\n";
-        sqlite3_exec(m_db, query.c_str(), printer, NULL, NULL);
-    }
-    if (m_online_id_ban_table_exists)
-    {
-        std::string query = "SELECT * FROM ";
-        query += ServerConfig::m_online_id_ban_table;
-        query += ";";
-        std::cout << "Online Id ban list:\n";
-        sqlite3_exec(m_db, query.c_str(), printer, NULL, NULL);
-    }
+            if (online_id_ban_table_exists)
+            {
+                std::string query = "SELECT * FROM ";
+                query += ServerConfig::m_online_id_ban_table;
+                query += ";";
+                std::cout << "Online Id ban list:\n";
+                sqlite3_exec(db, query.c_str(), printer, NULL, NULL);
+            }
+        });
 #endif
 }   // listBanTable
 
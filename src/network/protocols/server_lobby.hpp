@@ -39,6 +39,7 @@
 #endif
 
 class BareNetworkString;
+class DatabaseConnector;
 class NetworkItemManager;
 class NetworkString;
 class NetworkPlayerProfile;
@@ -81,7 +82,8 @@ private:
     bool m_player_reports_table_exists;
 
 #ifdef ENABLE_SQLITE3
-    sqlite3* m_db;
+    /** Does all database queries in its own thread, NULL if not used. */
+    DatabaseConnector* m_db_connector;
 
     std::string m_server_stats_table;
 
@@ -99,14 +101,9 @@ private:
 
     void pollDatabase();
 
-    bool easySQLQuery(const std::string& query,
-        std::function<void(sqlite3_stmt* stmt)> bind_function = nullptr) const;
+    void kickBannedPeers();
 
-    void checkTableExists(const std::string& table, bool& result);
-
-    std::string ip2Country(const SocketAddress& addr) const;
-
-    std::string ipv62Country(const SocketAddress& addr) const;
+    void createServerStatsTable();
 #endif
     void initDatabase();
 
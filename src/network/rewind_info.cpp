@@ -24,6 +24,61 @@
 #include "items/projectile_manager.hpp"
 #include "utils/log.hpp"
 
+#include <mutex>
+#include <new>
+
+namespace RewindInfoPool
+{
+    /** Size classes of the pool in bytes, bigger objects are allocated
+     *  normally. */
+    const size_t SIZE_CLASS = 32;
+    const size_t NUM_SIZE_CLASSES = 8;
+
+    /** Freed memory of each size class, which is reused for new objects.
+     *  The pool is shared by all processes, as RewindInfo can be created
+     *  in network thread and deleted in main thread. */
+    std::mutex g_pool_mutex;
+    std::vector<void*> g_free_list[NUM_SIZE_CLASSES];
+}   // namespace RewindInfoPool
+
+// ============================================================================
+void* RewindInfo::operator new(size_t size)
+{
+    using namespace RewindInfoPool;
+    const size_t size_class = (size + SIZE_CLASS - 1) / SIZE_CLASS - 1;
+    if (size_class >= NUM_SIZE_CLASSES)
+        return ::operator new(size);
+
+    std::unique_lock<std::mutex> lock(g_pool_mutex);
+    std::vector<void*>& free_list = g_free_list[size_class];
+    if (!free_list.empty())
+    {
+        void* p = free_list.back();
+        free_list.pop_back();
+        return p;
+    }
+    lock.unlock();
+    return ::operator new((size_class + 1) * SIZE_CLASS);
+}   // operator new
+
+// ----------------------------------------------------------------------------
+void RewindInfo::operator delete(void* p, size_t size)
+{
+    using namespace RewindInfoPool;
+    if (!p)
+        return;
+    const size_t size_class = (size + SIZE_CLASS - 1) / SIZE_CLASS - 1;
+    if (size_class >= NUM_SIZE_CLASSES)
+    {
+        ::operator delete(p);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_pool_mutex);
+    g_free_list[size_class].push_back(p);
+}   // operator delete
+
+// ============================================================================
+
 /** Constructor for a state: it only takes the size, and allocates a buffer
  *  for all state info.
  *  \param size Necessary buffer size for a state.
@@ -48,7 +103,7 @@ void RewindInfo::setTicks(int ticks)
 
 // ============================================================================
 RewindInfoState::RewindInfoState(int ticks, int start_offset,
-                                 std::vector<std::string>& rewinder_using,
+                                 std::vector<uint16_t>& rewinder_using,
                                  std::vector<uint8_t>& buffer)
                : RewindInfo(ticks, true/*is_confirmed*/)
 {
@@ -78,27 +133,34 @@ void RewindInfoState::restore()
 {
     m_buffer->reset();
     m_buffer->skip(m_start_offset);
-    for (const std::string& name : m_rewinder_using)
+    for (uint16_t id : m_rewinder_using)
     {
         const uint16_t data_size = m_buffer->getUInt16();
         const unsigned current_offset_now = m_buffer->getCurrentOffset();
-        std::shared_ptr<Rewinder> r =
-            RewindManager::get()->getRewinder(name);
+        std::shared_ptr<Rewinder> r = RewindManager::get()->getRewinder(id);
+        if (data_size == SKIPPED_STATE)
+        {
+            if (r)
+                r->keepLocalState();
+            continue;
+        }
 
         if (!r)
         {
             // For now we only need to get missing rewinder from
             // projectile_manager
-            r = ProjectileManager::get()->addRewinderFromNetworkState(name);
-        }
-        if (!r)
-        {
-            if (!RewindManager::get()->hasMissingRewinder(name))
+            const std::string name = RewindManager::get()->getRewinderName(id);
+            if (!name.empty())
+                r = ProjectileManager::get()->addRewinderFromNetworkState(name);
+            if (!r && !RewindManager::get()->hasMissingRewinder(id))
             {
-                Log::error("RewindInfoState", "Missing rewinder %s",
+                Log::error("RewindInfoState", "Missing rewinder %d %s", id,
                     name.c_str());
-                RewindManager::get()->addMissingRewinder(name);
+                RewindManager::get()->addMissingRewinder(id);
             }
+        }
+        if (!r)
+        {
             m_buffer->skip(data_size);
             continue;
         }
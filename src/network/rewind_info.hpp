@@ -56,6 +56,12 @@ private:
 
 public:
     RewindInfo(int ticks, bool is_confirmed);
+    // ------------------------------------------------------------------------
+    /** Rewind infos are allocated from a pool, as lots of them are created
+     *  and deleted every frame in networking. */
+    static void* operator new(size_t size);
+    // ------------------------------------------------------------------------
+    static void operator delete(void* p, size_t size);
 
     void setTicks(int ticks);
 
@@ -92,7 +98,8 @@ public:
 class RewindInfoState: public RewindInfo
 {
 private:
-    std::vector<std::string> m_rewinder_using;
+    /** Ids of rewinder (see RewindManager::getRewinder) in this state. */
+    std::vector<uint16_t> m_rewinder_using;
 
     int m_start_offset;
 
@@ -100,9 +107,12 @@ private:
     BareNetworkString *m_buffer;
 
 public:
+    /** Size written instead of the state size for a rewinder whose state was
+     *  skipped by server (without data), see Rewinder::keepLocalState. */
+    static const uint16_t SKIPPED_STATE = 0xffff;
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, int start_offset,
-                    std::vector<std::string>& rewinder_using,
+                    std::vector<uint16_t>& rewinder_using,
                     std::vector<uint8_t>& buffer);
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, BareNetworkString *buffer, bool is_confirmed);
@@ -114,6 +124,13 @@ public:
     /** Returns a pointer to the state buffer. */
     BareNetworkString *getBuffer() const { return m_buffer; }
     // ------------------------------------------------------------------------
+    /** Returns the offset of the first rewinder state in the buffer. */
+    int getStartOffset() const                     { return m_start_offset; }
+    // ------------------------------------------------------------------------
+    /** Returns the ids of rewinder in this state. */
+    const std::vector<uint16_t>& getRewinderUsing() const
+                                                   { return m_rewinder_using; }
+    // ------------------------------------------------------------------------
     virtual bool isState() const { return true; }
     // ------------------------------------------------------------------------
     /** Called when going back in time to undo any rewind information.
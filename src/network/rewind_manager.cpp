@@ -18,14 +18,18 @@
 
 #include "network/rewind_manager.hpp"
 
+#include "config/user_config.hpp"
 #include "graphics/irr_driver.hpp"
 #include "modes/soccer_world.hpp"
+#include "network/compress_network_body.hpp"
+#include "network/network.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/rewinder.hpp"
 #include "network/rewind_info.hpp"
 #include "network/smooth_network_body.hpp"
+#include "network/stk_host.hpp"
 #include "physics/physics.hpp"
 #include "race/history.hpp"
 #include "tracks/check_manager.hpp"
@@ -36,6 +40,7 @@
 #include "utils/profiler.hpp"
 
 #include <algorithm>
+#include <cstring>
 
 RewindManager* RewindManager::m_rewind_manager[PT_COUNT];
 std::atomic_bool RewindManager::m_enable_rewind_manager(false);
@@ -73,6 +78,14 @@ RewindManager::RewindManager()
  */
 RewindManager::~RewindManager()
 {
+    if (m_rewind_count > 0 || m_skipped_rewind_count > 0)
+    {
+        Log::info("RewindManager", "%u rewinds (%u skipped), restored %lu "
+            "mispredicted rewinders and replayed %lu ticks.", m_rewind_count,
+            m_skipped_rewind_count, (unsigned long)m_rewound_rewinders,
+            (unsigned long)m_rewound_ticks);
+    }
+
     for (RewindInfoEventFunction* rief : m_pending_rief)
         delete rief;
     m_pending_rief.clear();
@@ -87,6 +100,16 @@ void RewindManager::reset()
     m_is_rewinding = false;
     m_not_rewound_ticks.store(0);
     m_overall_state_size = 0;
+    m_rewind_count = 0;
+    m_skipped_rewind_count = 0;
+    m_last_rewound_rewinders = 0;
+    m_last_rewound_ticks = 0;
+    m_rewound_rewinders = 0;
+    m_rewound_ticks = 0;
+    m_predicted_states.resize(PREDICTED_STATES_SIZE);
+    for (PredictedStates& states : m_predicted_states)
+        states.m_ticks = -1;
+    m_mispredicted_rewinders = -1;
     m_state_frequency = stk_config->getPhysicsFPS() /
         NetworkConfig::get()->getStateFrequency();
 
@@ -161,7 +184,7 @@ void RewindManager::saveState()
     gp->startNewState();
 
     m_overall_state_size = 0;
-    std::vector<std::string> rewinder_using;
+    std::vector<uint16_t> rewinder_using;
 
     for (auto& p : m_all_rewinder)
     {
@@ -197,7 +220,8 @@ void RewindManager::update(int ticks_not_used)
 
     m_not_rewound_ticks.store(ticks, std::memory_order_relaxed);
 
-    if (!shouldSaveState(ticks))
+    if (!shouldSaveState(ticks) ||
+        (NetworkConfig::get()->isServer() && !shouldSendState(ticks)))
         return;
 
     // Save state, remove expired rewinder first
@@ -210,6 +234,7 @@ void RewindManager::update(int ticks_not_used)
             if (auto r = p.second.lock())
                 ret.push_back(r->getLocalStateRestoreFunction());
         }
+        savePredictedStates(ticks);
     }
     else
     {
@@ -221,6 +246,18 @@ void RewindManager::update(int ticks_not_used)
     PROFILER_POP_CPU_MARKER();
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Returns if the server sends a state at the given state ticks (see
+ *  shouldSaveState). An overloaded server only sends every n-th state, see
+ *  STKHost::updateTickCost.
+ */
+bool RewindManager::shouldSendState(int ticks) const
+{
+    const int scale = STKHost::existHost() ?
+        STKHost::get()->getStateIntervalScale() : 1;
+    return ((ticks - m_state_frequency + 1) / m_state_frequency) % scale == 0;
+}   // shouldSendState
+
 // ----------------------------------------------------------------------------
 /** Replays all events from the last event played till the specified time.
  *  \param world_ticks Up to (and inclusive) which time events will be replayed.
@@ -242,6 +279,22 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     // be getTime()+dt - world time has not been updated yet).
     m_rewind_queue.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
 
+    m_mispredicted_rewinders = needs_rewind && !fast_forward ?
+        countMispredictedRewinders(rewind_ticks) : -1;
+    if (m_mispredicted_rewinders == 0)
+    {
+        // Nothing to correct, keep the current (predicted) world
+        needs_rewind = false;
+        m_skipped_rewind_count++;
+        m_rewind_queue.clearLateEvents();
+        clearLocalStates(rewind_ticks);
+        if (Network::m_connection_debug)
+        {
+            Log::verbose("RewindManager", "Skipped rewind to %d at %d",
+                rewind_ticks, world_ticks);
+        }
+    }
+
     if (needs_rewind)
     {
         Log::setPrefix("Rewind");
@@ -266,6 +319,140 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     m_is_rewinding = false;
 }   // playEventsTill
 
+// ----------------------------------------------------------------------------
+/** Saves the predicted state of all rewinders on client at the ticks a state
+ *  is saved on server, so they can be compared with the confirmed state.
+ */
+void RewindManager::savePredictedStates(int ticks)
+{
+    if (!UserConfigParams::m_skip_matching_rewind)
+        return;
+
+    PredictedStates& predicted = m_predicted_states[
+        (ticks / m_state_frequency) % m_predicted_states.size()];
+    predicted.m_ticks = ticks;
+    predicted.m_data.clear();
+    for (PredictedState& state : predicted.m_rewinders)
+        state.m_size = -1;
+    for (auto& p : m_all_rewinder)
+    {
+        std::shared_ptr<Rewinder> r = p.second.lock();
+        if (!r)
+            continue;
+        // A confirmed state of a rewinder whose id is not known yet needs
+        // a rewind anyway
+        const uint16_t id = r->getRewinderId();
+        if (id >= m_rewinder_by_id.size() || m_rewinder_by_id[id].lock() != r)
+            continue;
+        int body_offset = -1;
+        std::unique_ptr<BareNetworkString> state(
+            r->savePrediction(&body_offset));
+        if (!state)
+            continue;
+        if (id >= predicted.m_rewinders.size())
+            predicted.m_rewinders.resize(id + 1, PredictedState{ 0, -1, -1 });
+        predicted.m_rewinders[id] = { (int)predicted.m_data.size(),
+            (int)state->getTotalSize(), body_offset };
+        predicted.m_data.insert(predicted.m_data.end(), state->getData(),
+            state->getData() + state->getTotalSize());
+    }
+}   // savePredictedStates
+
+// ----------------------------------------------------------------------------
+/** Compares the confirmed state at rewind_ticks with the prediction of
+ *  client for each rewinder (the physics values within tolerance, anything
+ *  else exactly). If no rewinder differs, the rewind would re-simulate the
+ *  world to what it is now and can be skipped. Events received in the past
+ *  of client after the state always need a rewind.
+ *  \return The number of rewinders whose prediction was wrong, including
+ *  rewinders which were only predicted or only confirmed (e.g. a flyable
+ *  which failed on server), or -1 if the prediction can't be compared.
+ */
+int RewindManager::countMispredictedRewinders(int rewind_ticks)
+{
+    if (!UserConfigParams::m_skip_matching_rewind ||
+        m_rewind_queue.getLatestLateEvent() > rewind_ticks)
+        return -1;
+
+    const PredictedStates& predicted = m_predicted_states[
+        (rewind_ticks / m_state_frequency) % m_predicted_states.size()];
+    if (predicted.m_ticks != rewind_ticks)
+        return -1;
+    RewindInfoState* state = m_rewind_queue.findConfirmedState(rewind_ticks);
+    if (!state)
+        return -1;
+
+    int mispredicted = 0;
+    // Number of predicted rewinders also in the confirmed state
+    unsigned confirmed_predictions = 0;
+    BareNetworkString* buffer = state->getBuffer();
+    buffer->reset();
+    buffer->skip(state->getStartOffset());
+    for (uint16_t id : state->getRewinderUsing())
+    {
+        const unsigned size = buffer->getUInt16();
+        const bool has_prediction = id < predicted.m_rewinders.size() &&
+            predicted.m_rewinders[id].m_size >= 0;
+        if (has_prediction)
+            confirmed_predictions++;
+        // Skipped states keep the prediction anyway
+        if (size == RewindInfoState::SKIPPED_STATE)
+            continue;
+        const char* confirmed = buffer->getCurrentData();
+        buffer->skip(size);
+        if (!has_prediction ||
+            !isStateNear(predicted, predicted.m_rewinders[id], confirmed,
+            size))
+            mispredicted++;
+    }
+    for (const PredictedState& prediction : predicted.m_rewinders)
+    {
+        if (prediction.m_size >= 0)
+            mispredicted++;
+    }
+    return mispredicted - (int)confirmed_predictions;
+}   // countMispredictedRewinders
+
+// ----------------------------------------------------------------------------
+/** Returns if the prediction of a rewinder matches its confirmed state. */
+bool RewindManager::isStateNear(const PredictedStates& predicted,
+                                const PredictedState& prediction,
+                                const char* confirmed, unsigned size) const
+{
+    if (prediction.m_size != (int)size)
+        return false;
+    const char* data = predicted.m_data.data() + prediction.m_offset;
+    const int offset = prediction.m_body_offset;
+    if (offset < 0)
+        return memcmp(data, confirmed, size) == 0;
+
+    const unsigned end = offset + CompressNetworkBody::COMPRESSED_SIZE;
+    if (end > size || memcmp(data, confirmed, offset) != 0 ||
+        memcmp(data + end, confirmed + end, size - end) != 0)
+        return false;
+    BareNetworkString body(data + offset,
+        CompressNetworkBody::COMPRESSED_SIZE);
+    BareNetworkString confirmed_body(confirmed + offset,
+        CompressNetworkBody::COMPRESSED_SIZE);
+    return CompressNetworkBody::isNear(&body, &confirmed_body,
+        0.01f/*max_distance*/, 0.01f/*max_angle*/, 0.05f/*max_velocity*/);
+}   // isStateNear
+
+// ----------------------------------------------------------------------------
+/** Removes the local states and predicted states up to (and including)
+ *  the given ticks, which are not needed anymore.
+ */
+void RewindManager::clearLocalStates(int ticks)
+{
+    m_local_state.erase(m_local_state.begin(),
+        m_local_state.upper_bound(ticks));
+    for (PredictedStates& predicted : m_predicted_states)
+    {
+        if (predicted.m_ticks <= ticks)
+            predicted.m_ticks = -1;
+    }
+}   // clearLocalStates
+
 // ----------------------------------------------------------------------------
 /** Adds a Rewinder to the list of all rewinders.
  *  \return true If successfully added, false otherwise.
@@ -276,10 +463,94 @@ bool RewindManager::addRewinder(std::shared_ptr<Rewinder> rewinder)
     // Maximum 1 bit to store no of rewinder used
     if (m_all_rewinder.size() == 255)
         return false;
-    m_all_rewinder[rewinder->getUniqueIdentity()] = rewinder;
+    const std::string& name = rewinder->getUniqueIdentity();
+    std::unique_lock<std::mutex> lock(m_rewinder_ids_mutex);
+    auto it = m_rewinder_ids.find(name);
+    int id = it == m_rewinder_ids.end() ? -1 : it->second;
+    lock.unlock();
+    if (id == -1 && NetworkConfig::get()->isServer())
+    {
+        // Ids are stored in 16bit in states and never reused in a race
+        if (m_rewinder_names.size() == 65535)
+            return false;
+        id = addRewinderName(name);
+    }
+    m_all_rewinder[name] = rewinder;
+
+    // Client knows the id only after receiving it from server
+    if (id != -1)
+    {
+        rewinder->setRewinderId((uint16_t)id);
+        if (id >= (int)m_rewinder_by_id.size())
+            m_rewinder_by_id.resize(id + 1);
+        m_rewinder_by_id[id] = rewinder;
+    }
     return true;
 }   // addRewinder
 
+// ----------------------------------------------------------------------------
+/** Returns the rewinder with the given id from server. The client resolves
+ *  the rewinder by its name only the first time (or when it was recreated).
+ */
+std::shared_ptr<Rewinder> RewindManager::getRewinder(uint16_t id)
+{
+    if (id < m_rewinder_by_id.size())
+    {
+        if (auto r = m_rewinder_by_id[id].lock())
+            return r;
+    }
+    std::shared_ptr<Rewinder> r = getRewinder(getRewinderName(id));
+    if (r)
+    {
+        r->setRewinderId(id);
+        if (id >= m_rewinder_by_id.size())
+            m_rewinder_by_id.resize(id + 1);
+        m_rewinder_by_id[id] = r;
+    }
+    return r;
+}   // getRewinder
+
+// ----------------------------------------------------------------------------
+/** Returns the id of a rewinder name, a new id is assigned if the name is
+ *  not in the id table yet. Used by server when adding rewinders, and by
+ *  clients for states from servers which don't send rewinder ids.
+ */
+uint16_t RewindManager::addRewinderName(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_rewinder_ids_mutex);
+    auto it = m_rewinder_ids.find(name);
+    if (it != m_rewinder_ids.end())
+        return it->second;
+    uint16_t id = (uint16_t)m_rewinder_names.size();
+    m_rewinder_names.push_back(name);
+    m_rewinder_ids[name] = id;
+    return id;
+}   // addRewinderName
+
+// ----------------------------------------------------------------------------
+/** Called by client (in network thread) when server tells the name of
+ *  a rewinder id.
+ */
+void RewindManager::setRewinderName(uint16_t id, const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_rewinder_ids_mutex);
+    if (id >= m_rewinder_names.size())
+        m_rewinder_names.resize(id + 1);
+    else if (m_rewinder_names[id] == name)
+        return;
+    m_rewinder_names[id] = name;
+    m_rewinder_ids[name] = id;
+}   // setRewinderName
+
+// ----------------------------------------------------------------------------
+std::string RewindManager::getRewinderName(uint16_t id) const
+{
+    std::lock_guard<std::mutex> lock(m_rewinder_ids_mutex);
+    if (id < m_rewinder_names.size())
+        return m_rewinder_names[id];
+    return "";
+}   // getRewinderName
+
 // ----------------------------------------------------------------------------
 /** Rewinds to the specified time, then goes forward till the current
  *  World::getTime() is reached again: it will replay everything before
@@ -339,13 +610,7 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
             if (restore_local_state)
                 restore_local_state();
         }
-        for (auto it = m_local_state.begin(); it != m_local_state.end();)
-        {
-            if (it->first <= exact_rewind_ticks)
-                it = m_local_state.erase(it);
-            else
-                break;
-        }
+        clearLocalStates(exact_rewind_ticks);
     }
     else if (!fast_forward)
     {
@@ -353,10 +618,24 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
             exact_rewind_ticks);
     }
 
+    m_rewind_count++;
+    // Only the rewinders which diverged from the prediction count, or all
+    // rewinders in the state if it was not compared
+    m_last_rewound_rewinders = m_mispredicted_rewinders > 0 ?
+        (unsigned)m_mispredicted_rewinders : 0;
+    m_last_rewound_ticks = now_ticks - exact_rewind_ticks;
+    m_rewound_ticks += m_last_rewound_ticks;
+    m_rewind_queue.clearLateEvents();
+
     // A loop in case that we should split states into several smaller ones:
     while (current && current->getTicks() == exact_rewind_ticks && 
            current->isState()                                        )
     {
+        if (m_mispredicted_rewinders < 0)
+        {
+            m_last_rewound_rewinders += (unsigned)static_cast<RewindInfoState*>
+                (current)->getRewinderUsing().size();
+        }
         current->restore();
         m_rewind_queue.next();
         current = m_rewind_queue.getCurrent();
@@ -386,7 +665,12 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
 
         // Now simulate the next time step
         if (!fast_forward)
+        {
+            // The predictions before the rewind are outdated now
+            if (shouldSaveState(world->getTicksSinceStart()))
+                savePredictedStates(world->getTicksSinceStart());
             world->updateWorld(1);
+        }
 #undef SHOW_ROLLBACK
 #ifdef SHOW_ROLLBACK
         irr_driver->update(stk_config->ticks2Time(1));
@@ -395,6 +679,14 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
 
     }   // while (world->getTicks() < current_ticks)
 
+    m_rewound_rewinders += m_last_rewound_rewinders;
+    if (Network::m_connection_debug)
+    {
+        Log::verbose("RewindManager", "Rewind to %d restored %u rewinders "
+            "and replayed %u ticks", exact_rewind_ticks,
+            m_last_rewound_rewinders, m_last_rewound_ticks);
+    }
+
     // Now compute the errors which need to be visually smoothed
     for (auto& p : m_all_rewinder)
     {
@@ -27,10 +27,12 @@
 #include <functional>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
 
+class BareNetworkString;
 class Rewinder;
 class RewindInfo;
 class RewindInfoEventFunction;
@@ -93,9 +95,55 @@ private:
 
     std::map<int, std::vector<std::function<void()> > > m_local_state;
 
+    /** State of a rewinder predicted by client, see
+     *  Rewinder::savePrediction. */
+    struct PredictedState
+    {
+        /** Offset of the state in PredictedStates::m_data. */
+        int m_offset;
+        /** Size of the state, -1 if there is no prediction. */
+        int m_size;
+        int m_body_offset;
+    };
+
+    /** The predicted states of all rewinders at one state tick. */
+    struct PredictedStates
+    {
+        /** The ticks of the states, -1 if unused. */
+        int m_ticks;
+        /** The states of all rewinders one after the other. */
+        std::vector<char> m_data;
+        /** The state of each rewinder, indexed by rewinder id. */
+        std::vector<PredictedState> m_rewinders;
+    };
+
+    /** Number of state ticks for which the predicted states are kept. */
+    static const unsigned PREDICTED_STATES_SIZE = 64;
+
+    /** Ring buffer of the predicted states at state ticks, indexed by
+     *  ticks / m_state_frequency, compared with the confirmed state to
+     *  skip a rewind. The buffers are reused, so saving the predictions
+     *  doesn't allocate memory for each rewinder. */
+    std::vector<PredictedStates> m_predicted_states;
+
     /** A list of all objects that can be rewound. */
     std::map<std::string, std::weak_ptr<Rewinder> > m_all_rewinder;
 
+    /** The rewinder id table of current race, ids are assigned by server
+     *  when adding a rewinder and never reused during a race, clients
+     *  receive them with the states they are first used in. */
+    std::vector<std::string> m_rewinder_names;
+
+    /** Reverse lookup of m_rewinder_names. */
+    std::map<std::string, uint16_t> m_rewinder_ids;
+
+    /** Protects the id table above, as clients update it from the network
+     *  thread. */
+    mutable std::mutex m_rewinder_ids_mutex;
+
+    /** Rewinders indexed by id, used when restoring states. */
+    std::vector<std::weak_ptr<Rewinder> > m_rewinder_by_id;
+
     /** The queue that stores all rewind infos. */
     RewindQueue m_rewind_queue;
 
@@ -117,7 +165,22 @@ private:
 
     bool m_schedule_reset_network_body;
 
-    std::set<std::string> m_missing_rewinders;
+    std::set<uint16_t> m_missing_rewinders;
+
+    /** Number of rewinds done and skipped in this race. */
+    unsigned m_rewind_count, m_skipped_rewind_count;
+
+    /** Number of rewinders whose prediction differs from the confirmed
+     *  state of the current rewind, or -1 if it was not compared. */
+    int m_mispredicted_rewinders;
+
+    /** Number of rewinders which diverged from the prediction and ticks
+     *  replayed by the last rewind. */
+    unsigned m_last_rewound_rewinders, m_last_rewound_ticks;
+
+    /** Total number of mispredicted rewinders and ticks replayed in this
+     *  race. */
+    uint64_t m_rewound_rewinders, m_rewound_ticks;
 
     RewindManager();
    ~RewindManager();
@@ -136,6 +199,16 @@ private:
     }
     // ------------------------------------------------------------------------
     void mergeRewindInfoEventFunction();
+    // ------------------------------------------------------------------------
+    void savePredictedStates(int ticks);
+    // ------------------------------------------------------------------------
+    int countMispredictedRewinders(int rewind_ticks);
+    // ------------------------------------------------------------------------
+    bool isStateNear(const PredictedStates& predicted,
+                     const PredictedState& prediction, const char* confirmed,
+                     unsigned size) const;
+    // ------------------------------------------------------------------------
+    void clearLocalStates(int ticks);
 
 public:
     // First static functions to manage rewinding.
@@ -188,6 +261,25 @@ public:
         return nullptr;
     }
     // ------------------------------------------------------------------------
+    std::shared_ptr<Rewinder> getRewinder(uint16_t id);
+    // ------------------------------------------------------------------------
+    uint16_t addRewinderName(const std::string& name);
+    // ------------------------------------------------------------------------
+    void setRewinderName(uint16_t id, const std::string& name);
+    // ------------------------------------------------------------------------
+    std::string getRewinderName(uint16_t id) const;
+    // ------------------------------------------------------------------------
+    /** Appends the name of rewinder id (in the same format as
+     *  BareNetworkString::encodeString) to buffer without creating a copy of
+     *  it, used by server for clients which don't support rewinder ids. */
+    void encodeRewinderName(uint16_t id, std::vector<uint8_t>* buffer) const
+    {
+        std::lock_guard<std::mutex> lock(m_rewinder_ids_mutex);
+        const std::string& name = m_rewinder_names.at(id);
+        buffer->push_back((uint8_t)name.size());
+        buffer->insert(buffer->end(), name.begin(), name.end());
+    }
+    // ------------------------------------------------------------------------
     bool addRewinder(std::shared_ptr<Rewinder> rewinder);
     // ------------------------------------------------------------------------
     /** Returns true if currently a rewind is happening. */
@@ -219,15 +311,37 @@ public:
         return ticks != 0 && a >= 0 && a % m_state_frequency == 0;
     }
     // ------------------------------------------------------------------------
+    bool shouldSendState(int ticks) const;
+    // ------------------------------------------------------------------------
     void resetSmoothNetworkBody()     { m_schedule_reset_network_body = true; }
     // ------------------------------------------------------------------------
     void handleResetSmoothNetworkBody();
     // ------------------------------------------------------------------------
-    void addMissingRewinder(const std::string& name)
-                                          { m_missing_rewinders.insert(name); }
+    void addMissingRewinder(uint16_t id)    { m_missing_rewinders.insert(id); }
+    // ------------------------------------------------------------------------
+    bool hasMissingRewinder(uint16_t id) const
+          { return m_missing_rewinders.find(id) != m_missing_rewinders.end(); }
+    // ------------------------------------------------------------------------
+    /** Returns the number of rewinds done in this race. */
+    unsigned getRewindCount() const                  { return m_rewind_count; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of rewinds skipped because the confirmed state
+     *  matched the local prediction. */
+    unsigned getSkippedRewindCount() const   { return m_skipped_rewind_count; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of rewinders which diverged from the prediction
+     *  in the last rewind. */
+    unsigned getLastRewoundRewinders() const
+                                           { return m_last_rewound_rewinders; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of ticks replayed by the last rewind. */
+    unsigned getLastRewoundTicks() const       { return m_last_rewound_ticks; }
+    // ------------------------------------------------------------------------
+    /** Returns the total number of mispredicted rewinders in this race. */
+    uint64_t getRewoundRewinders() const        { return m_rewound_rewinders; }
     // ------------------------------------------------------------------------
-    bool hasMissingRewinder(const std::string& name) const
-        { return m_missing_rewinders.find(name) != m_missing_rewinders.end(); }
+    /** Returns the total number of ticks replayed in this race. */
+    uint64_t getRewoundTicks() const                { return m_rewound_ticks; }
 
 };   // RewindManager
 
@@ -28,6 +28,7 @@
 #include "network/rewind_manager.hpp"
 
 #include <algorithm>
+#include <chrono>
 
 /** The RewindQueue stores one TimeStepInfo for each time step done.
  *  The TimeStepInfo stores all states and events to be used at the
@@ -45,6 +46,9 @@
  */
 RewindQueue::RewindQueue()
 {
+    m_all_rewind_info.resize(64, NULL);
+    m_first = 0;
+    m_size = 0;
     reset();
 }   // RewindQueue
 
@@ -74,13 +78,17 @@ void RewindQueue::reset()
     m_network_events.getData().clear();
     m_network_events.unlock();
 
-    AllRewindInfo::const_iterator i;
-    for (i = m_all_rewind_info.begin(); i != m_all_rewind_info.end(); ++i)
-        delete *i;
+    for (unsigned i = 0; i < m_size; i++)
+    {
+        delete at(i);
+        at(i) = NULL;
+    }
 
-    m_all_rewind_info.clear();
-    m_current = m_all_rewind_info.end();
+    m_first = 0;
+    m_size = 0;
+    m_current = 0;
     m_latest_confirmed_state_time = -1;
+    m_latest_late_event_time = -1;
 }   // reset
 
 // ----------------------------------------------------------------------------
@@ -94,23 +102,41 @@ void RewindQueue::reset()
  */
 void RewindQueue::insertRewindInfo(RewindInfo *ri)
 {
-    AllRewindInfo::iterator i = m_all_rewind_info.end();
+    if (m_size == m_all_rewind_info.size())
+    {
+        // Grow the ring buffer, this only happens until the buffer is large
+        // enough to hold all rewind info between two confirmed states
+        std::vector<RewindInfo*> new_info(m_all_rewind_info.size() * 2,
+                                          NULL);
+        for (unsigned i = 0; i < m_size; i++)
+            new_info[i] = at(i);
+        std::swap(m_all_rewind_info, new_info);
+        m_first = 0;
+    }
 
-    while (i != m_all_rewind_info.begin())
+    unsigned i = m_size;
+    while (i > 0)
     {
-        AllRewindInfo::iterator i_prev = i;
-        i_prev--;
+        RewindInfo* prev = at(i - 1);
         // Now test if 'ri' needs to be inserted after the
         // previous element, i.e. before the current element:
-        if ((*i_prev)->getTicks() < ri->getTicks()) break;
-        if ((*i_prev)->getTicks() == ri->getTicks() &&
-            ri->isEvent()                              ) break;
-        i = i_prev;
+        if (prev->getTicks() < ri->getTicks()) break;
+        if (prev->getTicks() == ri->getTicks() && ri->isEvent()) break;
+        i--;
     }
-    if(m_current == m_all_rewind_info.end())
-        m_current = m_all_rewind_info.insert(i, ri);
-    else
-        m_all_rewind_info.insert(i, ri);  
+
+    // Move all later rewind info one slot back (usually none)
+    m_size++;
+    for (unsigned j = m_size - 1; j > i; j--)
+        at(j) = at(j - 1);
+    at(i) = ri;
+
+    // Keep current pointing to the same rewind info, or to the new one
+    // if all rewind info were handled
+    if (m_current == m_size - 1)
+        m_current = i;
+    else if (i <= m_current)
+        m_current++;
 }   // insertRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -282,6 +308,14 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
             if ((*i)->getTicks() > *rewind_ticks)
                 *rewind_ticks = (*i)->getTicks();
         }   // if client and ticks < world_ticks
+        else if (NetworkConfig::get()->isClient() &&
+                 (*i)->getTicks() < world_ticks &&
+                 (*i)->getTicks() > m_latest_late_event_time)
+        {
+            // This event is only replayed in a rewind, so a rewind can
+            // only be skipped if it's before the state rewound to
+            m_latest_late_event_time = (*i)->getTicks();
+        }
 
         if ((*i)->isState() && (*i)->getTicks() > latest_confirmed_state &&
             (*i)->isConfirmed())
@@ -327,25 +361,22 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
  */
 void RewindQueue::cleanupOldRewindInfo(int ticks)
 {
-    auto i = m_all_rewind_info.begin();
-
-    while (!m_all_rewind_info.empty() &&
-        (*i)->getTicks() < ticks)
+    while (m_size > 0 && at(0)->getTicks() < ticks)
     {
-        if (m_current == i) next();
-        delete *i;
-        i = m_all_rewind_info.erase(i);
+        delete at(0);
+        at(0) = NULL;
+        m_first = (m_first + 1) & (m_all_rewind_info.size() - 1);
+        m_size--;
+        if (m_current > 0)
+            m_current--;
     }
 
-    if (m_all_rewind_info.empty())
-        m_current = m_all_rewind_info.end();
-
 }   // cleanupOldRewindInfo
 
 // ----------------------------------------------------------------------------
 bool RewindQueue::isEmpty() const
 {
-    return m_current == m_all_rewind_info.end();
+    return m_current == m_size;
 }   // isEmpty
 
 // ----------------------------------------------------------------------------
@@ -353,9 +384,26 @@ bool RewindQueue::isEmpty() const
  */
 bool RewindQueue::hasMoreRewindInfo() const
 {
-    return m_current != m_all_rewind_info.end();
+    return m_current != m_size;
 }   // hasMoreRewindInfo
 
+// ----------------------------------------------------------------------------
+/** Returns the confirmed state at exactly the given ticks, or NULL if there
+ *  is none.
+ */
+RewindInfoState* RewindQueue::findConfirmedState(int ticks) const
+{
+    for (unsigned i = m_size; i > 0; i--)
+    {
+        RewindInfo* ri = at(i - 1);
+        if (ri->getTicks() < ticks)
+            break;
+        if (ri->getTicks() == ticks && ri->isState() && ri->isConfirmed())
+            return static_cast<RewindInfoState*>(ri);
+    }
+    return NULL;
+}   // findConfirmedState
+
 // ----------------------------------------------------------------------------
 /** Rewinds the rewind queue and undos all events/states stored. It stops
  *  when the first confirmed state is reached that was recorded before the
@@ -367,27 +415,26 @@ int RewindQueue::undoUntil(int undo_ticks)
 {
     // A rewind is done after a state in the past is inserted. This function
     // makes sure that m_current is not end()
-    //assert(m_current != m_all_rewind_info.end());
-    assert(!m_all_rewind_info.empty());
-    m_current = m_all_rewind_info.end();
-    m_current--;
-    while((*m_current)->getTicks() > undo_ticks ||
-        (*m_current)->isEvent() || !(*m_current)->isConfirmed())
+    assert(m_size > 0);
+    m_current = m_size - 1;
+    while(at(m_current)->getTicks() > undo_ticks ||
+        at(m_current)->isEvent() || !at(m_current)->isConfirmed())
     {
         // Undo all events and states from the current time
-        (*m_current)->undo();
-        if(m_current == m_all_rewind_info.begin())
+        at(m_current)->undo();
+        if(m_current == 0)
         {
             // This shouldn't happen, but add some debug info just in case
             Log::error("undoUntil",
                        "At %d rewinding to %d current = %d = begin",
                        World::getWorld()->getTicksSinceStart(), undo_ticks, 
-                       (*m_current)->getTicks());
+                       at(m_current)->getTicks());
+            break;
         }
         m_current--;
     }
 
-    return (*m_current)->getTicks();
+    return at(m_current)->getTicks();
 }   // undoUntil
 
 // ----------------------------------------------------------------------------
@@ -397,10 +444,10 @@ int RewindQueue::undoUntil(int undo_ticks)
 void RewindQueue::replayAllEvents(int ticks)
 {
     // Replay all events that happened at the current time step
-    while ( hasMoreRewindInfo() && (*m_current)->getTicks() == ticks )
+    while ( hasMoreRewindInfo() && at(m_current)->getTicks() == ticks )
     {
-        if ((*m_current)->isEvent())
-            (*m_current)->replay();
+        if (at(m_current)->isEvent())
+            at(m_current)->replay();
         m_current++;
     }   // while current->getTIcks == ticks
 
@@ -427,37 +474,37 @@ void RewindQueue::unitTesting()
     assert(!q0.hasMoreRewindInfo());
 
     q0.addLocalState(NULL, /*confirmed*/true, 0);
-    assert(q0.m_all_rewind_info.front()->isState());
-    assert(!q0.m_all_rewind_info.front()->isEvent());
+    assert(q0.at(0)->isState());
+    assert(!q0.at(0)->isEvent());
     assert(q0.hasMoreRewindInfo());
     assert(q0.undoUntil(0) == 0);
 
     q0.addNetworkEvent(dummy_rewinder.get(), NULL, 0);
     // Network events are not immediately merged
-    assert(q0.m_all_rewind_info.size() == 1);
+    assert(q0.m_size == 1);
 
     bool needs_rewind;
     int rewind_ticks;
     int world_ticks = 0;
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
     assert(q0.hasMoreRewindInfo());
-    assert(q0.m_all_rewind_info.size() == 2);
-    AllRewindInfo::iterator rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
+    assert(q0.m_size == 2);
+    unsigned rii = 0;
+    assert(q0.at(rii)->isState());
     rii++;
-    assert((*rii)->isEvent());
+    assert(q0.at(rii)->isEvent());
 
     // Another state must be sorted before the event:
     q0.addNetworkState(NULL, 0);
     assert(q0.hasMoreRewindInfo());
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
-    assert(q0.m_all_rewind_info.size() == 3);
-    rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
+    assert(q0.m_size == 3);
+    rii = 0;
+    assert(q0.at(rii)->isState());
     rii++;
-    assert((*rii)->isState());
+    assert(q0.at(rii)->isState());
     rii++;
-    assert((*rii)->isEvent());
+    assert(q0.at(rii)->isEvent());
 
     // Test time base comparisons: adding an event to the end
     q0.addLocalEvent(dummy_rewinder.get(), NULL, true, 4);
@@ -466,18 +513,18 @@ void RewindQueue::unitTesting()
     // rii points to the 3rd element, the ones added just now
     // should be elements4 and 5:
     rii++;
-    assert((*rii)->getTicks()==1);
+    assert(q0.at(rii)->getTicks()==1);
     rii++;
-    assert((*rii)->getTicks()==4);
+    assert(q0.at(rii)->getTicks()==4);
 
     // Now test inserting an event first, then the state
     RewindQueue q1;
     q1.addLocalEvent(NULL, NULL, true, 5);
     q1.addLocalState(NULL, true, 5);
-    rii = q1.m_all_rewind_info.begin();
-    assert((*rii)->isState());
+    rii = 0;
+    assert(q1.at(rii)->isState());
     rii++;
-    assert((*rii)->isEvent());
+    assert(q1.at(rii)->isEvent());
 
     // Bugs seen before
     // ----------------
@@ -496,7 +543,7 @@ void RewindQueue::unitTesting()
     //    event, that m_current pooints to the first event, otherwise
     //    events with same time stamp will not be handled correctly.
     //    At this stage current points to the event at time 2 from above
-    AllRewindInfo::iterator current_old = b1.m_current;
+    unsigned current_old = b1.m_current;
     b1.addLocalEvent(NULL, NULL, true, 2);
     // Make sure that current was not modified, i.e. the new event at time
     // 2 was added at the end of the list:
@@ -509,7 +556,7 @@ void RewindQueue::unitTesting()
     assert(ri->getTicks() == 2);
     assert(ri->isEvent());
     b1.next();
-    assert(b1.m_current == b1.m_all_rewind_info.end());
+    assert(b1.m_current == b1.m_size);
 
     // 3) Test that if cleanupOldRewindInfo is called, it will if necessary
     //    adjust m_current to point to the latest confirmed state.
@@ -518,7 +565,90 @@ void RewindQueue::unitTesting()
     b2.addNetworkState(NULL, 2);
     b2.addNetworkState(NULL, 3);
     b2.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
-    assert((*b2.m_current)->getTicks() == 3);
+    assert(b2.at(b2.m_current)->getTicks() == 3);
+
+    // 4) Make sure that the ring buffer keeps the order when it wraps
+    //    around and grows.
+    RewindQueue b3;
+    for (int i = 0; i < 1000; i++)
+    {
+        b3.addLocalEvent(NULL, NULL, true, i);
+        // Unconfirmed states first to grow the buffer, then confirmed
+        // states to wrap around by cleaning up old rewind info
+        if (i % 3 == 0)
+            b3.addLocalState(NULL, /*confirmed*/i > 500, i);
+        if (i % 7 == 0)
+            b3.addLocalEvent(NULL, NULL, true, i - 5);
+    }
+    for (unsigned i = 1; i < b3.m_size; i++)
+        assert(b3.at(i - 1)->getTicks() <= b3.at(i)->getTicks());
 
 
 }   // unitTesting
+
+// ----------------------------------------------------------------------------
+/** Micro benchmark for RewindQueue, reports the number of rewind infos
+ *  inserted per second (with cleanup by confirmed states like a client
+ *  does), and the time to undo and replay a 300 ticks rewind window.
+ */
+void RewindQueue::benchmark()
+{
+    if (!RewindManager::exists())
+        RewindManager::create();
+    auto dummy_rewinder = std::make_shared<DummyRewinder>();
+    const int events_per_tick = 4;
+    const int state_frequency = 6;
+
+    // 1) Inserting events and states, with a confirmed state cleaning up
+    //    old rewind info every 60 ticks
+    const int insert_ticks = 100000;
+    RewindQueue q;
+    int inserts = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < insert_ticks; t++)
+    {
+        if (t % state_frequency == 0)
+        {
+            q.addLocalState(NULL, /*confirmed*/t % 60 == 0, t);
+            inserts++;
+        }
+        for (int e = 0; e < events_per_tick; e++)
+        {
+            q.addLocalEvent(dummy_rewinder.get(), new BareNetworkString(9),
+                /*confirmed*/true, t);
+            inserts++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    Log::info("RewindQueue", "Inserted %d rewind infos in %.3fs, "
+        "%.0f inserts/s.", inserts, seconds, (float)(inserts / seconds));
+
+    // 2) Undo and replay a 300 ticks window starting at a confirmed state
+    const int window = 300;
+    const int rewinds = 1000;
+    RewindQueue r;
+    r.addLocalState(NULL, /*confirmed*/true, 0);
+    for (int t = 0; t < window; t++)
+    {
+        if (t > 0 && t % state_frequency == 0)
+            r.addLocalState(NULL, /*confirmed*/false, t);
+        for (int e = 0; e < events_per_tick; e++)
+        {
+            r.addLocalEvent(dummy_rewinder.get(), new BareNetworkString(9),
+                /*confirmed*/true, t);
+        }
+    }
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rewinds; i++)
+    {
+        int ticks = r.undoUntil(window);
+        while (ticks < window)
+            r.replayAllEvents(ticks++);
+    }
+    seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    Log::info("RewindQueue", "Rewind of %d ticks (%d rewind infos): "
+        "%.2fus per rewind.", window, r.m_size,
+        (float)(seconds * 1e6 / rewinds));
+}   // benchmark
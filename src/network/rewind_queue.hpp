@@ -22,24 +22,34 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
-#include <list>
 #include <vector>
 
 class BareNetworkString;
 class EventRewinder;
 class RewindInfo;
+class RewindInfoState;
 class TimeStepInfo;
 
 /** \ingroup network
+ *  Stores all RewindInfo sorted by ticks in a ring buffer, so that adding
+ *  new RewindInfo (which is nearly always at the end) and removing old ones
+ *  (always at the front) doesn't allocate memory once the buffer has grown
+ *  large enough, and rewinding is a contiguous scan.
  */
 
 class RewindQueue
 {
 private:
 
-    typedef std::list<RewindInfo*> AllRewindInfo;
+    /** Ring buffer of all RewindInfo sorted by ticks, the capacity is
+     *  always a power of 2. */
+    std::vector<RewindInfo*> m_all_rewind_info;
 
-    AllRewindInfo m_all_rewind_info;
+    /** Index of the first (oldest) RewindInfo in m_all_rewind_info. */
+    unsigned m_first;
+
+    /** Number of RewindInfo stored in m_all_rewind_info. */
+    unsigned m_size;
 
     /** The list of all events received from the network. They are stored
      *  in a separate thread (so this data structure is thread-save), and
@@ -49,17 +59,38 @@ private:
     typedef std::vector<RewindInfo*> AllNetworkRewindInfo;
     Synchronised<AllNetworkRewindInfo> m_network_events;
 
-    /** Iterator to the curren time step info to be handled. */
-    AllRewindInfo::iterator m_current;
+    /** Index (from m_first) of the current time step info to be handled,
+     *  m_size if all are handled. */
+    unsigned m_current;
 
     /** Time at which the latest confirmed state is at. */
     int m_latest_confirmed_state_time;
 
+    /** The latest ticks of a network event which was received in the past
+     *  of client (so it is only applied by a rewind), -1 if none since
+     *  clearLateEvents was called. */
+    int m_latest_late_event_time;
 
     void cleanupOldRewindInfo(int ticks);
+    // ------------------------------------------------------------------------
+    /** Returns the i-th RewindInfo sorted by ticks. */
+    RewindInfo*& at(unsigned i)
+    {
+        assert(i < m_size);
+        return m_all_rewind_info[(m_first + i) &
+                                 (m_all_rewind_info.size() - 1)];
+    }   // at
+    // ------------------------------------------------------------------------
+    RewindInfo* at(unsigned i) const
+    {
+        assert(i < m_size);
+        return m_all_rewind_info[(m_first + i) &
+                                 (m_all_rewind_info.size() - 1)];
+    }   // at
 
 public:
         static void unitTesting();
+        static void benchmark();
 
          RewindQueue();
         ~RewindQueue();
@@ -81,6 +112,7 @@ public:
     void replayAllEvents(int ticks);
     bool isEmpty() const;
     bool hasMoreRewindInfo() const;
+    RewindInfoState* findConfirmedState(int ticks) const;
     int  undoUntil(int undo_ticks);
     void insertRewindInfo(RewindInfo *ri);
 
@@ -91,11 +123,19 @@ public:
         return m_latest_confirmed_state_time;
     }
     // ------------------------------------------------------------------------
+    /** Returns the latest ticks of an event received in the past of client,
+     *  which is not replayed yet. */
+    int getLatestLateEvent() const           { return m_latest_late_event_time; }
+    // ------------------------------------------------------------------------
+    /** Called after a rewind (or if a rewind is skipped), all late events
+     *  before are handled. */
+    void clearLateEvents()                   { m_latest_late_event_time = -1; }
+    // ------------------------------------------------------------------------
     /** Sets the current element to be the next one and returns the next
      *  RewindInfo element. */
     void next()
     {
-        assert(m_current != m_all_rewind_info.end());
+        assert(m_current < m_size);
         m_current++;
         return;
     }   // operator++
@@ -105,7 +145,7 @@ public:
      *  least one more RewindInfo (see hasMoreRewindInfo()). */
     RewindInfo* getCurrent()
     {
-        return (m_current != m_all_rewind_info.end() ) ? *m_current : NULL;
+        return m_current < m_size ? at(m_current) : NULL;
     }   // getNext
 
 };   // RewindQueue
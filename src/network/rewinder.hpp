@@ -20,12 +20,14 @@
 #define HEADER_REWINDER_HPP
 
 #include <cassert>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <memory>
 #include <vector>
 
 class BareNetworkString;
+class Vec3;
 
 enum RewinderName : char
 {
@@ -56,8 +58,17 @@ private:
     */
     std::string m_unique_identity;
 
+    /** Id of this rewinder in the state sent by server, it's assigned by the
+     *  server RewindManager when adding this rewinder, see
+     *  RewindManager::addRewinder. */
+    uint16_t m_rewinder_id;
+
 public:
-    Rewinder(const std::string& ui = "")             { m_unique_identity = ui; }
+    Rewinder(const std::string& ui = "")
+    {
+        m_unique_identity = ui;
+        m_rewinder_id = 0;
+    }
 
     virtual ~Rewinder() {}
 
@@ -72,10 +83,25 @@ public:
 
     /** Provides a copy of the state of the object in one memory buffer.
      *  The memory is managed by the RewindManager.
-     *  \param[out] ru The unique identity of rewinder writing to.
+     *  \param[out] ru The id of rewinder writing to.
      *  \return The address of the memory buffer with the state.
      */
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru) = 0;
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru) = 0;
+
+    /** Called on client when a state would be saved on server, to save the
+     *  locally predicted state in the same format as saveState, without
+     *  changing the object. It is compared to the confirmed state from server
+     *  to skip rewinds which are not needed, see
+     *  RewindManager::isPredictionCorrect.
+     *  \param[out] body_offset Offset of the compressed body (see
+     *         CompressNetworkBody) in the buffer, which is compared with
+     *         tolerance, or -1 if there is none.
+     *  \return The buffer with the predicted state, or NULL if this rewinder
+     *          can't predict its state (so a state from server for it always
+     *          needs a rewind).
+     */
+    virtual BareNetworkString* savePrediction(int* body_offset)
+                                                               { return NULL; }
 
     /** Called when an event needs to be undone. This is called while going
      *  backwards for rewinding - all stored events will get an 'undo' call.
@@ -99,6 +125,23 @@ public:
      */
     virtual void undoState(BareNetworkString *buffer) = 0;
 
+    /** Called by server to check if the state of this rewinder only needs to
+     *  be sent at a reduced rate to clients far away from it, see
+     *  GameProtocol::sendState. Only rewinders which implement
+     *  keepLocalState can support this.
+     *  \param[out] xyz Position used to compute the distance to the karts of
+     *         a client.
+     *  \return True if the state of this rewinder can be skipped.
+     */
+    virtual bool getRelevancePosition(Vec3* xyz) const        { return false; }
+
+    /** Called on client instead of restoreState when the server skipped the
+     *  state of this rewinder in a confirmed state (because it was too far
+     *  away from the karts of this client), so the locally predicted state
+     *  at that time should be kept.
+     */
+    virtual void keepLocalState()                                           {}
+
     // -------------------------------------------------------------------------
     /** Nothing to do here. */
     virtual void reset() {}
@@ -112,6 +155,10 @@ public:
         return m_unique_identity;
     }
     // -------------------------------------------------------------------------
+    uint16_t getRewinderId() const                    { return m_rewinder_id; }
+    // -------------------------------------------------------------------------
+    void setRewinderId(uint16_t id)                     { m_rewinder_id = id; }
+    // -------------------------------------------------------------------------
     bool rewinderAdd();
     // -------------------------------------------------------------------------
     template<typename T> std::shared_ptr<T> getShared()
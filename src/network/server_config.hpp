@@ -357,6 +357,49 @@ namespace ServerConfig
         "more rewind, which clients with slow device may have problem playing "
         "this server, use the default value is recommended."));
 
+    SERVER_CFG_PREFIX BoolServerConfigParam m_delta_state
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(true,
+        "delta-state",
+        "If enabled, states sent to clients which support it will only "
+        "contain the difference to the last state acknowledged by that "
+        "client, which reduces the upload bandwidth required by the server."));
+
+    SERVER_CFG_PREFIX BoolServerConfigParam m_adaptive_state_frequency
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(true,
+        "adaptive-state-frequency",
+        "If enabled, the server will send states less often (down to "
+        "state-frequency / max-state-interval-scale) when updating a race "
+        "takes too long to keep up the tick rate, for example when many "
+        "servers share one machine."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_max_state_interval_scale
+        SERVER_CFG_DEFAULT(IntServerConfigParam(4,
+        "max-state-interval-scale",
+        "Maximum times the interval of sending states can be increased by "
+        "adaptive-state-frequency."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_max_peer_upload_speed
+        SERVER_CFG_DEFAULT(IntServerConfigParam(0,
+        "max-peer-upload-speed",
+        "If larger than 0, players receiving more than this value of bytes "
+        "per second from the server will only get every second state, until "
+        "the upload speed to them drops."));
+
+    SERVER_CFG_PREFIX FloatServerConfigParam m_state_relevance_distance
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(150.0f,
+        "state-relevance-distance",
+        "Moving track objects further away (along the driveline if possible) "
+        "from all karts of a player than this value will only be sent to "
+        "that player every irrelevant-state-interval states, 0 to always "
+        "send them. Spectators get all of them at the reduced rate."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_irrelevant_state_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(4,
+        "irrelevant-state-interval",
+        "Send the state of objects further away than "
+        "state-relevance-distance to a player only every this number of "
+        "states."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_sql_management
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
         "sql-management",
@@ -0,0 +1,142 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/socket_poller.hpp"
+
+#include "network/network.hpp"
+#include "utils/log.hpp"
+
+#if defined(__linux__) && !defined(ANDROID)
+#  define STK_USE_EPOLL
+#  include <errno.h>
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+SocketPoller::SocketPoller()
+{
+    m_epoll_fd = -1;
+    m_wakeup_fd = -1;
+    m_woken_up.store(false);
+#ifdef STK_USE_EPOLL
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1)
+    {
+        Log::warn("SocketPoller", "epoll_create1 failed: %d.", errno);
+        return;
+    }
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeup_fd;
+    if (m_wakeup_fd == -1 ||
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &ev) == -1)
+    {
+        Log::warn("SocketPoller", "Failed to create eventfd: %d.", errno);
+        if (m_wakeup_fd != -1)
+            close(m_wakeup_fd);
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+        m_wakeup_fd = -1;
+    }
+#endif
+}   // SocketPoller
+
+// ----------------------------------------------------------------------------
+SocketPoller::~SocketPoller()
+{
+#ifdef STK_USE_EPOLL
+    if (m_epoll_fd != -1)
+    {
+        close(m_wakeup_fd);
+        close(m_epoll_fd);
+    }
+#endif
+}   // ~SocketPoller
+
+// ----------------------------------------------------------------------------
+/** Adds the socket of an enet host to be waited for.
+ *  \return True if successful, otherwise the caller should not use wait as
+ *  it won't notice packets for that host.
+ */
+bool SocketPoller::addHost(ENetHost* host)
+{
+#ifdef STK_USE_EPOLL
+    if (m_epoll_fd == -1)
+        return false;
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = host->socket;
+    // The same host is added again if listening is restarted
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, host->socket, &ev) == -1 &&
+        errno != EEXIST)
+    {
+        Log::warn("SocketPoller", "Failed to add socket: %d.", errno);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}   // addHost
+
+// ----------------------------------------------------------------------------
+/** Waits until any socket added has data to read, wakeUp is called, or the
+ *  timeout is reached. Only to be called by one thread.
+ *  \param timeout_ms Maximum time to wait in milliseconds.
+ *  \return True if woken up before the timeout.
+ */
+bool SocketPoller::wait(int timeout_ms)
+{
+#ifdef STK_USE_EPOLL
+    if (m_epoll_fd == -1)
+        return false;
+    epoll_event events[4];
+    int count = epoll_wait(m_epoll_fd, events, 4, timeout_ms);
+    for (int i = 0; i < count; i++)
+    {
+        if (events[i].data.fd == m_wakeup_fd)
+        {
+            uint64_t value;
+            while (read(m_wakeup_fd, &value, sizeof(value)) > 0);
+        }
+    }
+    // Clear after reading eventfd, so the next wakeUp writes it again
+    m_woken_up.store(false);
+    return count > 0;
+#else
+    return false;
+#endif
+}   // wait
+
+// ----------------------------------------------------------------------------
+/** Wakes up the thread in wait, or makes the next wait return immediately if
+ *  no thread is waiting now. Can be called by any thread.
+ */
+void SocketPoller::wakeUp()
+{
+#ifdef STK_USE_EPOLL
+    if (m_wakeup_fd == -1 || m_woken_up.exchange(true))
+        return;
+    uint64_t value = 1;
+    if (write(m_wakeup_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        Log::warn("SocketPoller", "Failed to write eventfd: %d.", errno);
+#endif
+}   // wakeUp
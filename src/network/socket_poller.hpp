@@ -0,0 +1,70 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file socket_poller.hpp
+ *  \brief Waits for data on the sockets of enet hosts.
+ */
+#ifndef HEADER_SOCKET_POLLER_HPP
+#define HEADER_SOCKET_POLLER_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+
+struct _ENetHost;
+
+/** \class SocketPoller
+ *  Lets the listening thread of STKHost sleep until a packet is received on
+ *  any of its sockets, or until another thread wakes it up (for example
+ *  when a packet needs to be sent), instead of waking up every 10ms in
+ *  enet_host_service. It uses epoll and eventfd, so it's only enabled on
+ *  linux, elsewhere addHost() returns false and enet_host_service should
+ *  be used with a timeout as before.
+ *  Each server still has its own STKHost with its own threads. Lobbies
+ *  can't share one pool of threads in a process yet, since the singletons
+ *  of a server (World, RaceManager, ProtocolManager, ...) only exist once
+ *  per ProcessType, and there are only the main and the child process.
+ *  \ingroup network
+ */
+class SocketPoller : public NoCopy
+{
+private:
+    /** Epoll file descriptor, or -1 if not available. */
+    int m_epoll_fd;
+
+    /** Eventfd used by other threads to wake up wait(). */
+    int m_wakeup_fd;
+
+    /** True if wakeUp was called since the last wait, so the eventfd is
+     *  only written once for many packets. */
+    std::atomic_bool m_woken_up;
+
+public:
+    SocketPoller();
+    // ------------------------------------------------------------------------
+    ~SocketPoller();
+    // ------------------------------------------------------------------------
+    bool addHost(_ENetHost* host);
+    // ------------------------------------------------------------------------
+    bool wait(int timeout_ms);
+    // ------------------------------------------------------------------------
+    void wakeUp();
+
+};   // class SocketPoller
+
+#endif // HEADER_SOCKET_POLLER_HPP
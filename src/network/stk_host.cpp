@@ -37,6 +37,7 @@
 #include "network/stk_ipv6.hpp"
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
+#include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
@@ -65,6 +66,7 @@
 #include <sys/types.h>
 
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <limits>
 #include <random>
@@ -321,6 +323,13 @@ void STKHost::init()
     m_network          = NULL;
     m_exit_timeout.store(std::numeric_limits<uint64_t>::max());
     m_client_ping.store(0);
+    m_upload_speed.store(0);
+    m_download_speed.store(0);
+    m_tick_cost.store(0);
+    m_state_interval_scale.store(1);
+    m_measured_ticks = 0;
+    m_measured_tick_time = 0;
+    m_socket_poller = new SocketPoller();
 
     // Start with initialising ENet
     // ============================
@@ -363,15 +372,19 @@ STKHost::~STKHost()
     stopListening();
 
     // Drop all unsent packets
-    for (auto& p : m_enet_cmd)
+    ENetCommand p;
+    while (m_enet_cmd.pop(&p))
     {
         if (std::get<3>(p) == ECT_SEND_PACKET)
         {
             ENetPacket* packet = std::get<1>(p);
             enet_packet_destroy(packet);
         }
+        else if (std::get<3>(p) == ECT_SEND_SHARED_PACKET)
+            releaseSharedPacket(std::get<1>(p));
     }
     delete m_network;
+    delete m_socket_poller;
     enet_deinitialize();
     if (m_client_loop)
     {
@@ -744,6 +757,7 @@ void STKHost::disconnectAllPeers(bool timeout_waiting)
             peer.second->disconnect();
         // Wait for at most 2 seconds for disconnect event to be generated
         m_exit_timeout.store(StkTime::getMonoTimeMs() + 2000);
+        m_socket_poller->wakeUp();
     }
     m_peers.clear();
 }   // disconnectAllPeers
@@ -779,6 +793,7 @@ void STKHost::stopListening()
 {
     if (m_exit_timeout.load() == std::numeric_limits<uint64_t>::max())
         m_exit_timeout.store(0);
+    m_socket_poller->wakeUp();
     if (m_listening_thread.joinable())
         m_listening_thread.join();
 }   // stopListening
@@ -820,12 +835,29 @@ void STKHost::mainLoop(ProcessType pt)
         }
     }
 
+    // Sleep in epoll instead of enet_host_service if possible
+    bool use_poller = m_socket_poller->addHost(host);
+    if (use_poller && direct_socket)
+        use_poller = m_socket_poller->addHost(direct_socket->getENetHost());
+
     uint64_t last_ping_time = StkTime::getMonoTimeMs();
     uint64_t last_update_speed_time = StkTime::getMonoTimeMs();
     uint64_t last_ping_time_update_for_client = StkTime::getMonoTimeMs();
     std::map<std::string, uint64_t> ctp;
     while (m_exit_timeout.load() > StkTime::getMonoTimeMs())
     {
+        if (use_poller)
+        {
+            // Enet needs to be serviced regularly for any active peer (for
+            // resending, pings and timeouts), otherwise an idle server only
+            // wakes up for packets, commands or the speed update per second
+            bool active = !is_server || m_exit_timeout.load() !=
+                std::numeric_limits<uint64_t>::max();
+            for (size_t i = 0; !active && i < host->peerCount; i++)
+                active = host->peers[i].state != ENET_PEER_STATE_DISCONNECTED;
+            m_socket_poller->wait(active ? 10 : 1000);
+        }
+
         // Clear outdated connect to peer list every 15 seconds
         for (auto it = ctp.begin(); it != ctp.end();)
         {
@@ -844,6 +876,25 @@ void STKHost::mainLoop(ProcessType pt)
                 getNetwork()->getENetHost()->totalReceivedData);
             getNetwork()->getENetHost()->totalSentData = 0;
             getNetwork()->getENetHost()->totalReceivedData = 0;
+
+            if (is_server)
+            {
+                const uint32_t max_upload =
+                    ServerConfig::m_max_peer_upload_speed;
+                std::lock_guard<std::mutex> lock(m_peers_mutex);
+                for (auto& p : m_peers)
+                {
+                    STKPeer* peer = p.second.get();
+                    peer->updateUploadSpeed();
+                    // Only send full states again after the speed dropped
+                    // well below the limit to avoid toggling every second
+                    if (max_upload == 0 ||
+                        peer->getUploadSpeed() < max_upload * 2 / 3)
+                        peer->setReducedState(false);
+                    else if (peer->getUploadSpeed() > max_upload)
+                        peer->setReducedState(true);
+                }
+            }
         }
 
         auto sl = LobbyProtocol::get<ServerLobby>();
@@ -909,10 +960,10 @@ void STKHost::mainLoop(ProcessType pt)
                                 player_name.c_str(), ap, max_ping);
                             p.second->setWarnedForHighPing(true);
                             p.second->setDisconnected(true);
-                            std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
-                            m_enet_cmd.emplace_back(p.second->getENetPeer(),
-                                (ENetPacket*)NULL, PDI_KICK_HIGH_PING,
-                                ECT_DISCONNECT, p.first->address);
+                            m_enet_cmd.push(ENetCommand(
+                                p.second->getENetPeer(), (ENetPacket*)NULL,
+                                PDI_KICK_HIGH_PING, ECT_DISCONNECT,
+                                p.first->address));
                         }
                         else if (!p.second->hasWarnedForHighPing())
                         {
@@ -994,12 +1045,8 @@ void STKHost::mainLoop(ProcessType pt)
             peer_lock.unlock();
         }
 
-        std::vector<std::tuple<ENetPeer*, ENetPacket*, uint32_t,
-            ENetCommandType, ENetAddress> > copied_list;
-        std::unique_lock<std::mutex> lock(m_enet_cmd_mutex);
-        std::swap(copied_list, m_enet_cmd);
-        lock.unlock();
-        for (auto& p : copied_list)
+        ENetCommand p;
+        while (m_enet_cmd.pop(&p))
         {
             ENetPeer* peer = std::get<0>(p);
             ENetAddress& ea = std::get<4>(p);
@@ -1015,7 +1062,9 @@ void STKHost::mainLoop(ProcessType pt)
                 (ea_peer_now.host != ea.host && ea_peer_now.port != ea.port))
 #endif
             {
-                if (packet != NULL)
+                if (std::get<3>(p) == ECT_SEND_SHARED_PACKET)
+                    releaseSharedPacket(packet);
+                else if (packet != NULL)
                     enet_packet_destroy(packet);
                 continue;
             }
@@ -1033,6 +1082,11 @@ void STKHost::mainLoop(ProcessType pt)
                 }
                 break;
             }
+            case ECT_SEND_SHARED_PACKET:
+                // Enet adds its own reference if sent successfully
+                enet_peer_send(peer, (uint8_t)std::get<2>(p), packet);
+                releaseSharedPacket(packet);
+                break;
             case ECT_DISCONNECT:
                 enet_peer_disconnect(peer, std::get<2>(p));
                 break;
@@ -1048,7 +1102,7 @@ void STKHost::mainLoop(ProcessType pt)
         }
 
         bool need_ping_update = false;
-        while (enet_host_service(host, &event, 10) != 0)
+        while (enet_host_service(host, &event, use_poller ? 0 : 10) != 0)
         {
             auto lp = LobbyProtocol::get<LobbyProtocol>();
             if (!is_server &&
@@ -1339,12 +1393,14 @@ std::shared_ptr<STKPeer> STKHost::getServerPeerForClient() const
  */
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
+    std::vector<STKPeer*> peers;
     std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    for (auto& p : m_peers)
     {
         if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1354,12 +1410,14 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
  */
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
+    std::vector<STKPeer*> peers;
     std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    for (auto& p : m_peers)
     {
         if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1371,16 +1429,18 @@ void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
+    std::vector<STKPeer*> peers;
     std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    for (auto& p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
             !p.second->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
         }
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1392,17 +1452,84 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
 void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
+    std::vector<STKPeer*> peers;
     std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    for (auto& p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isValidated())
             continue;
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersWith
 
+//-----------------------------------------------------------------------------
+/** Sends the same data to many peers. Peers with encryption get their own
+ *  encrypted packet, for all other peers only one enet packet is created
+ *  and shared (reference counted by enet), instead of a copy for each peer.
+ *  The packets of all peers are encrypted and added in one pass, and the
+ *  listening thread is woken up once to send all of them together.
+ *  The caller needs to make sure the peers are not deleted during this call
+ *  (by holding the peers mutex or shared pointers of them).
+ *  \param peers Peers to send the data to.
+ *  \param data Data to sent.
+ *  \param reliable If the data should be sent reliable or now.
+ */
+void STKHost::sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                                NetworkString *data, bool reliable)
+{
+    PROFILER_PUSH_CPU_MARKER("Broadcast", 255, 128, 0);
+    std::vector<STKPeer*> shared_peers;
+    bool wake_up = false;
+    for (STKPeer* peer : peers)
+    {
+        if (peer->isDisconnected())
+            continue;
+        wake_up = true;
+        if (peer->getCrypto())
+        {
+            peer->sendPacket(data, reliable, true/*encrypted*/,
+                false/*wake_up*/);
+        }
+        else
+            shared_peers.push_back(peer);
+    }
+    if (shared_peers.size() == 1)
+    {
+        shared_peers[0]->sendPacket(data, reliable, true/*encrypted*/,
+            false/*wake_up*/);
+    }
+    else if (!shared_peers.empty())
+    {
+        ENetPacket* packet = STKPeer::createPacket(data, reliable);
+        if (packet)
+        {
+            // Set all references before any command can be handled in the
+            // listening thread, each command releases one of them
+            packet->referenceCount = shared_peers.size();
+            for (STKPeer* peer : shared_peers)
+                peer->sendSharedPacket(packet);
+        }
+    }
+    if (wake_up)
+        m_socket_poller->wakeUp();
+    PROFILER_POP_CPU_MARKER();
+}   // sendPacketToPeers
+
+//-----------------------------------------------------------------------------
+/** Releases the reference of an enet command to a packet shared by many
+ *  peers (see sendPacketToPeers), it's destroyed if no longer used by enet
+ *  or other commands. Only called in the listening thread (or after it
+ *  stopped).
+ */
+void STKHost::releaseSharedPacket(ENetPacket* packet)
+{
+    if (--packet->referenceCount == 0)
+        enet_packet_destroy(packet);
+}   // releaseSharedPacket
+
 //-----------------------------------------------------------------------------
 /** Sends a message from a client to the server. */
 void STKHost::sendToServer(NetworkString *data, bool reliable)
@@ -1552,6 +1679,45 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
     return players;
 }   // getPlayersForNewGame
 
+// ----------------------------------------------------------------------------
+/** Called by the server after updating the race for one tick. Every second
+ *  the average time used per tick is compared with the time a tick lasts,
+ *  and the interval of sending game states is increased if the server can't
+ *  keep up with it, or decreased again if it has enough time left.
+ *  \param us Time in microseconds used to update the race for this tick.
+ */
+void STKHost::updateTickCost(uint64_t us)
+{
+    m_measured_tick_time += us;
+    if (++m_measured_ticks < (unsigned)stk_config->getPhysicsFPS())
+        return;
+
+    const uint32_t tick_cost =
+        (uint32_t)(m_measured_tick_time / m_measured_ticks);
+    m_tick_cost.store(tick_cost);
+    m_measured_ticks = 0;
+    m_measured_tick_time = 0;
+
+    const uint32_t tick_time = 1000000 / stk_config->getPhysicsFPS();
+    const int max_scale =
+        std::max((int)ServerConfig::m_max_state_interval_scale, 1);
+    const int scale = m_state_interval_scale.load();
+    int new_scale = scale;
+    if (!ServerConfig::m_adaptive_state_frequency)
+        new_scale = 1;
+    else if (tick_cost > tick_time * 3 / 4)
+        new_scale = std::min(scale * 2, max_scale);
+    else if (tick_cost < tick_time / 3)
+        new_scale = std::max(scale - 1, 1);
+
+    if (new_scale != scale)
+    {
+        m_state_interval_scale.store(new_scale);
+        Log::info("STKHost", "Tick cost %uus of %uus, sending states every "
+            "%d state intervals now.", tick_cost, tick_time, new_scale);
+    }
+}   // updateTickCost
+
 // ----------------------------------------------------------------------------
 /** Update players count in server
  *  \param ingame store the in game players count now
@@ -1632,3 +1798,89 @@ uint16_t STKHost::getPrivatePort() const
 {
     return m_network->getPort();
 }  // getPrivatePort
+
+// ----------------------------------------------------------------------------
+/** Measures the latency of adding enet commands from several threads (like
+ *  the game, lobby and game protocol threads of a server) while the
+ *  listening thread takes them out, for the lock-free queue used now and a
+ *  mutex protected vector as used before.
+ */
+void STKHost::benchmark()
+{
+    const int producers = 4;
+    const int commands = 250000;
+    auto measure = [](const char* name,
+                      const std::function<void(ENetCommand&&)>& push,
+                      const std::function<unsigned()>& drain)
+    {
+        std::atomic<int> finished(0);
+        std::vector<uint64_t> total_ns(producers), max_ns(producers);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < producers; i++)
+        {
+            threads.emplace_back([i, &push, &finished, &total_ns, &max_ns]()
+                {
+                    ENetAddress ea = {};
+                    for (int j = 0; j < commands; j++)
+                    {
+                        auto start = std::chrono::steady_clock::now();
+                        push(ENetCommand(NULL, NULL, j, ECT_SEND_PACKET, ea));
+                        uint64_t ns = std::chrono::duration_cast<
+                            std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+                        total_ns[i] += ns;
+                        max_ns[i] = std::max(max_ns[i], ns);
+                    }
+                    finished++;
+                });
+        }
+        unsigned drained = 0;
+        while (finished.load() < producers)
+        {
+            drained += drain();
+            StkTime::sleep(1);
+        }
+        drained += drain();
+        for (std::thread& t : threads)
+            t.join();
+        uint64_t total = 0, max_time = 0;
+        for (int i = 0; i < producers; i++)
+        {
+            total += total_ns[i];
+            max_time = std::max(max_time, max_ns[i]);
+        }
+        Log::info("STKHost", "%s: %.0fns average, %.1fus max per command "
+            "from %d threads (%u commands).", name,
+            (float)total / (producers * commands), (float)max_time / 1000.0f,
+            producers, drained);
+    };
+
+    std::mutex mutex;
+    std::vector<ENetCommand> commands_vector;
+    measure("Mutex and vector",
+        [&mutex, &commands_vector](ENetCommand&& c)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            commands_vector.push_back(std::move(c));
+        },
+        [&mutex, &commands_vector]()
+        {
+            std::vector<ENetCommand> copied_list;
+            std::unique_lock<std::mutex> lock(mutex);
+            std::swap(copied_list, commands_vector);
+            lock.unlock();
+            return (unsigned)copied_list.size();
+        });
+
+    MPSCQueue<ENetCommand> queue;
+    measure("Lock-free queue",
+        [&queue](ENetCommand&& c) { queue.push(std::move(c)); },
+        [&queue]()
+        {
+            unsigned count = 0;
+            ENetCommand c;
+            while (queue.pop(&c))
+                count++;
+            return count;
+        });
+}   // benchmark
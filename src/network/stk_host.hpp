@@ -22,6 +22,8 @@
 #ifndef STK_HOST_HPP
 #define STK_HOST_HPP
 
+#include "network/socket_poller.hpp"
+#include "utils/mpsc_queue.hpp"
 #include "utils/stk_process.hpp"
 #include "utils/synchronised.hpp"
 #include "utils/time.hpp"
@@ -66,7 +68,8 @@ enum ENetCommandType : unsigned int
 {
     ECT_SEND_PACKET = 0,
     ECT_DISCONNECT = 1,
-    ECT_RESET = 2
+    ECT_RESET = 2,
+    ECT_SEND_SHARED_PACKET = 3
 };
 
 class STKHost
@@ -89,14 +92,18 @@ private:
     /** Make sure the removing or adding a peer is thread-safe. */
     mutable std::mutex m_peers_mutex;
 
-    /** Let (atm enet_peer_send and enet_peer_disconnect) run in the listening
-     *  thread. */
-    std::vector<std::tuple</*peer receive*/ENetPeer*,
+    typedef std::tuple</*peer receive*/ENetPeer*,
         /*packet to send*/ENetPacket*, /*integer data*/uint32_t,
-        ENetCommandType, ENetAddress> > m_enet_cmd;
+        ENetCommandType, ENetAddress> ENetCommand;
+
+    /** Let (atm enet_peer_send and enet_peer_disconnect) run in the listening
+     *  thread. It's lock-free, so the game and lobby threads never wait for
+     *  each other or the listening thread when sending packets. */
+    MPSCQueue<ENetCommand> m_enet_cmd;
 
-    /** Protect \ref m_enet_cmd from multiple threads usage. */
-    std::mutex m_enet_cmd_mutex;
+    /** Lets the listening thread sleep until a packet is received or a
+     *  command is added to \ref m_enet_cmd. */
+    SocketPoller* m_socket_poller;
 
     /** The list of peers connected to this instance. */
     std::map<ENetPeer*, std::shared_ptr<STKPeer> > m_peers;
@@ -147,6 +154,20 @@ private:
 
     std::atomic<uint32_t> m_download_speed;
 
+    /** Average time in microseconds the server used to update the race for
+     *  one tick in the last second, see updateTickCost. */
+    std::atomic<uint32_t> m_tick_cost;
+
+    /** The server sends states every m_state_interval_scale times of the
+     *  configured state interval, it's increased if the server can't keep
+     *  up with the tick rate. */
+    std::atomic<int> m_state_interval_scale;
+
+    /** Number of ticks and total time (in microseconds) measured since
+     *  m_tick_cost was updated. */
+    unsigned m_measured_ticks;
+    uint64_t m_measured_tick_time;
+
     std::atomic<uint32_t> m_players_in_game;
 
     std::atomic<uint32_t> m_players_waiting;
@@ -170,6 +191,8 @@ private:
     // ------------------------------------------------------------------------
     void mainLoop(ProcessType pt);
     // ------------------------------------------------------------------------
+    static void releaseSharedPacket(ENetPacket* packet);
+    // ------------------------------------------------------------------------
     void getIPFromStun(int socket, const std::string& stun_address,
                        short family, SocketAddress* result);
 public:
@@ -272,6 +295,9 @@ public:
     void sendPacketExcept(STKPeer* peer, NetworkString *data,
                           bool reliable = true);
     // ------------------------------------------------------------------------
+    void sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                           NetworkString *data, bool reliable = true);
+    // ------------------------------------------------------------------------
     void setupClient(int peer_count, int channel_limit,
                      uint32_t max_incoming_bandwidth,
                      uint32_t max_outgoing_bandwidth);
@@ -286,11 +312,16 @@ public:
     // ------------------------------------------------------------------------
     void setErrorMessage(const irr::core::stringw &message);
     // ------------------------------------------------------------------------
+    /** Adds a command for the listening thread.
+     *  \param wake_up False if the caller adds more commands and wakes up
+     *         the listening thread after the last one. */
     void addEnetCommand(ENetPeer* peer, ENetPacket* packet, uint32_t i,
-                        ENetCommandType ect, ENetAddress ea)
+                        ENetCommandType ect, ENetAddress ea,
+                        bool wake_up = true)
     {
-        std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
-        m_enet_cmd.emplace_back(peer, packet, i, ect, ea);
+        m_enet_cmd.push(ENetCommand(peer, packet, i, ect, ea));
+        if (wake_up)
+            m_socket_poller->wakeUp();
     }
     // ------------------------------------------------------------------------
     /** Returns the last error (or "" if no error has happened). */
@@ -375,6 +406,15 @@ public:
     /* Return download speed in bytes per second. */
     unsigned getDownloadSpeed() const       { return m_download_speed.load(); }
     // ------------------------------------------------------------------------
+    void updateTickCost(uint64_t us);
+    // ------------------------------------------------------------------------
+    /* Return average time in microseconds to update the race for one tick. */
+    uint32_t getTickCost() const                  { return m_tick_cost.load(); }
+    // ------------------------------------------------------------------------
+    /* Return how many times the state interval is increased currently. */
+    int getStateIntervalScale() const
+                                       { return m_state_interval_scale.load(); }
+    // ------------------------------------------------------------------------
     void updatePlayers(unsigned* ingame = NULL,
                        unsigned* waiting = NULL,
                        unsigned* total = NULL);
@@ -395,6 +435,8 @@ public:
     // ------------------------------------------------------------------------
     static BareNetworkString getStunRequest(uint8_t* stun_tansaction_id);
     // ------------------------------------------------------------------------
+    static void benchmark();
+    // ------------------------------------------------------------------------
     ChildLoop* getChildLoop() const { return m_client_loop; }
 };   // class STKHost
 
@@ -54,6 +54,10 @@ STKPeer::STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id)
     m_last_activity.store((int64_t)StkTime::getMonoTimeMs());
     m_last_message.store(0);
     m_consecutive_messages = 0;
+    m_acked_state_ticks.store(-1);
+    m_sent_bytes.store(0);
+    m_upload_speed.store(0);
+    m_reduced_state.store(false);
 }   // STKPeer
 
 //-----------------------------------------------------------------------------
@@ -99,28 +103,24 @@ void STKPeer::reset()
  *  \param data The data to send.
  *  \param reliable If the data is sent reliable or not.
  *  \param encrypted If the data is sent encrypted or not.
+ *  \param wake_up False if the listening thread is woken up by the caller
+ *         after more packets are added, see STKHost::sendPacketToPeers.
  */
-void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted,
+                         bool wake_up)
 {
     if (m_disconnected.load())
         return;
 
     ENetPacket* packet = NULL;
     if (m_crypto && encrypted)
-    {
         packet = m_crypto->encryptSend(*data, reliable);
-    }
     else
-    {
-        packet = enet_packet_create(data->getData(),
-            data->getTotalSize(), (reliable ?
-            ENET_PACKET_FLAG_RELIABLE :
-            (ENET_PACKET_FLAG_UNSEQUENCED |
-            ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
-    }
+        packet = createPacket(data, reliable);
 
     if (packet)
     {
+        m_sent_bytes.fetch_add((uint32_t)packet->dataLength);
         if (Network::m_connection_debug)
         {
             Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
@@ -129,10 +129,42 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
         }
         m_host->addEnetCommand(m_enet_peer, packet,
                 encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
-                ECT_SEND_PACKET, m_address);
+                ECT_SEND_PACKET, m_address, wake_up);
     }
 }   // sendPacket
 
+//-----------------------------------------------------------------------------
+/** Sends a packet which is shared with other peers without encryption, see
+ *  STKHost::sendPacketToPeers. The caller must have added a reference to
+ *  the packet for this peer, which will be released after it's sent, and
+ *  wake up the listening thread after the packets of all peers are added.
+ *  \param packet The packet to send.
+ */
+void STKPeer::sendSharedPacket(ENetPacket* packet)
+{
+    m_sent_bytes.fetch_add((uint32_t)packet->dataLength);
+    if (Network::m_connection_debug)
+    {
+        Log::verbose("STKPeer", "sending shared packet of size %d to %s at "
+            "%lf", packet->dataLength, getAddress().toString().c_str(),
+            StkTime::getRealTime());
+    }
+    m_host->addEnetCommand(m_enet_peer, packet, EVENT_CHANNEL_NORMAL,
+        ECT_SEND_SHARED_PACKET, m_address, false/*wake_up*/);
+}   // sendSharedPacket
+
+//-----------------------------------------------------------------------------
+/** Creates an unencrypted enet packet with the data.
+ *  \param data The data to send.
+ *  \param reliable If the data is sent reliable or not.
+ */
+ENetPacket* STKPeer::createPacket(const NetworkString* data, bool reliable)
+{
+    return enet_packet_create(data->getData(), data->getTotalSize(),
+        (reliable ? ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+}   // createPacket
+
 //-----------------------------------------------------------------------------
 /** Returns if the peer is connected or not.
  */
@@ -131,13 +131,31 @@ protected:
     std::set<std::string> m_client_capabilities;
 
     std::array<int, AS_TOTAL> m_addons_scores;
+
+    /** Ticks of the last game state this peer acknowledged, which is used
+     *  by the server as baseline for delta states, -1 if none. */
+    std::atomic<int> m_acked_state_ticks;
+
+    /** Bytes sent to this peer since the last updateUploadSpeed. */
+    std::atomic<uint32_t> m_sent_bytes;
+
+    /** Bytes sent to this peer in the last second. */
+    std::atomic<uint32_t> m_upload_speed;
+
+    /** True if this peer only gets every second game state, set by STKHost
+     *  when the upload speed to this peer is too high. */
+    std::atomic_bool m_reduced_state;
 public:
     STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id);
     // ------------------------------------------------------------------------
     ~STKPeer();
     // ------------------------------------------------------------------------
     void sendPacket(NetworkString *data, bool reliable = true,
-                    bool encrypted = true);
+                    bool encrypted = true, bool wake_up = true);
+    // ------------------------------------------------------------------------
+    void sendSharedPacket(ENetPacket* packet);
+    // ------------------------------------------------------------------------
+    static ENetPacket* createPacket(const NetworkString* data, bool reliable);
     // ------------------------------------------------------------------------
     void disconnect();
     // ------------------------------------------------------------------------
@@ -221,7 +239,13 @@ public:
     // ------------------------------------------------------------------------
     ENetPeer* getENetPeer() const                       { return m_enet_peer; }
     // ------------------------------------------------------------------------
-    void setWaitingForGame(bool val)         { m_waiting_for_game.store(val); }
+    void setWaitingForGame(bool val)
+    {
+        m_waiting_for_game.store(val);
+        // The client will load a new world, so any baseline is outdated
+        if (val)
+            m_acked_state_ticks.store(-1);
+    }
     // ------------------------------------------------------------------------
     bool isWaitingForGame() const         { return m_waiting_for_game.load(); }
     // ------------------------------------------------------------------------
@@ -305,6 +329,21 @@ public:
     bool alwaysSpectate() const
                                { return m_always_spectate.load() != ASM_NONE; }
     // ------------------------------------------------------------------------
+    int getAckedStateTicks() const      { return m_acked_state_ticks.load(); }
+    // ------------------------------------------------------------------------
+    void setAckedStateTicks(int ticks)    { m_acked_state_ticks.store(ticks); }
+    // ------------------------------------------------------------------------
+    /** Called by STKHost every second to update the upload speed. */
+    void updateUploadSpeed()
+                           { m_upload_speed.store(m_sent_bytes.exchange(0)); }
+    // ------------------------------------------------------------------------
+    /* Return upload speed to this peer in bytes per second. */
+    uint32_t getUploadSpeed() const           { return m_upload_speed.load(); }
+    // ------------------------------------------------------------------------
+    void setReducedState(bool val)               { m_reduced_state.store(val); }
+    // ------------------------------------------------------------------------
+    bool hasReducedState() const              { return m_reduced_state.load(); }
+    // ------------------------------------------------------------------------
     void resetAlwaysSpectateFull()
     {
         if (m_always_spectate.load() == ASM_FULL)
@@ -26,6 +26,7 @@
 #include "karts/kart.hpp"
 #include "karts/kart_model.hpp"
 #include "karts/kart_properties.hpp"
+#include "physics/btKartRaycast.hpp"
 #include "physics/triangle_mesh.hpp"
 #include "tracks/terrain_info.hpp"
 #include "tracks/track.hpp"
@@ -240,8 +241,57 @@ void btKart::updateAllWheelTransformsWS()
                 m_num_wheels_on_ground++;
         }
     }
+    // The prepared rays are only valid for this update
+    m_prepared_rays.resize(0);
 }   // updateAllWheelTransformsWS
 
+// ----------------------------------------------------------------------------
+/** Does all raycasts which the next updateAllWheelTransformsWS() will do,
+ *  and stores the results, so that the raycasts of all karts can be done
+ *  in parallel before the karts are updated one after the other (see
+ *  STKDynamicsWorld::integrateTransforms()). The chassis is ignored
+ *  instead of changing its collision filter group like rayCast() does, so
+ *  this function does not change the physics world. rayCast() only uses a
+ *  stored result if the ray is exactly the same, e.g. not if the chassis
+ *  was moved in the meantime.
+ */
+void btKart::castWheelRays()
+{
+    m_prepared_rays.resize(0);
+    btKartRaycaster *raycaster =
+        dynamic_cast<btKartRaycaster*>(m_vehicleRaycaster);
+    if (!raycaster)
+        return;
+
+    const btTransform &chassis_trans = getChassisWorldTransform();
+    for (int i = 0; i < m_wheelInfo.size(); i++)
+    {
+        btWheelInfo wheel = m_wheelInfo[i];
+        btScalar max_susp_len = wheel.getSuspensionRestLength()
+                              + wheel.m_maxSuspensionTravel;
+        btScalar raylen = max_susp_len + 0.5f;
+        // Like in updateAllWheelTransformsWS, a second ray closer to the
+        // centre of the chassis is only used if the first one has no contact
+        for (int n = 0; n < 2; n++)
+        {
+            PreparedRay ray;
+            ray.m_wheel    = i;
+            ray.m_fraction = n == 0 ? 1.0f : 0.95f;
+            updateWheelTransformsWS(wheel, chassis_trans, false,
+                                    ray.m_fraction);
+            ray.m_from = wheel.m_raycastInfo.m_hardPointWS;
+            ray.m_to   = ray.m_from
+                       + wheel.m_raycastInfo.m_wheelDirectionWS * raylen;
+            ray.m_object = raycaster->castRay(ray.m_from, ray.m_to,
+                                              ray.m_result, m_chassisBody);
+            m_prepared_rays.push_back(ray);
+            if (ray.m_object &&
+                raylen * ray.m_result.m_distFraction < max_susp_len)
+                break;
+        }
+    }
+}   // castWheelRays
+
 // ----------------------------------------------------------------------------
 /**
  */
@@ -280,7 +330,22 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
 
     btAssert(m_vehicleRaycaster);
 
-    void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+    void* object = NULL;
+    bool prepared = false;
+    for (int i = 0; i < m_prepared_rays.size(); i++)
+    {
+        const PreparedRay &ray = m_prepared_rays[i];
+        if (ray.m_wheel == (int)index && ray.m_fraction == fraction &&
+            ray.m_from == source && ray.m_to == target)
+        {
+            object     = ray.m_object;
+            rayResults = ray.m_result;
+            prepared   = true;
+            break;
+        }
+    }
+    if (!prepared)
+        object = m_vehicleRaycaster->castRay(source,target,rayResults);
 
     wheel.m_raycastInfo.m_groundObject = 0;
 
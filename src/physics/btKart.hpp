@@ -124,6 +124,21 @@ private:
 
     btAlignedObjectArray<btWheelInfo> m_wheelInfo;
 
+    /** The result of a wheel raycast which was done before the vehicle
+     *  is updated, see castWheelRays(). */
+    struct PreparedRay
+    {
+        int       m_wheel;
+        float     m_fraction;
+        btVector3 m_from;
+        btVector3 m_to;
+        void     *m_object;
+        btVehicleRaycaster::btVehicleRaycasterResult m_result;
+    };   // PreparedRay
+
+    /** The wheel raycasts done by castWheelRays() for the next update. */
+    btAlignedObjectArray<PreparedRay> m_prepared_rays;
+
     void     defaultInit();
     btScalar rayCast(btWheelInfo& wheel, const btVector3& ray);
     void     updateWheelTransformsWS(btWheelInfo& wheel,
@@ -165,6 +180,7 @@ public:
     const btWheelInfo& getWheelInfo(int index) const;
     btWheelInfo&       getWheelInfo(int index);
     void               updateAllWheelTransformsWS();
+    void               castWheelRays();
     void               setAllBrakes(btScalar brake);
     void               updateSuspension(btScalar deltaTime);
     virtual void       updateFriction(btScalar timeStep);
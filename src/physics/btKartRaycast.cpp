@@ -21,21 +21,49 @@
 
 void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
                                btVehicleRaycasterResult& result)
+{
+    return castRay(from, to, result, NULL);
+}   // castRay
+
+// ----------------------------------------------------------------------------
+/** Casts a ray which does not hit the given object. This has the same result
+ *  as setting the collision filter group of the object to 0 during the
+ *  raycast, but does not change the object, so that several rays can be
+ *  cast at the same time (see btKart::castWheelRays()).
+ *  \param ignore The object to ignore, or NULL.
+ */
+void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
+                               btVehicleRaycasterResult& result,
+                               const btCollisionObject* ignore)
 {
     // ========================================================================
     class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
     {
     private:
         int m_triangle_index;
+        /** The bullet part of the mesh of the triangle hit. */
+        int m_triangle_part;
+        const btCollisionObject* m_ignore;
     public:
         /** Constructor, initialises the triangle index. */
         ClosestWithNormal(const btVector3 &from,
-                          const btVector3 &to)
+                          const btVector3 &to,
+                          const btCollisionObject* ignore)
                           : btCollisionWorld::ClosestRayResultCallback(from,to)
         {
             m_triangle_index = -1;
+            m_triangle_part  = -1;
+            m_ignore         = ignore;
         }   // CloestWithNormal
         // --------------------------------------------------------------------
+        virtual bool needsCollision(btBroadphaseProxy* proxy0) const
+        {
+            if (m_ignore && proxy0->m_clientObject == m_ignore)
+                return false;
+            return btCollisionWorld::ClosestRayResultCallback
+                                   ::needsCollision(proxy0);
+        }   // needsCollision
+        // --------------------------------------------------------------------
         /** Stores the index of the triangle hit. */
         virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
                                          bool normalInWorldSpace)
@@ -44,7 +72,10 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
             // other kart) we get shapePart=-1, or no localShapeInfo at all
             if(rayResult.m_localShapeInfo &&
                 rayResult.m_localShapeInfo->m_shapePart>-1)
+            {
                 m_triangle_index = rayResult.m_localShapeInfo->m_triangleIndex;
+                m_triangle_part  = rayResult.m_localShapeInfo->m_shapePart;
+            }
             return
                 btCollisionWorld::ClosestRayResultCallback::addSingleResult(rayResult,
                 normalInWorldSpace);
@@ -53,11 +84,15 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
         /** Returns the index of the triangle which was hit, or -1 if
          *  no triangle was hit. */
         int getTriangleIndex() const { return m_triangle_index; }
+        // --------------------------------------------------------------------
+        /** Returns the bullet part of the mesh of the triangle which was
+         *  hit. */
+        int getTrianglePart() const { return m_triangle_part; }
 
     };   // CloestWithNormal
     // ========================================================================
 
-    ClosestWithNormal rayCallback(from,to);
+    ClosestWithNormal rayCallback(from, to, ignore);
 
     m_dynamicsWorld->rayTest(from, to, rayCallback);
 
@@ -89,10 +124,13 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
 #ifdef DEBUG_NORMALS
                 btVector3 n=result.m_hitNormalInWorld;
 #endif
-                result.m_triangle_index = rayCallback.getTriangleIndex();
+                result.m_triangle_index =
+                    rbtm->m_triangle_mesh->getTriangleIndex(
+                        rayCallback.getTrianglePart(),
+                        rayCallback.getTriangleIndex());
                 result.m_hitNormalInWorld =
-                    rbtm->m_triangle_mesh->getInterpolatedNormal(rayCallback.getTriangleIndex(),
-                                             result.m_hitPointInWorld);
+                    rbtm->m_triangle_mesh->getInterpolatedNormal(
+                        result.m_triangle_index, result.m_hitPointInWorld);
 #ifdef DEBUG_NORMALS
                 printf("old %f %f %f new %f %f %f\n",
                     n.getX(), n.getY(), n.getZ(),
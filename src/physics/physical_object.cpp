@@ -27,6 +27,7 @@
 #include "graphics/sp/sp_mesh_buffer.hpp"
 #include "io/file_manager.hpp"
 #include "io/xml_node.hpp"
+#include "modes/world.hpp"
 #include "physics/physics.hpp"
 #include "physics/triangle_mesh.hpp"
 #include "network/compress_network_body.hpp"
@@ -176,6 +177,8 @@ PhysicalObject::PhysicalObject(bool is_dynamic,
         btQuaternion(0.0f, 0.0f, 0.0f, 1.0f));
 
     m_last_transform = m_current_transform;
+    m_local_transform = m_current_transform;
+    m_local_state_ticks = -1;
     m_no_server_state = false;
 
     m_body_added = false;
@@ -715,6 +718,9 @@ void PhysicalObject::reset()
 
     m_last_transform = m_init_pos;
     m_last_lv = m_last_av = Vec3(0.0f);
+    m_local_transform = m_init_pos;
+    m_local_lv = m_local_av = Vec3(0.0f);
+    m_local_state_ticks = -1;
 }   // reset
 
 // ----------------------------------------------------------------------------
@@ -838,7 +844,7 @@ void PhysicalObject::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
+BareNetworkString* PhysicalObject::saveState(std::vector<uint16_t>* ru)
 {
     bool has_live_join = false;
 
@@ -863,13 +869,22 @@ BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
         return nullptr;
     }
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
     m_last_transform = cur_transform;
     m_last_lv = current_lv;
     m_last_av = current_av;
     return buffer;
 }   // saveState
 
+// ----------------------------------------------------------------------------
+BareNetworkString* PhysicalObject::savePrediction(int* body_offset)
+{
+    *body_offset = 0;
+    BareNetworkString* buffer = new BareNetworkString();
+    CompressNetworkBody::save(m_body, buffer);
+    return buffer;
+}   // savePrediction
+
 // ----------------------------------------------------------------------------
 void PhysicalObject::restoreState(BareNetworkString *buffer, int count)
 {
@@ -889,6 +904,10 @@ std::function<void()> PhysicalObject::getLocalStateRestoreFunction()
     Vec3 av = m_body->getAngularVelocity();
     return [t, lv, av, this]()
     {
+        m_local_transform = t;
+        m_local_lv = lv;
+        m_local_av = av;
+        m_local_state_ticks = World::getWorld()->getTicksSinceStart();
         if (m_no_server_state)
         {
             m_body->setWorldTransform(m_last_transform);
@@ -912,6 +931,38 @@ std::function<void()> PhysicalObject::getLocalStateRestoreFunction()
     };
 }   // getLocalStateRestoreFunction
 
+// ----------------------------------------------------------------------------
+bool PhysicalObject::getRelevancePosition(Vec3* xyz) const
+{
+    // Only moving objects are sent in states
+    if (!m_is_dynamic)
+        return false;
+    *xyz = m_body->getWorldTransform().getOrigin();
+    return true;
+}   // getRelevancePosition
+
+// ----------------------------------------------------------------------------
+void PhysicalObject::keepLocalState()
+{
+    // Without a local state at the time of the skipped state (e.g. it was
+    // already removed) keep the current transform of the object
+    if (m_local_state_ticks != World::getWorld()->getTicksSinceStart())
+    {
+        btTransform t;
+        m_motion_state->getWorldTransform(t);
+        m_body->setWorldTransform(t);
+        m_body->setInterpolationWorldTransform(t);
+        return;
+    }
+    m_body->setWorldTransform(m_local_transform);
+    m_motion_state->setWorldTransform(m_local_transform);
+    m_body->setInterpolationWorldTransform(m_local_transform);
+    m_body->setLinearVelocity(m_local_lv);
+    m_body->setAngularVelocity(m_local_av);
+    m_body->setInterpolationLinearVelocity(m_local_lv);
+    m_body->setInterpolationAngularVelocity(m_local_av);
+}   // keepLocalState
+
 // ----------------------------------------------------------------------------
 void PhysicalObject::joinToMainTrack()
 {
@@ -195,6 +195,15 @@ private:
      * when the object is not moving */
     bool                  m_no_server_state;
 
+    /* Transform and velocities predicted locally at the time of the state
+     * restored, used if server skipped the state of this object */
+    btTransform           m_local_transform;
+    Vec3                  m_local_lv;
+    Vec3                  m_local_av;
+
+    /* World ticks of m_local_transform, -1 if there is none */
+    int                   m_local_state_ticks;
+
     void copyFromMainProcess(TrackObject* track_obj);
 public:
                     PhysicalObject(bool is_dynamic, const Settings& settings,
@@ -284,11 +293,14 @@ public:
     void addForRewind();
     virtual void saveTransform();
     virtual void computeError();
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru);
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru);
+    virtual BareNetworkString* savePrediction(int* body_offset);
     virtual void undoEvent(BareNetworkString *buffer) {}
     virtual void rewindToEvent(BareNetworkString *buffer) {}
     virtual void restoreState(BareNetworkString *buffer, int count);
     virtual void undoState(BareNetworkString *buffer) {}
+    virtual bool getRelevancePosition(Vec3* xyz) const;
+    virtual void keepLocalState();
     virtual std::function<void()> getLocalStateRestoreFunction();
     bool hasTriangleMesh() const { return m_triangle_mesh != NULL; }
     void joinToMainTrack();
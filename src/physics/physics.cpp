@@ -79,6 +79,9 @@ Physics::Physics() : btSequentialImpulseConstraintSolver()
 {
     m_collision_conf      = new btDefaultCollisionConfiguration();
     m_dispatcher          = new btCollisionDispatcher(m_collision_conf);
+    m_dynamics_world      = NULL;
+    m_axis_sweep          = NULL;
+    m_debug_drawer        = NULL;
 }   // Physics
 
 //-----------------------------------------------------------------------------
@@ -558,7 +561,9 @@ void Physics::KartKartCollision(AbstractKart *kart_a,
 }   // KartKartCollision
 
 //-----------------------------------------------------------------------------
-/** This function is called at each internal bullet timestep. It is used
+/** This function is called at each internal bullet timestep after all
+ *  islands are solved (either sequentially or in parallel, see
+ *  STKDynamicsWorld::solveConstraints). It is used
  *  here to do the collision handling: using the contact manifolds after a
  *  physics time step might miss some collisions (when more than one internal
  *  time step was done, and the collision is added and removed). So this
@@ -566,26 +571,11 @@ void Physics::KartKartCollision(AbstractKart *kart_a,
  *  actual physics timestep. This list only stores a collision if it's not
  *  already in the list, so a collisions which is reported more than once is
  *  nevertheless only handled once.
- *  The list of collision
  *  Parameters: see bullet documentation for details.
  */
-btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
-                             btPersistentManifold** manifold,int numManifolds,
-                             btTypedConstraint** constraints,
-                             int numConstraints,
-                             const btContactSolverInfo& info,
-                             btIDebugDraw* debugDrawer,
-                             btStackAlloc* stackAlloc,
-                             btDispatcher* dispatcher)
+void Physics::allSolved(const btContactSolverInfo& info,
+                        btIDebugDraw* debug_drawer, btStackAlloc* stack_alloc)
 {
-    btScalar returnValue=
-        btSequentialImpulseConstraintSolver::solveGroup(bodies, numBodies,
-                                                        manifold, numManifolds,
-                                                        constraints,
-                                                        numConstraints, info,
-                                                        debugDrawer,
-                                                        stackAlloc,
-                                                        dispatcher);
     int currentNumManifolds = m_dispatcher->getNumManifolds();
     // We can't explode a rocket in a loop, since a rocket might collide with
     // more than one object, and/or more than once with each object (if there
@@ -620,10 +610,11 @@ btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
             else if(upB->is(UserPointer::UP_KART))
             {
                 AbstractKart *kart=upB->getPointerKart();
-                int n = contact_manifold->getContactPoint(0).m_index0;
-                const Material *m
-                    = n>=0 ? upA->getPointerTriangleMesh()->getMaterial(n)
-                           : NULL;
+                const TriangleMesh *tm = upA->getPointerTriangleMesh();
+                int n = tm->getTriangleIndex(
+                    contact_manifold->getContactPoint(0).m_partId0,
+                    contact_manifold->getContactPoint(0).m_index0);
+                const Material *m = n>=0 ? tm->getMaterial(n) : NULL;
                 // I assume that the normal needs to be flipped in this case,
                 // but  I can't verify this since it appears that bullet
                 // always has the kart as object A, not B.
@@ -634,17 +625,18 @@ btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
             else if(upB->is(UserPointer::UP_PHYSICAL_OBJECT))
             {
                 std::vector<int> used;
+                const TriangleMesh *tm = upA->getPointerTriangleMesh();
                 for(int i=0; i< contact_manifold->getNumContacts(); i++)
                 {
-                    int n = contact_manifold->getContactPoint(i).m_index0;
+                    int n = tm->getTriangleIndex(
+                        contact_manifold->getContactPoint(i).m_partId0,
+                        contact_manifold->getContactPoint(i).m_index0);
                     // Make sure to call the callback function only once
                     // per triangle.
                     if(std::find(used.begin(), used.end(), n)!=used.end())
                         continue;
                     used.push_back(n);
-                    const Material *m
-                        = n >= 0 ? upB->getPointerTriangleMesh()->getMaterial(n)
-                        : NULL;
+                    const Material *m = n >= 0 ? tm->getMaterial(n) : NULL;
                     const btVector3 &normal = contact_manifold->getContactPoint(i)
                         .m_normalWorldOnB;
                     upA->getPointerPhysicalObject()->hit(m, normal);
@@ -658,10 +650,11 @@ btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
             if(upB->is(UserPointer::UP_TRACK))
             {
                 AbstractKart *kart = upA->getPointerKart();
-                int n = contact_manifold->getContactPoint(0).m_index1;
-                const Material *m
-                    = n>=0 ? upB->getPointerTriangleMesh()->getMaterial(n)
-                           : NULL;
+                const TriangleMesh *tm = upB->getPointerTriangleMesh();
+                int n = tm->getTriangleIndex(
+                    contact_manifold->getContactPoint(0).m_partId1,
+                    contact_manifold->getContactPoint(0).m_index1);
+                const Material *m = n>=0 ? tm->getMaterial(n) : NULL;
                 const btVector3 &normal = contact_manifold->getContactPoint(0)
                                                            .m_normalWorldOnB;
                 kart->crashed(m, normal);   // Kart hit track
@@ -730,17 +723,18 @@ btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
             else if(upB->is(UserPointer::UP_TRACK))
             {
                 std::vector<int> used;
+                const TriangleMesh *tm = upB->getPointerTriangleMesh();
                 for(int i=0; i< contact_manifold->getNumContacts(); i++)
                 {
-                    int n = contact_manifold->getContactPoint(i).m_index1;
+                    int n = tm->getTriangleIndex(
+                        contact_manifold->getContactPoint(i).m_partId1,
+                        contact_manifold->getContactPoint(i).m_index1);
                     // Make sure to call the callback function only once
                     // per triangle.
                     if(std::find(used.begin(), used.end(), n)!=used.end())
                         continue;
                     used.push_back(n);
-                    const Material *m
-                        = n >= 0 ? upB->getPointerTriangleMesh()->getMaterial(n)
-                        : NULL;
+                    const Material *m = n >= 0 ? tm->getMaterial(n) : NULL;
                     const btVector3 &normal = contact_manifold->getContactPoint(i)
                                              .m_normalWorldOnB;
                     upA->getPointerPhysicalObject()->hit(m, normal);
@@ -757,9 +751,7 @@ btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
         else
             assert("Unknown user pointer");           // 4) Should never happen
     }   // for i<numManifolds
-
-    return returnValue;
-}   // solveGroup
+}   // allSolved
 
 // ----------------------------------------------------------------------------
 /** A debug draw function to show the track and all karts.
@@ -176,12 +176,9 @@ public:
     /** Returns true if the debug drawer is enabled. */
     bool  isDebug() const     {return m_debug_drawer->debugEnabled(); }
     IrrDebugDrawer* getDebugDrawer() { return m_debug_drawer; }
-    virtual btScalar solveGroup(btCollisionObject** bodies, int numBodies,
-                                btPersistentManifold** manifold,int numManifolds,
-                                btTypedConstraint** constraints,int numConstraints,
-                                const btContactSolverInfo& info,
-                                btIDebugDraw* debugDrawer, btStackAlloc* stackAlloc,
-                                btDispatcher* dispatcher);
+    virtual void allSolved(const btContactSolverInfo& info,
+                           btIDebugDraw* debug_drawer,
+                           btStackAlloc* stack_alloc);
 };
 
 #endif // HEADER_PHYSICS_HPP
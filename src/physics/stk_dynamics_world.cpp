@@ -0,0 +1,199 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "physics/stk_dynamics_world.hpp"
+
+#include "physics/btKart.hpp"
+#include "utils/worker_pool.hpp"
+
+#include "BulletCollision/CollisionDispatch/btSimulationIslandManager.h"
+
+#include <algorithm>
+
+// ----------------------------------------------------------------------------
+/** Stores the bodies and contact manifolds of all islands which bullet's
+ *  sequential code would solve, in the same order. Bullet solves islands
+ *  without contacts only if they are in a batch with islands with contacts
+ *  (see InplaceSolverIslandCallback in btDiscreteDynamicsWorld.cpp), and
+ *  solving changes the bodies (the orientation is renormalized), so the
+ *  same islands are collected here.
+ *  \param solver_info The solver settings.
+ */
+void STKDynamicsWorld::collectIslands(const btContactSolverInfo& solver_info)
+{
+    struct IslandCollector : public btSimulationIslandManager::IslandCallback
+    {
+        STKDynamicsWorld *m_world;
+        int m_batch_size;
+        /** Number of islands that will be solved. */
+        unsigned int m_num_solved;
+        /** Number of manifolds in the islands after m_num_solved. */
+        int m_pending_manifolds;
+        // --------------------------------------------------------------------
+        virtual void ProcessIsland(btCollisionObject** bodies, int num_bodies,
+                                   btPersistentManifold** manifolds,
+                                   int num_manifolds, int island_id)
+        {
+            bool batched = island_id >= 0 && m_batch_size > 1;
+            if (!batched && num_manifolds == 0)
+                return;
+            Island island;
+            island.m_first_body     = m_world->m_island_bodies.size();
+            island.m_num_bodies     = num_bodies;
+            island.m_first_manifold = m_world->m_island_manifolds.size();
+            island.m_num_manifolds  = num_manifolds;
+            m_world->m_islands.push_back(island);
+            for (int i = 0; i < num_bodies; i++)
+                m_world->m_island_bodies.push_back(bodies[i]);
+            for (int i = 0; i < num_manifolds; i++)
+                m_world->m_island_manifolds.push_back(manifolds[i]);
+
+            m_pending_manifolds += num_manifolds;
+            if (!batched || m_pending_manifolds > m_batch_size)
+            {
+                m_num_solved = (unsigned int)m_world->m_islands.size();
+                m_pending_manifolds = 0;
+            }
+        }   // ProcessIsland
+    };   // IslandCollector
+
+    m_islands.clear();
+    m_island_bodies.resize(0);
+    m_island_manifolds.resize(0);
+
+    IslandCollector collector;
+    collector.m_world             = this;
+    collector.m_batch_size        = solver_info.m_minimumSolverBatchSize;
+    collector.m_num_solved        = 0;
+    collector.m_pending_manifolds = 0;
+    m_islandManager->buildAndProcessIslands(m_dispatcher1, this, &collector);
+
+    // The last batch is solved if it has any contacts
+    if (collector.m_pending_manifolds > 0)
+        collector.m_num_solved = (unsigned int)m_islands.size();
+    if (collector.m_num_solved < m_islands.size())
+    {
+        const Island &first_unsolved = m_islands[collector.m_num_solved];
+        m_island_bodies.resize(first_unsolved.m_first_body);
+        m_island_manifolds.resize(first_unsolved.m_first_manifold);
+        m_islands.resize(collector.m_num_solved);
+    }
+}   // collectIslands
+
+// ----------------------------------------------------------------------------
+/** Solves the contacts of all islands. Without worker threads bullet's
+ *  sequential code is used. Otherwise the islands are split into groups
+ *  which are solved in parallel, each by its own solver. The islands don't
+ *  share any body which the solver changes (static bodies like the track
+ *  have no inverse mass, and each solver uses its own fixed body for
+ *  contacts with them), and the solver handles the contacts of each body
+ *  in the same order as when all islands are solved together, so the
+ *  result is the same as with the sequential code. Afterwards
+ *  allSolved() of the actual solver is called, which in STK handles the
+ *  collisions.
+ *  \param solver_info The solver settings.
+ */
+void STKDynamicsWorld::solveConstraints(btContactSolverInfo& solver_info)
+{
+    // Joints would have to be assigned to the islands, and with a random
+    // order each solver would use different random numbers. STK uses
+    // neither, so these cases are left to bullet.
+    if (!m_worker_pool || m_worker_pool->getNumThreads() < 2 ||
+        getNumConstraints() > 0 ||
+        (solver_info.m_solverMode & SOLVER_RANDMIZE_ORDER) != 0)
+    {
+        btDiscreteDynamicsWorld::solveConstraints(solver_info);
+        return;
+    }
+
+    m_constraintSolver->prepareSolve(getNumCollisionObjects(),
+                                     m_dispatcher1->getNumManifolds());
+    collectIslands(solver_info);
+
+    // Split the islands into a few groups for each thread, so that the
+    // threads can balance the work, each with about the same number of
+    // contacts
+    const unsigned int num_islands = (unsigned int)m_islands.size();
+    const unsigned int num_groups =
+        std::min(num_islands, m_worker_pool->getNumThreads() * 4);
+    int total_weight = 0;
+    for (const Island &island : m_islands)
+        total_weight += island.m_num_manifolds + 1;
+    std::vector<unsigned int> group_start;
+    int weight = 0;
+    for (unsigned int i = 0; i < num_islands; i++)
+    {
+        if (group_start.size() < num_groups &&
+            weight >= total_weight * (int)group_start.size() / (int)num_groups)
+            group_start.push_back(i);
+        weight += m_islands[i].m_num_manifolds + 1;
+    }
+    group_start.push_back(num_islands);
+
+    while (m_solvers.size() + 1 < group_start.size())
+    {
+        m_solvers.emplace_back(new btSequentialImpulseConstraintSolver());
+    }
+
+    m_worker_pool->parallelFor((unsigned int)group_start.size() - 1,
+        [this, &group_start, &solver_info](unsigned int group)
+    {
+        const Island &first = m_islands[group_start[group]];
+        const Island &last  = m_islands[group_start[group + 1] - 1];
+        int num_bodies = last.m_first_body + last.m_num_bodies
+                       - first.m_first_body;
+        int num_manifolds = last.m_first_manifold + last.m_num_manifolds
+                          - first.m_first_manifold;
+        btPersistentManifold **manifolds = num_manifolds > 0
+            ? &m_island_manifolds[first.m_first_manifold] : NULL;
+        m_solvers[group]->solveGroup(&m_island_bodies[first.m_first_body],
+                                     num_bodies, manifolds, num_manifolds,
+                                     NULL, 0, solver_info, m_debugDrawer,
+                                     m_stackAlloc, m_dispatcher1);
+    });
+
+    m_constraintSolver->allSolved(solver_info, m_debugDrawer, m_stackAlloc);
+}   // solveConstraints
+
+// ----------------------------------------------------------------------------
+/** Moves the bodies, and then does all wheel raycasts of all karts in
+ *  parallel, which would otherwise be done one kart after the other when
+ *  the karts are updated right after this function (in updateActions()).
+ *  Updating a kart only changes the velocities of its chassis, so the
+ *  results are the same as when the rays are cast while updating. The
+ *  exception is a timed rotation, which changes the transform of a chassis
+ *  that a later kart might hit, so then all rays are cast while updating.
+ *  \param time_step The time step.
+ */
+void STKDynamicsWorld::integrateTransforms(btScalar time_step)
+{
+    btDiscreteDynamicsWorld::integrateTransforms(time_step);
+    if (!m_worker_pool || m_worker_pool->getNumThreads() < 2)
+        return;
+
+    m_karts.clear();
+    for (int i = 0; i < m_actions.size(); i++)
+    {
+        btKart *kart = dynamic_cast<btKart*>(m_actions[i]);
+        if (!kart || kart->getTimedRotationTicks() > 0)
+            return;
+        m_karts.push_back(kart);
+    }
+    m_worker_pool->parallelFor((unsigned int)m_karts.size(),
+        [this](unsigned int i) { m_karts[i]->castWheelRays(); });
+}   // integrateTransforms
@@ -21,12 +21,59 @@
 
 #include "btBulletDynamicsCommon.h"
 
+#include "utils/cpp2011.hpp"
+
+#include <memory>
+#include <vector>
+
+class btKart;
+class WorkerPool;
+
 /** A thin wrapper around bullet's btDiscreteDynamicsWorld. Used to
  *  be able to query and set the 'left over' time from a previous
  *  time step, which is needed for more precise rewind/replays.
+ *  It can also solve the independent simulation islands (e.g. each kart
+ *  with the track) in parallel, see solveConstraints(), and do the wheel
+ *  raycasts of all karts in parallel, see integrateTransforms().
  */
 class STKDynamicsWorld : public btDiscreteDynamicsWorld
 {
+private:
+    /** Threads used to solve the islands and to do the wheel raycasts,
+     *  NULL to use bullet's sequential code. */
+    WorkerPool *m_worker_pool;
+
+    /** One solver for each group of islands solved in parallel, since a
+     *  solver stores the state of the group it is solving. */
+    std::vector<std::unique_ptr<btSequentialImpulseConstraintSolver> >
+                m_solvers;
+
+    /** The bodies of all islands to solve, island after island. */
+    btAlignedObjectArray<btCollisionObject*> m_island_bodies;
+
+    /** The contact manifolds of all islands to solve, island after
+     *  island. */
+    btAlignedObjectArray<btPersistentManifold*> m_island_manifolds;
+
+    /** An island to solve. */
+    struct Island
+    {
+        int m_first_body;
+        int m_num_bodies;
+        int m_first_manifold;
+        int m_num_manifolds;
+    };
+    std::vector<Island> m_islands;
+
+    /** The karts whose wheel raycasts are done in parallel. */
+    std::vector<btKart*> m_karts;
+
+    void collectIslands(const btContactSolverInfo& solver_info);
+
+protected:
+    virtual void solveConstraints(btContactSolverInfo& solver_info) OVERRIDE;
+    virtual void integrateTransforms(btScalar time_step) OVERRIDE;
+
 public:
     /** The standard constructor which just created a btDiscreteDynamicsWorld. */
     STKDynamicsWorld(btDispatcher*             dispatcher,
@@ -38,6 +85,7 @@ public:
                                              constraintSolver,
                                              collisionConfiguration)
     {
+        m_worker_pool = NULL;
     }
 
     /** Resets m_localTime to 0. This allows more precise replay of
@@ -49,7 +97,10 @@ public:
     // ------------------------------------------------------------------------
     /** Gets the local time. */
     float getLocalTime() const { return m_localTime; }
+    // ------------------------------------------------------------------------
+    /** Sets the threads used to solve the islands and do the wheel
+     *  raycasts in parallel, NULL to do both sequentially. */
+    void setWorkerPool(WorkerPool *pool) { m_worker_pool = pool; }
 };   // STKDynamicsWorld
 #endif
 /* EOF */
-
@@ -19,15 +19,48 @@
 #include "physics/triangle_mesh.hpp"
 
 #include "config/stk_config.hpp"
+#include "io/file_manager.hpp"
 #include "main_loop.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/fnv_hash.hpp"
 #include "utils/log.hpp"
+#include "utils/string_utils.hpp"
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <set>
+
+#ifndef WIN32
+#  include <sys/mman.h>
+#endif
+
+namespace
+{
+    /** Header of a cached BVH file, followed by the serialized BVH. The size
+     *  is a multiple of 16, so the BVH is aligned as bullet needs. */
+    struct BVHCacheHeader
+    {
+        char     m_magic[8];
+        uint32_t m_bullet_version;
+        uint32_t m_pointer_size;
+        uint64_t m_hash;
+        uint32_t m_triangles;
+        uint32_t m_size;
+    };
+    static_assert(sizeof(BVHCacheHeader) % 16 == 0,
+                  "BVH must be aligned to 16 bytes");
+    const char BVH_CACHE_MAGIC[8] = { 'S', 'T', 'K', 'B', 'V', 'H', '0', '1' };
+    /** Number of cached BVH files kept for each name, so tracks which are
+     *  used with different objects (e.g. in different modes) have a file for
+     *  each. */
+    const unsigned BVH_CACHE_FILES = 4;
+}
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -45,6 +78,10 @@ TriangleMesh::TriangleMesh(bool can_be_transformed) : m_mesh()
     // (and m_mesh->m_weldingThreshold at m_normals
     m_collision_shape  = NULL;
     m_collision_object = NULL;
+    m_bvh_buffer        = NULL;
+    m_bvh_buffer_size   = 0;
+    m_bvh_buffer_mapped = false;
+    m_num_triangles     = 0;
     m_user_pointer.set(this);
 }   // TriangleMesh
 
@@ -69,6 +106,23 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
                                const btVector3 &n3,
                                const Material* m)
 {
+    if (m_parts.empty() || m_parts.back().m_shared)
+    {
+        MeshPart part;
+        memset(&part, 0, sizeof(part));
+        part.m_first  = m_num_triangles;
+        part.m_offset = (unsigned int)m_p1p2p3.size();
+        part.m_shared = false;
+        m_parts.push_back(part);
+    }
+    MeshPart &part = m_parts.back();
+    part.m_count++;
+    m_num_triangles++;
+    if (m_indices.size() < 3 * part.m_count)
+    {
+        for (int i = 0; i < 3; i++)
+            m_indices.push_back((int)m_indices.size());
+    }
     m_triangleIndex2Material.push_back(m);
 
     btVector3 normal = (t2-t1).cross(t3-t1);
@@ -79,23 +133,273 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
                          ? normal : n2                                     );
     m_normals.push_back( normal.angle(n3)>stk_config->m_smooth_angle_limit
                          ? normal : n3                                     );
-    m_mesh.addTriangle(t1, t2, t3);
+    m_vertices.push_back(t1);
+    m_vertices.push_back(t2);
+    m_vertices.push_back(t3);
 
     // Area of triangle ABC
     btVector3 edge1 = t2 - t1;
     btVector3 edge2 = t3 - t1;
     m_p1p2p3.push_back(edge1.cross(edge2).length2());
+    updateMeshParts();
 }   // addTriangle
 
+// -----------------------------------------------------------------------------
+/** Adds triangles which are used in place, so the memory of the triangles
+ *  is shared with other processes using the same triangles. They are added
+ *  as a new part of the bullet mesh, which gives the same collision shape
+ *  as adding each triangle with addTriangle().
+ *  \param triangles The triangles.
+ */
+void TriangleMesh::addSharedTriangles(const SharedTriangles &triangles)
+{
+    if (triangles.m_count == 0)
+        return;
+    MeshPart part;
+    part.m_first  = m_num_triangles;
+    part.m_count  = triangles.m_count;
+    part.m_offset = 0;
+    part.m_shared = true;
+    part.m_data   = triangles;
+    m_parts.push_back(part);
+    m_num_triangles += triangles.m_count;
+    updateMeshParts();
+}   // addSharedTriangles
+
+// -----------------------------------------------------------------------------
+/** Sets the bullet mesh parts to the current parts of this mesh. This is
+ *  needed whenever the arrays of the triangles which are not shared grow,
+ *  since they can be moved.
+ */
+void TriangleMesh::updateMeshParts()
+{
+    IndexedMeshArray &meshes = m_mesh.getIndexedMeshArray();
+    meshes.resize((int)m_parts.size());
+    for (unsigned int i = 0; i < m_parts.size(); i++)
+    {
+        const MeshPart &part = m_parts[i];
+        btIndexedMesh &mesh = meshes[i];
+        mesh.m_numTriangles        = (int)part.m_count;
+        mesh.m_numVertices         = (int)part.m_count * 3;
+        mesh.m_triangleIndexStride = 3 * sizeof(int);
+        mesh.m_vertexStride        = sizeof(btVector3);
+        mesh.m_indexType           = PHY_INTEGER;
+        mesh.m_vertexType          = PHY_FLOAT;
+        if (part.m_shared)
+        {
+            mesh.m_triangleIndexBase =
+                (const unsigned char*)part.m_data.m_indices;
+            mesh.m_vertexBase = (const unsigned char*)part.m_data.m_vertices;
+        }
+        else
+        {
+            mesh.m_triangleIndexBase = (const unsigned char*)&m_indices[0];
+            mesh.m_vertexBase =
+                (const unsigned char*)&m_vertices[3 * part.m_offset];
+        }
+    }
+}   // updateMeshParts
+
+// -----------------------------------------------------------------------------
+/** Returns a hash of all triangle points, which identifies the BVH of this
+ *  mesh in the cache. The BVH stores the part of each triangle, so the
+ *  sizes of the parts are included if there is more than one.
+ */
+uint64_t TriangleMesh::getTrianglesHash() const
+{
+    FNVHash hash;
+    for (const MeshPart &part : m_parts)
+    {
+        if (m_parts.size() > 1)
+            hash.add((uint32_t)part.m_count);
+        const btVector3 *p = getPoints(part.m_first);
+        for (unsigned int i = 0; i < part.m_count * 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+                hash.add((float)p[i][j]);
+        }
+    }
+    return hash.get();
+}   // getTrianglesHash
+
+// -----------------------------------------------------------------------------
+/** Loads a BVH from the cache, the file is memory mapped if possible, so
+ *  the BVH is only read from disk when used, and shared by all processes
+ *  using the same track (for example servers).
+ *  \param filename Full path of the cached BVH.
+ *  \param hash Hash of the triangles, which must match the cached one.
+ *  \return The BVH, or NULL if not cached or invalid.
+ */
+btOptimizedBvh* TriangleMesh::loadBVH(const std::string& filename,
+                                      uint64_t hash)
+{
+    FILE *f = FileUtils::fopenU8Path(filename, "rb");
+    if (!f)
+        return NULL;
+    // Check the size and header of the file, deSerializeInPlace() trusts
+    // the data completely
+    BVHCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, f) == 1 &&
+        memcmp(header.m_magic, BVH_CACHE_MAGIC, sizeof(BVH_CACHE_MAGIC)) == 0
+        && header.m_bullet_version == (uint32_t)btGetVersion() &&
+        header.m_pointer_size == (uint32_t)sizeof(void*) &&
+        header.m_hash == hash &&
+        header.m_triangles == (uint32_t)m_num_triangles &&
+        header.m_size >= sizeof(btOptimizedBvh);
+    if (valid)
+    {
+        fseek(f, 0, SEEK_END);
+        long file_size = ftell(f);
+        valid = file_size == (long)(sizeof(header) + header.m_size);
+    }
+    if (!valid)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    m_bvh_buffer_size = sizeof(header) + header.m_size;
+#ifndef WIN32
+    // A private mapping, deSerializeInPlace only writes to the first page
+    void *mem = mmap(NULL, m_bvh_buffer_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fileno(f), 0);
+    fclose(f);
+    if (mem == MAP_FAILED)
+    {
+        Log::warn("TriangleMesh", "Failed to map cached BVH '%s'.",
+                  filename.c_str());
+        return NULL;
+    }
+    m_bvh_buffer = mem;
+    m_bvh_buffer_mapped = true;
+#else
+    m_bvh_buffer = btAlignedAlloc(m_bvh_buffer_size, 16);
+    fseek(f, 0, SEEK_SET);
+    valid = fread(m_bvh_buffer, m_bvh_buffer_size, 1, f) == 1;
+    fclose(f);
+    m_bvh_buffer_mapped = false;
+    if (!valid)
+    {
+        freeBVHBuffer();
+        return NULL;
+    }
+#endif
+
+    btOptimizedBvh* bvh = btOptimizedBvh::deSerializeInPlace(
+        (char*)m_bvh_buffer + sizeof(header), header.m_size,
+        !IS_LITTLE_ENDIAN);
+    if (bvh == NULL)
+    {
+        Log::warn("TriangleMesh", "Failed to load cached BVH '%s'.",
+                  filename.c_str());
+        freeBVHBuffer();
+    }
+    return bvh;
+}   // loadBVH
+
+// -----------------------------------------------------------------------------
+/** Saves a BVH in the cache, removing the oldest files with the same name if
+ *  there are too many.
+ *  \param bvh The BVH to save.
+ *  \param cache_name Name of the cached BVH without hash.
+ *  \param filename Full path of the cached BVH.
+ *  \param hash Hash of the triangles.
+ */
+void TriangleMesh::saveBVH(const btOptimizedBvh* bvh,
+                           const std::string& cache_name,
+                           const std::string& filename, uint64_t hash) const
+{
+    const std::string& dir = file_manager->getCachedBVHDir();
+    const std::string prefix = cache_name + "-";
+    std::set<std::string> files;
+    file_manager->listFiles(files, dir);
+    std::vector<std::string> old_files;
+    for (const std::string& file : files)
+    {
+        // Name, dash, 16 hex digits of hash and .bvh
+        if (file.size() == prefix.size() + 20 &&
+            StringUtils::startsWith(file, prefix) &&
+            StringUtils::getExtension(file) == "bvh")
+            old_files.push_back(dir + file);
+    }
+    if (old_files.size() >= BVH_CACHE_FILES)
+    {
+        std::sort(old_files.begin(), old_files.end(),
+            [](const std::string& a, const std::string& b)
+            {
+                return file_manager->fileIsNewer(b, a);
+            });
+        for (unsigned i = 0; i <= old_files.size() - BVH_CACHE_FILES; i++)
+            file_manager->removeFile(old_files[i]);
+    }
+
+    BVHCacheHeader header;
+    memcpy(header.m_magic, BVH_CACHE_MAGIC, sizeof(BVH_CACHE_MAGIC));
+    header.m_bullet_version = (uint32_t)btGetVersion();
+    header.m_pointer_size = (uint32_t)sizeof(void*);
+    header.m_hash = hash;
+    header.m_triangles = (uint32_t)m_num_triangles;
+    header.m_size = bvh->calculateSerializeBufferSize();
+    char *buffer = (char*)btAlignedAlloc(sizeof(header) + header.m_size, 16);
+    memcpy(buffer, &header, sizeof(header));
+    if (bvh->serialize(buffer + sizeof(header), header.m_size,
+                       !IS_LITTLE_ENDIAN))
+    {
+        const size_t size = sizeof(header) + header.m_size;
+        if (!FileUtils::writeFileAtomically(filename, [buffer, size](FILE *f)
+            {
+                return fwrite(buffer, size, 1, f) == 1;
+            }))
+        {
+            Log::warn("TriangleMesh", "Failed to write cached BVH '%s'.",
+                      filename.c_str());
+        }
+    }
+    btAlignedFree(buffer);
+}   // saveBVH
+
+// -----------------------------------------------------------------------------
+void TriangleMesh::freeBVHBuffer()
+{
+    if (m_bvh_buffer == NULL)
+        return;
+#ifndef WIN32
+    if (m_bvh_buffer_mapped)
+        munmap(m_bvh_buffer, m_bvh_buffer_size);
+    else
+#endif
+        btAlignedFree(m_bvh_buffer);
+    m_bvh_buffer = NULL;
+    m_bvh_buffer_size = 0;
+    m_bvh_buffer_mapped = false;
+}   // freeBVHBuffer
+
+// -----------------------------------------------------------------------------
+/** Returns the size of the BVH tree in bytes (as serialized), 0 if no
+ *  collision shape was created.
+ */
+size_t TriangleMesh::getBVHSize() const
+{
+    if (!m_collision_shape)
+        return 0;
+    btBvhTriangleMeshShape* shape =
+        static_cast<btBvhTriangleMeshShape*>(m_collision_shape);
+    return shape->getOptimizedBvh() ?
+        shape->getOptimizedBvh()->calculateSerializeBufferSize() : 0;
+}   // getBVHSize
+
 // -----------------------------------------------------------------------------
 /** Creates a collision body only, which can be used for raycasting, but
- *  has no physical properties.
- *  @param serialized_bhv if non-null, load the serialized bhv from file instead
- *                        of builing it on the fly
+ *  has no physical properties. The BVH tree uses quantized AABBs, which
+ *  need about a quarter of the memory.
+ *  @param bvh_cache_name If non-null, the BVH is loaded from the BVH cache
+ *                        if this mesh was cached with this name before,
+ *                        otherwise it's built and saved in the cache.
  */
-void TriangleMesh::createCollisionShape(bool create_collision_object, const char* serialized_bhv)
+void TriangleMesh::createCollisionShape(bool create_collision_object,
+                                        const char* bvh_cache_name)
 {
-    if(m_triangleIndex2Material.size()==0)
+    if(m_num_triangles==0)
     {
         m_collision_shape  = NULL;
         m_motion_state     = NULL;
@@ -103,56 +407,42 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
         m_collision_object = NULL;
         return;
     }
+    // Quantized nodes store the triangle index in the remaining bits
+    const bool quantized = m_num_triangles <
+        (1 << (31 - MAX_NUM_PARTS_IN_BITS));
+
+    std::string filename;
+    uint64_t hash = 0;
+    btOptimizedBvh* bvh = NULL;
+    if (bvh_cache_name != NULL && quantized &&
+        !file_manager->getCachedBVHDir().empty())
+    {
+        hash = getTrianglesHash();
+        char hash_string[17];
+        snprintf(hash_string, sizeof(hash_string), "%016llx",
+                 (unsigned long long)hash);
+        filename = file_manager->getCachedBVHDir() + bvh_cache_name + "-" +
+            hash_string + ".bvh";
+        bvh = loadBVH(filename, hash);
+    }
+
     // Now convert the triangle mesh into a static rigid body
     btBvhTriangleMeshShape* bhv_triangle_mesh;
-
-    if (serialized_bhv != NULL)
+    if (bvh != NULL)
     {
-        FILE *f = fopen(serialized_bhv, "rb");
-        fseek(f, 0, SEEK_END);
-        long pos = ftell(f);
-        assert(pos != -1L);
-        fseek(f, 0, SEEK_SET);
-
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
-        fclose(f);
-
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
-        if (bhv == NULL)
-        {
-            Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-        }
-        else
-        {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
-        }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
-
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh,
+            true /* useQuantizedAabbCompression */, false /* buildBvh */);
+        bhv_triangle_mesh->setOptimizedBvh(bvh);
     }
     else
     {
-        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
-
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh,
+            quantized /* useQuantizedAabbCompression */);
+        if (!filename.empty())
+        {
+            saveBVH(bhv_triangle_mesh->getOptimizedBvh(), bvh_cache_name,
+                    filename, hash);
+        }
     }
 
     m_collision_shape = bhv_triangle_mesh;
@@ -179,16 +469,16 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
  *  for height of terrain detection).
  *  \param friction Friction to be used for this TriangleMesh.
  *  \param flags Additional collision flags (default 0).
- *  \param serializedBhv if non-NULL, the bhv is deserialized instead of
- *                       being calculated on the fly
+ *  \param bvh_cache_name If non-NULL, the BVH is loaded from or saved in
+ *         the BVH cache with this name, see createCollisionShape.
  */
 void TriangleMesh::createPhysicalBody(float friction,
                                       btCollisionObject::CollisionFlags flags,
-                                      const char* serializedBhv)
+                                      const char* bvh_cache_name)
 {
     // We need the collision shape, but not the collision object (since
     // this will be created when the dynamics body is anyway).
-    createCollisionShape(/*create_collision_object*/false, serializedBhv);
+    createCollisionShape(/*create_collision_object*/false, bvh_cache_name);
     main_loop->renderGUI(5583);
 
     btTransform startTransform;
@@ -233,6 +523,8 @@ void TriangleMesh::removeAll()
     }
     delete m_collision_shape;
     m_collision_shape = NULL;
+    // The loaded BVH is only used by the collision shape
+    freeBVHBuffer();
 }   // removeAll
 
 // -----------------------------------------------------------------------------
@@ -352,18 +644,22 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
     public:
         /** Stores the index of the triangle that was hit. */
         int m_index;
+        const TriangleMesh *m_mesh;
         // --------------------------------------------------------------------
         MaterialRayResult(const btVector3 &p1, const btVector3 &p2,
                           const TriangleMesh *me)
                         : btCollisionWorld::ClosestRayResultCallback(p1,p2)
         {
             m_index = -1;;
+            m_mesh  = me;
         }   // MaterialRayResult
         // --------------------------------------------------------------------
         virtual btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
                                          bool normalInWorldSpace)
         {
-            m_index = rayResult.m_localShapeInfo->m_triangleIndex;
+            m_index = m_mesh->getTriangleIndex(
+                rayResult.m_localShapeInfo->m_shapePart,
+                rayResult.m_localShapeInfo->m_triangleIndex);
             return btCollisionWorld::ClosestRayResultCallback
                     ::addSingleResult(rayResult, normalInWorldSpace);
         }   // AddSingleResult
@@ -384,7 +680,7 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
     {
         *xyz      = ray_callback.m_hitPointWorld;
         xyz->setW(0.0f);
-        *material = m_triangleIndex2Material[index];
+        *material = getMaterial(index);
 
         if(normal)
         {
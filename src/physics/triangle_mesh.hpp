@@ -19,12 +19,15 @@
 #ifndef HEADER_TRIANGLE_MESH_HPP
 #define HEADER_TRIANGLE_MESH_HPP
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include "btBulletDynamicsCommon.h"
 
 #include "physics/user_pointer.hpp"
 #include "utils/aligned_array.hpp"
 
+class btOptimizedBvh;
 class Material;
 
 /**
@@ -33,20 +36,68 @@ class Material;
  */
 class TriangleMesh
 {
+public:
+    /** Triangles in memory which is shared with other processes, e.g. a
+     *  memory mapped file (see TrackBundle). The memory must stay valid as
+     *  long as the mesh exists. */
+    struct SharedTriangles
+    {
+        unsigned int           m_count;
+        /** The three points of each triangle. */
+        const btVector3       *m_vertices;
+        /** The indices 0 to 3*m_count-1 of the points. */
+        const int             *m_indices;
+        /** The three normals of each triangle, as stored by addTriangle(). */
+        const btVector3       *m_normals;
+        const float           *m_p1p2p3;
+        /** Index of the material of each triangle in m_materials. An index
+         *  which is not smaller than m_num_materials means no material. */
+        const uint32_t        *m_material_ids;
+        const Material* const *m_materials;
+        unsigned int           m_num_materials;
+    };
+
 private:
+    /** A range of triangles, which is a part of the bullet mesh. The data
+     *  of the triangles is either shared or stored in this object. */
+    struct MeshPart
+    {
+        /** Index of the first triangle of this part in the mesh. */
+        unsigned int    m_first;
+        unsigned int    m_count;
+        /** Index of the first triangle in the arrays of this object if the
+         *  part is not shared. */
+        unsigned int    m_offset;
+        bool            m_shared;
+        SharedTriangles m_data;
+    };
+
     UserPointer                  m_user_pointer;
+    /** The material of each triangle which is not shared. */
     std::vector<const Material*> m_triangleIndex2Material;
     btRigidBody                 *m_body;
     /** Keep track if the physical body was created here or not. */
     bool                         m_free_body;
 
     btCollisionObject           *m_collision_object;
-    btTriangleMesh               m_mesh;
+    /** The bullet mesh, with one bullet part for each entry of m_parts. */
+    btTriangleIndexVertexArray   m_mesh;
     btVector3 dummy1, dummy2;
     btDefaultMotionState        *m_motion_state;
     btCollisionShape            *m_collision_shape;
 
-    /** The three normals for each triangle. */
+    std::vector<MeshPart>        m_parts;
+
+    unsigned int                 m_num_triangles;
+
+    /** The three points of each triangle which is not shared. */
+    AlignedArray<btVector3>      m_vertices;
+
+    /** The indices of the points of a part which is not shared, which are
+     *  the same for all such parts. */
+    std::vector<int>             m_indices;
+
+    /** The three normals for each triangle which is not shared. */
     AlignedArray<btVector3>      m_normals;
 
     /** Pre-compute value used in smoothing. */
@@ -57,6 +108,44 @@ private:
      *  to the current transform of the body. */
     bool m_can_be_transformed;
 
+    /** Memory of a BVH loaded from the cache. The BVH object is created in
+     *  this memory, so it can only be freed after the collision shape. */
+    void                        *m_bvh_buffer;
+
+    /** Size of m_bvh_buffer. */
+    size_t                       m_bvh_buffer_size;
+
+    /** True if m_bvh_buffer is a mapped file instead of allocated memory. */
+    bool                         m_bvh_buffer_mapped;
+
+    uint64_t        getTrianglesHash() const;
+    btOptimizedBvh* loadBVH(const std::string& filename, uint64_t hash);
+    void            saveBVH(const btOptimizedBvh* bvh,
+                            const std::string& cache_name,
+                            const std::string& filename,
+                            uint64_t hash) const;
+    void            freeBVHBuffer();
+    void            updateMeshParts();
+    // ------------------------------------------------------------------------
+    /** Returns the part of the mesh which contains a triangle. */
+    const MeshPart& getPart(unsigned int indx) const
+    {
+        assert(indx < m_num_triangles);
+        unsigned int i = (unsigned int)m_parts.size() - 1;
+        while (m_parts[i].m_first > indx)
+            i--;
+        return m_parts[i];
+    }   // getPart
+    // ------------------------------------------------------------------------
+    /** Returns the points of a triangle. */
+    const btVector3* getPoints(unsigned int indx) const
+    {
+        const MeshPart &part = getPart(indx);
+        const btVector3 *p = part.m_shared ? part.m_data.m_vertices
+                                           : &m_vertices[3 * part.m_offset];
+        return p + 3 * (indx - part.m_first);
+    }   // getPoints
+
 public:
     class RigidBodyTriangleMesh : public btRigidBody
     {
@@ -76,11 +165,13 @@ public:
                      const btVector3 &t3, const btVector3 &n1,
                      const btVector3 &n2, const btVector3 &n3,
                      const Material* m);
-    void createCollisionShape(bool create_collision_object=true, const char* serialized_bhv=NULL);
+    void addSharedTriangles(const SharedTriangles &triangles);
+    void createCollisionShape(bool create_collision_object=true,
+                              const char* bvh_cache_name=NULL);
     void createPhysicalBody(float friction,
                             btCollisionObject::CollisionFlags flags=
                                (btCollisionObject::CollisionFlags)0,
-                            const char* serializedBhv = NULL);
+                            const char* bvh_cache_name = NULL);
     void removeAll();
     void removeCollisionObject();
     btVector3 getInterpolatedNormal(unsigned int index,
@@ -102,13 +193,42 @@ public:
     const btRigidBody *getBody() const { return m_body; }
     // ------------------------------------------------------------------------
     const Material* getMaterial(int n) const
-                                          {return m_triangleIndex2Material[n];}
+    {
+        const MeshPart &part = getPart(n);
+        if (!part.m_shared)
+            return m_triangleIndex2Material[part.m_offset + n - part.m_first];
+        const uint32_t id = part.m_data.m_material_ids[n - part.m_first];
+        return id < part.m_data.m_num_materials ? part.m_data.m_materials[id]
+                                                : NULL;
+    }   // getMaterial
+    // ------------------------------------------------------------------------
+    /** Returns the number of triangles. */
+    unsigned int getNumTriangles() const          { return m_num_triangles; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of triangles which are in shared memory. */
+    unsigned int getNumSharedTriangles() const
+    {
+        return m_num_triangles - (unsigned int)m_p1p2p3.size();
+    }   // getNumSharedTriangles
+    // ------------------------------------------------------------------------
+    /** Returns the index of a triangle in this mesh from the part and the
+     *  index in the part which bullet reports for a ray hit or contact. */
+    int getTriangleIndex(int part, int index) const
+    {
+        return part > 0 && index >= 0 ? (int)m_parts[part].m_first + index
+                                      : index;
+    }   // getTriangleIndex
     // ------------------------------------------------------------------------
     const btCollisionShape &getCollisionShape() const
                                           { return *m_collision_shape; }
     // ------------------------------------------------------------------------
     btCollisionShape &getCollisionShape() { return *m_collision_shape; }
     // ------------------------------------------------------------------------
+    size_t getBVHSize() const;
+    // ------------------------------------------------------------------------
+    /** Returns true if the BVH was loaded from the cache. */
+    bool isBVHCached() const               { return m_bvh_buffer != NULL; }
+    // ------------------------------------------------------------------------
     bool castRay(const btVector3 &from, const btVector3 &to,
                  btVector3 *xyz, const Material **material,
                  btVector3 *normal=NULL, bool interpolate_normal=false) const;
@@ -119,8 +239,7 @@ public:
     void getTriangle(unsigned int indx, btVector3 *p1, btVector3 *p2,
                      btVector3 *p3) const
     {
-        const IndexedMeshArray &m = m_mesh.getIndexedMeshArray();
-        btVector3 *p = &(((btVector3*)(m[0].m_vertexBase))[3*indx]);
+        const btVector3 *p = getPoints(indx);
         *p1 = p[0];
         *p2 = p[1];
         *p3 = p[2];
@@ -132,24 +251,28 @@ public:
     void getNormals(unsigned int indx, btVector3 *n1, 
                     btVector3 *n2, btVector3 *n3) const
     {
-        assert(indx < m_triangleIndex2Material.size());
-        unsigned int n = indx*3;
-        *n1 = m_normals[n  ];
-        *n2 = m_normals[n+1];
-        *n3 = m_normals[n+2];
+        const MeshPart &part = getPart(indx);
+        const btVector3 *n = part.m_shared ? part.m_data.m_normals
+                                           : &m_normals[3 * part.m_offset];
+        n += 3 * (indx - part.m_first);
+        *n1 = n[0];
+        *n2 = n[1];
+        *n3 = n[2];
     }   // getNormals
     // ------------------------------------------------------------------------
     /** Returns basically the area of the triangle, which is needed when
      *  smoothing the normals. */
     float getP1P2P3(unsigned int indx) const
     {
-        assert(indx < m_p1p2p3.size());
-        return m_p1p2p3[indx];
+        const MeshPart &part = getPart(indx);
+        const unsigned int i = indx - part.m_first;
+        return part.m_shared ? part.m_data.m_p1p2p3[i]
+                             : m_p1p2p3[part.m_offset + i];
     }
     // ------------------------------------------------------------------------
     void copyFrom(const TriangleMesh& tm)
     {
-        for (int i = 0; i < tm.m_mesh.getNumTriangles(); i++)
+        for (unsigned int i = 0; i < tm.getNumTriangles(); i++)
         {
             btVector3 v[6];
             tm.getTriangle(i, v, v + 1, v + 2);
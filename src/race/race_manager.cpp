@@ -1175,6 +1175,21 @@ void RaceManager::setupPlayerKartInfo()
     computeRandomKartList();
 }   // setupPlayerKartInfo
 
+//---------------------------------------------------------------------------------------------
+/** Removes the ghost karts from a race that was started with ghost karts,
+ *  used when the replay can't be loaded. The ghost karts are the first
+ *  karts, so the other karts keep their order.
+ */
+void RaceManager::removeGhostKarts()
+{
+    assert(m_num_ghost_karts <= m_kart_status.size());
+    m_kart_status.erase(m_kart_status.begin(),
+                        m_kart_status.begin() + m_num_ghost_karts);
+    m_num_karts -= m_num_ghost_karts;
+    m_num_ghost_karts = 0;
+    setRaceGhostKarts(false);
+}   // removeGhostKarts
+
 //---------------------------------------------------------------------------------------------
 /** \brief Function to start the race with only ghost kart(s) and watch.
  * \param trackIdent Internal name of the track to race on
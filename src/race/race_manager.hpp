@@ -852,6 +852,8 @@ public:
         m_has_ghost_karts = ghost;
     }   // setRaceGhostKarts
     // ----------------------------------------------------------------------------------------
+    void removeGhostKarts();
+    // ----------------------------------------------------------------------------------------
     void setWatchingReplay(bool watch)
     {
         m_watching_replay = watch;
@@ -0,0 +1,379 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "race/simulation_benchmark.hpp"
+
+#include "config/stk_config.hpp"
+#include "config/user_config.hpp"
+#include "karts/abstract_kart.hpp"
+#include "modes/world.hpp"
+#include "tracks/track.hpp"
+#include "tracks/track_manager.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+#include "utils/profiler.hpp"
+#include "utils/string_utils.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+
+#ifndef WIN32
+#  include <sys/resource.h>
+#  include <unistd.h>
+#endif
+
+std::string SimulationBenchmark::m_output_file = "";
+std::string SimulationBenchmark::m_cases       =
+    "race:lighthouse,battle:temple,soccer:soccer_field,ctf";
+int         SimulationBenchmark::m_ticks       = 60 * 120;
+int         SimulationBenchmark::m_num_karts   = 8;
+int         SimulationBenchmark::m_seed        = 1;
+bool        SimulationBenchmark::m_physics     = false;
+
+// ----------------------------------------------------------------------------
+/** Enables the benchmark.
+ *  \param output_file The JSON file to write.
+ *  \param cases Comma separated list of mode:track, e.g. race:lighthouse.
+ *         If the track is missing the first official track supporting the
+ *         mode is used. Empty to benchmark the default list.
+ */
+void SimulationBenchmark::enable(const std::string& output_file,
+                                 const std::string& cases)
+{
+    m_output_file = output_file;
+    if (!cases.empty())
+        m_cases = cases;
+}   // enable
+
+// ----------------------------------------------------------------------------
+/** Converts one mode:track entry of the case list.
+ *  \return False if the mode is unknown or no track supports it.
+ */
+bool SimulationBenchmark::parseCase(const std::string& text, Case* c)
+{
+    std::vector<std::string> parts = StringUtils::split(text, ':');
+    if (parts.empty() || parts.size() > 2)
+        return false;
+    c->m_mode_name = parts[0];
+    if (c->m_mode_name == "race")
+        c->m_mode = RaceManager::MINOR_MODE_NORMAL_RACE;
+    else if (c->m_mode_name == "battle")
+        c->m_mode = RaceManager::MINOR_MODE_FREE_FOR_ALL;
+    else if (c->m_mode_name == "soccer")
+        c->m_mode = RaceManager::MINOR_MODE_SOCCER;
+    else if (c->m_mode_name == "ctf")
+        c->m_mode = RaceManager::MINOR_MODE_CAPTURE_THE_FLAG;
+    else
+        return false;
+
+    if (parts.size() == 2)
+    {
+        c->m_track = parts[1];
+        return track_manager->getTrack(c->m_track) != NULL;
+    }
+
+    for (unsigned int i = 0; i < track_manager->getNumberOfTracks(); i++)
+    {
+        const Track* track = track_manager->getTrack(i);
+        if (track->isAddon() || track->isInternal())
+            continue;
+        bool supported;
+        if (c->m_mode == RaceManager::MINOR_MODE_NORMAL_RACE)
+            supported = track->isRaceTrack();
+        else if (c->m_mode == RaceManager::MINOR_MODE_SOCCER)
+            supported = track->isSoccer();
+        else if (c->m_mode == RaceManager::MINOR_MODE_CAPTURE_THE_FLAG)
+            supported = track->isCTF();
+        else
+            supported = track->isArena();
+        if (supported)
+        {
+            c->m_track = track->getIdent();
+            return true;
+        }
+    }
+    return false;
+}   // parseCase
+
+// ----------------------------------------------------------------------------
+/** Returns the peak resident memory of the process in KB, or -1 if it is
+ *  not known.
+ */
+long SimulationBenchmark::getPeakMemoryKB()
+{
+#ifdef WIN32
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#  ifdef __APPLE__
+    // In bytes on macOS
+    return usage.ru_maxrss / 1024;
+#  else
+    return usage.ru_maxrss;
+#  endif
+#endif
+}   // getPeakMemoryKB
+
+// ----------------------------------------------------------------------------
+/** Returns the current resident memory of the process in KB, and the part
+ *  of it which can be shared with other processes (mapped files, e.g. the
+ *  cached BVHs and server bundles of tracks). Both are -1 if not known.
+ */
+void SimulationBenchmark::getResidentMemoryKB(long* resident, long* shared)
+{
+    *resident = -1;
+    *shared   = -1;
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f)
+        return;
+    long size, resident_pages, shared_pages;
+    if (fscanf(f, "%ld %ld %ld", &size, &resident_pages, &shared_pages) == 3)
+    {
+        const long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+        *resident = resident_pages * page_kb;
+        *shared   = shared_pages * page_kb;
+    }
+    fclose(f);
+#endif
+}   // getResidentMemoryKB
+
+// ----------------------------------------------------------------------------
+/** Runs all cases and writes the results. All karts are AI karts, and all
+ *  races are set up so that they don't end before the requested number of
+ *  ticks is simulated.
+ */
+void SimulationBenchmark::run()
+{
+    FILE* out = FileUtils::fopenU8Path(m_output_file, "w");
+    if (!out)
+    {
+        Log::error("SimulationBenchmark", "Can't open '%s'.",
+                   m_output_file.c_str());
+        return;
+    }
+    UserConfigParams::m_sfx   = false;
+    UserConfigParams::m_music = false;
+    const bool profiler_enabled = UserConfigParams::m_profiler_enabled;
+    UserConfigParams::m_profiler_enabled = true;
+    const bool parallel_physics = UserConfigParams::m_parallel_physics;
+
+    fprintf(out, "{\n  \"seed\": %d,\n  \"karts\": %d,\n"
+            "  \"physics_fps\": %d,\n  \"cases\": [", m_seed, m_num_karts,
+            stk_config->getPhysicsFPS());
+    bool first = true;
+    for (const std::string& text : StringUtils::split(m_cases, ','))
+    {
+        Case c;
+        if (!parseCase(text, &c))
+        {
+            Log::error("SimulationBenchmark", "Invalid case '%s'.",
+                       text.c_str());
+            continue;
+        }
+        if (!m_physics)
+        {
+            runCase(c, m_num_karts, parallel_physics, NULL, out, first);
+            first = false;
+            continue;
+        }
+        for (int num_karts : { 8, 16, 32 })
+        {
+            std::vector<uint32_t> checksums;
+            runCase(c, num_karts, false, &checksums, out, first);
+            runCase(c, num_karts, true, &checksums, out, false);
+            first = false;
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+
+    UserConfigParams::m_profiler_enabled = profiler_enabled;
+    UserConfigParams::m_parallel_physics = parallel_physics;
+    Log::info("SimulationBenchmark", "Results written to '%s'.",
+              m_output_file.c_str());
+}   // run
+
+// ----------------------------------------------------------------------------
+/** Returns a checksum of the position, rotation and velocity of all karts.
+ */
+uint32_t SimulationBenchmark::computeChecksum()
+{
+    // FNV-1a
+    uint32_t checksum = 2166136261u;
+    auto add = [&checksum](const btVector3& v)
+    {
+        const unsigned char* bytes = (const unsigned char*)&v;
+        for (unsigned int i = 0; i < 3 * sizeof(btScalar); i++)
+            checksum = (checksum ^ bytes[i]) * 16777619u;
+    };
+    for (auto& kart : World::getWorld()->getKarts())
+    {
+        const btRigidBody* body = kart->getBody();
+        const btTransform& t = body->getWorldTransform();
+        add(t.getOrigin());
+        for (int i = 0; i < 3; i++)
+            add(t.getBasis()[i]);
+        add(body->getLinearVelocity());
+        add(body->getAngularVelocity());
+    }
+    return checksum;
+}   // computeChecksum
+
+// ----------------------------------------------------------------------------
+/** Simulates one case and appends its result to the JSON file.
+ *  \param c The mode and track.
+ *  \param num_karts Number of AI karts.
+ *  \param parallel_physics If the physics islands are solved in parallel.
+ *  \param checksums If not NULL, the checksum of the karts after each tick
+ *         is compared with this list, or stored in it if it is empty.
+ *  \param out The JSON file.
+ *  \param first True if this is the first case written.
+ */
+void SimulationBenchmark::runCase(const Case& c, int num_karts,
+                                  bool parallel_physics,
+                                  std::vector<uint32_t>* checksums,
+                                  FILE* out, bool first)
+{
+    Log::info("SimulationBenchmark", "Simulating %s on %s with %d karts%s.",
+              c.m_mode_name.c_str(), c.m_track.c_str(), num_karts,
+              parallel_physics ? " and parallel physics" : "");
+    UserConfigParams::m_parallel_physics = parallel_physics;
+
+    // The same seed for each case, so the results don't depend on the cases
+    // run before
+    srand(m_seed);
+    UserConfigParams::m_item_seed = m_seed;
+
+    RaceManager* rm = RaceManager::get();
+    rm->setNumPlayers(0);
+    rm->setMajorMode(RaceManager::MAJOR_MODE_SINGLE);
+    rm->setMinorMode(c.m_mode);
+    rm->setDifficulty(RaceManager::DIFFICULTY_HARD);
+    rm->setTrack(c.m_track);
+    rm->setReverseTrack(false);
+    rm->setDefaultAIKartList(std::vector<std::string>(num_karts, "tux"));
+    rm->setNumKarts(num_karts);
+    // Make sure that no race ends before all ticks are simulated
+    rm->setNumLaps(99999);
+    if (c.m_mode == RaceManager::MINOR_MODE_SOCCER)
+        rm->setMaxGoal(99999);
+    else if (rm->isBattleMode())
+        rm->setHitCaptureTime(99999, 0.0f);
+    rm->setupPlayerKartInfo();
+    rm->startNew(false);
+
+    World* world = World::getWorld();
+    // Ready, set, go is not measured
+    const int max_start_ticks = stk_config->time2Ticks(30.0f);
+    for (int i = 0; i < max_start_ticks &&
+         world->getPhase() < WorldStatus::GO_PHASE; i++)
+    {
+        world->updateWorld(1);
+        world->updateTime(1);
+        PROFILER_SYNC_FRAME();
+    }
+
+    profiler.reset();
+    const bool compare = checksums && !checksums->empty();
+    int mismatch_tick = -1;
+    int ticks = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (; ticks < m_ticks && world->getPhase() <= WorldStatus::RACE_PHASE;
+         ticks++)
+    {
+        world->updateWorld(1);
+        world->updateTime(1);
+        PROFILER_SYNC_FRAME();
+        if (!checksums)
+            continue;
+        const uint32_t checksum = computeChecksum();
+        if (!compare)
+            checksums->push_back(checksum);
+        else if (mismatch_tick == -1 &&
+                 (ticks >= (int)checksums->size() ||
+                  (*checksums)[ticks] != checksum))
+            mismatch_tick = ticks;
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    if (ticks < m_ticks)
+    {
+        Log::warn("SimulationBenchmark", "Race ended after %d ticks.",
+                  ticks);
+    }
+
+    if (compare && mismatch_tick != -1)
+    {
+        Log::error("SimulationBenchmark", "Parallel physics differs from "
+                   "sequential physics at tick %d.", mismatch_tick);
+    }
+
+    fprintf(out, "%s\n    {\n      \"mode\": \"%s\",\n"
+            "      \"track\": \"%s\",\n      \"karts\": %d,\n"
+            "      \"parallel_physics\": %s,\n", first ? "" : ",",
+            c.m_mode_name.c_str(), c.m_track.c_str(), num_karts,
+            parallel_physics ? "true" : "false");
+    if (compare)
+        fprintf(out, "      \"first_mismatch_tick\": %d,\n", mismatch_tick);
+    fprintf(out, "      \"ticks\": %d,\n"
+            "      \"seconds\": %.3f,\n      \"ticks_per_second\": %.1f,\n"
+            "      \"markers_ms\": {", ticks, seconds,
+            seconds > 0.0 ? ticks / seconds : 0.0);
+    const std::map<std::string, double> totals = profiler.getMarkerTotals();
+    bool first_marker = true;
+    for (auto& total : totals)
+    {
+        std::string name;
+        for (char ch : total.first)
+        {
+            if (ch == '"' || ch == '\\')
+                name += '\\';
+            name += ch;
+        }
+        fprintf(out, "%s\n        \"%s\": %.3f", first_marker ? "" : ",",
+                name.c_str(), total.second);
+        first_marker = false;
+    }
+    // The counters are not reset, so they include loading the track and
+    // all cases run before
+    fprintf(out, "\n      },\n      \"counters\": {");
+    bool first_counter = true;
+    for (auto& counter : profiler.getCounters())
+    {
+        fprintf(out, "%s\n        \"%s\": %lld", first_counter ? "" : ",",
+                counter.first.c_str(), (long long)counter.second);
+        first_counter = false;
+    }
+    // The peak of the whole process so far, so it includes all cases run
+    // before. The memory of a server is the resident memory minus the
+    // shared memory, which is the same for all servers using this track.
+    long resident, shared;
+    getResidentMemoryKB(&resident, &shared);
+    fprintf(out, "\n      },\n      \"server_bundle\": %s,\n"
+            "      \"resident_memory_kb\": %ld,\n"
+            "      \"shared_memory_kb\": %ld,\n"
+            "      \"peak_memory_kb\": %ld\n    }",
+            Track::getCurrentTrack()->hasServerBundle() ? "true" : "false",
+            resident, shared, getPeakMemoryKB());
+
+    rm->exitRace();
+}   // runCase
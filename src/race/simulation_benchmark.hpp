@@ -0,0 +1,94 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SIMULATION_BENCHMARK_HPP
+#define HEADER_SIMULATION_BENCHMARK_HPP
+
+#include "race/race_manager.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/** Runs AI only races on a list of tracks and modes with a fixed seed and
+ *  fixed karts, without rendering anything, and writes how fast the world
+ *  is simulated to a JSON file: ticks per second, the time of each profiler
+ *  marker (e.g. karts, projectiles, physics and rewind in World::update),
+ *  the resident and shared memory after each case and the peak memory of
+ *  the process.
+ *  In the physics mode each case is run with 8, 16 and 32 karts, first
+ *  with sequential and then with parallel physics. The state of all karts
+ *  is compared after each tick, and the first tick in which the parallel
+ *  physics differs is written too.
+ *  \ingroup race
+ */
+class SimulationBenchmark
+{
+private:
+    /** A track on which a mode is benchmarked. */
+    struct Case
+    {
+        std::string m_mode_name;
+        RaceManager::MinorRaceModeType m_mode;
+        std::string m_track;
+    };
+
+    /** The JSON file written, empty if the benchmark is not enabled. */
+    static std::string m_output_file;
+
+    /** The comma separated mode:track list. */
+    static std::string m_cases;
+
+    /** Number of ticks simulated in each case. */
+    static int m_ticks;
+
+    /** Number of AI karts in each case. */
+    static int m_num_karts;
+
+    /** Seed of the random numbers and items. */
+    static int m_seed;
+
+    /** True to compare sequential and parallel physics. */
+    static bool m_physics;
+
+    static bool parseCase(const std::string& text, Case* c);
+    static void runCase(const Case& c, int num_karts, bool parallel_physics,
+                        std::vector<uint32_t>* checksums, FILE* out,
+                        bool first);
+    static uint32_t computeChecksum();
+    static long getPeakMemoryKB();
+    static void getResidentMemoryKB(long* resident, long* shared);
+
+public:
+    static void enable(const std::string& output_file,
+                       const std::string& cases);
+    static void run();
+    // ------------------------------------------------------------------------
+    /** Returns if the simulation benchmark should be run. */
+    static bool isEnabled()                 { return !m_output_file.empty(); }
+    // ------------------------------------------------------------------------
+    static void setTicks(int ticks)                      { m_ticks = ticks; }
+    // ------------------------------------------------------------------------
+    static void setNumKarts(int num_karts)       { m_num_karts = num_karts; }
+    // ------------------------------------------------------------------------
+    static void enablePhysicsMode()                      { m_physics = true; }
+
+};   // SimulationBenchmark
+
+#endif
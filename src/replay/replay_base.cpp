@@ -18,8 +18,18 @@
 #include "replay/replay_base.hpp"
 
 #include "io/file_manager.hpp"
+#include "network/network_string.hpp"
 #include "utils/file_utils.hpp"
 
+#include <cstring>
+
+namespace
+{
+    /** Start of all binary replay files. Text replays start with
+     *  "version:", so both formats can't be confused. */
+    const char BINARY_MAGIC[8] = { 'S', 'T', 'K', 'R', 'P', 'L', 'Y', 0 };
+}   // namespace
+
 // -----------------------------------------------------------------------------
 ReplayBase::ReplayBase()
 {
@@ -28,13 +38,17 @@ ReplayBase::ReplayBase()
 /** Opens a replay file which is determined by sub classes.
  *  \param writeable True if the file should be opened for writing.
  *  \param full_path True if the file is full path.
+ *  \param binary True if the file is opened in binary mode.
  *  \return A FILE *, or NULL if the file could not be opened.
  */
-FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file_number)
+FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file_number,
+                                 bool binary)
 {
+    const char* mode = writeable ? (binary ? "wb" : "w")
+                                 : (binary ? "rb" : "r");
     FILE* fd = FileUtils::fopenU8Path(full_path ? getReplayFilename(replay_file_number) :
         file_manager->getReplayDir() + getReplayFilename(replay_file_number),
-        writeable ? "w" : "r");
+        mode);
     if (!fd)
     {
         return NULL;
@@ -42,3 +56,36 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
     return fd;
 
 }   // openReplayFile
+
+// -----------------------------------------------------------------------------
+/** Writes the start of a binary replay file.
+ *  \param header_size Size of the header written after it.
+ *  \param fd The replay file.
+ */
+void ReplayBase::writeBinaryPrefix(uint32_t header_size, FILE* fd) const
+{
+    BareNetworkString s(BINARY_PREFIX_SIZE);
+    for (unsigned int i = 0; i < sizeof(BINARY_MAGIC); i++)
+        s.addUInt8(BINARY_MAGIC[i]);
+    s.addUInt32(getCurrentReplayVersion()).addUInt32(header_size);
+    fwrite(s.getData(), s.getTotalSize(), 1, fd);
+}   // writeBinaryPrefix
+
+// -----------------------------------------------------------------------------
+/** Reads the start of a replay file.
+ *  \param data The first BINARY_PREFIX_SIZE bytes of the file.
+ *  \param version Set to the version of the replay.
+ *  \param header_size Set to the size of the header after the prefix.
+ *  \return False if this is not a binary replay file.
+ */
+bool ReplayBase::readBinaryPrefix(const uint8_t* data, unsigned int* version,
+                                  uint32_t* header_size) const
+{
+    if (memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+        return false;
+    BareNetworkString s((const char*)data + sizeof(BINARY_MAGIC),
+                        BINARY_PREFIX_SIZE - sizeof(BINARY_MAGIC));
+    *version     = s.getUInt32();
+    *header_size = s.getUInt32();
+    return true;
+}   // readBinaryPrefix
@@ -22,6 +22,7 @@
 #include "LinearMath/btTransform.h"
 #include "utils/no_copy.hpp"
 
+#include <cstdint>
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -33,6 +34,7 @@ class ReplayBase : public NoCopy
 {
     // Needs access to KartReplayEvent
     friend class GhostKart;
+    friend class ReplayEvents;
 
 protected:
     /** Stores a transform event, i.e. a position and rotation of a kart
@@ -98,20 +100,36 @@ protected:
     };   // KartReplayEvent
 
     // ------------------------------------------------------------------------
-    FILE *openReplayFile(bool writeable, bool full_path = false, int replay_file_number=1);
+    FILE *openReplayFile(bool writeable, bool full_path = false, int replay_file_number=1,
+                         bool binary = false);
     // ------------------------------------------------------------------------
     /** Returns the filename that was opened. */
     virtual const std::string& getReplayFilename(int replay_file_number = 1) const = 0;
     // ------------------------------------------------------------------------
     /** Returns the version number of the replay file recorderd by this executable.
      *  This is also used as a maximum supported version by this exexcutable. */
-    unsigned int getCurrentReplayVersion() const { return 4; }
+    unsigned int getCurrentReplayVersion() const { return 5; }
 
     // ------------------------------------------------------------------------
     /** This is used to check that a loaded replay file can still
      *  be understood by this executable. */
     unsigned int getMinSupportedReplayVersion() const { return 3; }
 
+    // ------------------------------------------------------------------------
+    /** The first version which is saved in the binary format, older
+     *  versions are text files. */
+    unsigned int getFirstBinaryReplayVersion() const { return 5; }
+
+    // ------------------------------------------------------------------------
+    /** Size of the start of a binary replay: a magic string, the version
+     *  and the size of the header which follows. */
+    static const unsigned int BINARY_PREFIX_SIZE = 16;
+    // ------------------------------------------------------------------------
+    void writeBinaryPrefix(uint32_t header_size, FILE* fd) const;
+    // ------------------------------------------------------------------------
+    bool readBinaryPrefix(const uint8_t* data, unsigned int* version,
+                          uint32_t* header_size) const;
+
 public:
              ReplayBase();
     virtual ~ReplayBase() {};
@@ -0,0 +1,415 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "replay/replay_events.hpp"
+
+#include "io/mapped_file.hpp"
+#include "network/network_string.hpp"
+#include "utils/log.hpp"
+
+#include "mini_glm.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    /** Number of integer values of an event, the rotation is stored
+     *  separately. */
+    const int NUM_VALUES = 19;
+
+    // ------------------------------------------------------------------------
+    int32_t quantize(float f, float scale)
+    {
+        return (int32_t)lroundf(f * scale);
+    }   // quantize
+
+    // ------------------------------------------------------------------------
+    /** Converts all values except the rotation of an event to integers. */
+    void quantizeEvent(const ReplayEvents::Event& e, int32_t* v)
+    {
+        const btVector3& xyz = e.m_transform.getOrigin();
+        v[0]  = quantize(xyz.getX(), 100.0f);
+        v[1]  = quantize(xyz.getY(), 100.0f);
+        v[2]  = quantize(xyz.getZ(), 100.0f);
+        v[3]  = quantize(e.m_physic_info.m_speed, 100.0f);
+        v[4]  = quantize(e.m_physic_info.m_steer, 1000.0f);
+        for (int i = 0; i < 4; i++)
+        {
+            v[5 + i] = quantize(e.m_physic_info.m_suspension_length[i],
+                                1000.0f);
+        }
+        v[9]  = e.m_physic_info.m_skidding_state;
+        v[10] = e.m_bonus_info.m_attachment;
+        v[11] = quantize(e.m_bonus_info.m_nitro_amount, 100.0f);
+        v[12] = e.m_bonus_info.m_item_amount;
+        v[13] = e.m_bonus_info.m_item_type;
+        v[14] = e.m_bonus_info.m_special_value;
+        v[15] = quantize(e.m_kart_replay_event.m_distance, 100.0f);
+        v[16] = e.m_kart_replay_event.m_nitro_usage;
+        v[17] = e.m_kart_replay_event.m_skidding_effect;
+        v[18] = (e.m_kart_replay_event.m_zipper_usage ? 1 : 0) |
+                (e.m_kart_replay_event.m_red_skidding ? 2 : 0) |
+                (e.m_kart_replay_event.m_jumping      ? 4 : 0);
+    }   // quantizeEvent
+
+    // ------------------------------------------------------------------------
+    void dequantizeEvent(const int32_t* v, uint32_t rotation,
+                         ReplayEvents::Event* e)
+    {
+        e->m_transform.setOrigin(btVector3(v[0] / 100.0f, v[1] / 100.0f,
+                                           v[2] / 100.0f));
+        e->m_transform.setRotation(MiniGLM::decompressbtQuaternion(rotation));
+        e->m_physic_info.m_speed = v[3] / 100.0f;
+        e->m_physic_info.m_steer = v[4] / 1000.0f;
+        for (int i = 0; i < 4; i++)
+            e->m_physic_info.m_suspension_length[i] = v[5 + i] / 1000.0f;
+        e->m_physic_info.m_skidding_state = v[9];
+        e->m_bonus_info.m_attachment = v[10];
+        e->m_bonus_info.m_nitro_amount = v[11] / 100.0f;
+        e->m_bonus_info.m_item_amount = v[12];
+        e->m_bonus_info.m_item_type = v[13];
+        e->m_bonus_info.m_special_value = v[14];
+        e->m_kart_replay_event.m_distance = v[15] / 100.0f;
+        e->m_kart_replay_event.m_nitro_usage = v[16];
+        e->m_kart_replay_event.m_skidding_effect = v[17];
+        e->m_kart_replay_event.m_zipper_usage = (v[18] & 1) != 0;
+        e->m_kart_replay_event.m_red_skidding = (v[18] & 2) != 0;
+        e->m_kart_replay_event.m_jumping = (v[18] & 4) != 0;
+    }   // dequantizeEvent
+
+    // ------------------------------------------------------------------------
+    /** Adds a zigzag encoded integer with 7 bits per byte, so small positive
+     *  and negative values only need one byte. */
+    void addVarInt(BareNetworkString* s, int32_t value)
+    {
+        uint32_t u = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        while (u >= 0x80)
+        {
+            s->addUInt8((uint8_t)(u | 0x80));
+            u >>= 7;
+        }
+        s->addUInt8((uint8_t)u);
+    }   // addVarInt
+
+    // ------------------------------------------------------------------------
+    int32_t getVarInt(const BareNetworkString& s)
+    {
+        uint32_t u = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            uint8_t b = s.getUInt8();
+            u |= (uint32_t)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+        }
+        throw std::out_of_range("Invalid variable length integer.");
+    }   // getVarInt
+
+}   // namespace
+
+// ----------------------------------------------------------------------------
+ReplayEvents::ReplayEvents()
+{
+    m_body_offset     = 0;
+    m_num_events      = 0;
+    m_cached_chunk[0] = -1;
+    m_cached_chunk[1] = -1;
+    m_next_slot       = 0;
+}   // ReplayEvents
+
+// ----------------------------------------------------------------------------
+/** Adds an event read from a text replay. */
+void ReplayEvents::add(const Event& event)
+{
+    assert(!m_file);
+    m_events.push_back(event);
+    m_num_events++;
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Uses the chunks of a binary replay file, which are checked with
+ *  checkChunks().
+ *  \param file The replay file.
+ *  \param body_offset Offset of the first chunk in the file.
+ *  \param chunks The chunks of this kart.
+ *  \param times The time of each event is added to it.
+ *  \return False if the chunks are invalid.
+ */
+bool ReplayEvents::setChunks(std::shared_ptr<const MappedFile> file,
+                             size_t body_offset,
+                             const std::vector<Chunk>& chunks,
+                             std::vector<float>* times)
+{
+    m_events.clear();
+    m_file.reset();
+    m_chunks.clear();
+    m_num_events  = 0;
+    m_cached_chunk[0] = m_cached_chunk[1] = -1;
+
+    if (body_offset > file->getSize() ||
+        !checkChunks((const uint8_t*)file->getData() + body_offset,
+                     file->getSize() - body_offset, chunks))
+        return false;
+
+    m_file        = file;
+    m_body_offset = body_offset;
+    m_chunks      = chunks;
+    for (unsigned i = 0; i < m_chunks.size(); i++)
+    {
+        decodeChunk(i, times, NULL);
+        m_num_events += m_chunks[i].m_num_events;
+    }
+    return true;
+}   // setChunks
+
+// ----------------------------------------------------------------------------
+/** Checks the chunks of one kart in a binary replay file: the number of
+ *  events of each chunk, that each chunk is inside the body of the file and
+ *  that all its events can be decoded.
+ *  \param body The body of the replay file.
+ *  \param body_size Size of the body.
+ *  \param chunks The chunks of the kart.
+ *  \return False if there is no chunk or a chunk is invalid.
+ */
+bool ReplayEvents::checkChunks(const uint8_t* body, size_t body_size,
+                               const std::vector<Chunk>& chunks)
+{
+    // A ghost kart needs at least one event
+    if (chunks.empty())
+        return false;
+
+    std::vector<Event> events;
+    for (unsigned i = 0; i < chunks.size(); i++)
+    {
+        const Chunk& c = chunks[i];
+        // get() finds the chunk of an event from its index
+        const bool valid = c.m_num_events > 0 &&
+            (i + 1 == chunks.size() ? c.m_num_events <= CHUNK_EVENTS
+                                    : c.m_num_events == CHUNK_EVENTS) &&
+            (uint64_t)c.m_offset + c.m_size <= body_size &&
+            decodeChunkData(body + c.m_offset, c.m_size, c.m_num_events,
+                            NULL, &events);
+        if (!valid)
+        {
+            Log::warn("ReplayEvents", "Invalid chunk %d.", i);
+            return false;
+        }
+    }
+    return true;
+}   // checkChunks
+
+// ----------------------------------------------------------------------------
+/** Returns an event, decoding its chunk if it's not one of the last two
+ *  chunks used.
+ */
+ReplayEvents::Event ReplayEvents::get(unsigned index) const
+{
+    assert(index < m_num_events);
+    if (!m_file)
+        return m_events[index];
+
+    const int chunk = index / CHUNK_EVENTS;
+    int slot = m_cached_chunk[0] == chunk ? 0 :
+               m_cached_chunk[1] == chunk ? 1 : -1;
+    if (slot == -1)
+    {
+        slot = m_next_slot;
+        if (!decodeChunk(chunk, NULL, &m_cache[slot]))
+        {
+            // The ghost kart stands still instead of crashing the game
+            Log::warn("ReplayEvents", "Invalid chunk %d.", chunk);
+            Event e = {};
+            e.m_transform.setIdentity();
+            m_cache[slot].assign(m_chunks[chunk].m_num_events, e);
+        }
+        m_cached_chunk[slot] = chunk;
+    }
+    // Searching backwards or forwards alternates between two chunks, so
+    // always replace the chunk which was not used last
+    m_next_slot = 1 - slot;
+    return m_cache[slot][index % CHUNK_EVENTS];
+}   // get
+
+// ----------------------------------------------------------------------------
+bool ReplayEvents::decodeChunk(unsigned chunk, std::vector<float>* times,
+                               std::vector<Event>* events) const
+{
+    const Chunk& c = m_chunks[chunk];
+    const uint8_t* data = (const uint8_t*)m_file->getData() + m_body_offset +
+        c.m_offset;
+    return decodeChunkData(data, c.m_size, c.m_num_events, times, events);
+}   // decodeChunk
+
+// ----------------------------------------------------------------------------
+/** Decodes a chunk.
+ *  \param data The encoded chunk.
+ *  \param size Size of the encoded chunk.
+ *  \param num_events Number of events in the chunk.
+ *  \param times If not NULL the times of all events are added to it.
+ *  \param events If not NULL it is set to all events of the chunk.
+ *  \return False if the chunk is invalid.
+ */
+bool ReplayEvents::decodeChunkData(const uint8_t* data, uint32_t size,
+                                   uint32_t num_events,
+                                   std::vector<float>* times,
+                                   std::vector<Event>* events)
+{
+    BareNetworkString s((const char*)data, (int)size);
+    try
+    {
+        int32_t ms = 0;
+        for (uint32_t i = 0; i < num_events; i++)
+        {
+            ms += getVarInt(s);
+            if (times)
+                times->push_back(ms / 1000.0f);
+        }
+        if (!events)
+            return true;
+
+        events->resize(num_events);
+        int32_t v[NUM_VALUES] = {};
+        for (uint32_t i = 0; i < num_events; i++)
+        {
+            for (int j = 0; j < NUM_VALUES; j++)
+                v[j] += getVarInt(s);
+            dequantizeEvent(v, s.getUInt32(), &(*events)[i]);
+        }
+    }
+    catch (std::exception& e)
+    {
+        return false;
+    }
+    return s.size() == 0;
+}   // decodeChunkData
+
+// ----------------------------------------------------------------------------
+/** Encodes events as a chunk.
+ *  \param times Time of each event.
+ *  \param events The events.
+ *  \param num_events Number of events.
+ *  \param out The chunk is added to it.
+ */
+void ReplayEvents::encodeChunk(const float* times, const Event* events,
+                               unsigned num_events, BareNetworkString* out)
+{
+    int32_t previous_ms = 0;
+    for (unsigned i = 0; i < num_events; i++)
+    {
+        const int32_t ms = quantize(times[i], 1000.0f);
+        addVarInt(out, ms - previous_ms);
+        previous_ms = ms;
+    }
+
+    int32_t previous[NUM_VALUES] = {};
+    for (unsigned i = 0; i < num_events; i++)
+    {
+        int32_t v[NUM_VALUES];
+        quantizeEvent(events[i], v);
+        for (int j = 0; j < NUM_VALUES; j++)
+        {
+            addVarInt(out, v[j] - previous[j]);
+            previous[j] = v[j];
+        }
+        out->addUInt32(MiniGLM::compressQuaternion(
+            events[i].m_transform.getRotation()));
+    }
+}   // encodeChunk
+
+// ----------------------------------------------------------------------------
+/** Checks that encoded events are decoded with the precision of the
+ *  quantization.
+ */
+void ReplayEvents::unitTesting()
+{
+    std::vector<float> times;
+    std::vector<Event> events;
+    for (int i = 0; i < 10; i++)
+    {
+        Event e = {};
+        e.m_transform.setOrigin(btVector3(100.0f - i * 3.7f, 0.5f * i,
+                                          -2000.0f + i * 1.234f));
+        e.m_transform.setRotation(btQuaternion(btVector3(0, 1, 0),
+                                               0.3f * i));
+        e.m_physic_info.m_speed = 20.0f + i;
+        e.m_physic_info.m_steer = -0.5f + 0.1f * i;
+        e.m_physic_info.m_suspension_length[2] = 0.123f;
+        e.m_bonus_info.m_item_type = i % 3;
+        e.m_bonus_info.m_special_value = -i;
+        e.m_kart_replay_event.m_distance = 1000.0f * i;
+        e.m_kart_replay_event.m_jumping = i % 2 == 0;
+        events.push_back(e);
+        times.push_back(i * 0.1f);
+    }
+
+    BareNetworkString s;
+    encodeChunk(times.data(), events.data(), (unsigned)events.size(), &s);
+    std::vector<float> decoded_times;
+    std::vector<Event> decoded_events;
+    bool valid = decodeChunkData((const uint8_t*)s.getData(),
+        s.getTotalSize(), (uint32_t)events.size(), &decoded_times,
+        &decoded_events);
+    (void)valid;
+    assert(valid);
+    assert(decoded_times.size() == times.size());
+    for (unsigned i = 0; i < events.size(); i++)
+    {
+        const Event& a = events[i];
+        const Event& b = decoded_events[i];
+        (void)a;
+        (void)b;
+        assert(fabsf(decoded_times[i] - times[i]) < 0.001f);
+        assert((a.m_transform.getOrigin() - b.m_transform.getOrigin())
+               .length() < 0.01f);
+        assert(a.m_transform.getRotation().angle(b.m_transform.getRotation())
+               < 0.01f);
+        assert(fabsf(a.m_physic_info.m_steer - b.m_physic_info.m_steer)
+               < 0.001f);
+        assert(b.m_physic_info.m_suspension_length[2] == 0.123f);
+        assert(b.m_bonus_info.m_item_type == a.m_bonus_info.m_item_type);
+        assert(b.m_bonus_info.m_special_value ==
+               a.m_bonus_info.m_special_value);
+        assert(b.m_kart_replay_event.m_distance ==
+               a.m_kart_replay_event.m_distance);
+        assert(b.m_kart_replay_event.m_jumping ==
+               a.m_kart_replay_event.m_jumping);
+    }
+
+    // A truncated chunk is invalid
+    assert(!decodeChunkData((const uint8_t*)s.getData(),
+        s.getTotalSize() - 1, (uint32_t)events.size(), NULL,
+        &decoded_events));
+
+    // The chunks of a kart are rejected if a chunk is outside the body or
+    // its number of events is wrong
+    std::vector<Chunk> chunks(1);
+    chunks[0].m_offset     = 0;
+    chunks[0].m_size       = s.getTotalSize();
+    chunks[0].m_num_events = (uint32_t)events.size();
+    assert(checkChunks((const uint8_t*)s.getData(), s.getTotalSize(),
+                       chunks));
+    assert(!checkChunks((const uint8_t*)s.getData(), s.getTotalSize() - 1,
+                        chunks));
+    chunks[0].m_num_events++;
+    assert(!checkChunks((const uint8_t*)s.getData(), s.getTotalSize(),
+                        chunks));
+    assert(!checkChunks((const uint8_t*)s.getData(), s.getTotalSize(),
+                        std::vector<Chunk>()));
+}   // unitTesting
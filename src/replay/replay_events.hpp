@@ -0,0 +1,128 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_REPLAY_EVENTS_HPP
+#define HEADER_REPLAY_EVENTS_HPP
+
+#include "replay/replay_base.hpp"
+#include "utils/no_copy.hpp"
+
+#include "LinearMath/btTransform.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class BareNetworkString;
+class MappedFile;
+
+/** The recorded events of one kart in a replay. Events read from a text
+ *  replay are stored as they are. A binary replay is split in chunks of
+ *  events, which are decoded when an event of the chunk is used, so only
+ *  the times of the events and a few decoded chunks are kept in memory.
+ *
+ *  In a chunk all times come first, so the times can be read without
+ *  decoding the rest of the chunk. Values are quantized to integers (e.g.
+ *  positions to cm), and each is stored as the difference to the value of
+ *  the previous event in the chunk as a variable length integer. Rotations
+ *  are compressed like in network states.
+ *  \ingroup replay
+ */
+class ReplayEvents : public NoCopy
+{
+public:
+    /** Everything recorded at one time. */
+    struct Event
+    {
+        btTransform                 m_transform;
+        ReplayBase::PhysicInfo      m_physic_info;
+        ReplayBase::BonusInfo       m_bonus_info;
+        ReplayBase::KartReplayEvent m_kart_replay_event;
+    };   // Event
+
+    /** Position of a chunk in a binary replay file. */
+    struct Chunk
+    {
+        /** Offset from the start of the body of the file. */
+        uint32_t m_offset;
+        uint32_t m_size;
+        uint32_t m_num_events;
+    };   // Chunk
+
+    /** Number of events of all but the last chunk of a kart. */
+    static const unsigned CHUNK_EVENTS = 256;
+
+private:
+    /** All events of a text replay. */
+    std::vector<Event> m_events;
+
+    /** The binary replay file, shared by all karts of the file. */
+    std::shared_ptr<const MappedFile> m_file;
+
+    /** Offset of the body in m_file. */
+    size_t m_body_offset;
+
+    std::vector<Chunk> m_chunks;
+
+    unsigned m_num_events;
+
+    /** Index of the chunk in each slot of the cache, -1 if unused. */
+    mutable int m_cached_chunk[2];
+
+    /** Decoded events of the cached chunks. */
+    mutable std::vector<Event> m_cache[2];
+
+    /** The slot to replace on the next cache miss. */
+    mutable int m_next_slot;
+
+    // ------------------------------------------------------------------------
+    static bool decodeChunkData(const uint8_t* data, uint32_t size,
+                                uint32_t num_events,
+                                std::vector<float>* times,
+                                std::vector<Event>* events);
+    // ------------------------------------------------------------------------
+    bool decodeChunk(unsigned chunk, std::vector<float>* times,
+                     std::vector<Event>* events) const;
+
+public:
+    ReplayEvents();
+    // ------------------------------------------------------------------------
+    void add(const Event& event);
+    // ------------------------------------------------------------------------
+    bool setChunks(std::shared_ptr<const MappedFile> file,
+                   size_t body_offset, const std::vector<Chunk>& chunks,
+                   std::vector<float>* times);
+    // ------------------------------------------------------------------------
+    static bool checkChunks(const uint8_t* body, size_t body_size,
+                            const std::vector<Chunk>& chunks);
+    // ------------------------------------------------------------------------
+    Event get(unsigned index) const;
+    // ------------------------------------------------------------------------
+    static void encodeChunk(const float* times, const Event* events,
+                            unsigned num_events, BareNetworkString* out);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    /** Returns the number of events. */
+    unsigned size() const                           { return m_num_events; }
+    // ------------------------------------------------------------------------
+    bool empty() const                         { return m_num_events == 0; }
+
+};   // class ReplayEvents
+
+#endif
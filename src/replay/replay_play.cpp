@@ -20,9 +20,11 @@
 
 #include "config/stk_config.hpp"
 #include "io/file_manager.hpp"
+#include "io/mapped_file.hpp"
 #include "karts/ghost_kart.hpp"
 #include "karts/controller/ghost_controller.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
@@ -31,6 +33,7 @@
 #include "utils/string_utils.hpp"
 
 #include <stdio.h>
+#include <stdexcept>
 #include <string>
 #include <cinttypes>
 
@@ -106,20 +109,85 @@ void ReplayPlay::loadAllReplayFile()
 //-----------------------------------------------------------------------------
 bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int call_index)
 {
-
-    char s[1024], s1[1024];
     if (StringUtils::getExtension(fn) != "replay") return false;
-    FILE* fd = FileUtils::fopenU8Path(custom_replay ? fn :
-        file_manager->getReplayDir() + fn, "r");
+    const std::string full_path = custom_replay ? fn :
+        file_manager->getReplayDir() + fn;
+    FILE* fd = FileUtils::fopenU8Path(full_path, "rb");
     if (fd == NULL) return false;
-    auto scoped = [&]() { fclose(fd); };
-    MemUtils::deref<decltype(scoped)> cls(scoped); 
     ReplayData rd;
 
     // custom_replay is true when full path of filename is given
     rd.m_custom_replay_file = custom_replay;
     rd.m_filename = fn;
 
+    // Binary replays are checked completely when they are listed, so that
+    // they are not rejected when the race starts
+    uint8_t prefix[BINARY_PREFIX_SIZE];
+    unsigned int version = 0;
+    uint32_t header_size = 0;
+    bool binary = fread(prefix, BINARY_PREFIX_SIZE, 1, fd) == 1 &&
+                  readBinaryPrefix(prefix, &version, &header_size);
+    bool valid;
+    if (binary)
+    {
+        fclose(fd);
+        MappedFile file;
+        std::vector<std::vector<ReplayEvents::Chunk> > chunks;
+        size_t body_offset = 0;
+        valid = file.open(full_path) &&
+                readBinaryFile(file, fn, &rd, &chunks, &body_offset);
+    }
+    else
+    {
+        fclose(fd);
+        fd = FileUtils::fopenU8Path(full_path, "r");
+        if (fd == NULL) return false;
+        valid = readTextHeader(fd, fn, call_index, &rd);
+        fclose(fd);
+    }
+    if (!valid)
+        return false;
+
+    // If former official tracks are present as addons, show the matching replays.
+    if (rd.m_track_name.compare("greenvalley") == 0)
+        rd.m_track_name = std::string("addon_green-valley");
+    if (rd.m_track_name.compare("mansion") == 0)
+        rd.m_track_name = std::string("addon_blackhill-mansion");
+
+    Track* t = track_manager->getTrack(rd.m_track_name);
+    if (t == NULL)
+    {
+        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
+        rd.m_track_name.c_str(), fn.c_str());
+        return false;
+    }
+
+    rd.m_track = t;
+
+    m_replay_file_list.push_back(rd);
+
+    assert(m_replay_file_list.size() > 0);
+    // Force to use custom replay file immediately
+    if (custom_replay)
+        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+
+    return true;
+
+}   // addReplayFile
+
+//-----------------------------------------------------------------------------
+/** Reads the header of a text replay file, i.e. of version 4 and older.
+ *  \param fd The replay file.
+ *  \param fn Name of the replay file.
+ *  \param call_index Used as UID of version 3 replays.
+ *  \param rd The replay data to fill.
+ *  \return False if the header is invalid.
+ */
+bool ReplayPlay::readTextHeader(FILE* fd, const std::string& fn,
+                                int call_index, ReplayData* rd)
+{
+    char s[1024], s1[1024];
+
     fgets(s, 1023, fd);
     unsigned int version;
     if (sscanf(s,"version: %u", &version) != 1)
@@ -134,14 +202,14 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
                   version, getMinSupportedReplayVersion(), fn.c_str());
         return false;
     }
-    else if (version > getCurrentReplayVersion())
+    else if (version >= getFirstBinaryReplayVersion())
     {
-        Log::warn("Replay", "Replay is version '%d', STK replay version is '%d', skipped '%s'",
-                  version, getCurrentReplayVersion(), fn.c_str());
+        Log::warn("Replay", "Replay is version '%d', but not a binary replay, skipped '%s'",
+                  version, fn.c_str());
         return false;
     }
 
-    rd.m_replay_version = version;
+    rd->m_replay_version = version;
 
     if (version >= 4)
     {
@@ -151,10 +219,10 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             Log::warn("Replay", "No STK release version found in replay file, '%s'.", fn.c_str());
             return false;
         }
-        rd.m_stk_version = s1;
+        rd->m_stk_version = s1;
     }
     else
-        rd.m_stk_version = "";
+        rd->m_stk_version = "";
 
     while(true)
     {
@@ -172,21 +240,21 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             break;
         }
 
-        rd.m_kart_list.push_back(std::string(s1));
+        rd->m_kart_list.push_back(std::string(s1));
         if (scanned == 2)
         {
             // If username of kart is present, use it
-            rd.m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
-            if (rd.m_name_list.size() == 1)
+            rd->m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
+            if (rd->m_name_list.size() == 1)
             {
                 // First user is the game master and the "owner" of this replay file
-                rd.m_user_name = rd.m_name_list[0];
+                rd->m_user_name = rd->m_name_list[0];
             }
         } else
         { // scanned == 1
             // If username is not present, kart display name will default to kart name
             // (see GhostController::getName)
-            rd.m_name_list.push_back("");
+            rd->m_name_list.push_back("");
         }
 
         // Read kart color data
@@ -199,10 +267,10 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
                 Log::warn("Replay", "Kart color missing in replay file, '%s'.", fn.c_str());
                 return false;
             }
-            rd.m_kart_color.push_back(f);
+            rd->m_kart_color.push_back(f);
         }
         else
-            rd.m_kart_color.push_back(0.0f); // Use default kart color
+            rd->m_kart_color.push_back(0.0f); // Use default kart color
     }
 
     int reverse = 0;
@@ -212,10 +280,10 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         Log::warn("Replay", "No reverse info found in replay file, '%s'.", fn.c_str());
         return false;
     }
-    rd.m_reverse = reverse != 0;
+    rd->m_reverse = reverse != 0;
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "difficulty: %u", &rd.m_difficulty) != 1)
+    if (sscanf(s, "difficulty: %u", &rd->m_difficulty) != 1)
     {
         Log::warn("Replay", " No difficulty found in replay file, '%s'.", fn.c_str());
         return false;
@@ -229,11 +297,11 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             Log::warn("Replay", "Replay mode not found in replay file, '%s'.", fn.c_str());
             return false;
         }
-        rd.m_minor_mode = s1;
+        rd->m_minor_mode = s1;
     }
     // Assume time-trial mode for old replays
     else
-        rd.m_minor_mode = "time-trial";
+        rd->m_minor_mode = "time-trial";
 
     // sscanf always stops at whitespaces, but a track name may contain a whitespace
     // Official tracks should avoid whitespaces in their name, but it
@@ -253,7 +321,7 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
 
         if (i >= 8)
         {
-            rd.m_track_name = std::string(s1);
+            rd->m_track_name = std::string(s1);
         }
         else
         {
@@ -267,31 +335,15 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         return false;
     }
 
-    // If former official tracks are present as addons, show the matching replays.
-    if (rd.m_track_name.compare("greenvalley") == 0)
-        rd.m_track_name = std::string("addon_green-valley");
-    if (rd.m_track_name.compare("mansion") == 0)
-        rd.m_track_name = std::string("addon_blackhill-mansion");
-
-    Track* t = track_manager->getTrack(rd.m_track_name);
-    if (t == NULL)
-    {
-        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
-        rd.m_track_name.c_str(), fn.c_str());
-        return false;
-    }
-
-    rd.m_track = t;
-
     fgets(s, 1023, fd);
-    if (sscanf(s, "laps: %u", &rd.m_laps) != 1)
+    if (sscanf(s, "laps: %u", &rd->m_laps) != 1)
     {
         Log::warn("Replay", "No number of laps found in replay file, '%s'.", fn.c_str());
         return false;
     }
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "min_time: %f", &rd.m_min_time) != 1)
+    if (sscanf(s, "min_time: %f", &rd->m_min_time) != 1)
     {
         Log::warn("Replay", "Finish time not found in replay file, '%s'.", fn.c_str());
         return false;
@@ -300,7 +352,7 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     if (version >= 4)
     {
         fgets(s, 1023, fd);
-        if (sscanf(s, "replay_uid: %" PRIu64, &rd.m_replay_uid) != 1)
+        if (sscanf(s, "replay_uid: %" PRIu64, &rd->m_replay_uid) != 1)
         {
             Log::warn("Replay", "Replay UID not found in replay file, '%s'.", fn.c_str());
             return false;
@@ -308,40 +360,174 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     }
     // No UID in old replay format
     else
-        rd.m_replay_uid = call_index;
+        rd->m_replay_uid = call_index;
 
-    m_replay_file_list.push_back(rd);
+    return true;
+}   // readTextHeader
 
-    assert(m_replay_file_list.size() > 0);
-    // Force to use custom replay file immediately
-    if (custom_replay)
-        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+//-----------------------------------------------------------------------------
+/** Reads the header of a binary replay file.
+ *  \param fn Name of the replay file.
+ *  \param version Version of the replay file.
+ *  \param data The header, which follows the binary prefix.
+ *  \param size Size of the header.
+ *  \param rd The replay data to fill.
+ *  \param chunks If not NULL it is set to the chunks of each kart.
+ *  \return False if the header is invalid.
+ */
+bool ReplayPlay::readBinaryHeader(const std::string& fn, unsigned int version,
+                                  const uint8_t* data, uint32_t size,
+                                  ReplayData* rd,
+                                  std::vector<std::vector<ReplayEvents::Chunk> >* chunks)
+{
+    if (version < getFirstBinaryReplayVersion() ||
+        version > getCurrentReplayVersion())
+    {
+        Log::warn("Replay", "Replay is version '%d', STK replay version is '%d', skipped '%s'",
+                  version, getCurrentReplayVersion(), fn.c_str());
+        return false;
+    }
+    rd->m_replay_version = version;
+
+    BareNetworkString s((const char*)data, (int)size);
+    try
+    {
+        std::string stk_version;
+        s.decodeString(&stk_version);
+        rd->m_stk_version = stk_version.c_str();
 
+        const unsigned int num_karts = s.getUInt8();
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            std::string ident;
+            core::stringw name;
+            s.decodeString(&ident);
+            s.decodeStringW(&name);
+            rd->m_kart_list.push_back(ident);
+            rd->m_name_list.push_back(name);
+            rd->m_kart_color.push_back(s.getFloat());
+        }
+        // First user is the game master and the "owner" of this replay file
+        if (num_karts > 0)
+            rd->m_user_name = rd->m_name_list[0];
+
+        rd->m_reverse    = s.getUInt8() != 0;
+        rd->m_difficulty = s.getUInt8();
+        s.decodeString(&rd->m_minor_mode);
+        s.decodeString(&rd->m_track_name);
+        rd->m_laps       = s.getUInt32();
+        rd->m_min_time   = s.getFloat();
+        rd->m_replay_uid = s.getUInt64();
+
+        // The index of the chunks is only needed to load the events
+        if (!chunks)
+            return !rd->m_track_name.empty();
+
+        chunks->resize(num_karts);
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            const uint32_t num_chunks = s.getUInt32();
+            // Each chunk needs 10 bytes of the index
+            if (num_chunks > s.size() / 10)
+                throw std::out_of_range("Invalid number of chunks.");
+            (*chunks)[i].resize(num_chunks);
+            for (ReplayEvents::Chunk& c : (*chunks)[i])
+            {
+                c.m_offset     = s.getUInt32();
+                c.m_size       = s.getUInt32();
+                c.m_num_events = s.getUInt16();
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("Replay", "Invalid header in replay file, '%s'.",
+                  fn.c_str());
+        return false;
+    }
     return true;
+}   // readBinaryHeader
 
-}   // addReplayFile
+//-----------------------------------------------------------------------------
+/** Reads and checks the header and all chunks of a binary replay file.
+ *  \param file The replay file.
+ *  \param fn Name of the replay file.
+ *  \param rd The replay data to fill.
+ *  \param chunks The chunks of each kart are stored here.
+ *  \param body_offset The offset of the first chunk is stored here.
+ *  \return False if the file is invalid.
+ */
+bool ReplayPlay::readBinaryFile(const MappedFile& file, const std::string& fn,
+                               ReplayData* rd,
+                               std::vector<std::vector<ReplayEvents::Chunk> >*
+                                   chunks,
+                               size_t* body_offset)
+{
+    const uint8_t* data = (const uint8_t*)file.getData();
+    unsigned int version = 0;
+    uint32_t header_size = 0;
+    if (!data || file.getSize() < BINARY_PREFIX_SIZE ||
+        !readBinaryPrefix(data, &version, &header_size) ||
+        header_size == 0 ||
+        header_size > file.getSize() - BINARY_PREFIX_SIZE ||
+        !readBinaryHeader(fn, version, data + BINARY_PREFIX_SIZE, header_size,
+                          rd, chunks) ||
+        chunks->size() != rd->m_kart_list.size())
+        return false;
+
+    *body_offset = BINARY_PREFIX_SIZE + header_size;
+    for (unsigned int i = 0; i < chunks->size(); i++)
+    {
+        if (!ReplayEvents::checkChunks(data + *body_offset,
+                                       file.getSize() - *body_offset,
+                                       (*chunks)[i]))
+        {
+            Log::warn("Replay", "Invalid data of kart %d in '%s'.", i,
+                      fn.c_str());
+            return false;
+        }
+    }
+    return true;
+}   // readBinaryFile
 
 //-----------------------------------------------------------------------------
-void ReplayPlay::load()
+/** Creates the ghost karts of the selected replay files.
+ *  \return False if a replay file can't be read anymore, in which case there
+ *          are no ghost karts.
+ */
+bool ReplayPlay::load()
 {
     m_ghost_karts.clear();
 
+    bool loaded = true;
     if (m_second_replay_enabled)
-        loadFile(/* second replay */ true);
+        loaded = loadFile(/* second replay */ true);
 
     // Always load the first replay
-    loadFile(/* second replay */ false);
-    
+    loaded = loaded && loadFile(/* second replay */ false);
+    if (!loaded)
+        m_ghost_karts.clear();
+    return loaded;
 } // load
 
 //-----------------------------------------------------------------------------
-void ReplayPlay::loadFile(bool second_replay)
+/** Creates the ghost karts of a replay file.
+ *  \param second_replay True to load the second replay file.
+ *  \return False if the file can't be read.
+ */
+bool ReplayPlay::loadFile(bool second_replay)
 {
     char s[1024];
 
     int replay_index = second_replay ? m_second_replay_file : m_current_replay_file;
     int replay_file_number = second_replay ? 2 : 1;
 
+    if (m_replay_file_list.at(replay_index).m_replay_version >=
+        getFirstBinaryReplayVersion())
+    {
+        return loadBinaryFile(second_replay);
+    }
+
     FILE *fd = openReplayFile(/*writeable*/false,
             m_replay_file_list.at(replay_index).m_custom_replay_file, replay_file_number);
 
@@ -349,8 +535,7 @@ void ReplayPlay::loadFile(bool second_replay)
     {
         Log::error("Replay", "Can't read '%s', ghost replay disabled.",
                     getReplayFilename(replay_file_number).c_str());
-        destroy();
-        return;
+        return false;
     }
 
     Log::info("Replay", "Reading replay file '%s'.",
@@ -375,16 +560,61 @@ void ReplayPlay::loadFile(bool second_replay)
     }
 
     fclose(fd);
+    return true;
 }   // loadFile
 
 //-----------------------------------------------------------------------------
-/** Reads all data from a replay file for a specific kart.
- *  \param fd The file descriptor from which to read.
+/** Creates the ghost karts of a binary replay file. The file is mapped, and
+ *  only the times of the events are read. The other data of the events is
+ *  decoded by the ghost karts when it is used.
+ *  \param second_replay True to load the second replay file.
+ *  \return False if the file can't be read or was changed since it was
+ *          listed.
  */
-void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+bool ReplayPlay::loadBinaryFile(bool second_replay)
 {
-    char s[1024];
+    int replay_index = second_replay ? m_second_replay_file : m_current_replay_file;
+    int replay_file_number = second_replay ? 2 : 1;
+    const ReplayData &rd = m_replay_file_list[replay_index];
+
+    const std::string& fn = getReplayFilename(replay_file_number);
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    ReplayData header;
+    std::vector<std::vector<ReplayEvents::Chunk> > chunks;
+    size_t body_offset = 0;
+    if (!file->open(rd.m_custom_replay_file ? fn
+                                            : file_manager->getReplayDir() + fn)
+        || !readBinaryFile(*file, fn, &header, &chunks, &body_offset) ||
+        chunks.size() != rd.m_kart_list.size())
+    {
+        Log::error("Replay", "Can't read '%s', ghost replay disabled.",
+                    fn.c_str());
+        return false;
+    }
+
+    Log::info("Replay", "Reading replay file '%s'.", fn.c_str());
+
+    for (unsigned int i = 0; i < chunks.size(); i++)
+    {
+        std::shared_ptr<GhostKart> ghost = createGhostKart(second_replay);
+        if (!ghost->loadReplayChunks(file, body_offset, chunks[i]))
+        {
+            // Not possible after readBinaryFile(), but a ghost kart without
+            // events can't be used
+            Log::error("Replay", "Invalid data of kart %d in '%s', ghost "
+                       "replay disabled.", i, fn.c_str());
+            return false;
+        }
+    }
+    return true;
+}   // loadBinaryFile
 
+//-----------------------------------------------------------------------------
+/** Creates the next ghost kart of a replay file with its controller.
+ *  \param second_replay True if the kart is from the second replay file.
+ */
+std::shared_ptr<GhostKart> ReplayPlay::createGhostKart(bool second_replay)
+{
     int replay_index = second_replay ? m_second_replay_file
                                      : m_current_replay_file;
 
@@ -403,6 +633,23 @@ void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
     Controller* controller = new GhostController(getGhostKart(kart_num).get(),
                                                  rd.m_name_list[kart_num-first_loaded_f_num]);
     getGhostKart(kart_num)->setController(controller);
+    return m_ghost_karts[kart_num];
+}   // createGhostKart
+
+//-----------------------------------------------------------------------------
+/** Reads all data from a replay file for a specific kart.
+ *  \param fd The file descriptor from which to read.
+ */
+void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+{
+    char s[1024];
+
+    int replay_index = second_replay ? m_second_replay_file
+                                     : m_current_replay_file;
+
+    const unsigned int kart_num = (unsigned int)m_ghost_karts.size();
+    ReplayData &rd = m_replay_file_list[replay_index];
+    createGhostKart(second_replay);
 
     unsigned int size;
     if(sscanf(next_line,"size: %u",&size)!=1)
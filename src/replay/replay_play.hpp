@@ -20,6 +20,7 @@
 #define HEADER_REPLAY__PLAY_HPP
 
 #include "replay/replay_base.hpp"
+#include "replay/replay_events.hpp"
 #include "tracks/track.hpp"
 
 #include "irrString.h"
@@ -31,6 +32,7 @@
 using namespace irr;
 
 class GhostKart;
+class MappedFile;
 
 /**
   * \ingroup replay
@@ -125,10 +127,22 @@ private:
           ReplayPlay();
          ~ReplayPlay();
     void  readKartData(FILE *fd, char *next_line, bool second_replay);
+    bool  readTextHeader(FILE* fd, const std::string& fn, int call_index,
+                         ReplayData* rd);
+    bool  readBinaryHeader(const std::string& fn, unsigned int version,
+                           const uint8_t* data, uint32_t size,
+                           ReplayData* rd,
+                           std::vector<std::vector<ReplayEvents::Chunk> >* chunks);
+    bool  readBinaryFile(const MappedFile& file, const std::string& fn,
+                         ReplayData* rd,
+                         std::vector<std::vector<ReplayEvents::Chunk> >* chunks,
+                         size_t* body_offset);
+    bool  loadBinaryFile(bool second_replay);
+    std::shared_ptr<GhostKart> createGhostKart(bool second_replay);
 public:
     void  reset();
-    void  load();
-    void  loadFile(bool second_replay);
+    bool  load();
+    bool  loadFile(bool second_replay);
     void  loadAllReplayFile();
     // ------------------------------------------------------------------------
     static void        setSortOrder(SortOrder so)       { m_sort_order = so; }
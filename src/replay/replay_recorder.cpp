@@ -31,8 +31,10 @@
 #include "modes/easter_egg_hunt.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/world.hpp"
+#include "network/network_string.hpp"
 #include "physics/btKart.hpp"
 #include "race/race_manager.hpp"
+#include "replay/replay_events.hpp"
 #include "tracks/track.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/translation.hpp"
@@ -383,7 +385,8 @@ void ReplayRecorder::save()
         << "_" << num_karts << "_" << time << ".replay";
     m_filename = oss.str();
 
-    FILE *fd = openReplayFile(/*writeable*/true);
+    FILE *fd = openReplayFile(/*writeable*/true, /*full_path*/false,
+                              /*replay_file_number*/1, /*binary*/true);
     if (!fd)
     {
         Log::error("ReplayRecorder", "Can't open '%s' for writing - "
@@ -395,26 +398,31 @@ void ReplayRecorder::save()
         StringUtils::utf8ToWide(file_manager->getReplayDir() + getReplayFilename()));
     MessageQueue::add(MessageQueue::MT_GENERIC, msg);
 
-    fprintf(fd, "version: %d\n", getCurrentReplayVersion());
-    fprintf(fd, "stk_version: %s\n", STK_VERSION);
+    BareNetworkString header;
+    header.encodeString(std::string(STK_VERSION));
 
-    unsigned int player_count = 0;
-    for (unsigned int real_karts = 0; real_karts < num_karts; real_karts++)
+    std::vector<unsigned int> recorded_karts;
+    for (unsigned int k = 0; k < num_karts; k++)
     {
-        const AbstractKart *kart = world->getKart(real_karts);
-        if (kart->isGhostKart()) continue;
-
-        // XML encode the username to handle Unicode
-        fprintf(fd, "kart: %s %s\n", kart->getIdent().c_str(),
-                StringUtils::xmlEncode(kart->getController()->getName()).c_str());
+        if (!world->getKart(k)->isGhostKart())
+            recorded_karts.push_back(k);
+    }
+    header.addUInt8((uint8_t)recorded_karts.size());
 
+    unsigned int player_count = 0;
+    for (unsigned int k : recorded_karts)
+    {
+        const AbstractKart *kart = world->getKart(k);
+        float kart_color = 0.0f;
         if (kart->getController()->isPlayerController())
         {
-            fprintf(fd, "kart_color: %f\n", StateManager::get()->getActivePlayer(player_count)->getConstProfile()->getDefaultKartColor());
+            kart_color = StateManager::get()->getActivePlayer(player_count)
+                ->getConstProfile()->getDefaultKartColor();
             player_count++;
         }
-        else
-            fprintf(fd, "kart_color: 0\n");
+        header.encodeString(kart->getIdent())
+              .encodeString(kart->getController()->getName())
+              .addFloat(kart_color);
     }
 
     m_last_uid = computeUID(min_time);
@@ -422,60 +430,54 @@ void ReplayRecorder::save()
     int num_laps = RaceManager::get()->getNumLaps();
     if (num_laps == 9999) num_laps = 0; // no lap in that race mode
 
-    fprintf(fd, "kart_list_end\n");
-    fprintf(fd, "reverse: %d\n",    (int)RaceManager::get()->getReverseTrack());
-    fprintf(fd, "difficulty: %d\n", RaceManager::get()->getDifficulty());
-    fprintf(fd, "mode: %s\n",       RaceManager::get()->getMinorModeName().c_str());
-    fprintf(fd, "track: %s\n",      Track::getCurrentTrack()->getIdent().c_str());
-    fprintf(fd, "laps: %d\n",       num_laps);
-    fprintf(fd, "min_time: %f\n",   min_time);
-    fprintf(fd, "replay_uid: %" PRIu64 "\n", m_last_uid);
-
-    for (unsigned int k = 0; k < num_karts; k++)
+    header.addUInt8(RaceManager::get()->getReverseTrack() ? 1 : 0)
+          .addUInt8((uint8_t)RaceManager::get()->getDifficulty())
+          .encodeString(RaceManager::get()->getMinorModeName())
+          .encodeString(Track::getCurrentTrack()->getIdent())
+          .addUInt32(num_laps).addFloat(min_time).addUInt64(m_last_uid);
+
+    // The events are encoded first, since the header ends with the index
+    // of the chunks
+    BareNetworkString body;
+    std::vector<float> times;
+    std::vector<ReplayEvents::Event> events;
+    for (unsigned int k : recorded_karts)
     {
-        if (world->getKart(k)->isGhostKart()) continue;
-
         const unsigned int num_transforms = std::min(m_max_frames,
                                                      m_count_transforms[k]);
-
-        fprintf(fd, "size:     %d\n", num_transforms);
-
+        times.resize(num_transforms);
+        events.resize(num_transforms);
         for (unsigned int i = 0; i < num_transforms; i++)
         {
-            const TransformEvent *p  = &(m_transform_events[k][i]);
-            const PhysicInfo *q      = &(m_physic_info[k][i]);
-            const BonusInfo *b      = &(m_bonus_info[k][i]);
-            const KartReplayEvent *r = &(m_kart_replay_event[k][i]);
-            fprintf(fd, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                    p->m_time,
-                    p->m_transform.getOrigin().getX(),
-                    p->m_transform.getOrigin().getY(),
-                    p->m_transform.getOrigin().getZ(),
-                    p->m_transform.getRotation().getX(),
-                    p->m_transform.getRotation().getY(),
-                    p->m_transform.getRotation().getZ(),
-                    p->m_transform.getRotation().getW(),
-                    q->m_speed,
-                    q->m_steer,
-                    q->m_suspension_length[0],
-                    q->m_suspension_length[1],
-                    q->m_suspension_length[2],
-                    q->m_suspension_length[3],
-                    q->m_skidding_state,
-                    b->m_attachment,
-                    b->m_nitro_amount,
-                    b->m_item_amount,
-                    b->m_item_type,
-                    b->m_special_value,
-                    r->m_distance,
-                    r->m_nitro_usage,
-                    (int)r->m_zipper_usage,
-                    r->m_skidding_effect,
-                    (int)r->m_red_skidding,
-                    (int)r->m_jumping
-                );
-        }   // for i
+            times[i] = m_transform_events[k][i].m_time;
+            ReplayEvents::Event& e = events[i];
+            e.m_transform         = m_transform_events[k][i].m_transform;
+            e.m_physic_info       = m_physic_info[k][i];
+            e.m_bonus_info        = m_bonus_info[k][i];
+            e.m_kart_replay_event = m_kart_replay_event[k][i];
+        }
+
+        const unsigned int chunk_events = ReplayEvents::CHUNK_EVENTS;
+        const unsigned int num_chunks =
+            (num_transforms + chunk_events - 1) / chunk_events;
+        header.addUInt32(num_chunks);
+        for (unsigned int c = 0; c < num_chunks; c++)
+        {
+            const unsigned int first = c * chunk_events;
+            const unsigned int n = std::min(chunk_events,
+                                            num_transforms - first);
+            const uint32_t offset = body.getTotalSize();
+            ReplayEvents::encodeChunk(&times[first], &events[first], n,
+                                      &body);
+            header.addUInt32(offset).addUInt32(body.getTotalSize() - offset)
+                  .addUInt16((uint16_t)n);
+        }
     }
+
+    writeBinaryPrefix(header.getTotalSize(), fd);
+    fwrite(header.getData(), header.getTotalSize(), 1, fd);
+    if (body.getTotalSize() > 0)
+        fwrite(body.getData(), body.getTotalSize(), 1, fd);
     fclose(fd);
 }   // save
 
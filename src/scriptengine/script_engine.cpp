@@ -23,6 +23,7 @@ extern "C"
 #include <assert.h>
 #include <angelscript.h>
 #include "io/file_manager.hpp"
+#include "io/mapped_file.hpp"
 #include "karts/kart.hpp"
 #include "modes/world.hpp"
 #include "scriptengine/aswrappedcall.hpp"
@@ -37,11 +38,13 @@ extern "C"
 #include "scriptengine/scriptstdstring.hpp"
 #include "scriptengine/scriptvec3.hpp"
 #include "scriptengine/scriptarray.hpp"
+#include <stdio.h>
 #include <string.h>
 #include "states_screens/dialogs/tutorial_message_dialog.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "tracks/track.hpp"
 #include "utils/file_utils.hpp"
+#include "utils/fnv_hash.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/profiler.hpp"
 
@@ -63,6 +66,101 @@ namespace Scripting
         Log::warn("Scripting", "%s (%d, %d) : %s : %s\n", msg->section, msg->row, msg->col, type, msg->message);
     }
 
+    /** A stream in memory from which the bytecode of a module is loaded, or
+     *  to which it is saved. */
+    class ByteCodeStream : public asIBinaryStream
+    {
+    private:
+        const char *m_data;
+        size_t      m_size;
+        size_t      m_position;
+        std::string m_buffer;
+
+        bool read(void *ptr, asUINT size)
+        {
+            if (size > m_size - m_position)
+            {
+                memset(ptr, 0, size);
+                m_position = m_size;
+                return false;
+            }
+            memcpy(ptr, m_data + m_position, size);
+            m_position += size;
+            return true;
+        }   // read
+
+    public:
+        ByteCodeStream(const void *data = NULL, size_t size = 0)
+        {
+            m_data     = (const char*)data;
+            m_size     = size;
+            m_position = 0;
+        }   // ByteCodeStream
+        // --------------------------------------------------------------------
+        /** Returns the data written to this stream. */
+        const std::string& getBuffer() const { return m_buffer; }
+#if ANGELSCRIPT_VERSION >= 23500
+        // --------------------------------------------------------------------
+        virtual int Read(void *ptr, asUINT size)
+        {
+            return read(ptr, size) ? 0 : -1;
+        }   // Read
+        // --------------------------------------------------------------------
+        virtual int Write(const void *ptr, asUINT size)
+        {
+            m_buffer.append((const char*)ptr, size);
+            return 0;
+        }   // Write
+#else
+        // --------------------------------------------------------------------
+        virtual void Read(void *ptr, asUINT size) { read(ptr, size); }
+        // --------------------------------------------------------------------
+        virtual void Write(const void *ptr, asUINT size)
+        {
+            m_buffer.append((const char*)ptr, size);
+        }   // Write
+#endif
+    };   // ByteCodeStream
+
+    /** Header of a cached bytecode file, followed by the bytecode. */
+    struct ByteCodeHeader
+    {
+        char     m_magic[8];
+        uint64_t m_size;
+        uint64_t m_hash;
+    };   // ByteCodeHeader
+
+    const char BYTECODE_MAGIC[8] = "STKASBC";
+
+    /** Returns the hash of bytecode, which detects damaged cache files. */
+    uint64_t getByteCodeHash(const void *data, size_t size)
+    {
+        FNVHash hash;
+        hash.add(data, size);
+        return hash.get();
+    }   // getByteCodeHash
+
+    /** Returns the name of the cache file for the bytecode of scripts. The
+     *  name is a hash of the preprocessed scripts, and of the versions of
+     *  STK and AngelScript, since the bytecode refers to the registered
+     *  application functions.
+     *  \param sections The preprocessed scripts.
+     */
+    std::string getByteCodeFilename(const std::vector<std::string>& sections)
+    {
+        FNVHash hash;
+        hash.add(STK_VERSION);
+        hash.add(ANGELSCRIPT_VERSION_STRING);
+        hash.add((uint32_t)sizeof(void*));
+        for (const std::string& section : sections)
+            hash.add(section);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.asbc",
+                 (unsigned long long)hash.get());
+        return name;
+    }   // getByteCodeFilename
+
 
     //Constructor, creates a new Scripting Engine using AngelScript
     ScriptEngine::ScriptEngine()
@@ -86,6 +184,9 @@ namespace Scripting
     {
         // Release the engine
         m_pending_timeouts.clearAndDeleteAll();
+        for (asIScriptContext *ctx : m_context_pool)
+            ctx->Release();
+        m_context_pool.clear();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
         m_engine->Release();
     }
@@ -172,6 +273,50 @@ namespace Scripting
         return result;
     }
 
+    //-----------------------------------------------------------------------------
+    /** Returns a context which is not in use, which is reused from previous
+     *  calls if possible. Script functions which call back into the engine
+     *  get a different context, since the active context is not returned
+     *  before the function finished.
+     *  \return The context, or NULL if it could not be created.
+     */
+    asIScriptContext* ScriptEngine::requestContext()
+    {
+        if (!m_context_pool.empty())
+        {
+            asIScriptContext *ctx = m_context_pool.back();
+            m_context_pool.pop_back();
+            return ctx;
+        }
+        PROFILER_ADD_TO_COUNTER("Script contexts created", 1);
+        return m_engine->CreateContext();
+    }   // requestContext
+
+    //-----------------------------------------------------------------------------
+    /** Returns a context from requestContext() to the pool after the
+     *  function executed in it finished.
+     */
+    void ScriptEngine::returnContext(asIScriptContext *ctx)
+    {
+        // Releases the references to the function and its arguments
+        ctx->Unprepare();
+        m_context_pool.push_back(ctx);
+    }   // returnContext
+
+    //-----------------------------------------------------------------------------
+    /** Executes the function prepared in a context, and measures the time
+     *  in the profiler.
+     *  \return The result of asIScriptContext::Execute().
+     */
+    int ScriptEngine::executeContext(asIScriptContext *ctx)
+    {
+        PROFILER_PUSH_CPU_MARKER("Script callback", 0x80, 0x00, 0x80);
+        PROFILER_ADD_TO_COUNTER("Script callbacks", 1);
+        int r = ctx->Execute();
+        PROFILER_POP_CPU_MARKER();
+        return r;
+    }   // executeContext
+
     //-----------------------------------------------------------------------------
 
     void ScriptEngine::evalScript(std::string script_fragment)
@@ -188,7 +333,7 @@ namespace Scripting
             return;
         }
 
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = requestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "evalScript: Failed to create the context.");
@@ -200,12 +345,13 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "evalScript: Failed to prepare the context.");
-            ctx->Release();
+            returnContext(ctx);
+            func->Release();
             return;
         }
 
         // Execute the function
-        r = ctx->Execute();
+        r = executeContext(ctx);
         if (r != asEXECUTION_FINISHED)
         {
             // The execution didn't finish as we had planned. Determine why.
@@ -223,7 +369,7 @@ namespace Scripting
             }
         }
 
-        ctx->Release();
+        returnContext(ctx);
         func->Release();
     }
 
@@ -231,7 +377,7 @@ namespace Scripting
 
     void ScriptEngine::runDelegate(asIScriptFunction* delegate)
     {
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = requestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "runMethod: Failed to create the context.");
@@ -243,12 +389,12 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "runMethod: Failed to prepare the context.");
-            ctx->Release();
+            returnContext(ctx);
             return;
         }
 
         // Execute the function
-        r = ctx->Execute();
+        r = executeContext(ctx);
         if (r != asEXECUTION_FINISHED)
         {
             // The execution didn't finish as we had planned. Determine why.
@@ -268,7 +414,7 @@ namespace Scripting
             }
         }
 
-        ctx->Release();
+        returnContext(ctx);
     }
 
     //-----------------------------------------------------------------------------
@@ -406,8 +552,8 @@ namespace Scripting
             return; // function unavailable
         }
 
-        // Create a context that will execute the script.
-        asIScriptContext *ctx = m_engine->CreateContext();
+        // Get a context that will execute the script.
+        asIScriptContext *ctx = requestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "Failed to create the context.");
@@ -424,7 +570,7 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "Failed to prepare the context.");
-            ctx->Release();
+            returnContext(ctx);
             //m_engine->Release();
             return;
         }
@@ -437,7 +583,7 @@ namespace Scripting
             callback(ctx);
 
         // Execute the function
-        r = ctx->Execute();
+        r = executeContext(ctx);
         if (r != asEXECUTION_FINISHED)
         {
             // The execution didn't finish as we had planned. Determine why.
@@ -472,8 +618,8 @@ namespace Scripting
                 get_return_value(ctx);
         }
 
-        // We must release the contexts when no longer using them
-        ctx->Release();
+        // The context can be reused once the function finished
+        returnContext(ctx);
     }
 
     //-----------------------------------------------------------------------------
@@ -486,6 +632,7 @@ namespace Scripting
                 curr.second->Release();
         }
         m_functions_cache.clear();
+        m_script_sections.clear();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
     }
 
@@ -522,8 +669,6 @@ namespace Scripting
 
     bool ScriptEngine::loadScript(std::string script_path, bool clear_previous)
     {
-        int r;
-
         std::string script = getScript(script_path);
         if (script.size() == 0)
         {
@@ -531,29 +676,143 @@ namespace Scripting
             return false;
         }
 
-        // Add the script sections that will be compiled into executable code.
-        // If we want to combine more than one file into the same script, then 
-        // we can call AddScriptSection() several times for the same module and
-        // the script engine will treat them all as if they were one. The script
-        // section name, will allow us to localize any errors in the script code.
-        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
-            clear_previous ? asGM_ALWAYS_CREATE : asGM_CREATE_IF_NOT_EXISTS);
-        r = mod->AddScriptSection("script", &script[0], script.size());
-        if (r < 0)
+        if (clear_previous)
         {
-            Log::error("Scripting", "AddScriptSection() failed");
-            return false;
+            m_script_sections.clear();
+            m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE, asGM_ALWAYS_CREATE);
         }
-    
+
+        // The scripts are only added to the module in compileLoadedScripts(),
+        // since they are not needed if the bytecode is in the cache.
+        m_script_sections.push_back(script);
         return true;
     }
 
     //-----------------------------------------------------------------------------
 
+    /** Loads the bytecode of a module from the cache.
+    *  \param mod The module, which must be empty.
+    *  \param filename Name of the cache file.
+    *  \return True if the bytecode was loaded.
+    */
+    bool ScriptEngine::loadByteCode(asIScriptModule *mod,
+                                    const std::string &filename)
+    {
+        MappedFile file;
+        if (!file.open(filename))
+            return false;
+
+        // AngelScript doesn't validate the bytecode, so a truncated or
+        // damaged file could crash it
+        ByteCodeHeader header;
+        if (file.getSize() < sizeof(header))
+            return false;
+        memcpy(&header, file.getData(), sizeof(header));
+        const char *data = (const char*)file.getData() + sizeof(header);
+        if (memcmp(header.m_magic, BYTECODE_MAGIC,
+                   sizeof(BYTECODE_MAGIC)) != 0 ||
+            header.m_size != file.getSize() - sizeof(header) ||
+            header.m_hash != getByteCodeHash(data, (size_t)header.m_size))
+        {
+            Log::warn("Scripting", "Cached bytecode '%s' is damaged.",
+                      filename.c_str());
+            return false;
+        }
+
+        ByteCodeStream stream(data, (size_t)header.m_size);
+        if (mod->LoadByteCode(&stream) < 0)
+        {
+            Log::warn("Scripting", "Cached bytecode '%s' can't be loaded.",
+                      filename.c_str());
+            return false;
+        }
+        return true;
+    }   // loadByteCode
+
+    //-----------------------------------------------------------------------------
+    /** Saves the bytecode of a compiled module to the cache.
+    *  \param mod The module.
+    *  \param filename Name of the cache file.
+    */
+    void ScriptEngine::saveByteCode(asIScriptModule *mod,
+                                    const std::string &filename) const
+    {
+        ByteCodeStream stream;
+        if (mod->SaveByteCode(&stream) < 0)
+            return;
+
+        const std::string& buffer = stream.getBuffer();
+        ByteCodeHeader header;
+        memcpy(header.m_magic, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC));
+        header.m_size = buffer.size();
+        header.m_hash = getByteCodeHash(buffer.data(), buffer.size());
+        bool written = FileUtils::writeFileAtomically(filename,
+            [&header, &buffer](FILE* f)
+            {
+                return fwrite(&header, sizeof(header), 1, f) == 1 &&
+                    fwrite(buffer.data(), 1, buffer.size(), f) ==
+                    buffer.size();
+            });
+        if (!written)
+        {
+            Log::warn("Scripting", "Can't write bytecode cache '%s'.",
+                      filename.c_str());
+        }
+    }   // saveByteCode
+
+    //-----------------------------------------------------------------------------
+    /** Compiles the scripts loaded with loadScript() into the main module,
+    *  or loads their bytecode from the cache if the same scripts were
+    *  compiled before.
+    */
     bool ScriptEngine::compileLoadedScripts()
     {
         int r;
-        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE, asGM_CREATE_IF_NOT_EXISTS);
+        asIScriptModule *mod;
+        std::string cache_file;
+        if (!m_script_sections.empty())
+        {
+            if (!file_manager->getCachedScriptsDir().empty())
+            {
+                cache_file = file_manager->getCachedScriptsDir() +
+                             getByteCodeFilename(m_script_sections);
+            }
+            mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
+                                      asGM_ALWAYS_CREATE);
+            if (!cache_file.empty() && loadByteCode(mod, cache_file))
+            {
+                PROFILER_ADD_TO_COUNTER("Script bytecode cache hits", 1);
+                m_script_sections.clear();
+                return true;
+            }
+            PROFILER_ADD_TO_COUNTER("Script bytecode cache misses", 1);
+
+            // Start with an empty module again in case loading failed
+            mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
+                                      asGM_ALWAYS_CREATE);
+
+            // Add the script sections that will be compiled into executable
+            // code. The script engine treats all sections as if they were
+            // one. The script section name, will allow us to localize any
+            // errors in the script code.
+            for (const std::string &script : m_script_sections)
+            {
+                r = mod->AddScriptSection("script", script.c_str(),
+                                          script.size());
+                if (r < 0)
+                {
+                    Log::error("Scripting", "AddScriptSection() failed");
+                    m_script_sections.clear();
+                    return false;
+                }
+            }
+            m_script_sections.clear();
+        }
+        else
+        {
+            mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
+                                      asGM_CREATE_IF_NOT_EXISTS);
+        }
 
         // Compile the script. If there are any compiler messages they will
         // be written to the message stream that we set right after creating the 
@@ -566,6 +825,9 @@ namespace Scripting
             return false;
         }
 
+        if (!cache_file.empty())
+            saveByteCode(mod, cache_file);
+
         // The engine doesn't keep a copy of the script sections after Build() has
         // returned. So if the script needs to be recompiled, then all the script
         // sections must be added again.
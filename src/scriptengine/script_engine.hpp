@@ -28,6 +28,7 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <vector>
 
 class TrackObjectPresentation;
 
@@ -91,7 +92,22 @@ namespace Scripting
         std::map<std::string, asIScriptFunction*> m_functions_cache;
         PtrVector<PendingTimeout> m_pending_timeouts;
 
+        /** Contexts which are not in use, so that a callback does not need
+         *  to create a new context. */
+        std::vector<asIScriptContext*> m_context_pool;
+
+        /** The preprocessed sources of the scripts loaded since the last
+         *  compilation, which are compiled (or loaded from the bytecode
+         *  cache) by compileLoadedScripts(). */
+        std::vector<std::string> m_script_sections;
+
         void configureEngine(asIScriptEngine *engine);
+        asIScriptContext* requestContext();
+        void returnContext(asIScriptContext *ctx);
+        int executeContext(asIScriptContext *ctx);
+        bool loadByteCode(asIScriptModule *mod, const std::string &filename);
+        void saveByteCode(asIScriptModule *mod,
+                          const std::string &filename) const;
     };   // class ScriptEngine
 
 }
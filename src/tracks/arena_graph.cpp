@@ -20,25 +20,57 @@
 
 #include "config/user_config.hpp"
 #include "io/file_manager.hpp"
+#include "io/mapped_file.hpp"
 #include "io/xml_node.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/arena_node.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/fnv_hash.hpp"
 #include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <queue>
 
+namespace
+{
+    /** Header of cached path tables, followed by the distance and the next
+     *  node table. */
+    struct NavmeshTablesHeader
+    {
+        char     m_magic[8];
+        uint64_t m_hash;
+        uint32_t m_nodes;
+        uint32_t m_padding;
+    };
+    const char NAVMESH_TABLES_MAGIC[8] =
+        { 'S', 'T', 'K', 'N', 'A', 'V', '0', '1' };
+}
+
 // -----------------------------------------------------------------------------
 ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
           : Graph()
 {
+    m_distance  = NULL;
+    m_next_node = NULL;
     loadNavmesh(navmesh);
-    buildGraph();
-    // Compute shortest distance from all nodes
-    for (unsigned int i = 0; i < getNumNodes(); i++)
-        computeDijkstra(i);
+    buildSectorGrid();
+    m_navmesh_hash = computeNavmeshHash();
+
+    // Compute shortest distance from all nodes, unless cached before
+    const std::string filename = getTablesFilename(navmesh);
+    if (filename.empty() || !loadTables(filename))
+    {
+        computeTables(WorkerPool::get());
+        if (!filename.empty())
+            saveTables(filename);
+    }
 
     setNearbyNodesOfAllNodes();
     if (node && RaceManager::get()->getMinorMode() == RaceManager::MINOR_MODE_SOCCER)
@@ -48,6 +80,11 @@ ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
 
 }   // ArenaGraph
 
+// -----------------------------------------------------------------------------
+ArenaGraph::~ArenaGraph()
+{
+}   // ~ArenaGraph
+
 // -----------------------------------------------------------------------------
 ArenaNode* ArenaGraph::getNode(unsigned int i) const
 {
@@ -175,49 +212,146 @@ void ArenaGraph::loadNavmesh(const std::string &navmesh)
 }   // loadNavmesh
 
 // ----------------------------------------------------------------------------
-void ArenaGraph::buildGraph()
+/** Returns a hash of the node centers and adjacent nodes, which identifies
+ *  the path tables of this navmesh in the cache.
+ */
+uint64_t ArenaGraph::computeNavmeshHash() const
 {
-    const unsigned int n_nodes = getNumNodes();
-
-    m_distance_matrix = std::vector<std::vector<float>>
-        (n_nodes, std::vector<float>(n_nodes, 9999.9f));
-    for (unsigned int i = 0; i < n_nodes; i++)
+    FNVHash hash;
+    hash.add((uint32_t)getNumNodes());
+    for (unsigned int i = 0; i < getNumNodes(); i++)
     {
         ArenaNode* cur_node = getNode(i);
+        for (int j = 0; j < 3; j++)
+            hash.add((float)cur_node->getCenter()[j]);
+        hash.add((uint32_t)cur_node->getAdjacentNodes().size());
         for (const int& adjacent : cur_node->getAdjacentNodes())
-        {
-            Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
-            float distance = diff.length();
-            m_distance_matrix[i][adjacent] = distance;
-        }
-        m_distance_matrix[i][i] = 0.0f;
+            hash.add((uint32_t)adjacent);
     }
+    return hash.get();
+}   // computeNavmeshHash
 
-    // Allocate and initialise the previous node data structure:
-    m_parent_node = std::vector<std::vector<int16_t>>
-        (n_nodes, std::vector<int16_t>(n_nodes, Graph::UNKNOWN_SECTOR));
-    for (unsigned int i = 0; i < n_nodes; i++)
-    {
-        for (unsigned int j = 0; j < n_nodes; j++)
+// ----------------------------------------------------------------------------
+/** Returns the full path of the cached path tables of a navmesh, which is
+ *  named after the track directory, or "" if there is no cache directory.
+ */
+std::string ArenaGraph::getTablesFilename(const std::string &navmesh)
+{
+    const std::string dir = file_manager->getCachedNavmeshDir();
+    if (dir.empty())
+        return "";
+    std::string track = StringUtils::getBasename(StringUtils::getPath(navmesh));
+    if (track.empty())
+        track = "navmesh";
+    return dir + track + ".navmesh";
+}   // getTablesFilename
+
+// ----------------------------------------------------------------------------
+/** Uses cached path tables if they were computed for the same navmesh.
+ *  \param filename Full path of the cached tables.
+ *  \return False if not cached or cached for another navmesh.
+ */
+bool ArenaGraph::loadTables(const std::string &filename)
+{
+    const size_t n = getNumNodes();
+    if (n == 0)
+        return false;
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(filename))
+        return false;
+    const size_t table_size = n * n * sizeof(uint16_t);
+    if (file->getSize() != sizeof(NavmeshTablesHeader) + 2 * table_size)
+        return false;
+    NavmeshTablesHeader header;
+    memcpy(&header, file->getData(), sizeof(header));
+    if (memcmp(header.m_magic, NAVMESH_TABLES_MAGIC,
+               sizeof(NAVMESH_TABLES_MAGIC)) != 0 ||
+        header.m_hash != m_navmesh_hash || header.m_nodes != n)
+        return false;
+
+    const char* data = (const char*)file->getData() + sizeof(header);
+    m_distance  = (const uint16_t*)data;
+    m_next_node = (const int16_t*)(data + table_size);
+    m_cached_tables = std::move(file);
+    m_distance_storage.clear();
+    m_next_node_storage.clear();
+    return true;
+}   // loadTables
+
+// ----------------------------------------------------------------------------
+/** Saves the computed path tables in the cache.
+ *  \param filename Full path of the cached tables.
+ */
+void ArenaGraph::saveTables(const std::string &filename) const
+{
+    const size_t n = getNumNodes();
+    if (n == 0 || m_distance_storage.size() != n * n)
+        return;
+    NavmeshTablesHeader header;
+    memcpy(header.m_magic, NAVMESH_TABLES_MAGIC, sizeof(NAVMESH_TABLES_MAGIC));
+    header.m_hash    = m_navmesh_hash;
+    header.m_nodes   = (uint32_t)n;
+    header.m_padding = 0;
+
+    bool written = FileUtils::writeFileAtomically(filename,
+        [this, &header, n](FILE* f)
         {
-            if (i == j || m_distance_matrix[i][j] >= 9899.9f)
-                m_parent_node[i][j] = -1;
-            else
-                m_parent_node[i][j] = i;
-        }   // for j
-    }   // for i
+            return fwrite(&header, sizeof(header), 1, f) == 1 &&
+                fwrite(m_distance_storage.data(), n * n * sizeof(uint16_t),
+                       1, f) == 1 &&
+                fwrite(m_next_node_storage.data(), n * n * sizeof(int16_t),
+                       1, f) == 1;
+        });
+    if (!written)
+    {
+        Log::warn("ArenaGraph", "Failed to write cached path tables '%s'.",
+                  filename.c_str());
+    }
+}   // saveTables
 
-}   // buildGraph
+// ----------------------------------------------------------------------------
+/** Computes the shortest paths from all nodes, with a Dijkstra search from
+ *  each node. The searches are independent, so they are shared by the
+ *  threads of the worker pool.
+ *  \param pool The worker pool, or NULL to compute all in this thread.
+ */
+void ArenaGraph::computeTables(WorkerPool* pool)
+{
+    const unsigned int n = getNumNodes();
+    m_distance_storage.assign((size_t)n * n, 0);
+    m_next_node_storage.assign((size_t)n * n, Graph::UNKNOWN_SECTOR);
+    m_distance  = m_distance_storage.data();
+    m_next_node = m_next_node_storage.data();
+    m_cached_tables.reset();
+
+    if (!pool)
+    {
+        std::vector<float> distance;
+        for (unsigned int source = 0; source < n; source++)
+            computeDijkstra(source, &distance);
+        return;
+    }
+    pool->parallelFor(n, [this](unsigned int source)
+    {
+        std::vector<float> distance;
+        computeDijkstra(source, &distance);
+    });
+}   // computeTables
 
 // ----------------------------------------------------------------------------
 /** Dijkstra shortest path computation. It computes the shortest distance from
  *  the specified node 'source' to all other nodes. At the end of the
- *  computation, m_distance_matrix[i][j] stores the shortest path distance from
- *  source to j and m_parent_node[source][j] stores the last vertex visited on
- *  the shortest path from i to j before visiting j. Suppose the shortest path
- *  from i to j is i->......->k->j  then m_parent_node[i][j] = k
+ *  computation, row 'source' of m_distance stores the shortest path distance
+ *  from source to each node, and row 'source' of m_next_node the last vertex
+ *  visited on the shortest path from source to each node before visiting it.
+ *  Suppose the shortest path from source to j is source->......->k->j then
+ *  this is k, which is also the next node on the path from j to source.
+ *  Can be called by several threads for different sources.
+ *  \param source The source node.
+ *  \param distance Temporary storage for distances, to avoid allocating it
+ *         for each source.
  */
-void ArenaGraph::computeDijkstra(int source)
+void ArenaGraph::computeDijkstra(int source, std::vector<float>* distance)
 {
     // Stores the distance (float) to 'source' from a specified node (int)
     typedef std::pair<int, float> IndDistPair;
@@ -231,52 +365,65 @@ void ArenaGraph::computeDijkstra(int source)
         }
     };
 
-    std::priority_queue<IndDistPair, std::vector<IndDistPair>, Shortest> queue;
-    IndDistPair begin(source, 0.0f);
-    queue.push(begin);
     const unsigned int n = getNumNodes();
-    std::vector<bool> visited;
-    visited.resize(n, false);
+    std::vector<float>& dist = *distance;
+    dist.assign(n, 9999.9f);
+    dist[source] = 0.0f;
+    int16_t* parent = &m_next_node_storage[(size_t)source * n];
+
+    std::priority_queue<IndDistPair, std::vector<IndDistPair>, Shortest> queue;
+    queue.push(IndDistPair(source, 0.0f));
     while (!queue.empty())
     {
         // Get element with shortest path
         IndDistPair current = queue.top();
         queue.pop();
         int cur_index = current.first;
-        if (visited[cur_index]) continue;
-        visited[cur_index] = true;
+        // Node was reached with a shorter path before
+        if (current.second > dist[cur_index]) continue;
 
-        for (const int& adjacent : getNode(cur_index)->getAdjacentNodes())
+        ArenaNode* cur_node = getNode(cur_index);
+        for (const int& adjacent : cur_node->getAdjacentNodes())
         {
-            // Distance already computed, can be ignored
-            if (visited[adjacent]) continue;
-
-            float new_dist =
-                current.second + m_distance_matrix[cur_index][adjacent];
-            if (new_dist < m_distance_matrix[source][adjacent])
+            float new_dist = current.second +
+                (getNode(adjacent)->getCenter() - cur_node->getCenter())
+                .length();
+            if (new_dist < dist[adjacent])
             {
-                m_distance_matrix[source][adjacent] = new_dist;
-                m_parent_node[source][adjacent] = cur_index;
+                dist[adjacent] = new_dist;
+                parent[adjacent] = cur_index;
+                queue.push(IndDistPair(adjacent, new_dist));
             }
-            IndDistPair pair(adjacent, new_dist);
-            queue.push(pair);
         }
     }
+
+    uint16_t* row = &m_distance_storage[(size_t)source * n];
+    for (unsigned int i = 0; i < n; i++)
+        row[i] = MiniGLM::toFloat16(dist[i]);
 }   // computeDijkstra
 
 // ----------------------------------------------------------------------------
 /** THIS FUNCTION IS ONLY USED FOR UNIT-TESTING, to verify that the new
  *  Dijkstra algorithm gives the same results.
  *  computeFloydWarshall() computes the shortest distance between any two
- *  nodes. At the end of the computation, m_distance_matrix[i][j] stores the
- *  shortest path distance from i to j and m_parent_node[i][j] stores the last
- *  vertex visited on the shortest path from i to j before visiting j. Suppose
- *  the shortest path from i to j is i->......->k->j  then
- *  m_parent_node[i][j] = k
+ *  nodes, the returned matrix stores at [i][j] the shortest path distance
+ *  from i to j.
  */
-void ArenaGraph::computeFloydWarshall()
+std::vector<std::vector<float> > ArenaGraph::computeFloydWarshall() const
 {
     unsigned int n = getNumNodes();
+    std::vector<std::vector<float> > distance(n,
+        std::vector<float>(n, 9999.9f));
+    for (unsigned int i = 0; i < n; i++)
+    {
+        ArenaNode* cur_node = getNode(i);
+        for (const int& adjacent : cur_node->getAdjacentNodes())
+        {
+            Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
+            distance[i][adjacent] = diff.length();
+        }
+        distance[i][i] = 0.0f;
+    }
 
     for (unsigned int k = 0; k < n; k++)
     {
@@ -284,16 +431,12 @@ void ArenaGraph::computeFloydWarshall()
         {
             for (unsigned int j = 0; j < n; j++)
             {
-                if ((m_distance_matrix[i][k] + m_distance_matrix[k][j]) <
-                    m_distance_matrix[i][j])
-                {
-                    m_distance_matrix[i][j] =
-                        m_distance_matrix[i][k] + m_distance_matrix[k][j];
-                    m_parent_node[i][j] = m_parent_node[k][j];
-                }
+                if ((distance[i][k] + distance[k][j]) < distance[i][j])
+                    distance[i][j] = distance[i][k] + distance[k][j];
             }
         }
     }
+    return distance;
 
 }   // computeFloydWarshall
 
@@ -349,7 +492,9 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
         // Get the distance to all nodes at i
         ArenaNode* cur_node = getNode(i);
         std::vector<int> nearby_nodes;
-        std::vector<float> dist = m_distance_matrix[i];
+        std::vector<float> dist(getNumNodes());
+        for (unsigned int j = 0; j < getNumNodes(); j++)
+            dist[j] = getDistance(i, j);
 
         // Skip the same node
         dist[i] = 999999.0f;
@@ -366,99 +511,129 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
 
 }   // setNearbyNodesOfAllNodes
 
-// ----------------------------------------------------------------------------
-/** Determines the full path from 'from' to 'to' and returns it in a
- *  std::vector (in reverse order). Used only for unit testing.
- */
-std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
-                      const std::vector< std::vector< int16_t > >& parent_node)
-{
-    std::vector<int16_t> path;
-    path.push_back(to);
-    while(from!=to)
-    {
-        to = parent_node[from][to];
-        path.push_back(to);
-    }
-    return path;
-}   // getPathFromTo
-
 // ============================================================================
-/** Unit testing for arena graph distance and parent node computation.
+/** Unit testing for arena graph distance and next node computation.
  *  Instead of using hand-tuned test cases we use the tested, verified and
  *  easier to understand Floyd-Warshall algorithm to compute the distances,
  *  and check if the (significanty faster) Dijkstra algorithm gives the same
- *  results. For now we use the cave mesh as test case.
+ *  results, within the precision of half floats. There are often different
+ *  shortest paths with the same length, so instead of comparing next nodes
+ *  the path following the next nodes must have the shortest length. For now
+ *  we use the cave mesh as test case.
  */
 void ArenaGraph::unitTesting()
 {
     Track *track = track_manager->getTrack("cave");
     std::string navmesh_file_name=track->getTrackFile("navmesh.xml");
 
-    double s = StkTime::getRealTime();
     ArenaGraph* ag = new ArenaGraph(navmesh_file_name);
-    double e = StkTime::getRealTime();
-    Log::error("Time", "Dijkstra       %lf", e-s);
-
-    // Save the Dijkstra results
-    std::vector< std::vector< float > > distance_matrix = ag->m_distance_matrix;
-    std::vector< std::vector< int16_t > > parent_node = ag->m_parent_node;
-    ag->buildGraph();
-
-    // Now compute results with Floyd-Warshall
-    s = StkTime::getRealTime();
-    ag->computeFloydWarshall();
-    e = StkTime::getRealTime();
-    Log::error("Time", "Floyd-Warshall %lf", e-s);
+    // Test the computed tables, not the cached ones
+    ag->computeTables(WorkerPool::get());
+    std::vector< std::vector< float > > distance_matrix =
+        ag->computeFloydWarshall();
 
     int error_count = 0;
-    for(unsigned int i=0; i<ag->m_distance_matrix.size(); i++)
+    const int n = (int)ag->getNumNodes();
+    for (int i = 0; i < n; i++)
     {
-        for(unsigned int j=0; j<ag->m_distance_matrix[i].size(); j++)
+        for (int j = 0; j < n; j++)
         {
-            if(ag->m_distance_matrix[i][j] - distance_matrix[i][j] > 0.001f)
+            const float expected = distance_matrix[i][j];
+            const float tolerance = expected * 0.001f + 0.001f;
+            if (fabsf(ag->getDistance(i, j) - expected) > tolerance)
             {
                 Log::error("ArenaGraph",
                            "Incorrect distance %d, %d: Dijkstra: %f F.W.: %f",
-                           i, j, distance_matrix[i][j], ag->m_distance_matrix[i][j]);
+                           i, j, ag->getDistance(i, j), expected);
                 error_count++;
             }    // if distance is too different
 
-            // Unortunately it happens frequently that there are different
-            // shortest path with the same length. And Dijkstra might find
-            // a different path then Floyd-Warshall. So the test for parent
-            // polygon often results in false positives, so it is disabled,
-            // but I leave the code in place in case it is useful for some
-            // debugging in the feature
-#undef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
-#ifdef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
-            if(ag->m_parent_node[i][j] != parent_node[i][j])
+            if (i == j || expected >= 9899.9f)
+                continue;
+            float length = 0.0f;
+            int node = i;
+            for (int steps = 0; node != j && steps < n; steps++)
             {
+                int next = ag->getNextNode(node, j);
+                if (next == Graph::UNKNOWN_SECTOR)
+                    break;
+                length += (ag->getNode(next)->getCenter() -
+                    ag->getNode(node)->getCenter()).length();
+                node = next;
+            }
+            if (node != j || fabsf(length - expected) > tolerance)
+            {
+                Log::error("ArenaGraph",
+                           "Incorrect path %d, %d: length %f F.W.: %f",
+                           i, j, length, expected);
                 error_count++;
-                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, parent_node);
-                std::vector<int16_t> floyd_path = getPathFromTo(i, j, ag->m_parent_node);
-                if(dijkstra_path.size()!=floyd_path.size())
-                {
-                    Log::error("ArenaGraph",
-                               "Incorrect path length %d, %d: Dijkstra: %d F.W.: %d",
-                               i, j, parent_node[i][j], ag->m_parent_node[i][j]);
-                    continue;
-                }
-                Log::error("ArenaGraph", "Path problems from %d to %d:",
-                           i, j);
-                for (unsigned k = 0; k < dijkstra_path.size(); k++)
-                {
-                    if(dijkstra_path[k]!=floyd_path[k])
-                        Log::error("ArenaGraph", "%d/%d dijkstra: %d floyd %d",
-                            k, dijkstra_path.size(), dijkstra_path[k],
-                            floyd_path[k]);
-                }    // for k<dijkstra_path.size()
-
-            }   // if dijkstra parent_node != floyd parent node
-#endif
+            }
         }   // for j
     }   // for i
 
     delete ag;
+    assert(error_count == 0);
 
 }   // unitTesting
+
+// ----------------------------------------------------------------------------
+/** Benchmark for the path tables of the arena with the most nodes, reports
+ *  the time to compute them with one thread and with all threads, and to
+ *  load them from the cache.
+ */
+void ArenaGraph::benchmark()
+{
+    ArenaGraph* largest = NULL;
+    std::string largest_ident, largest_navmesh;
+    for (unsigned int i = 0; i < track_manager->getNumberOfTracks(); i++)
+    {
+        Track* track = track_manager->getTrack(i);
+        if ((!track->isArena() && !track->isSoccer()) || track->isAddon() ||
+            track->isInternal())
+            continue;
+        std::string navmesh = track->getTrackFile("navmesh.xml");
+        if (!file_manager->fileExists(navmesh))
+            continue;
+        ArenaGraph* ag = new ArenaGraph(navmesh);
+        if (!largest || ag->getNumNodes() > largest->getNumNodes())
+        {
+            delete largest;
+            largest = ag;
+            largest_ident = track->getIdent();
+            largest_navmesh = navmesh;
+        }
+        else
+            delete ag;
+    }
+    if (!largest)
+    {
+        Log::warn("ArenaGraph", "No arena found.");
+        return;
+    }
+
+    const size_t n = largest->getNumNodes();
+    const unsigned int threads = WorkerPool::get()->getNumThreads();
+    double start = StkTime::getRealTime();
+    largest->computeTables(NULL);
+    double single = StkTime::getRealTime() - start;
+    start = StkTime::getRealTime();
+    largest->computeTables(WorkerPool::get());
+    double parallel = StkTime::getRealTime() - start;
+
+    const std::string filename = getTablesFilename(largest_navmesh);
+    double load = -1.0;
+    if (!filename.empty())
+    {
+        largest->saveTables(filename);
+        start = StkTime::getRealTime();
+        if (largest->loadTables(filename))
+            load = StkTime::getRealTime() - start;
+    }
+    Log::info("ArenaGraph", "%s: %d nodes, compute %.2fms with 1 thread, "
+        "%.2fms with %d threads, load %.3fms.", largest_ident.c_str(),
+        (int)n, single * 1000.0, parallel * 1000.0, threads, load * 1000.0);
+    // Before the tables were float distances and int16 parent nodes
+    Log::info("ArenaGraph", "Tables use %dkB instead of %dkB.",
+        (int)(n * n * 4 / 1024), (int)(n * n * 6 / 1024));
+    delete largest;
+}   // benchmark
@@ -22,23 +22,46 @@
 #include "tracks/graph.hpp"
 #include "utils/cpp2011.hpp"
 
+#include "mini_glm.hpp"
+
+#include <memory>
 #include <set>
 
 class ArenaNode;
+class MappedFile;
+class WorkerPool;
 class XMLNode;
 
 /**
  *  \brief A graph made from navmesh
+ *  The shortest paths between all nodes are computed once for each navmesh
+ *  and cached on disk, the cached tables are memory mapped when loading the
+ *  arena again.
  *  \ingroup tracks
  */
 class ArenaGraph : public Graph
 {
 private:
-    /** The actual graph data structure, it is an adjacency matrix. */
-    std::vector<std::vector<float>> m_distance_matrix;
+    /** Shortest distance between any two nodes as half floats,
+     *  m_distance[from * n + to] for n nodes. */
+    const uint16_t* m_distance;
+
+    /** Next node on the shortest paths, m_next_node[to * n + from] is the
+     *  next node on the path from 'from' to 'to', -1 if there is none. So
+     *  each row is the parent table of a shortest path search from 'to'. */
+    const int16_t* m_next_node;
+
+    /** Storage of the tables if they were computed instead of loaded. */
+    std::vector<uint16_t> m_distance_storage;
 
-    /** The matrix that is used to store computed shortest paths. */
-    std::vector<std::vector<int16_t>> m_parent_node;
+    std::vector<int16_t> m_next_node_storage;
+
+    /** The cached tables if they were loaded. */
+    std::unique_ptr<MappedFile> m_cached_tables;
+
+    /** Hash of the node centers and adjacent nodes, which must match the
+     *  cached tables. */
+    uint64_t m_navmesh_hash;
 
     /** Used in soccer mode to colorize the goal lines in minimap. */
     std::set<int> m_red_node;
@@ -50,16 +73,21 @@ private:
     // ------------------------------------------------------------------------
     void loadNavmesh(const std::string &navmesh);
     // ------------------------------------------------------------------------
-    void buildGraph();
+    uint64_t computeNavmeshHash() const;
     // ------------------------------------------------------------------------
-    void setNearbyNodesOfAllNodes();
+    void computeTables(WorkerPool* pool);
     // ------------------------------------------------------------------------
-    void computeDijkstra(int n);
+    void computeDijkstra(int source, std::vector<float>* distance);
     // ------------------------------------------------------------------------
-    void computeFloydWarshall();
+    bool loadTables(const std::string &filename);
     // ------------------------------------------------------------------------
-    static std::vector<int16_t> getPathFromTo(int from, int to,
-                     const std::vector< std::vector< int16_t > >& parent_node);
+    void saveTables(const std::string &filename) const;
+    // ------------------------------------------------------------------------
+    static std::string getTablesFilename(const std::string &navmesh);
+    // ------------------------------------------------------------------------
+    void setNearbyNodesOfAllNodes();
+    // ------------------------------------------------------------------------
+    std::vector<std::vector<float> > computeFloydWarshall() const;
     // ------------------------------------------------------------------------
     virtual bool hasLapLine() const OVERRIDE                  { return false; }
     // ------------------------------------------------------------------------
@@ -70,21 +98,20 @@ public:
     // ------------------------------------------------------------------------
     static void unitTesting();
     // ------------------------------------------------------------------------
+    static void benchmark();
+    // ------------------------------------------------------------------------
     ArenaGraph(const std::string &navmesh, const XMLNode *node = NULL);
     // ------------------------------------------------------------------------
-    virtual ~ArenaGraph() {}
+    virtual ~ArenaGraph();
     // ------------------------------------------------------------------------
     ArenaNode* getNode(unsigned int i) const;
     // ------------------------------------------------------------------------
-    /** Returns the next node on the shortest path from i to j.
-     *  Note: m_parent_node[j][i] contains the parent of i on path from j to i,
-     *  which is the next node on the path from i to j (undirected graph)
-     */
+    /** Returns the next node on the shortest path from i to j. */
     int getNextNode(int i, int j) const
     {
         if (i == Graph::UNKNOWN_SECTOR || j == Graph::UNKNOWN_SECTOR)
             return Graph::UNKNOWN_SECTOR;
-        return (int)(m_parent_node[j][i]);
+        return (int)(m_next_node[(size_t)j * getNumNodes() + i]);
     }
     // ------------------------------------------------------------------------
     /** Returns the distance between any two nodes */
@@ -92,7 +119,8 @@ public:
     {
         if (from == Graph::UNKNOWN_SECTOR || to == Graph::UNKNOWN_SECTOR)
             return 99999.0f;
-        return m_distance_matrix[from][to];
+        return MiniGLM::toFloat32(
+            (short)m_distance[(size_t)from * getNumNodes() + to]);
     }
 
 };   // ArenaGraph
@@ -245,6 +245,7 @@ void DriveGraph::load(const std::string &quad_file_name,
     }
     delete xml;
 
+    buildSectorGrid();
     setDefaultSuccessors();
     computeDistanceFromStart(getStartNode(), 0.0f);
     computeDirectionData();
@@ -31,11 +31,18 @@
 #include "tracks/drive_node_2d.hpp"
 #include "tracks/drive_node_3d.hpp"
 #include "tracks/track.hpp"
+#include "utils/cpp2011.hpp"
 #include "utils/log.hpp"
+#include "utils/time.hpp"
 
 #include <ICameraSceneNode.h>
 #include <ISceneManager.h>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+
 #ifndef SERVER_ONLY
 #include <ge_main.hpp>
 #endif
@@ -44,6 +51,42 @@ const int Graph::UNKNOWN_SECTOR = -1;
 const float Graph::MIN_HEIGHT_TESTING = -1.0f;
 const float Graph::MAX_HEIGHT_TESTING = 5.0f;
 Graph *Graph::m_graph = NULL;
+
+namespace
+{
+    /** A road of arena nodes in the shape of an eight, which crosses itself
+     *  at different heights, used to benchmark the sector search. */
+    class BenchmarkGraph : public Graph
+    {
+    private:
+        virtual bool hasLapLine() const OVERRIDE              { return false; }
+        virtual void differentNodeColor(int n, video::SColor* c) const
+            OVERRIDE                                                        {}
+    public:
+        BenchmarkGraph(unsigned int nodes, bool use_grid)
+        {
+            const float width = 6.0f;
+            auto center = [nodes](unsigned int i)
+            {
+                const float t = 2.0f * M_PI * i / nodes;
+                return Vec3(600.0f * sinf(t), 8.0f * sinf(t),
+                            400.0f * sinf(2.0f * t));
+            };
+            for (unsigned int i = 0; i < nodes; i++)
+            {
+                const Vec3 c0 = center(i), c1 = center((i + 1) % nodes);
+                Vec3 right(c1.getZ() - c0.getZ(), 0, c0.getX() - c1.getX());
+                right.normalize();
+                right *= width;
+                createQuad(c0 - right, c0 + right, c1 + right, c1 - right, i,
+                    false/*invisible*/, false/*ai_ignore*/, true/*is_arena*/,
+                    false/*ignore*/);
+            }
+            if (use_grid)
+                buildSectorGrid();
+        }   // BenchmarkGraph
+    };   // BenchmarkGraph
+}
 // -----------------------------------------------------------------------------
 Graph::Graph()
 {
@@ -55,6 +98,11 @@ Graph::Graph()
     m_bb_min      = Vec3( 99999,  99999,  99999);
     m_bb_max      = Vec3(-99999, -99999, -99999);
     memset(m_bb_nodes, 0, 4 * sizeof(int));
+    m_grid_min_x     = 0.0f;
+    m_grid_min_z     = 0.0f;
+    m_grid_cell_size = 1.0f;
+    m_grid_width     = 0;
+    m_grid_height    = 0;
 }  // Graph
 
 // -----------------------------------------------------------------------------
@@ -693,6 +741,34 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
                             ? (unsigned int)all_sectors->size()
                             : (unsigned int)m_all_nodes.size();
     *sector = UNKNOWN_SECTOR;
+
+    if (!all_sectors && !m_grid_nodes.empty())
+    {
+        // Only test the nodes near xyz, and return the one which would be
+        // found first when testing all nodes in the order below
+        int x, z;
+        getGridCell(xyz, &x, &z);
+        if (x < 0 || z < 0)
+            return;
+        const int n     = (int)m_all_nodes.size();
+        const int first = indx < n - 1 ? indx + 1 : 0;
+        int min_order   = n;
+        const int cell  = z * m_grid_width + x;
+        for (unsigned int i = m_grid_cell_start[cell];
+             i < m_grid_cell_start[cell + 1]; i++)
+        {
+            const int node = m_grid_nodes[i];
+            const int order = (node - first + n) % n;
+            if (order < min_order &&
+                getQuad(node)->pointInside(xyz, ignore_vertical))
+            {
+                min_order = order;
+                *sector   = node;
+            }
+        }
+        return;
+    }
+
     for(unsigned int i=0; i<max_count; i++)
     {
         if(all_sectors)
@@ -766,6 +842,21 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
         if(current_sector<0) current_sector += getNumNodes();
     }
 
+    if (!all_sectors && !m_grid_nodes.empty())
+    {
+        const int first = current_sector + 1 == (int)getNumNodes()
+                        ? 0 : current_sector + 1;
+        for (int phase = 0; phase < 2; phase++)
+        {
+            int sector = findNearestSectorInGrid(xyz, first,
+                /*test_height*/phase == 0 && !ignore_vertical);
+            if (sector != UNKNOWN_SECTOR)
+                return sector;
+        }
+        Log::warn("Graph", "unknown sector found.");
+        return 0;
+    }
+
     int   min_sector = UNKNOWN_SECTOR;
     float min_dist_2 = 999999.0f*999999.0f;
 
@@ -821,6 +912,227 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
     return 0;
 }   // findOutOfRoadSector
 
+//-----------------------------------------------------------------------------
+/** Finds the node whose center line is closest to xyz using the grid, like
+ *  one phase of findOutOfRoadSector. The cells are searched in rings around
+ *  xyz, till all nodes in the remaining cells must be further away than the
+ *  closest node found.
+ *  \param xyz The position.
+ *  \param first The node which findOutOfRoadSector tests first, if nodes
+ *         have the same distance the first in that order is returned.
+ *  \param test_height If the height of xyz must fit to 2d nodes.
+ *  \return The closest node, or UNKNOWN_SECTOR if no node was found.
+ */
+int Graph::findNearestSectorInGrid(const Vec3& xyz, int first,
+                                   bool test_height) const
+{
+    const int n = (int)getNumNodes();
+    const float px = xyz.getX();
+    const float pz = xyz.getZ();
+    int cx = (int)floorf((px - m_grid_min_x) / m_grid_cell_size);
+    int cz = (int)floorf((pz - m_grid_min_z) / m_grid_cell_size);
+    cx = std::max(0, std::min(cx, m_grid_width - 1));
+    cz = std::max(0, std::min(cz, m_grid_height - 1));
+
+    int   min_sector = UNKNOWN_SECTOR;
+    int   min_order  = n;
+    float min_dist_2 = 999999.0f*999999.0f;
+    auto test_cell = [&](int x, int z)
+    {
+        const int cell = z * m_grid_width + x;
+        if (test_height && !m_grid_cell_3d[cell] &&
+            (xyz.getY() - m_grid_cell_height[cell].second >= 5.0f ||
+             xyz.getY() - m_grid_cell_height[cell].first <= -1.0f))
+            return;
+        for (unsigned int i = m_grid_cell_start[cell];
+             i < m_grid_cell_start[cell + 1]; i++)
+        {
+            const int node = m_grid_nodes[i];
+            const Quad* q = getQuad(node);
+            if (q->isIgnored())
+                continue;
+            float dist_2 = m_all_nodes[node]->getDistance2FromPoint(xyz);
+            if (dist_2 > min_dist_2)
+                continue;
+            const int order = (node - first + n) % n;
+            if (dist_2 == min_dist_2 && order >= min_order)
+                continue;
+            float dist = xyz.getY() - q->getMinHeight();
+            if (!test_height || (dist < 5.0f && dist > -1.0f) ||
+                q->is3DQuad())
+            {
+                min_dist_2 = dist_2;
+                min_order  = order;
+                min_sector = node;
+            }
+        }
+    };
+
+    for (int r = 0; ; r++)
+    {
+        const int x0 = cx - r, x1 = cx + r, z0 = cz - r, z1 = cz + r;
+        // Test the cells on the border of the (2r+1)^2 block
+        for (int x = std::max(x0, 0); x <= std::min(x1, m_grid_width - 1);
+             x++)
+        {
+            if (z0 >= 0)
+                test_cell(x, z0);
+            if (r > 0 && z1 < m_grid_height)
+                test_cell(x, z1);
+        }
+        for (int z = std::max(z0 + 1, 0);
+             z <= std::min(z1 - 1, m_grid_height - 1); z++)
+        {
+            if (x0 >= 0)
+                test_cell(x0, z);
+            if (r > 0 && x1 < m_grid_width)
+                test_cell(x1, z);
+        }
+
+        // The distance to the nearest cell outside of the block is a lower
+        // bound for the distance of all nodes not tested yet
+        bool more_cells = false;
+        float bound = 999999.0f;
+        if (x0 > 0)
+        {
+            more_cells = true;
+            bound = std::min(bound,
+                std::max(0.0f, px - (m_grid_min_x + x0 * m_grid_cell_size)));
+        }
+        if (x1 < m_grid_width - 1)
+        {
+            more_cells = true;
+            bound = std::min(bound, std::max(0.0f,
+                m_grid_min_x + (x1 + 1) * m_grid_cell_size - px));
+        }
+        if (z0 > 0)
+        {
+            more_cells = true;
+            bound = std::min(bound,
+                std::max(0.0f, pz - (m_grid_min_z + z0 * m_grid_cell_size)));
+        }
+        if (z1 < m_grid_height - 1)
+        {
+            more_cells = true;
+            bound = std::min(bound, std::max(0.0f,
+                m_grid_min_z + (z1 + 1) * m_grid_cell_size - pz));
+        }
+        if (!more_cells ||
+            (min_sector != UNKNOWN_SECTOR && bound * bound > min_dist_2))
+            break;
+    }
+    return min_sector;
+}   // findNearestSectorInGrid
+
+//-----------------------------------------------------------------------------
+/** Returns the grid cell of a point, or -1 for both coordinates if the
+ *  point is outside of the grid (and so outside of all nodes).
+ */
+void Graph::getGridCell(const Vec3& xyz, int* x, int* z) const
+{
+    const float gx = (xyz.getX() - m_grid_min_x) / m_grid_cell_size;
+    const float gz = (xyz.getZ() - m_grid_min_z) / m_grid_cell_size;
+    if (!(gx >= 0.0f && gz >= 0.0f && gx <= (float)m_grid_width &&
+          gz <= (float)m_grid_height))
+    {
+        *x = *z = -1;
+        return;
+    }
+    *x = std::min((int)gx, m_grid_width - 1);
+    *z = std::min((int)gz, m_grid_height - 1);
+}   // getGridCell
+
+//-----------------------------------------------------------------------------
+/** Builds the grid used by findRoadSector and findOutOfRoadSector, which
+ *  must be called after all nodes are created. The cells have about the
+ *  size of an average node.
+ */
+void Graph::buildSectorGrid()
+{
+    m_grid_cell_start.clear();
+    m_grid_nodes.clear();
+    m_grid_cell_height.clear();
+    m_grid_cell_3d.clear();
+    m_grid_width = m_grid_height = 0;
+    const unsigned int n = getNumNodes();
+    if (n == 0)
+        return;
+
+    // The 2d bounding box of each node, including the box which 3d nodes
+    // test (see BoundingBox3D), so it contains all points inside the node
+    std::vector<float> min_x(n), max_x(n), min_z(n), max_z(n);
+    float grid_max_x = -999999.0f, grid_max_z = -999999.0f;
+    m_grid_min_x = m_grid_min_z = 999999.0f;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        const Quad* q = getQuad(i);
+        min_x[i] = min_z[i] = 999999.0f;
+        max_x[i] = max_z[i] = -999999.0f;
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            const Vec3 points[3] = { (*q)[j], (*q)[j] + 5.0f * q->getNormal(),
+                                     (*q)[j] - 1.0f * q->getNormal() };
+            for (const Vec3& p : points)
+            {
+                min_x[i] = std::min(min_x[i], p.getX());
+                max_x[i] = std::max(max_x[i], p.getX());
+                min_z[i] = std::min(min_z[i], p.getZ());
+                max_z[i] = std::max(max_z[i], p.getZ());
+            }
+        }
+        m_grid_min_x = std::min(m_grid_min_x, min_x[i]);
+        m_grid_min_z = std::min(m_grid_min_z, min_z[i]);
+        grid_max_x   = std::max(grid_max_x, max_x[i]);
+        grid_max_z   = std::max(grid_max_z, max_z[i]);
+    }
+
+    const float size_x = std::max(grid_max_x - m_grid_min_x, 1.0f);
+    const float size_z = std::max(grid_max_z - m_grid_min_z, 1.0f);
+    // At most 512 cells in each direction
+    m_grid_cell_size = std::max(sqrtf(size_x * size_z / n),
+                                std::max(size_x, size_z) / 512.0f);
+    m_grid_width  = std::max(1, (int)ceilf(size_x / m_grid_cell_size));
+    m_grid_height = std::max(1, (int)ceilf(size_z / m_grid_cell_size));
+
+    auto for_each_cell = [this, &min_x, &max_x, &min_z, &max_z]
+        (unsigned int node, const std::function<void(int)>& f)
+    {
+        int x0, z0, x1, z1;
+        getGridCell(Vec3(min_x[node], 0, min_z[node]), &x0, &z0);
+        getGridCell(Vec3(max_x[node], 0, max_z[node]), &x1, &z1);
+        for (int z = z0; z <= z1; z++)
+        {
+            for (int x = x0; x <= x1; x++)
+                f(z * m_grid_width + x);
+        }
+    };
+    // Count the nodes in each cell first, then fill the cells
+    m_grid_cell_start.resize(m_grid_width * m_grid_height + 1, 0);
+    for (unsigned int i = 0; i < n; i++)
+        for_each_cell(i, [this](int cell) { m_grid_cell_start[cell + 1]++; });
+    for (unsigned int i = 1; i < m_grid_cell_start.size(); i++)
+        m_grid_cell_start[i] += m_grid_cell_start[i - 1];
+    m_grid_nodes.resize(m_grid_cell_start.back());
+    m_grid_cell_height.assign(m_grid_width * m_grid_height,
+        std::make_pair(999999.0f, -999999.0f));
+    m_grid_cell_3d.assign(m_grid_width * m_grid_height, false);
+    std::vector<unsigned int> next(m_grid_cell_start.begin(),
+                                   m_grid_cell_start.end() - 1);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        const Quad* q = getQuad(i);
+        for_each_cell(i, [this, i, q, &next](int cell)
+            {
+                m_grid_nodes[next[cell]++] = i;
+                std::pair<float, float>& height = m_grid_cell_height[cell];
+                height.first  = std::min(height.first, q->getMinHeight());
+                height.second = std::max(height.second, q->getMinHeight());
+                if (q->is3DQuad())
+                    m_grid_cell_3d[cell] = true;
+            });
+    }
+}   // buildSectorGrid
+
 //-----------------------------------------------------------------------------
 void Graph::loadBoundingBoxNodes()
 {
@@ -833,3 +1145,75 @@ void Graph::loadBoundingBoxNodes()
     m_bb_nodes[3] = findOutOfRoadSector(Vec3(m_bb_max.x(), 0, m_bb_max.z()),
         -1/*curr_sector*/, NULL/*all_sectors*/, true/*ignore_vertical*/);
 }   // loadBoundingBoxNodes
+
+//-----------------------------------------------------------------------------
+/** Benchmark for findRoadSector and findOutOfRoadSector with a large graph,
+ *  compares the number of searches per second using the grid with testing
+ *  all nodes, and checks that both find the same nodes.
+ */
+void Graph::benchmark()
+{
+    const unsigned int nodes = 5000;
+    BenchmarkGraph linear_graph(nodes, /*use_grid*/false);
+    BenchmarkGraph grid_graph(nodes, /*use_grid*/true);
+
+    // Random points around the road, with the previous sector often near
+    // the point like for a kart which left its previous node
+    const int count = 20000;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> x(-650.0f, 650.0f);
+    std::uniform_real_distribution<float> y(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> z(-450.0f, 450.0f);
+    std::uniform_int_distribution<int> node(-1, nodes - 1);
+    std::vector<Vec3> points;
+    std::vector<int> sectors;
+    for (int i = 0; i < count; i++)
+    {
+        if (i % 2 == 0)
+        {
+            points.push_back(Vec3(x(random), y(random), z(random)));
+        }
+        else
+        {
+            // Close to a node, so findRoadSector succeeds most of the time
+            const Vec3& c = grid_graph.getQuad(node(random) + 1)->getCenter();
+            points.push_back(c + Vec3(x(random), y(random), z(random)) *
+                0.01f);
+        }
+        sectors.push_back(node(random));
+    }
+
+    for (int method = 0; method < 2; method++)
+    {
+        const char* name = method == 0 ? "findRoadSector"
+                                       : "findOutOfRoadSector";
+        double times[2];
+        std::vector<int> results[2];
+        for (int g = 0; g < 2; g++)
+        {
+            const Graph& graph = g == 0 ? (const Graph&)linear_graph
+                                        : (const Graph&)grid_graph;
+            results[g].reserve(count);
+            double start = StkTime::getRealTime();
+            for (int i = 0; i < count; i++)
+            {
+                int sector = sectors[i];
+                if (method == 0)
+                    graph.findRoadSector(points[i], &sector);
+                else
+                    sector = graph.findOutOfRoadSector(points[i], sector);
+                results[g].push_back(sector);
+            }
+            times[g] = StkTime::getRealTime() - start;
+        }
+        int errors = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (results[0][i] != results[1][i])
+                errors++;
+        }
+        Log::info("Graph", "%s with %d nodes: %.0f searches/s testing all "
+            "nodes, %.0f searches/s with grid, %d different results.", name,
+            nodes, count / times[0], count / times[1], errors);
+    }
+}   // benchmark
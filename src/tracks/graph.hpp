@@ -66,6 +66,8 @@ protected:
     // ------------------------------------------------------------------------
     /** Map 4 bounding box points to 4 closest graph nodes. */
     void loadBoundingBoxNodes();
+    // ------------------------------------------------------------------------
+    void buildSectorGrid();
 
 private:
     /** The 2d bounding box, used for hashing. */
@@ -90,6 +92,29 @@ private:
     /** The render target used for drawing the minimap. */
     std::unique_ptr<RenderTarget> m_render_target;
 
+    /** A uniform grid in the x/z plane to find the nodes near a point, each
+     *  cell lists all nodes whose bounding box overlaps the cell. Nodes of
+     *  cell i are m_grid_nodes[m_grid_cell_start[i]] till (excluding)
+     *  m_grid_nodes[m_grid_cell_start[i+1]]. Empty if not built. */
+    std::vector<unsigned int> m_grid_cell_start;
+
+    std::vector<int> m_grid_nodes;
+
+    /** Range of the minimum height of all 2d nodes in each cell, so cells
+     *  can be skipped if no node can pass the height test. */
+    std::vector<std::pair<float, float> > m_grid_cell_height;
+
+    /** For each cell if it contains a 3d node, which have no height test. */
+    std::vector<bool> m_grid_cell_3d;
+
+    /** Minimum x and z of the grid. */
+    float m_grid_min_x, m_grid_min_z;
+
+    float m_grid_cell_size;
+
+    /** Number of cells in x and z direction. */
+    int m_grid_width, m_grid_height;
+
     // ------------------------------------------------------------------------
     void createMesh(bool show_invisible=true,
                     bool enable_transparency=false,
@@ -103,6 +128,11 @@ private:
     // ------------------------------------------------------------------------
     void cleanupDebugMesh();
     // ------------------------------------------------------------------------
+    int findNearestSectorInGrid(const Vec3& xyz, int first,
+                                bool test_height) const;
+    // ------------------------------------------------------------------------
+    void getGridCell(const Vec3& xyz, int* x, int* z) const;
+    // ------------------------------------------------------------------------
     virtual bool hasLapLine() const = 0;
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const = 0;
@@ -118,6 +148,8 @@ public:
      *  that an instance exist. */
     static Graph* get() { return m_graph; }
     // ------------------------------------------------------------------------
+    static void benchmark();
+    // ------------------------------------------------------------------------
     /** Set the graph (either drive or arena graph for now). */
     static void setGraph(Graph* graph)
     {
@@ -50,6 +50,7 @@
 #include "graphics/sp/sp_shader_manager.hpp"
 #include "graphics/sp/sp_texture_manager.hpp"
 #include "io/file_manager.hpp"
+#include "io/mapped_file.hpp"
 #include "io/xml_node.hpp"
 #include "items/item.hpp"
 #include "items/item_manager.hpp"
@@ -75,9 +76,11 @@
 #include "tracks/drive_graph.hpp"
 #include "tracks/drive_node.hpp"
 #include "tracks/model_definition_loader.hpp"
+#include "tracks/track_bundle.hpp"
 #include "tracks/track_manager.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
 #include "utils/log.hpp"
 #include "mini_glm.hpp"
 #include "utils/string_utils.hpp"
@@ -94,7 +97,9 @@
 #include <SMeshBuffer.h>
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <set>
 #include <stdexcept>
 #include <sstream>
 #include <wchar.h>
@@ -384,45 +389,15 @@ void Track::cleanup()
     delete m_gfx_effect_mesh;
     m_gfx_effect_mesh = NULL;
 
+    m_server_bundle.reset();
+
 #ifndef SERVER_ONLY
     if (CVS->isGLSL())
         irr_driver->cleanSunInterposer();
 #endif
 
 
-    // The m_all_cached_mesh contains each mesh loaded from a file, which
-    // means that the mesh is stored in irrlichts mesh cache. To clean
-    // everything loaded by this track, we drop the ref count for each mesh
-    // here, till the ref count is 1, which means the mesh is only contained
-    // in the mesh cache, and can therefore be removed. Meshes load more
-    // than once are in m_all_cached_mesh more than once (which is easier
-    // than storing the mesh only once, but then having to test for each
-    // mesh if it is already contained in the list or not).
-    for (unsigned int i = 0; i < m_all_cached_meshes.size(); i++)
-    {
-        irr_driver->dropAllTextures(m_all_cached_meshes[i]);
-        // If a mesh is not in Irrlicht's texture cache, its refcount is
-        // 1 (since its scene node was removed, so the only other reference
-        // is in m_all_cached_meshes). In this case we only drop it once
-        // and don't try to remove it from the cache.
-        if (m_all_cached_meshes[i]->getReferenceCount() == 1)
-        {
-            m_all_cached_meshes[i]->drop();
-            continue;
-        }
-        m_all_cached_meshes[i]->drop();
-        if (m_all_cached_meshes[i]->getReferenceCount() == 1)
-            irr_driver->removeMeshFromCache(m_all_cached_meshes[i]);
-    }
-    m_all_cached_meshes.clear();
-
-    // Now free meshes that are not associated to any scene node.
-    for (unsigned int i = 0; i < m_detached_cached_meshes.size(); i++)
-    {
-        irr_driver->dropAllTextures(m_detached_cached_meshes[i]);
-        irr_driver->removeMeshFromCache(m_detached_cached_meshes[i]);
-    }
-    m_detached_cached_meshes.clear();
+    dropCachedMeshes();
 
     for(unsigned int i=0; i<m_sky_textures.size(); i++)
     {
@@ -515,6 +490,46 @@ void Track::cleanup()
     m_current_track[PT_MAIN] = NULL;
 }   // cleanup
 
+//-----------------------------------------------------------------------------
+/** Removes the meshes loaded by this track from irrlicht's mesh cache.
+ */
+void Track::dropCachedMeshes()
+{
+    // The m_all_cached_mesh contains each mesh loaded from a file, which
+    // means that the mesh is stored in irrlichts mesh cache. To clean
+    // everything loaded by this track, we drop the ref count for each mesh
+    // here, till the ref count is 1, which means the mesh is only contained
+    // in the mesh cache, and can therefore be removed. Meshes load more
+    // than once are in m_all_cached_mesh more than once (which is easier
+    // than storing the mesh only once, but then having to test for each
+    // mesh if it is already contained in the list or not).
+    for (unsigned int i = 0; i < m_all_cached_meshes.size(); i++)
+    {
+        irr_driver->dropAllTextures(m_all_cached_meshes[i]);
+        // If a mesh is not in Irrlicht's texture cache, its refcount is
+        // 1 (since its scene node was removed, so the only other reference
+        // is in m_all_cached_meshes). In this case we only drop it once
+        // and don't try to remove it from the cache.
+        if (m_all_cached_meshes[i]->getReferenceCount() == 1)
+        {
+            m_all_cached_meshes[i]->drop();
+            continue;
+        }
+        m_all_cached_meshes[i]->drop();
+        if (m_all_cached_meshes[i]->getReferenceCount() == 1)
+            irr_driver->removeMeshFromCache(m_all_cached_meshes[i]);
+    }
+    m_all_cached_meshes.clear();
+
+    // Now free meshes that are not associated to any scene node.
+    for (unsigned int i = 0; i < m_detached_cached_meshes.size(); i++)
+    {
+        irr_driver->dropAllTextures(m_detached_cached_meshes[i]);
+        irr_driver->removeMeshFromCache(m_detached_cached_meshes[i]);
+    }
+    m_detached_cached_meshes.clear();
+}   // dropCachedMeshes
+
 //-----------------------------------------------------------------------------
 void Track::loadTrackInfo()
 {
@@ -853,7 +868,8 @@ void Track::mapPoint2MiniMap(const Vec3 &xyz, Vec3 *draw_at) const
  *         height map calculation.
  */
 void Track::createPhysicsModel(unsigned int main_track_count,
-                               bool for_height_map)
+                               bool for_height_map,
+                               const TrackBundle *bundle)
 {
     // Remove the temporary track rigid body, and then convert all objects
     // (i.e. the track and all additional objects) into a new rigid body
@@ -875,6 +891,17 @@ void Track::createPhysicsModel(unsigned int main_track_count,
     // (like invisible walls).
     if (!for_height_map)
     {
+        if (bundle)
+        {
+            bundle->createTriangles(TrackBundle::TB_PHYSICS_ONLY_TRACK,
+                                    m_track_mesh);
+            if (m_gfx_effect_mesh)
+            {
+                bundle->createTriangles(
+                    TrackBundle::TB_PHYSICS_ONLY_GFX_EFFECT,
+                    m_gfx_effect_mesh);
+            }
+        }
         for (unsigned int i = 0; i<m_static_physics_only_nodes.size(); i++)
         {
             main_loop->renderGUI(5550, i, m_static_physics_only_nodes.size());
@@ -922,13 +949,26 @@ void Track::createPhysicsModel(unsigned int main_track_count,
         uploadNodeVertexBuffer(m_all_nodes[i]);
     }
     main_loop->renderGUI(5580);
+    // The cached BVH is also identified by the hash of all triangles, so it
+    // is rebuilt when the track or the objects joined to it change
     if (for_height_map)
-        m_track_mesh->createCollisionShape();
+    {
+        m_track_mesh->createCollisionShape(true/*create_collision_object*/,
+            (m_ident + "-height-map").c_str());
+    }
     else
-        m_track_mesh->createPhysicalBody(m_friction);
+    {
+        m_track_mesh->createPhysicalBody(m_friction,
+            (btCollisionObject::CollisionFlags)0,
+            (m_ident + "-track").c_str());
+    }
     main_loop->renderGUI(5585);
     if (m_gfx_effect_mesh)
-        m_gfx_effect_mesh->createCollisionShape();
+    {
+        m_gfx_effect_mesh->createCollisionShape(
+            true/*create_collision_object*/,
+            (m_ident + "-gfx-effect").c_str());
+    }
     main_loop->renderGUI(5590);
 
 }   // createPhysicsModel
@@ -1330,7 +1370,6 @@ bool Track::loadMainTrack(const XMLNode &root)
     // could be relaxed to fix this, it is not certain how the physics
     // will handle items that are out of the AABB
     m_aabb_max.setY(m_aabb_max.getY()+30.0f);
-    Physics::get()->init(m_aabb_min, m_aabb_max);
 
     ModelDefinitionLoader lodLoader(this);
 
@@ -1548,6 +1587,28 @@ bool Track::loadMainTrack(const XMLNode &root)
     return true;
 }   // loadMainTrack
 
+// ----------------------------------------------------------------------------
+/** Creates the meshes of the main model and the static objects from the
+ *  server bundle of the track, instead of loading the models. The physics
+ *  only static objects are added in createPhysicsModel().
+ *  \param bundle The server bundle.
+ */
+void Track::loadMainTrackFromBundle(const TrackBundle &bundle)
+{
+    assert(m_track_mesh==NULL);
+    assert(m_height_map_mesh==NULL);
+    assert(m_gfx_effect_mesh==NULL);
+    m_challenges.clear();
+
+    m_track_mesh      = new TriangleMesh(/*can_be_transformed*/false);
+    m_gfx_effect_mesh = new TriangleMesh(/*can_be_transformed*/false);
+    bundle.createTriangles(TrackBundle::TB_TRACK, m_track_mesh);
+    bundle.createTriangles(TrackBundle::TB_GFX_EFFECT, m_gfx_effect_mesh);
+    m_aabb_min = bundle.getAABBMin();
+    m_aabb_max = bundle.getAABBMax();
+    m_gfx_effect_mesh->createCollisionShape();
+}   // loadMainTrackFromBundle
+
 // ----------------------------------------------------------------------------
 void Track::freeCachedMeshVertexBuffer()
 {
@@ -1823,6 +1884,53 @@ static void recursiveUpdatePhysics(std::vector<TrackObject*>& tos)
 }   // recursiveUpdatePhysics
 
 // ----------------------------------------------------------------------------
+/** Loads the materials.xml file of the track if it exists.
+ */
+void Track::loadMaterials()
+{
+    try
+    {
+        std::string materials_file = m_root+"materials.xml";
+        if(m_cache_track)
+        {
+            if(!m_materials_loaded)
+                material_manager->addSharedMaterial(materials_file);
+            m_materials_loaded = true;
+        }
+        else
+            material_manager->pushTempMaterial(materials_file);
+    }
+    catch (std::exception& e)
+    {
+        // no temporary materials.xml file, ignore
+        (void)e;
+    }
+}   // loadMaterials
+
+//-----------------------------------------------------------------------------
+/** Returns the server bundle of a scene of this track, or NULL if none was
+ *  written or the track changed since then.
+ *  \param mode_id Index of the mode whose scene is loaded.
+ */
+std::unique_ptr<TrackBundle> Track::loadServerBundle(unsigned int mode_id)
+                                                                         const
+{
+    const std::string &scene = m_all_modes[mode_id].m_scene;
+    const std::string filename = TrackBundle::getFilename(m_ident, scene);
+    if (filename.empty() || !file_manager->fileExists(filename))
+        return nullptr;
+    std::unique_ptr<TrackBundle> bundle(new TrackBundle());
+    if (!bundle->load(filename, TrackBundle::computeTrackHash(m_root, scene),
+                      m_root))
+    {
+        Log::warn("track", "The server bundle of '%s' is outdated, run "
+                  "--server-track-bundles again.", m_ident.c_str());
+        return nullptr;
+    }
+    return bundle;
+}   // loadServerBundle
+
+//-----------------------------------------------------------------------------
 /** This function load the actual scene, i.e. all parts of the track,
  *  animations, items, ... It  is called from world during initialisation.
  *  Track is the first model to be loaded, so at this stage the root scene node
@@ -1894,23 +2002,7 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     main_loop->renderGUI(3200);
 
     // First read the temporary materials.xml file if it exists
-    try
-    {
-        std::string materials_file = m_root+"materials.xml";
-        if(m_cache_track)
-        {
-            if(!m_materials_loaded)
-                material_manager->addSharedMaterial(materials_file);
-            m_materials_loaded = true;
-        }
-        else
-            material_manager->pushTempMaterial(materials_file);
-    }
-    catch (std::exception& e)
-    {
-        // no temporary materials.xml file, ignore
-        (void)e;
-    }
+    loadMaterials();
     main_loop->renderGUI(3300);
 
     // Start building the scene graph
@@ -1970,7 +2062,9 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     else
     {
         // Seed random engine locally
-        uint32_t seed = (uint32_t)StkTime::getTimeSinceEpoch();
+        uint32_t seed = UserConfigParams::m_item_seed >= 0 ?
+            (uint32_t)UserConfigParams::m_item_seed :
+            (uint32_t)StkTime::getTimeSinceEpoch();
         ItemManager::updateRandomSeed(seed);
         m_item_manager = std::make_shared<ItemManager>();
         powerup_manager->setRandomSeed(seed);
@@ -2063,7 +2157,16 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         node->get("xyz", &m_godrays_position);
     }
 
-    loadMainTrack(*root);
+    // A server without graphics only needs the collision triangles of the
+    // main model and the static objects, which are taken from the server
+    // bundle of the track if one was written (see createServerBundles())
+    if (GUIEngine::isNoGraphics())
+        m_server_bundle = loadServerBundle(mode_id);
+    if (m_server_bundle)
+        loadMainTrackFromBundle(*m_server_bundle);
+    else
+        loadMainTrack(*root);
+    Physics::get()->init(m_aabb_min, m_aabb_max);
     main_loop->renderGUI(4700);
 
     unsigned int main_track_count = (unsigned int)m_all_nodes.size();
@@ -2257,7 +2360,8 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         std::swap(m_track_mesh, m_height_map_mesh);
         std::swap(m_gfx_effect_mesh, gfx_effect_mesh);
     }
-    createPhysicsModel(main_track_count, false/*for_height_map*/);
+    createPhysicsModel(main_track_count, false/*for_height_map*/,
+                       m_server_bundle.get());
 
     main_loop->renderGUI(5600);
 
@@ -3020,8 +3124,11 @@ void Track::initChildTrack()
 
     // We call physics init in child process too
     Physics::get()->init(m_aabb_min, m_aabb_max);
-    m_track_mesh->createPhysicalBody(m_friction);
-    m_gfx_effect_mesh->createCollisionShape();
+    // Same meshes as the main process, so the cached BVH is shared
+    m_track_mesh->createPhysicalBody(m_friction,
+        (btCollisionObject::CollisionFlags)0, (m_ident + "-track").c_str());
+    m_gfx_effect_mesh->createCollisionShape(true/*create_collision_object*/,
+        (m_ident + "-gfx-effect").c_str());
 
     // All child track objects are only cloned if they have physical objects
     for (auto* to : m_track_object_manager->getObjects().m_contents_vector)
@@ -3049,6 +3156,340 @@ void Track::cleanChildTrack()
     m_current_track[PT_CHILD] = NULL;
 }   // cleanChildTrack
 
+//-----------------------------------------------------------------------------
+/** Measures for the main model of each track the time to create its
+ *  collision shape when the BVH is built, and when it is loaded from the BVH
+ *  cache. Uses its own cache names, which are removed afterwards.
+ */
+void Track::benchmark()
+{
+    double total_build = 0.0, total_load = 0.0;
+    for (unsigned int i = 0; i < track_manager->getNumberOfTracks(); i++)
+    {
+        Track* track = track_manager->getTrack(i);
+        if (track->isInternal() || track->isAddon())
+            continue;
+        XMLNode* root = file_manager->createXMLTree(track->m_filename);
+        if (!root)
+            continue;
+        std::string model_name;
+        const XMLNode* track_node = root->getNode("track");
+        if (track_node)
+            track_node->get("model", &model_name);
+        delete root;
+        if (model_name.empty())
+            continue;
+        scene::IMesh* mesh = irr_driver->getMesh(track->m_root + model_name);
+        if (!mesh)
+            continue;
+
+        TriangleMesh triangle_mesh(/*can_be_transformed*/false);
+        int triangles = 0;
+        for (unsigned int j = 0; j < mesh->getMeshBufferCount(); j++)
+        {
+            scene::IMeshBuffer* mb = mesh->getMeshBuffer(j);
+            const u16* indices = mb->getIndices();
+            for (unsigned int k = 0; k + 2 < mb->getIndexCount(); k += 3)
+            {
+                Vec3 v0 = mb->getPosition(indices[k]);
+                Vec3 v1 = mb->getPosition(indices[k + 1]);
+                Vec3 v2 = mb->getPosition(indices[k + 2]);
+                Vec3 normal = (v1 - v0).cross(v2 - v0);
+                if (normal.length2() > 0.0f)
+                    normal.normalize();
+                triangle_mesh.addTriangle(v0, v1, v2, normal, normal, normal,
+                    /*material*/NULL);
+                triangles++;
+            }
+        }
+        irr_driver->removeMeshFromCache(mesh);
+
+        auto start = std::chrono::steady_clock::now();
+        triangle_mesh.createCollisionShape(/*create_collision_object*/false);
+        double build = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        triangle_mesh.removeAll();
+
+        // The first call writes the cache, the second one loads it
+        const std::string name = "benchmark-" + track->getIdent();
+        triangle_mesh.createCollisionShape(false, name.c_str());
+        triangle_mesh.removeAll();
+        start = std::chrono::steady_clock::now();
+        triangle_mesh.createCollisionShape(false, name.c_str());
+        double load = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        bool cached = triangle_mesh.isBVHCached();
+        size_t size = triangle_mesh.getBVHSize();
+        triangle_mesh.removeAll();
+
+        Log::info("Track", "%s: %d triangles, build %.2fms, "
+            "load %.2fms%s, BVH %dkB.", track->getIdent().c_str(),
+            triangles, build * 1000.0f,
+            load * 1000.0f, cached ? "" : " (not cached)",
+            (int)(size / 1024));
+        total_build += build;
+        total_load += load;
+    }
+    Log::info("Track", "All tracks: build %.2fms, load %.2fms.",
+        total_build * 1000.0f, total_load * 1000.0f);
+
+    const std::string& dir = file_manager->getCachedBVHDir();
+    if (dir.empty())
+        return;
+    std::set<std::string> files;
+    file_manager->listFiles(files, dir);
+    for (const std::string& file : files)
+    {
+        if (file.compare(0, 10, "benchmark-") == 0)
+            file_manager->removeFile(dir + file);
+    }
+}   // benchmark
+
+// ----------------------------------------------------------------------------
+/** Unit testing for server bundles: the triangles and materials of a saved
+ *  and loaded bundle must be the same as the ones the track meshes get from
+ *  the models, and a bundle must be rejected if the hash of the track files
+ *  changed or the file is truncated. For now we use the lighthouse track.
+ */
+void Track::unitTesting()
+{
+    Track *track = track_manager->getTrack("lighthouse");
+    assert(track);
+    const std::string &scene = track->m_all_modes[0].m_scene;
+    const std::string filename =
+        TrackBundle::getFilename("unittest-" + track->getIdent(), scene);
+    if (filename.empty())
+    {
+        Log::warn("Track", "No server bundle directory, test skipped.");
+        return;
+    }
+    const uint64_t hash = TrackBundle::computeTrackHash(track->m_root, scene);
+
+    TrackBundle converted;
+    bool ok = track->loadBundleModels(0, &converted);
+    assert(ok);
+    ok = converted.save(filename, hash, track->m_root);
+    assert(ok);
+    TrackBundle loaded;
+    ok = loaded.load(filename, hash, track->m_root);
+    assert(ok);
+
+    int error_count = 0;
+    // Compares a part of the loaded bundle with the triangles first to
+    // last-1 which the models added to a track mesh
+    auto compare = [&loaded, &error_count](TrackBundle::Part part,
+        const TriangleMesh &expected, unsigned int first, unsigned int last)
+    {
+        TriangleMesh mesh(/*can_be_transformed*/false);
+        loaded.createTriangles(part, &mesh);
+        if (mesh.getNumTriangles() != last - first)
+        {
+            Log::error("Track", "Part %d: %d triangles instead of %d.",
+                       part, mesh.getNumTriangles(), last - first);
+            error_count++;
+            return;
+        }
+        for (unsigned int i = 0; i < mesh.getNumTriangles(); i++)
+        {
+            btVector3 a[6], b[6];
+            expected.getTriangle(first + i, a, a + 1, a + 2);
+            expected.getNormals(first + i, a + 3, a + 4, a + 5);
+            mesh.getTriangle(i, b, b + 1, b + 2);
+            mesh.getNormals(i, b + 3, b + 4, b + 5);
+            bool same = expected.getP1P2P3(first + i) == mesh.getP1P2P3(i) &&
+                expected.getMaterial(first + i) == mesh.getMaterial(i);
+            for (unsigned int j = 0; j < 6; j++)
+                same = same && (a[j] - b[j]).length2() == 0.0f;
+            if (!same)
+            {
+                Log::error("Track", "Part %d: triangle %d differs.", part, i);
+                error_count++;
+            }
+        }
+    };
+    const unsigned int num_track =
+        converted.getNumTriangles(TrackBundle::TB_TRACK);
+    const unsigned int num_gfx =
+        converted.getNumTriangles(TrackBundle::TB_GFX_EFFECT);
+    compare(TrackBundle::TB_TRACK, *track->m_track_mesh, 0, num_track);
+    compare(TrackBundle::TB_GFX_EFFECT, *track->m_gfx_effect_mesh, 0,
+            num_gfx);
+    compare(TrackBundle::TB_PHYSICS_ONLY_TRACK, *track->m_track_mesh,
+            num_track, track->m_track_mesh->getNumTriangles());
+    compare(TrackBundle::TB_PHYSICS_ONLY_GFX_EFFECT,
+            *track->m_gfx_effect_mesh, num_gfx,
+            track->m_gfx_effect_mesh->getNumTriangles());
+
+    // A bundle of changed track files is not used
+    TrackBundle stale;
+    if (stale.load(filename, hash + 1, track->m_root))
+    {
+        Log::error("Track", "Bundle with a wrong hash was loaded.");
+        error_count++;
+    }
+
+    // Neither is a partly written bundle
+    const std::string truncated = TrackBundle::getFilename(
+        "unittest-truncated-" + track->getIdent(), scene);
+    MappedFile file;
+    ok = file.open(filename) && FileUtils::writeFileAtomically(truncated,
+        [&file](FILE *f)
+        {
+            return fwrite(file.getData(), file.getSize() - 16, 1, f) == 1;
+        });
+    if (!ok)
+    {
+        Log::error("Track", "Truncated bundle can't be written.");
+        error_count++;
+    }
+    TrackBundle partial;
+    if (partial.load(truncated, hash, track->m_root))
+    {
+        Log::error("Track", "Truncated bundle was loaded.");
+        error_count++;
+    }
+
+    track->unloadBundleModels();
+    file_manager->removeFile(filename);
+    file_manager->removeFile(truncated);
+    assert(error_count == 0);
+}   // unitTesting
+
+//-----------------------------------------------------------------------------
+/** Loads the main model and the static objects of a scene in the same way
+ *  as loadTrackModel(), and adds the triangles they add to the track meshes
+ *  to a bundle. The models stay loaded till unloadBundleModels() is called.
+ *  \param mode_id Index of the mode whose scene is used.
+ *  \param bundle The bundle to which the triangles are added.
+ *  \return False if the scene can't be loaded.
+ */
+bool Track::loadBundleModels(unsigned int mode_id, TrackBundle *bundle)
+{
+    XMLNode *root = file_manager->createXMLTree(m_root +
+                                                m_all_modes[mode_id].m_scene);
+    if (!root || root->getName() != "scene" || !root->getNode("track"))
+    {
+        delete root;
+        return false;
+    }
+
+    file_manager->pushTextureSearchPath(m_root,
+        StringUtils::insertValues("tracks/%s", m_ident.c_str()));
+    file_manager->pushModelSearchPath(m_root);
+    loadMaterials();
+
+    loadMainTrack(*root);
+    delete root;
+    const unsigned int num_track = m_track_mesh->getNumTriangles();
+    const unsigned int num_gfx   = m_gfx_effect_mesh->getNumTriangles();
+    for (unsigned int i = 0; i < m_static_physics_only_nodes.size(); i++)
+        convertTrackToBullet(m_static_physics_only_nodes[i]);
+
+    bundle->setAABB(m_aabb_min, m_aabb_max);
+    bundle->addTriangles(TrackBundle::TB_TRACK, *m_track_mesh, 0, num_track);
+    bundle->addTriangles(TrackBundle::TB_GFX_EFFECT, *m_gfx_effect_mesh, 0,
+                         num_gfx);
+    bundle->addTriangles(TrackBundle::TB_PHYSICS_ONLY_TRACK, *m_track_mesh,
+                         num_track, m_track_mesh->getNumTriangles());
+    bundle->addTriangles(TrackBundle::TB_PHYSICS_ONLY_GFX_EFFECT,
+                         *m_gfx_effect_mesh, num_gfx,
+                         m_gfx_effect_mesh->getNumTriangles());
+    return true;
+}   // loadBundleModels
+
+//-----------------------------------------------------------------------------
+/** Removes the models loaded by loadBundleModels().
+ */
+void Track::unloadBundleModels()
+{
+    for (unsigned int i = 0; i < m_animated_textures.size(); i++)
+        delete m_animated_textures[i];
+    m_animated_textures.clear();
+    for (unsigned int i = 0; i < m_all_nodes.size(); i++)
+        irr_driver->removeNode(m_all_nodes[i]);
+    m_all_nodes.clear();
+    for (unsigned int i = 0; i < m_static_physics_only_nodes.size(); i++)
+        m_static_physics_only_nodes[i]->remove();
+    m_static_physics_only_nodes.clear();
+    m_challenges.clear();
+    delete m_track_mesh;
+    m_track_mesh = NULL;
+    delete m_gfx_effect_mesh;
+    m_gfx_effect_mesh = NULL;
+    dropCachedMeshes();
+
+    file_manager->popTextureSearchPath();
+    file_manager->popModelSearchPath();
+    if (m_cache_track)
+        material_manager->makeMaterialsPermanent();
+    else
+        material_manager->popTempMaterial();
+}   // unloadBundleModels
+
+//-----------------------------------------------------------------------------
+/** Writes the server bundle of a scene of this track.
+ *  \param mode_id Index of the mode whose scene is used.
+ *  \return False if the bundle was not written.
+ */
+bool Track::createServerBundle(unsigned int mode_id)
+{
+    const std::string &scene = m_all_modes[mode_id].m_scene;
+    const std::string filename = TrackBundle::getFilename(m_ident, scene);
+    TrackBundle bundle;
+    if (filename.empty() || !loadBundleModels(mode_id, &bundle))
+        return false;
+    // The challenge orbs of the overworld are not part of a bundle
+    const bool written = m_challenges.empty() &&
+        bundle.save(filename, TrackBundle::computeTrackHash(m_root, scene),
+                    m_root);
+    unloadBundleModels();
+    return written;
+}   // createServerBundle
+
+//-----------------------------------------------------------------------------
+/** Writes the server bundles of all tracks (except internal ones) and
+ *  computes the cached path tables of their navmeshes, so a server loads
+ *  these tracks without their models. This must run without graphics, so
+ *  that the models are converted in the same way as on a server.
+ */
+void Track::createServerBundles()
+{
+    if (file_manager->getServerBundleDir().empty())
+        return;
+    unsigned int num_bundles = 0;
+    for (unsigned int i = 0; i < track_manager->getNumberOfTracks(); i++)
+    {
+        Track* track = track_manager->getTrack(i);
+        if (track->isInternal())
+            continue;
+        std::set<std::string> scenes;
+        for (unsigned int j = 0; j < track->m_all_modes.size(); j++)
+        {
+            const std::string &scene = track->m_all_modes[j].m_scene;
+            if (!scenes.insert(scene).second)
+                continue;
+            auto start = std::chrono::steady_clock::now();
+            if (!track->createServerBundle(j))
+            {
+                Log::warn("Track", "No server bundle written for '%s' (%s).",
+                          track->getIdent().c_str(), scene.c_str());
+                continue;
+            }
+            double time = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            Log::info("Track", "Wrote server bundle of '%s' (%s) in %.2fms.",
+                      track->getIdent().c_str(), scene.c_str(),
+                      time * 1000.0f);
+            num_bundles++;
+        }
+        // Writes the cached path tables
+        if ((track->isArena() || track->isSoccer()) && track->hasNavMesh())
+            delete new ArenaGraph(track->getTrackFile("navmesh.xml"));
+    }
+    Log::info("Track", "Wrote %d server bundles in '%s'.", num_bundles,
+              file_manager->getServerBundleDir().c_str());
+}   // createServerBundles
+
 //-----------------------------------------------------------------------------
 video::IImage* Track::getSkyTexture(std::string path) const
 {
@@ -70,6 +70,7 @@ class ParticleKind;
 class PhysicalObject;
 class RenderTarget;
 class TrackObject;
+class TrackBundle;
 class TrackObjectManager;
 class TriangleMesh;
 class XMLNode;
@@ -217,6 +218,9 @@ private:
      *  allowing the kart to drive in/partly under water), but the
      *  actual surface position is needed for the water splash effect. */
     TriangleMesh*            m_gfx_effect_mesh;
+    /** The server bundle from which the track meshes were created, which
+     *  must exist as long as the meshes since they use its triangles. */
+    std::shared_ptr<TrackBundle> m_server_bundle;
     /** Minimum coordinates of this track. */
     Vec3                     m_aabb_min;
     /** Maximum coordinates of this track. */
@@ -415,6 +419,13 @@ private:
     void loadArenaGraph(const XMLNode &node);
     btQuaternion getArenaStartRotation(const Vec3& xyz, float heading);
     bool loadMainTrack(const XMLNode &node);
+    void loadMainTrackFromBundle(const TrackBundle &bundle);
+    void loadMaterials();
+    std::unique_ptr<TrackBundle> loadServerBundle(unsigned int mode_id) const;
+    bool loadBundleModels(unsigned int mode_id, TrackBundle *bundle);
+    void unloadBundleModels();
+    bool createServerBundle(unsigned int mode_id);
+    void dropCachedMeshes();
     void loadMinimap();
     void createWater(const XMLNode &node);
     void getMusicInformation(std::vector<std::string>&  filenames,
@@ -445,6 +456,12 @@ public:
     // ------------------------------------------------------------------------
     static void cleanChildTrack();
     // ------------------------------------------------------------------------
+    static void benchmark();
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    static void createServerBundles();
+    // ------------------------------------------------------------------------
     void handleAnimatedTextures(scene::ISceneNode *node, const XMLNode &xml);
 
     /** Flag to avoid loading navmeshes (useful to speedup debugging: e.g.
@@ -464,7 +481,8 @@ public:
     void               startMusic        () const;
 
     void               createPhysicsModel(unsigned int main_track_count,
-                                          bool for_height_map);
+                                          bool for_height_map,
+                                          const TrackBundle *bundle = NULL);
     void               updateGraphics(float dt);
     void               update(int ticks);
     void               reset();
@@ -614,6 +632,10 @@ public:
     /** Returns the graphical effect mesh for this track. */
     const TriangleMesh& getGFXEffectMesh() const {return *m_gfx_effect_mesh;}
     // ------------------------------------------------------------------------
+    /** Returns true if the meshes of this track use the triangles of a
+     *  server bundle. */
+    bool hasServerBundle() const          { return m_server_bundle != NULL; }
+    // ------------------------------------------------------------------------
     /** Get the max players supported for this track, for arena only. */
     unsigned int getMaxArenaPlayers() const
                                                 { return m_max_arena_players; }
@@ -0,0 +1,409 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "tracks/track_bundle.hpp"
+
+#include "config/stk_config.hpp"
+#include "graphics/material.hpp"
+#include "graphics/material_manager.hpp"
+#include "io/file_manager.hpp"
+#include "physics/triangle_mesh.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/fnv_hash.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+
+#include <IFileSystem.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <sys/stat.h>
+
+namespace
+{
+    /** Header of a bundle file. It is followed by the materials, each a
+     *  flag byte (1 if the texture path is relative to the track directory)
+     *  and four NUL terminated strings (texture path, texture name, second
+     *  texture and shader), padded to 16 bytes. Then follow the triangles of
+     *  each part: the points, the normals, the p1p2p3 values and the
+     *  material indices, padded to 16 bytes. The file ends with the point
+     *  indices 0 to 3*n-1, which are used by all parts (n is the largest
+     *  number of triangles of a part). All sizes are multiples of 16, so
+     *  the points and normals are aligned as bullet needs. */
+    struct TrackBundleHeader
+    {
+        char     m_magic[8];
+        uint64_t m_hash;
+        float    m_smooth_angle_limit;
+        uint32_t m_num_materials;
+        uint32_t m_materials_size;
+        uint32_t m_num_triangles[TrackBundle::TB_COUNT];
+        float    m_aabb_min[3];
+        float    m_aabb_max[3];
+        uint32_t m_file_size;
+        uint32_t m_padding[2];
+    };
+    static_assert(sizeof(TrackBundleHeader) % 16 == 0,
+                  "Triangles must be aligned to 16 bytes");
+    static_assert(sizeof(btVector3) == 16, "Unexpected size of btVector3");
+    const char TRACK_BUNDLE_MAGIC[8] = { 'S', 'T', 'K', 'T', 'B', 'D',
+                                         '0', '3' };
+    const uint32_t NO_MATERIAL = 0xffffffff;
+
+    // ------------------------------------------------------------------------
+    /** Returns the size of the triangles of a part in a file. */
+    size_t getPartSize(uint32_t num_triangles)
+    {
+        const size_t size = num_triangles * (6 * sizeof(btVector3) +
+                                             sizeof(float) + sizeof(uint32_t));
+        return (size + 15) / 16 * 16;
+    }   // getPartSize
+
+    // ------------------------------------------------------------------------
+    /** Returns the lower case absolute path of a track directory, which is
+     *  how materials store the path of their texture. */
+    std::string getMaterialRoot(const std::string &root)
+    {
+        std::string path = file_manager->getFileSystem()
+            ->getAbsolutePath(root.c_str()).c_str();
+        if (!path.empty() && path[path.size() - 1] != '/')
+            path += "/";
+        return StringUtils::toLowerCase(path);
+    }   // getMaterialRoot
+}   // namespace
+
+// ----------------------------------------------------------------------------
+TrackBundle::TrackBundle()
+{
+    memset(m_triangles, 0, sizeof(m_triangles));
+}   // TrackBundle
+
+// ----------------------------------------------------------------------------
+/** Returns the full path of the bundle of a scene file of a track, or "" if
+ *  there is no directory for bundles.
+ *  \param ident Identifier of the track.
+ *  \param scene Name of the scene file.
+ */
+std::string TrackBundle::getFilename(const std::string &ident,
+                                     const std::string &scene)
+{
+    const std::string dir = file_manager->getServerBundleDir();
+    if (dir.empty())
+        return "";
+    return dir + ident + "-" + StringUtils::removeExtension(scene) +
+           ".bundle";
+}   // getFilename
+
+// ----------------------------------------------------------------------------
+/** Returns a hash of the name, size and modification time of all files in
+ *  a track directory, so a bundle is not used anymore once a model, the
+ *  scene or the materials of the track changed.
+ *  \param root The track directory.
+ *  \param scene Name of the scene file.
+ */
+uint64_t TrackBundle::computeTrackHash(const std::string &root,
+                                       const std::string &scene)
+{
+    FNVHash hash;
+    hash.add(scene);
+
+    std::set<std::string> files;
+    file_manager->listFiles(files, root);
+    for (const std::string &file : files)
+    {
+        struct stat st;
+        if (FileManager::isDirectory(root + file) ||
+            FileUtils::statU8Path(root + file, &st) != 0)
+            continue;
+        hash.add(file);
+        hash.add((uint64_t)st.st_size);
+        hash.add((uint64_t)st.st_mtime);
+    }
+    return hash.get();
+}   // computeTrackHash
+
+// ----------------------------------------------------------------------------
+/** Loads a bundle. The file is memory mapped if possible, so its pages are
+ *  shared by all servers using the same track, and the triangles are only
+ *  read from disk when used.
+ *  \param filename Full path of the bundle.
+ *  \param hash The hash of the track files (see computeTrackHash()).
+ *  \param root The track directory.
+ *  \return False if the bundle doesn't exist or can't be used.
+ */
+bool TrackBundle::load(const std::string &filename, uint64_t hash,
+                       const std::string &root)
+{
+    if (!m_file.open(filename))
+        return false;
+    const char *data = (const char*)m_file.getData();
+    const size_t size = m_file.getSize();
+    TrackBundleHeader header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    // A truncated file is rejected before any offset is computed from it
+    if (memcmp(header.m_magic, TRACK_BUNDLE_MAGIC,
+               sizeof(TRACK_BUNDLE_MAGIC)) != 0 ||
+        header.m_file_size != size || header.m_hash != hash ||
+        header.m_smooth_angle_limit != stk_config->m_smooth_angle_limit)
+        return false;
+
+    size_t offset = sizeof(header);
+    if (header.m_materials_size % 16 != 0 ||
+        header.m_materials_size > size - offset ||
+        !loadMaterials(data + offset, header.m_materials_size,
+                       header.m_num_materials, root))
+        return false;
+    offset += header.m_materials_size;
+
+    uint32_t max_triangles = 0;
+    for (unsigned int i = 0; i < TB_COUNT; i++)
+    {
+        const uint32_t n = header.m_num_triangles[i];
+        if (n > (size - offset) / (6 * sizeof(btVector3)) ||
+            getPartSize(n) > size - offset)
+            return false;
+        TriangleMesh::SharedTriangles &t = m_triangles[i];
+        t.m_count         = n;
+        t.m_vertices      = (const btVector3*)(data + offset);
+        t.m_normals       = t.m_vertices + 3 * n;
+        t.m_p1p2p3        = (const float*)(t.m_normals + 3 * n);
+        t.m_material_ids  = (const uint32_t*)(t.m_p1p2p3 + n);
+        t.m_materials     = m_materials.data();
+        t.m_num_materials = (unsigned int)m_materials.size();
+        offset += getPartSize(n);
+        max_triangles = std::max(max_triangles, n);
+    }
+    if (size - offset != max_triangles * 3 * sizeof(int))
+        return false;
+    for (unsigned int i = 0; i < TB_COUNT; i++)
+        m_triangles[i].m_indices = (const int*)(data + offset);
+    m_aabb_min = Vec3(header.m_aabb_min[0], header.m_aabb_min[1],
+                      header.m_aabb_min[2]);
+    m_aabb_max = Vec3(header.m_aabb_max[0], header.m_aabb_max[1],
+                      header.m_aabb_max[2]);
+    return true;
+}   // load
+
+// ----------------------------------------------------------------------------
+/** Finds the materials of a bundle, which must be the same as when the
+ *  bundle was written.
+ *  \param data The materials in the file.
+ *  \param size Size of the materials in the file.
+ *  \param num_materials Number of materials.
+ *  \param root The track directory.
+ */
+bool TrackBundle::loadMaterials(const char *data, size_t size,
+                                unsigned int num_materials,
+                                const std::string &root)
+{
+    const std::string material_root = getMaterialRoot(root);
+    const char *end = data + size;
+    m_materials.clear();
+    for (unsigned int i = 0; i < num_materials; i++)
+    {
+        if (data >= end)
+            return false;
+        const bool relative = *data++ == 1;
+        std::string strings[4];
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            const char *nul = (const char*)memchr(data, 0, end - data);
+            if (!nul)
+                return false;
+            strings[j].assign(data, nul);
+            data = nul + 1;
+        }
+        std::string &full_path = strings[0];
+        if (relative)
+            full_path = material_root + full_path;
+        const Material *material = material_manager->getMaterialSPM(
+            full_path.empty() ? strings[1] : full_path, strings[2],
+            strings[3]);
+        if (material->getTexFullPath() != full_path ||
+            material->getTexFname() != strings[1])
+        {
+            Log::warn("TrackBundle", "Material '%s' changed.",
+                      full_path.empty() ? strings[1].c_str()
+                                        : full_path.c_str());
+            return false;
+        }
+        m_materials.push_back(material);
+    }
+    return true;
+}   // loadMaterials
+
+// ----------------------------------------------------------------------------
+/** Writes the bundle.
+ *  \param filename Full path of the bundle.
+ *  \param hash The hash of the track files (see computeTrackHash()).
+ *  \param root The track directory.
+ *  \return False if the file can't be written.
+ */
+bool TrackBundle::save(const std::string &filename, uint64_t hash,
+                       const std::string &root) const
+{
+    const std::string material_root = getMaterialRoot(root);
+    std::string materials;
+    for (const Material *material : m_materials)
+    {
+        const std::string &full_path = material->getTexFullPath();
+        const bool relative =
+            StringUtils::startsWith(full_path, material_root);
+        materials += relative ? '\1' : '\0';
+        materials += relative ? full_path.substr(material_root.size())
+                              : full_path;
+        materials += '\0';
+        materials += material->getTexFname()    + '\0';
+        materials += material->getUVTwoTexture() + '\0';
+        materials += material->getShaderName()  + '\0';
+    }
+    materials.resize((materials.size() + 15) / 16 * 16, '\0');
+
+    TrackBundleHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, TRACK_BUNDLE_MAGIC, sizeof(TRACK_BUNDLE_MAGIC));
+    header.m_hash               = hash;
+    header.m_smooth_angle_limit = stk_config->m_smooth_angle_limit;
+    header.m_num_materials      = (uint32_t)m_materials.size();
+    header.m_materials_size     = (uint32_t)materials.size();
+    uint32_t max_triangles = 0;
+    uint64_t file_size = sizeof(header) + materials.size();
+    for (unsigned int i = 0; i < TB_COUNT; i++)
+    {
+        header.m_num_triangles[i] = m_triangles[i].m_count;
+        max_triangles = std::max(max_triangles, m_triangles[i].m_count);
+        file_size += getPartSize(m_triangles[i].m_count);
+    }
+    file_size += (uint64_t)max_triangles * 3 * sizeof(int);
+    if (file_size > 0xffffffffULL)
+    {
+        Log::warn("TrackBundle", "Track is too large for '%s'.",
+                  filename.c_str());
+        return false;
+    }
+    header.m_file_size = (uint32_t)file_size;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        header.m_aabb_min[i] = m_aabb_min[i];
+        header.m_aabb_max[i] = m_aabb_max[i];
+    }
+
+    std::vector<int> indices(max_triangles * 3);
+    for (unsigned int i = 0; i < indices.size(); i++)
+        indices[i] = (int)i;
+    bool written = FileUtils::writeFileAtomically(filename,
+        [this, &header, &materials, &indices](FILE *f)
+        {
+            return fwrite(&header, sizeof(header), 1, f) == 1 &&
+                fwrite(materials.data(), materials.size(), 1, f) == 1 &&
+                writeTriangles(f) && (indices.empty() ||
+                fwrite(indices.data(), sizeof(int), indices.size(), f) ==
+                indices.size());
+        });
+    if (!written)
+    {
+        Log::warn("TrackBundle", "Failed to write '%s'.", filename.c_str());
+        return false;
+    }
+    return true;
+}   // save
+
+// ----------------------------------------------------------------------------
+/** Writes the triangles of all parts of a bundle, see save().
+ *  \param f The file.
+ */
+bool TrackBundle::writeTriangles(FILE *f) const
+{
+    for (unsigned int i = 0; i < TB_COUNT; i++)
+    {
+        const NewPart &part = m_new_triangles[i];
+        const size_t n = part.m_p1p2p3.size();
+        if (n == 0)
+            continue;
+        const size_t padding = getPartSize((uint32_t)n) - n *
+            (6 * sizeof(btVector3) + sizeof(float) + sizeof(uint32_t));
+        const char zero[16] = { 0 };
+        if (fwrite(part.m_vertices.data(), sizeof(btVector3), 3 * n, f)
+            != 3 * n ||
+            fwrite(part.m_normals.data(), sizeof(btVector3), 3 * n, f)
+            != 3 * n ||
+            fwrite(part.m_p1p2p3.data(), sizeof(float), n, f) != n ||
+            fwrite(part.m_material_ids.data(), sizeof(uint32_t), n, f) != n
+            || (padding != 0 && fwrite(zero, padding, 1, f) != 1))
+            return false;
+    }
+    return true;
+}   // writeTriangles
+
+// ----------------------------------------------------------------------------
+/** Adds triangles of a track mesh to a bundle which will be written.
+ *  \param part The part to which the triangles are added.
+ *  \param mesh The mesh.
+ *  \param first Index of the first triangle to add.
+ *  \param last Index after the last triangle to add.
+ */
+void TrackBundle::addTriangles(Part part, const TriangleMesh &mesh,
+                               unsigned int first, unsigned int last)
+{
+    NewPart &triangles = m_new_triangles[part];
+    for (unsigned int i = first; i < last; i++)
+    {
+        btVector3 v[6];
+        mesh.getTriangle(i, v, v + 1, v + 2);
+        mesh.getNormals(i, v + 3, v + 4, v + 5);
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            // The unused w component is not stored by the mesh either
+            v[j].setW(0.0f);
+            v[j + 3].setW(0.0f);
+            triangles.m_vertices.push_back(v[j]);
+            triangles.m_normals.push_back(v[j + 3]);
+        }
+        triangles.m_p1p2p3.push_back(mesh.getP1P2P3(i));
+        const Material *material = mesh.getMaterial(i);
+        uint32_t id = NO_MATERIAL;
+        if (material)
+        {
+            auto index = m_material_index.find(material);
+            if (index == m_material_index.end())
+            {
+                index = m_material_index.insert(std::make_pair(material,
+                    (uint32_t)m_materials.size())).first;
+                m_materials.push_back(material);
+            }
+            id = index->second;
+        }
+        triangles.m_material_ids.push_back(id);
+    }
+    m_triangles[part].m_count = (unsigned int)triangles.m_p1p2p3.size();
+}   // addTriangles
+
+// ----------------------------------------------------------------------------
+/** Adds the triangles of a part of a loaded bundle to a track mesh, which
+ *  uses them in place.
+ *  \param part The part.
+ *  \param mesh The mesh.
+ */
+void TrackBundle::createTriangles(Part part, TriangleMesh *mesh) const
+{
+    mesh->addSharedTriangles(m_triangles[part]);
+}   // createTriangles
@@ -0,0 +1,128 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_TRACK_BUNDLE_HPP
+#define HEADER_TRACK_BUNDLE_HPP
+
+#include "io/mapped_file.hpp"
+#include "physics/triangle_mesh.hpp"
+#include "utils/no_copy.hpp"
+#include "utils/vec3.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+class Material;
+
+/** The collision triangles of the main model and the static objects of a
+ *  track, which a server without graphics loads instead of the models (see
+ *  Track::createServerBundles()). The triangles are stored as they were
+ *  added to the track meshes, together with the material of each triangle,
+ *  so the meshes are the same as when converting the models. A bundle is
+ *  only used if the files in the track directory did not change since it
+ *  was written.
+ *  The triangles are stored in the layout of TriangleMesh, so the track
+ *  meshes use them in place (see TriangleMesh::addSharedTriangles()), and
+ *  all servers on a host which use the same track share their memory. The
+ *  bundle must therefore exist as long as the track meshes.
+ *  \ingroup tracks
+ */
+class TrackBundle : public NoCopy
+{
+public:
+    /** The groups of triangles in a bundle. The main model and the static
+     *  objects are converted first, the physics only static objects after
+     *  all track objects, so they are added to the meshes separately. */
+    enum Part { TB_TRACK, TB_GFX_EFFECT, TB_PHYSICS_ONLY_TRACK,
+                TB_PHYSICS_ONLY_GFX_EFFECT, TB_COUNT };
+
+private:
+    /** The triangles of a part of a bundle which is written. */
+    struct NewPart
+    {
+        std::vector<btVector3> m_vertices;
+        std::vector<btVector3> m_normals;
+        std::vector<float>     m_p1p2p3;
+        std::vector<uint32_t>  m_material_ids;
+    };
+
+    /** The file of a loaded bundle. */
+    MappedFile m_file;
+
+    /** The triangles of each part of a loaded bundle, in m_file. */
+    TriangleMesh::SharedTriangles m_triangles[TB_COUNT];
+
+    /** The triangles of each part of a bundle which is written. */
+    NewPart m_new_triangles[TB_COUNT];
+
+    /** The materials used by the triangles. */
+    std::vector<const Material*> m_materials;
+
+    /** Index of each material in m_materials when writing. */
+    std::map<const Material*, uint32_t> m_material_index;
+
+    Vec3 m_aabb_min;
+    Vec3 m_aabb_max;
+
+    bool loadMaterials(const char *data, size_t size,
+                       unsigned int num_materials, const std::string &root);
+    bool writeTriangles(FILE *f) const;
+
+public:
+    TrackBundle();
+    // ------------------------------------------------------------------------
+    static std::string getFilename(const std::string &ident,
+                                   const std::string &scene);
+    // ------------------------------------------------------------------------
+    static uint64_t computeTrackHash(const std::string &root,
+                                     const std::string &scene);
+    // ------------------------------------------------------------------------
+    bool load(const std::string &filename, uint64_t hash,
+              const std::string &root);
+    // ------------------------------------------------------------------------
+    bool save(const std::string &filename, uint64_t hash,
+              const std::string &root) const;
+    // ------------------------------------------------------------------------
+    void addTriangles(Part part, const TriangleMesh &mesh, unsigned int first,
+                      unsigned int last);
+    // ------------------------------------------------------------------------
+    void createTriangles(Part part, TriangleMesh *mesh) const;
+    // ------------------------------------------------------------------------
+    /** Sets the bounding box of the track. */
+    void setAABB(const Vec3 &min, const Vec3 &max)
+    {
+        m_aabb_min = min;
+        m_aabb_max = max;
+    }   // setAABB
+    // ------------------------------------------------------------------------
+    /** Returns the minimum of the bounding box of the track. */
+    const Vec3& getAABBMin() const                       { return m_aabb_min; }
+    // ------------------------------------------------------------------------
+    /** Returns the maximum of the bounding box of the track. */
+    const Vec3& getAABBMax() const                       { return m_aabb_max; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of triangles of a part. */
+    unsigned int getNumTriangles(Part part) const
+                                        { return m_triangles[part].m_count; }
+
+};   // TrackBundle
+
+#endif
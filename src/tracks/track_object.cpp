@@ -74,6 +74,8 @@ TrackObject::TrackObject(const core::vector3df& xyz, const core::vector3df& hpr,
     m_init_hpr        = hpr;
     m_init_scale      = scale;
     m_enabled         = true;
+    m_update_scheduled          = false;
+    m_graphics_update_scheduled = false;
     m_presentation    = NULL;
     m_animator        = NULL;
     m_parent_library  = NULL;
@@ -108,6 +110,8 @@ void TrackObject::init(const XMLNode &xml_node, scene::ISceneNode* parent,
     m_init_hpr   = core::vector3df(0,0,0);
     m_init_scale = core::vector3df(1,1,1);
     m_enabled    = true;
+    m_update_scheduled          = false;
+    m_graphics_update_scheduled = false;
     m_initially_visible = false;
     m_presentation = NULL;
     m_animator = NULL;
@@ -544,6 +548,38 @@ void TrackObject::update(float dt)
     if (m_animator) m_animator->updateWithWorldTicks(true/*has_physics*/);
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Returns true if update() has to be called in the next time step, i.e. if
+ *  the object has a library script to start, a dynamic physical body which
+ *  bullet did not deactivate, or a running animation which moves its
+ *  physical body. Static objects never need an update.
+ */
+bool TrackObject::needsUpdate() const
+{
+    if (m_presentation && m_presentation->needsUpdate())
+        return true;
+    if (m_physical_object && m_physical_object->isDynamic() &&
+        m_physical_object->getBody()->isActive())
+        return true;
+    // Animations of objects without physics are only updated in
+    // updateGraphics(), see ThreeDAnimation::updateWithWorldTicks()
+    return m_animator && m_physical_object && !m_animator->isPaused();
+}   // needsUpdate
+
+// ----------------------------------------------------------------------------
+/** Returns true if updateGraphics() has to be called in the next frame, the
+ *  same as needsUpdate() but for the graphical elements.
+ */
+bool TrackObject::needsUpdateGraphics() const
+{
+    if (m_presentation && m_presentation->needsUpdateGraphics())
+        return true;
+    if (m_physical_object && m_physical_object->isDynamic() &&
+        m_physical_object->getBody()->isActive())
+        return true;
+    return m_animator && !m_physical_object && !m_animator->isPaused();
+}   // needsUpdateGraphics
+
 
 // ----------------------------------------------------------------------------
 /** This reset all physical object moved by 3d animation back to current ticks
@@ -72,6 +72,16 @@ private:
 
     std::shared_ptr<GE::GERenderInfo>    m_render_info;
 
+    /** True if this object is in the list of objects which the
+     *  TrackObjectManager updates each time step. */
+    bool                     m_update_scheduled;
+
+    /** True if this object is in the list of objects which the
+     *  TrackObjectManager updates each frame. */
+    bool                     m_graphics_update_scheduled;
+
+    friend class TrackObjectManager;
+
 protected:
 
     /** The initial XYZ position of the object. */
@@ -134,6 +144,8 @@ public:
               bool isAbsoluteCoord);
 
     virtual void reset();
+    bool needsUpdate() const;
+    bool needsUpdateGraphics() const;
     const core::vector3df& getPosition() const;
     const core::vector3df  getAbsolutePosition() const;
     const core::vector3df  getAbsoluteCenterPosition() const;
@@ -29,6 +29,7 @@
 #include "tracks/track_object.hpp"
 #include "utils/log.hpp"
 
+#include <algorithm>
 #include <IMeshSceneNode.h>
 #include <ISceneManager.h>
 
@@ -100,6 +101,7 @@ void TrackObjectManager::init()
             moveable_objects++;
         }
     }
+    rebuildActiveObjects();
 }   // init
 
 // ----------------------------------------------------------------------------
@@ -112,8 +114,58 @@ void TrackObjectManager::reset()
         curr->reset();
         curr->resetEnabled();
     }
+    rebuildActiveObjects();
 }   // reset
 
+// ----------------------------------------------------------------------------
+/** Rebuilds the lists of objects which are updated, after all objects were
+ *  reset. All objects with an animation are updated at least once, so that
+ *  paused animations are moved to their reset position.
+ */
+void TrackObjectManager::rebuildActiveObjects()
+{
+    m_active_objects.clear();
+    m_active_graphics_objects.clear();
+    m_dynamic_objects.clear();
+    for (TrackObject* curr : m_all_objects)
+    {
+        curr->m_update_scheduled          = false;
+        curr->m_graphics_update_scheduled = false;
+        if (curr->getAnimator())
+        {
+            curr->m_update_scheduled          = true;
+            curr->m_graphics_update_scheduled = true;
+            m_active_objects.push_back(curr);
+            m_active_graphics_objects.push_back(curr);
+        }
+        else
+            wakeUp(curr);
+        if (curr->getPhysicalObject() &&
+            curr->getPhysicalObject()->isDynamic())
+            m_dynamic_objects.push_back(curr);
+    }
+}   // rebuildActiveObjects
+
+// ----------------------------------------------------------------------------
+/** Adds an object to the lists of objects which are updated each time step
+ *  or each frame if it needs this. Called when an object might need an
+ *  update again, e.g. when its animation continues.
+ *  \param object The object.
+ */
+void TrackObjectManager::wakeUp(TrackObject* object)
+{
+    if (!object->m_update_scheduled && object->needsUpdate())
+    {
+        object->m_update_scheduled = true;
+        m_active_objects.push_back(object);
+    }
+    if (!object->m_graphics_update_scheduled && object->needsUpdateGraphics())
+    {
+        object->m_graphics_update_scheduled = true;
+        m_active_graphics_objects.push_back(object);
+    }
+}   // wakeUp
+
 // ----------------------------------------------------------------------------
 /** returns a reference to the track object
  *  with a particular ID
@@ -175,11 +227,19 @@ void TrackObjectManager::handleExplosion(const Vec3 &pos, const PhysicalObject *
  */
 void TrackObjectManager::updateGraphics(float dt)
 {
-    TrackObject* curr;
-    for_in(curr, m_all_objects)
+    // Objects are removed in place, keeping the order of the others. An
+    // update can add objects (at the end), so the size is checked each time.
+    unsigned int num_active = 0;
+    for (unsigned int i = 0; i < m_active_graphics_objects.size(); i++)
     {
+        TrackObject* curr = m_active_graphics_objects[i];
         curr->updateGraphics(dt);
+        if (curr->needsUpdateGraphics())
+            m_active_graphics_objects[num_active++] = curr;
+        else
+            curr->m_graphics_update_scheduled = false;
     }
+    m_active_graphics_objects.resize(num_active);
 }   // updateGraphics
 
 // ----------------------------------------------------------------------------
@@ -188,11 +248,26 @@ void TrackObjectManager::updateGraphics(float dt)
  */
 void TrackObjectManager::update(float dt)
 {
-    TrackObject* curr;
-    for_in (curr, m_all_objects)
+    for (TrackObject* curr : m_dynamic_objects)
+    {
+        if ((!curr->m_update_scheduled ||
+             !curr->m_graphics_update_scheduled) &&
+            curr->getPhysicalObject()->getBody()->isActive())
+            wakeUp(curr);
+    }
+
+    // See updateGraphics()
+    unsigned int num_active = 0;
+    for (unsigned int i = 0; i < m_active_objects.size(); i++)
     {
+        TrackObject* curr = m_active_objects[i];
         curr->update(dt);
+        if (curr->needsUpdate())
+            m_active_objects[num_active++] = curr;
+        else
+            curr->m_update_scheduled = false;
     }
+    m_active_objects.resize(num_active);
 }   // update
 
 // ----------------------------------------------------------------------------
@@ -202,6 +277,7 @@ void TrackObjectManager::resetAfterRewind()
     for_in (curr, m_all_objects)
     {
         curr->resetAfterRewind();
+        wakeUp(curr);
     }
 }   // resetAfterRewind
 
@@ -271,6 +347,12 @@ bool TrackObjectManager::castRay(const btVector3 &from,
 void TrackObjectManager::insertObject(TrackObject* object)
 {
     m_all_objects.push_back(object);
+    object->m_update_scheduled          = false;
+    object->m_graphics_update_scheduled = false;
+    wakeUp(object);
+    if (object->getPhysicalObject() &&
+        object->getPhysicalObject()->isDynamic())
+        m_dynamic_objects.push_back(object);
 }
 
 // ----------------------------------------------------------------------------
@@ -287,6 +369,12 @@ void TrackObjectManager::insertDriveableObject(TrackObject* object)
  */
 void TrackObjectManager::removeObject(TrackObject* obj)
 {
+    for (std::vector<TrackObject*>* list :
+         { &m_active_objects, &m_active_graphics_objects, &m_dynamic_objects })
+    {
+        list->erase(std::remove(list->begin(), list->end(), obj),
+                    list->end());
+    }
     m_all_objects.remove(obj);
     delete obj;
 }   // removeObject
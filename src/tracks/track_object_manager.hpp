@@ -51,6 +51,23 @@ protected:
     /** A second list which holds all objects that karts can drive on. */
     PtrVector<TrackObject, REF> m_driveable_objects;
 
+    /** The objects which are updated each time step. Objects are removed
+     *  once they don't need an update anymore (see
+     *  TrackObject::needsUpdate()), e.g. when bullet deactivates their body
+     *  or their animation is paused, so static objects cost nothing. */
+    std::vector<TrackObject*> m_active_objects;
+
+    /** The objects which are updated each frame, see
+     *  TrackObject::needsUpdateGraphics(). */
+    std::vector<TrackObject*> m_active_graphics_objects;
+
+    /** All objects with a dynamic physical body. Bullet activates a body
+     *  without telling the object (e.g. on a collision with a kart), so
+     *  these objects are woken up once their body is active again. */
+    std::vector<TrackObject*> m_dynamic_objects;
+
+    void rebuildActiveObjects();
+
 public:
          TrackObjectManager();
         ~TrackObjectManager();
@@ -73,6 +90,7 @@ public:
     void insertDriveableObject(TrackObject* object);
     void removeObject(TrackObject* who);
     void removeDriveableObject(TrackObject* obj) { m_driveable_objects.remove(obj); }
+    void wakeUp(TrackObject* object);
     TrackObject* getTrackObject(const std::string& libraryInstance, const std::string& name);
 
           PtrVector<TrackObject>& getObjects()       { return m_all_objects; }
@@ -858,6 +858,14 @@ void TrackObjectPresentationBillboard::updateGraphics(float dt)
 #endif
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Only billboards which fade out close to the camera change each frame.
+ */
+bool TrackObjectPresentationBillboard::needsUpdateGraphics() const
+{
+    return m_fade_out_when_close && !GUIEngine::isNoGraphics();
+}   // needsUpdateGraphics
+
 // ----------------------------------------------------------------------------
 TrackObjectPresentationBillboard::~TrackObjectPresentationBillboard()
 {
@@ -93,6 +93,13 @@ public:
     virtual void move(const core::vector3df& xyz, const core::vector3df& hpr,
         const core::vector3df& scale, bool isAbsoluteCoord) {}
 
+    // ------------------------------------------------------------------------
+    /** Returns true if update() has to be called in the next time step. */
+    virtual bool needsUpdate() const { return false; }
+    // ------------------------------------------------------------------------
+    /** Returns true if updateGraphics() has to be called each frame. */
+    virtual bool needsUpdateGraphics() const { return false; }
+
     // ------------------------------------------------------------------------
     /** Returns the position of this TrackObjectPresentation. */
     virtual const core::vector3df& getPosition() const { return m_init_xyz; }
@@ -205,6 +212,13 @@ public:
         m_reset_executed = false;
         TrackObjectPresentationSceneNode::reset();
     }
+    // ------------------------------------------------------------------------
+    /** The scripts of the library are only run in the first update after
+     *  the start and after each reset. */
+    virtual bool needsUpdate() const OVERRIDE
+    {
+        return !m_start_executed || !m_reset_executed;
+    }   // needsUpdate
     virtual void move(const core::vector3df& xyz, const core::vector3df& hpr,
         const core::vector3df& scale, bool isAbsoluteCoord) OVERRIDE;
 };   // TrackObjectPresentationLibraryNode
@@ -295,6 +309,8 @@ public:
     virtual ~TrackObjectPresentationSound();
     void onTriggerItemApproached(int kart_id);
     virtual void updateGraphics(float dt) OVERRIDE;
+    virtual bool needsUpdateGraphics() const OVERRIDE
+                                                   { return m_sound != NULL; }
     virtual void move(const core::vector3df& xyz, const core::vector3df& hpr,
         const core::vector3df& scale, bool isAbsoluteCoord) OVERRIDE;
     void triggerSound(bool loop);
@@ -325,6 +341,7 @@ public:
                                      scene::ISceneNode* parent);
     virtual ~TrackObjectPresentationBillboard();
     virtual void updateGraphics(float dt) OVERRIDE;
+    virtual bool needsUpdateGraphics() const OVERRIDE;
 };   // TrackObjectPresentationBillboard
 
 
@@ -347,6 +364,8 @@ public:
     virtual ~TrackObjectPresentationParticles();
 
     virtual void updateGraphics(float dt) OVERRIDE;
+    virtual bool needsUpdateGraphics() const OVERRIDE
+                                                 { return m_emitter != NULL; }
     void triggerParticles();
     void stop();
     void stopIn(double delay);
@@ -19,10 +19,17 @@
 #include "utils/log.hpp"
 #include "utils/string_utils.hpp"
 
+#include <atomic>
 #include <stdio.h>
 #include <string>
 #include <sys/stat.h>
 
+#if defined(WIN32)
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
+
 // ----------------------------------------------------------------------------
 #if defined(WIN32)
 #include <windows.h>
@@ -166,3 +173,49 @@ int FileUtils::renameU8Path(const std::string& u8_path_old,
     return rename(u8_path_old.c_str(), u8_path_new.c_str());
 #endif
 }   // renameU8Path
+
+// ----------------------------------------------------------------------------
+/** remove() with unicode path capability.
+ */
+int FileUtils::removeU8Path(const std::string& u8_path)
+{
+#if defined(WIN32)
+    return _wremove(StringUtils::utf8ToWide(u8_path).c_str());
+#else
+    return remove(u8_path.c_str());
+#endif
+}   // removeU8Path
+
+// ----------------------------------------------------------------------------
+/** Writes a file, e.g. of a cache, so that other threads and processes never
+ *  read a partly written file: the data is written to a temporary file whose
+ *  name is unique to this process and call, which then replaces the file.
+ *  If several writers save the same file, one of the complete files is kept.
+ *  \param u8_path Path of the file.
+ *  \param write Writes the data to the temporary file, returns false on an
+ *         error.
+ *  \return True if the file was written.
+ */
+bool FileUtils::writeFileAtomically(const std::string& u8_path,
+                                    const std::function<bool(FILE*)>& write)
+{
+    static std::atomic<unsigned int> counter(0);
+#if defined(WIN32)
+    const int pid = _getpid();
+#else
+    const int pid = (int)getpid();
+#endif
+    const std::string tmp = u8_path + "." + StringUtils::toString(pid) + "-" +
+        StringUtils::toString(counter.fetch_add(1)) + ".tmp";
+
+    FILE* f = fopenU8Path(tmp, "wb");
+    if (!f)
+        return false;
+    bool written = write(f);
+    written = fclose(f) == 0 && written;
+    if (written && renameU8Path(tmp, u8_path) == 0)
+        return true;
+    removeU8Path(tmp);
+    return false;
+}   // writeFileAtomically
+
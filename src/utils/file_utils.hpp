@@ -18,6 +18,7 @@
 #ifndef HEADER_FILE_UTILS_HPP
 #define HEADER_FILE_UTILS_HPP
 
+#include <functional>
 #include <stdio.h>
 #include <string>
 #include <sys/stat.h>
@@ -39,6 +40,11 @@ namespace FileUtils
     int renameU8Path(const std::string& u8_path_old,
                      const std::string& u8_path_new);
     // ------------------------------------------------------------------------
+    int removeU8Path(const std::string& u8_path);
+    // ------------------------------------------------------------------------
+    bool writeFileAtomically(const std::string& u8_path,
+                             const std::function<bool(FILE*)>& write);
+    // ------------------------------------------------------------------------
     /* Return a path which can be opened for writing in all systems, as long as
      * u8_path is unicode encoded. */
     inline std::string getPortableWritingPath(const std::string& u8_path)
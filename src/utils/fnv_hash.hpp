@@ -0,0 +1,66 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_FNV_HASH_HPP
+#define HEADER_FNV_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/** A 64-bit FNV-1a hash, which identifies the data a cached file was
+ *  computed from. It is fast and stable across platforms, but must not be
+ *  used where collisions could be provoked on purpose.
+ *  \ingroup utils
+ */
+class FNVHash
+{
+private:
+    uint64_t m_hash;
+
+public:
+    FNVHash() : m_hash(14695981039346656037ULL) {}
+    // ------------------------------------------------------------------------
+    /** Adds bytes to the hash. */
+    void add(const void* data, size_t size)
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++)
+            m_hash = (m_hash ^ bytes[i]) * 1099511628211ULL;
+    }   // add
+    // ------------------------------------------------------------------------
+    /** Adds a string including its terminating 0, so that consecutive
+     *  strings can't be confused. */
+    void add(const std::string& s)           { add(s.c_str(), s.size() + 1); }
+    // ------------------------------------------------------------------------
+    void add(const char* s)                        { add(s, strlen(s) + 1); }
+    // ------------------------------------------------------------------------
+    void add(uint32_t value)                { add(&value, sizeof(value)); }
+    // ------------------------------------------------------------------------
+    void add(uint64_t value)                { add(&value, sizeof(value)); }
+    // ------------------------------------------------------------------------
+    /** Adds the bit pattern of a float. */
+    void add(float value)                   { add(&value, sizeof(value)); }
+    // ------------------------------------------------------------------------
+    /** Returns the hash of all data added so far. */
+    uint64_t get() const                                  { return m_hash; }
+
+};   // FNVHash
+
+#endif
@@ -0,0 +1,205 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_INTERVAL_TREE_HPP
+#define HEADER_INTERVAL_TREE_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/** A static interval tree, which finds all closed intervals [start, end]
+ *  containing a key. All intervals are added first, then build() sorts them
+ *  by start, the sorted array is used as an implicit balanced binary tree
+ *  (the middle element of each range is the root of that range), with the
+ *  maximum end of each subtree stored in the root, so subtrees which can't
+ *  contain the key are skipped.
+ *  The tree is not modified after build(), so it can be read by many threads
+ *  at the same time.
+ */
+template<typename KEY, typename VALUE>
+class IntervalTree
+{
+private:
+    struct Interval
+    {
+        KEY m_start;
+        KEY m_end;
+        /** Maximum end of the subtree which has this interval as root. */
+        KEY m_max_end;
+        VALUE m_value;
+    };
+
+    std::vector<Interval> m_intervals;
+
+    // ------------------------------------------------------------------------
+    KEY buildMaxEnd(size_t lo, size_t hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        Interval& root = m_intervals[mid];
+        root.m_max_end = root.m_end;
+        if (lo < mid)
+            root.m_max_end = std::max(root.m_max_end, buildMaxEnd(lo, mid));
+        if (mid + 1 < hi)
+        {
+            root.m_max_end = std::max(root.m_max_end,
+                buildMaxEnd(mid + 1, hi));
+        }
+        return root.m_max_end;
+    }   // buildMaxEnd
+    // ------------------------------------------------------------------------
+    /** Visits intervals in [lo, hi) containing key from the largest start,
+     *  returns true if the visitor stopped the search. */
+    bool visit(size_t lo, size_t hi, const KEY& key,
+               const std::function<bool(const VALUE&)>& visitor) const
+    {
+        if (lo >= hi)
+            return false;
+        size_t mid = lo + (hi - lo) / 2;
+        const Interval& root = m_intervals[mid];
+        if (root.m_max_end < key)
+            return false;
+        if (!(key < root.m_start))
+        {
+            // Intervals on the right have larger starts
+            if (visit(mid + 1, hi, key, visitor))
+                return true;
+            if (!(root.m_end < key) && visitor(root.m_value))
+                return true;
+        }
+        return visit(lo, mid, key, visitor);
+    }   // visit
+
+public:
+    // ------------------------------------------------------------------------
+    /** Adds an interval, build() must be called before any lookup. */
+    void add(const KEY& start, const KEY& end, const VALUE& value)
+    {
+        if (end < start)
+            return;
+        m_intervals.push_back({ start, end, end, value });
+    }   // add
+    // ------------------------------------------------------------------------
+    void build()
+    {
+        std::sort(m_intervals.begin(), m_intervals.end(),
+            [](const Interval& a, const Interval& b)
+            {
+                return a.m_start < b.m_start;
+            });
+        if (!m_intervals.empty())
+            buildMaxEnd(0, m_intervals.size());
+    }   // build
+    // ------------------------------------------------------------------------
+    /** Calls the visitor for each interval containing the key, in order of
+     *  decreasing start, till the visitor returns true.
+     *  \return True if the visitor returned true.
+     */
+    bool forEachContaining(const KEY& key,
+                      const std::function<bool(const VALUE&)>& visitor) const
+    {
+        return visit(0, m_intervals.size(), key, visitor);
+    }   // forEachContaining
+    // ------------------------------------------------------------------------
+    /** Returns the value of the interval containing the key with the largest
+     *  start, or NULL if none. */
+    const VALUE* find(const KEY& key) const
+    {
+        const VALUE* result = NULL;
+        forEachContaining(key, [&result](const VALUE& value)
+            {
+                result = &value;
+                return true;
+            });
+        return result;
+    }   // find
+    // ------------------------------------------------------------------------
+    size_t size() const                         { return m_intervals.size(); }
+    // ------------------------------------------------------------------------
+    bool empty() const                         { return m_intervals.empty(); }
+    // ------------------------------------------------------------------------
+    /** Compares the lookups of random intervals with a linear search. */
+    static void unitTesting()
+    {
+        IntervalTree<int, int> tree;
+        assert(tree.find(0) == NULL);
+
+        // Nested, overlapping, adjacent and single point intervals
+        std::vector<std::pair<int, int> > all =
+            { { 0, 10 }, { 2, 4 }, { 5, 5 }, { 11, 20 }, { 3, 15 },
+              { 30, 40 }, { 5, 5 } };
+        // Reject empty intervals
+        tree.add(10, 0, -1);
+        unsigned seed = 1;
+        for (unsigned i = 0; i < 200; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            int start = (int)((seed >> 16) % 500);
+            seed = seed * 1103515245u + 12345u;
+            all.emplace_back(start, start + (int)((seed >> 16) % 50));
+        }
+        for (unsigned i = 0; i < all.size(); i++)
+            tree.add(all[i].first, all[i].second, (int)i);
+        tree.build();
+        assert(tree.size() == all.size());
+
+        for (int key = -1; key < 560; key++)
+        {
+            std::vector<int> expected, found;
+            int best = -1;
+            for (unsigned i = 0; i < all.size(); i++)
+            {
+                if (all[i].first > key || all[i].second < key)
+                    continue;
+                expected.push_back((int)i);
+                if (best == -1 || all[i].first > all[best].first)
+                    best = (int)i;
+            }
+            int last_start = key;
+            tree.forEachContaining(key,
+                [&found, &all, &last_start](const int& value)
+                {
+                    found.push_back(value);
+                    // Visited in order of decreasing start
+                    assert(all[value].first <= last_start);
+                    last_start = all[value].first;
+                    return false;
+                });
+            std::sort(found.begin(), found.end());
+            assert(found == expected);
+            const int* value = tree.find(key);
+            assert((value == NULL) == (best == -1));
+            assert(!value || all[*value].first == all[best].first);
+            (void)value;
+        }
+
+        // A visitor can stop the search
+        int count = 0;
+        const bool stopped = tree.forEachContaining(5, [&count](const int&)
+            {
+                return ++count == 2;
+            });
+        assert(stopped && count == 2);
+        (void)stopped;
+    }   // unitTesting
+
+};   // class IntervalTree
+
+#endif
@@ -0,0 +1,204 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MPSC_QUEUE_HPP
+#define HEADER_MPSC_QUEUE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** An unbounded lock-free queue which can be pushed to by any number of
+ *  threads, but only popped by one thread (multi-producer single-consumer).
+ *  A push is one atomic exchange plus a store, so producers never wait for
+ *  each other or the consumer. Based on the MPSC node queue by Dmitry
+ *  Vyukov, with a dummy node so the consumer never touches the head which
+ *  producers exchange.
+ *  If a producer is interrupted between the exchange and linking its node,
+ *  the consumer sees the queue as empty till the link is done, so pop may
+ *  return false while a push is in progress, the item will be returned by
+ *  a later pop.
+ *  Popped nodes are kept in a free list and reused by later pushes, so no
+ *  memory is allocated once the queue has grown to its usual size.
+ */
+template<typename TYPE>
+class MPSCQueue : public NoCopy
+{
+private:
+    struct Node
+    {
+        std::atomic<Node*> m_next;
+        TYPE m_data;
+        // --------------------------------------------------------------------
+        Node() : m_next(nullptr), m_data() {}
+        // --------------------------------------------------------------------
+        Node(TYPE&& data) : m_next(nullptr), m_data(std::move(data)) {}
+    };
+
+    /** Latest node pushed, exchanged by producers. */
+    std::atomic<Node*> m_head;
+
+    /** Dummy node before the oldest node, only used by the consumer. */
+    Node* m_tail;
+
+    /** Stack of nodes given back by the consumer. */
+    std::atomic<Node*> m_free;
+
+    /** Set while a producer takes a node from m_free. With only one thread
+     *  removing nodes at a time the stack has no ABA problem, a producer
+     *  finding it set allocates a new node instead of waiting. */
+    std::atomic_flag m_free_busy;
+
+    // ------------------------------------------------------------------------
+    /** Takes a node from the free list, or returns nullptr if it's empty or
+     *  another producer is using it. */
+    Node* getFreeNode()
+    {
+        if (m_free_busy.test_and_set(std::memory_order_acquire))
+            return nullptr;
+        Node* node = m_free.load(std::memory_order_acquire);
+        // Only the consumer adds nodes meanwhile, which doesn't change the
+        // next pointer of nodes already in the free list
+        while (node && !m_free.compare_exchange_weak(node,
+            node->m_next.load(std::memory_order_relaxed),
+            std::memory_order_acquire, std::memory_order_acquire));
+        m_free_busy.clear(std::memory_order_release);
+        return node;
+    }   // getFreeNode
+
+public:
+    // ------------------------------------------------------------------------
+    MPSCQueue()
+    {
+        m_tail = new Node();
+        m_head.store(m_tail);
+        m_free.store(nullptr);
+        m_free_busy.clear();
+    }   // MPSCQueue
+    // ------------------------------------------------------------------------
+    /** All producers must have finished before. */
+    ~MPSCQueue()
+    {
+        TYPE data;
+        while (pop(&data));
+        delete m_tail;
+        Node* node = m_free.load();
+        while (node)
+        {
+            Node* next = node->m_next.load();
+            delete node;
+            node = next;
+        }
+    }   // ~MPSCQueue
+    // ------------------------------------------------------------------------
+    /** Adds an item to the queue, can be called by any thread. */
+    void push(TYPE data)
+    {
+        Node* node = getFreeNode();
+        if (node)
+        {
+            node->m_next.store(nullptr, std::memory_order_relaxed);
+            node->m_data = std::move(data);
+        }
+        else
+            node = new Node(std::move(data));
+        Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->m_next.store(node, std::memory_order_release);
+    }   // push
+    // ------------------------------------------------------------------------
+    /** Removes the oldest item, only to be called by the consumer thread.
+     *  \param[out] data The item removed.
+     *  \return False if the queue is empty.
+     */
+    bool pop(TYPE* data)
+    {
+        Node* next = m_tail->m_next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return false;
+        *data = std::move(next->m_data);
+        // The next node becomes the new dummy node, the producer which
+        // linked it won't touch the old one anymore
+        Node* old = m_tail;
+        m_tail = next;
+        Node* top = m_free.load(std::memory_order_relaxed);
+        do
+        {
+            old->m_next.store(top, std::memory_order_relaxed);
+        }
+        while (!m_free.compare_exchange_weak(top, old,
+            std::memory_order_release, std::memory_order_relaxed));
+        return true;
+    }   // pop
+    // ------------------------------------------------------------------------
+    /** Pushes items from several threads while one thread pops them, and
+     *  checks that each item is popped exactly once and in the order of its
+     *  producer. */
+    static void unitTesting()
+    {
+        const unsigned producers = 4;
+        const unsigned items = 100000;
+        MPSCQueue<std::pair<unsigned, unsigned> > queue;
+        std::vector<std::thread> threads;
+        for (unsigned p = 0; p < producers; p++)
+        {
+            threads.emplace_back([&queue, p]()
+                {
+                    for (unsigned i = 0; i < items; i++)
+                        queue.push(std::make_pair(p, i));
+                });
+        }
+        std::vector<unsigned> next(producers, 0);
+        unsigned popped = 0;
+        std::pair<unsigned, unsigned> item;
+        while (popped < producers * items)
+        {
+            if (!queue.pop(&item))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            assert(item.first < producers);
+            assert(item.second == next[item.first]);
+            next[item.first]++;
+            popped++;
+        }
+        for (std::thread& t : threads)
+            t.join();
+        assert(!queue.pop(&item));
+        for (unsigned p = 0; p < producers; p++)
+            assert(next[p] == items);
+
+        // Reused nodes keep the order too
+        for (unsigned i = 0; i < 10; i++)
+            queue.push(std::make_pair(0u, i));
+        for (unsigned i = 0; i < 10; i++)
+        {
+            bool has_item = queue.pop(&item);
+            assert(has_item && item.second == i);
+            (void)has_item;
+        }
+        assert(!queue.pop(&item));
+    }   // unitTesting
+
+};   // class MPSCQueue
+
+#endif
@@ -70,6 +70,7 @@ Profiler profiler;
     }   // getTimeMilliseconds
 
 #else
+    #include <pthread.h>
     #include <sys/time.h>
     double getTimeMilliseconds()
     {
@@ -80,6 +81,40 @@ Profiler profiler;
 #endif
 // --- End portable precise timer ---
 
+/** Id of the thread in the profiler, -1 if not known yet, or -2 if the
+ *  thread is not profiled because there are too many threads. */
+thread_local int g_thread_id = -1;
+
+// thread_local can't have a destructor with all compilers (see tls.hpp), so
+// the id of an exiting thread is given back by the destructor of thread
+// specific storage, which stores the thread id plus one.
+#ifdef WIN32
+static DWORD g_thread_id_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t g_thread_id_key;
+#endif
+static std::atomic<bool> g_has_thread_id_key(false);
+
+#ifdef WIN32
+static void NTAPI releaseThreadIdOnExit(void* value)
+#else
+static void releaseThreadIdOnExit(void* value)
+#endif
+{
+    // The profiler may already be destroyed
+    if (value && g_has_thread_id_key.load())
+        profiler.releaseThreadId((int)(intptr_t)value - 1);
+}   // releaseThreadIdOnExit
+
+//-----------------------------------------------------------------------------
+Profiler::ThreadData::ThreadData()
+{
+    m_events.resize(EVENT_BUFFER_SIZE);
+    m_write_index    = 0;
+    m_read_index     = 0;
+    m_dropped_events = 0;
+}   // ThreadData
+
 //-----------------------------------------------------------------------------
 Profiler::Profiler()
 {
@@ -94,27 +129,62 @@ Profiler::Profiler()
     m_current_frame       = 0;
     m_has_wrapped_around  = false;
     m_drawing             = true;
+    m_frame_data          = false;
+    m_trace_file          = NULL;
+    m_trace_first_event   = true;
+    m_trace_start         = 0.0;
+    m_trace_end           = 0.0;
+    m_trace_last_flush    = 0.0;
+    for (int i = 0; i < MAX_THREADS; i++)
+    {
+        m_all_threads_data[i] = NULL;
+        m_thread_id_used[i] = false;
+    }
+    m_too_many_threads_logged = false;
+    for (int i = 0; i < MAX_COUNTERS; i++)
+        m_counters[i] = 0;
+
+    // The profiler is created during static initialization, so this is the
+    // main thread
+    g_thread_id = 0;
+    m_thread_id_used[0] = true;
     m_threads_used = 1;
+#ifdef WIN32
+    g_thread_id_key = FlsAlloc(releaseThreadIdOnExit);
+    g_has_thread_id_key = g_thread_id_key != FLS_OUT_OF_INDEXES;
+#else
+    g_has_thread_id_key =
+        pthread_key_create(&g_thread_id_key, releaseThreadIdOnExit) == 0;
+#endif
 }   // Profiler
 
 //-----------------------------------------------------------------------------
 Profiler::~Profiler()
 {
+    if (g_has_thread_id_key.exchange(false))
+    {
+#ifdef WIN32
+        FlsFree(g_thread_id_key);
+#else
+        pthread_key_delete(g_thread_id_key);
+#endif
+    }
+    if (m_trace_file)
+        fclose(m_trace_file);
+    for (int i = 0; i < MAX_THREADS; i++)
+        delete m_all_threads_data[i].load();
 }   // ~Profiler
 
-thread_local int g_thread_id = -1;
-const int MAX_THREADS = 10;
 //-----------------------------------------------------------------------------
 /** It is split from the constructor so that it can be avoided allocating
  *  unnecessary memory when the profiler is never used (for example in no
- *  graphics). */
+ *  graphics). Without it only the trace can be recorded. */
 void Profiler::init()
 {
-    m_all_threads_data.resize(MAX_THREADS);
-
-    // Add this thread to the thread mapping
-    g_thread_id = 0;
+    m_frame_data = true;
     m_gpu_times.resize(Q_LAST * m_max_frames);
+    m_frame_start.resize(m_max_frames);
+    m_frame_start[m_current_frame] = m_time_last_sync;
 }   // init
 
 //------------------------------------------------------------------------------
@@ -122,73 +192,173 @@ void Profiler::init()
  */
 void Profiler::reset()
 {
-    for (int i = 0; i < m_threads_used; i++)
+    for (int i = 0; i < getThreadsUsed(); i++)
     {
-        ThreadData &td = m_all_threads_data[i];
-        td.m_all_event_data.clear();
-        td.m_event_stack.clear();
-        td.m_ordered_headings.clear();
+        ThreadData *td = m_all_threads_data[i].load(std::memory_order_acquire);
+        if (!td)
+            continue;
+        // Discard events which were not read yet
+        td->m_read_index.store(
+            td->m_write_index.load(std::memory_order_acquire),
+            std::memory_order_release);
+        td->m_frame_markers.clear();
+        td->m_ordered_headings.clear();
     }   // for i in threads
 
-    m_all_threads_data.clear();
-    m_gpu_times.clear();
-    m_all_event_names.clear();
+    std::fill(m_gpu_times.begin(), m_gpu_times.end(), 0);
+    m_marker_totals.clear();
     m_current_frame       = 0;
     m_has_wrapped_around  = false;
     m_freeze_state        = UNFROZEN;
+    m_time_last_sync      = getTimeMilliseconds();
+    if (m_frame_data)
+        m_frame_start[0] = m_time_last_sync;
 }   // reset
 
 //-----------------------------------------------------------------------------
-/** Returns a unique index for a thread. If the calling thread is not yet in
- *  the mapping, it will assign a new unique id to this thread. */
-int Profiler::getThreadID()
+/** Returns the data of the calling thread, which is created the first time
+ *  a thread calls this. Returns NULL if there are too many threads.
+ */
+Profiler::ThreadData* Profiler::getThreadData()
 {
     if (g_thread_id == -1)
+        g_thread_id = acquireThreadId();
+    if (g_thread_id < 0)
+        return NULL;
+
+    ThreadData *td =
+        m_all_threads_data[g_thread_id].load(std::memory_order_relaxed);
+    if (!td)
+    {
+        td = new ThreadData();
+        m_all_threads_data[g_thread_id].store(td, std::memory_order_release);
+    }
+    return td;
+}   // getThreadData
+
+//-----------------------------------------------------------------------------
+/** Finds an id for a new thread, which is given back when the thread exits.
+ *  \return The id, or -2 if all ids are used.
+ */
+int Profiler::acquireThreadId()
+{
+    for (int i = 0; i < MAX_THREADS; i++)
     {
-        if (m_threads_used >= MAX_THREADS)
+        bool used = false;
+        if (!m_thread_id_used[i].compare_exchange_strong(used, true,
+            std::memory_order_acquire))
+            continue;
+        int threads_used = m_threads_used.load();
+        while (threads_used < i + 1 &&
+               !m_threads_used.compare_exchange_weak(threads_used, i + 1));
+
+        // Events still open when the previous thread with this id exited
+        // will never be closed
+        ThreadData *td =
+            m_all_threads_data[i].load(std::memory_order_relaxed);
+        if (td)
+            td->m_event_stack.clear();
+        if (g_has_thread_id_key.load())
         {
-            g_thread_id = MAX_THREADS - 1;
-            return g_thread_id;
+#ifdef WIN32
+            FlsSetValue(g_thread_id_key, (void*)(intptr_t)(i + 1));
+#else
+            pthread_setspecific(g_thread_id_key, (void*)(intptr_t)(i + 1));
+#endif
         }
-        g_thread_id = m_threads_used.fetch_add(1);
+        return i;
+    }
+    if (!m_too_many_threads_logged.exchange(true))
+    {
+        Log::warn("Profiler", "More than %d threads are used, further "
+            "threads are not profiled till others exit.", MAX_THREADS);
     }
-    return g_thread_id;
-}   // getThreadID
+    return -2;
+}   // acquireThreadId
+
+//-----------------------------------------------------------------------------
+/** Called when a thread exits, so that its id can be used by a new thread.
+ */
+void Profiler::releaseThreadId(int id)
+{
+    if (id > 0 && id < MAX_THREADS)
+        m_thread_id_used[id].store(false, std::memory_order_release);
+}   // releaseThreadId
+
+//-----------------------------------------------------------------------------
+/** Returns the id of the marker with the given name, a new marker is added
+ *  the first time a name is used.
+ *  \param name Name of the marker.
+ *  \param colour Colour of the marker in the on-screen display, only used
+ *         when the marker is added.
+ */
+int Profiler::getMarkerId(const std::string& name,
+                          const video::SColor& colour)
+{
+    std::lock_guard<std::mutex> lock(m_markers_mutex);
+    auto it = m_marker_ids.find(name);
+    if (it != m_marker_ids.end())
+        return it->second;
+    int id = (int)m_marker_names.size();
+    m_marker_ids[name] = id;
+    m_marker_names.push_back(name);
+    m_marker_colours.push_back(colour);
+    return id;
+}   // getMarkerId
+
+//-----------------------------------------------------------------------------
+std::string Profiler::getMarkerName(int marker) const
+{
+    std::lock_guard<std::mutex> lock(m_markers_mutex);
+    return m_marker_names[marker];
+}   // getMarkerName
+
+//-----------------------------------------------------------------------------
+video::SColor Profiler::getMarkerColour(int marker) const
+{
+    std::lock_guard<std::mutex> lock(m_markers_mutex);
+    return m_marker_colours[marker];
+}   // getMarkerColour
 
 //-----------------------------------------------------------------------------
 /// Push a new marker that starts now
-void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
+void Profiler::pushCPUMarker(int marker)
 {
     // Don't do anything when disabled or frozen
     if (!UserConfigParams::m_profiler_enabled ||
          m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
         return;
 
-    // We need to look before getting the thread id (since this might
-    // be a new thread which changes the structure).
-    m_lock.lock();
-    int thread_id = getThreadID();
+    ThreadData *td = getThreadData();
+    if (!td)
+        return;
 
-    ThreadData &td = m_all_threads_data[thread_id];
-    AllEventData::iterator i = td.m_all_event_data.find(name);
-    double  start = getTimeMilliseconds() - m_time_last_sync;
-    if (i != td.m_all_event_data.end())
-    {
-        i->second.setStart(m_current_frame, start, (int)td.m_event_stack.size());
-    }
-    else
-    {
-        EventData ed(colour, m_max_frames);
-        ed.setStart(m_current_frame, start, (int)td.m_event_stack.size());
-        td.m_all_event_data[name] = ed;
-        // Ordered headings is used to determine the order in which the
-        // bar graph is drawn. Outer profiling events will be added first,
-        // so they will be drawn first, which gives the proper nested
-        // displayed of events.
-        td.m_ordered_headings.push_back(name);
-    }
-    td.m_event_stack.push_back(name);
-    m_lock.unlock();
+    OpenEvent event;
+    event.m_start  = getTimeMilliseconds();
+    event.m_frame  = m_current_frame.load(std::memory_order_relaxed);
+    event.m_marker = marker;
+    td->m_event_stack.push_back(event);
+}   // pushCPUMarker
+
+//-----------------------------------------------------------------------------
+/** Push a new marker with a name which is not constant. The marker ids of
+ *  the names are cached for each thread, so only the first use of a name
+ *  needs a lock.
+ */
+void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
+{
+    if (!UserConfigParams::m_profiler_enabled ||
+         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
+        return;
+
+    ThreadData *td = getThreadData();
+    if (!td)
+        return;
+    std::map<std::string, int> &ids = td->m_dynamic_marker_ids;
+    auto it = ids.find(name);
+    if (it == ids.end())
+        it = ids.emplace(name, getMarkerId(name, colour)).first;
+    pushCPUMarker(it->second);
 }   // pushCPUMarker
 
 //-----------------------------------------------------------------------------
@@ -201,26 +371,32 @@ void Profiler::popCPUMarker()
         return;
     double now = getTimeMilliseconds();
 
-    m_lock.lock();
-    int thread_id = getThreadID();
-    ThreadData &td = m_all_threads_data[thread_id];
-
+    ThreadData *td = getThreadData();
     // When the profiler gets enabled (which happens in the middle of the
     // main loop), there can be some pops without matching pushes (for one
     // frame) - ignore those events.
-    if (td.m_event_stack.size() == 0)
+    if (!td || td->m_event_stack.empty())
+        return;
+
+    const OpenEvent &open = td->m_event_stack.back();
+    Event event;
+    event.m_start  = open.m_start;
+    event.m_end    = now;
+    event.m_frame  = open.m_frame;
+    event.m_marker = (uint16_t)open.m_marker;
+    event.m_layer  = (uint16_t)(td->m_event_stack.size() - 1);
+    td->m_event_stack.pop_back();
+
+    // Only this thread writes, and only the main thread reads the events
+    uint32_t write = td->m_write_index.load(std::memory_order_relaxed);
+    uint32_t read = td->m_read_index.load(std::memory_order_acquire);
+    if (write - read >= EVENT_BUFFER_SIZE)
     {
-        m_lock.unlock();
+        td->m_dropped_events.fetch_add(1, std::memory_order_relaxed);
         return;
     }
-
-    assert(td.m_event_stack.size() > 0);
-
-    const std::string &name = td.m_event_stack.back();
-    td.m_all_event_data[name].setEnd(m_current_frame, now - m_time_last_sync);
-
-    td.m_event_stack.pop_back();
-    m_lock.unlock();
+    td->m_events[write & (EVENT_BUFFER_SIZE - 1)] = event;
+    td->m_write_index.store(write + 1, std::memory_order_release);
 }   // popCPUMarker
 
 //-----------------------------------------------------------------------------
@@ -249,15 +425,83 @@ void Profiler::activate()
  */
 void Profiler::desactivate()
 {
-    UserConfigParams::m_profiler_enabled = false;
+    // Keep recording a trace till it's stopped
+    if (!m_trace_file)
+        UserConfigParams::m_profiler_enabled = false;
     computeStableFPS();
 }   // desactivate
 
+//-----------------------------------------------------------------------------
+/** Reads the events completed by all threads since the last call, adds them
+ *  to the markers of the frames in which they started and writes them to
+ *  the trace file. Must only be called in the main thread.
+ */
+void Profiler::processEvents()
+{
+    for (int i = 0; i < getThreadsUsed(); i++)
+    {
+        ThreadData *td = m_all_threads_data[i].load(std::memory_order_acquire);
+        if (!td)
+            continue;
+        uint32_t read = td->m_read_index.load(std::memory_order_relaxed);
+        uint32_t write = td->m_write_index.load(std::memory_order_acquire);
+        if (read == write)
+            continue;
+        m_new_events.clear();
+        for (; read != write; read++)
+            m_new_events.push_back(td->m_events[read & (EVENT_BUFFER_SIZE-1)]);
+        td->m_read_index.store(write, std::memory_order_release);
+
+        // Events are completed from the inside out, sort them so that outer
+        // events are added first to the ordered headings
+        std::sort(m_new_events.begin(), m_new_events.end(),
+            [](const Event& a, const Event& b)
+            {
+                if (a.m_start != b.m_start)
+                    return a.m_start < b.m_start;
+                return a.m_layer < b.m_layer;
+            });
+        for (const Event& e : m_new_events)
+        {
+            if (e.m_marker >= m_marker_totals.size())
+                m_marker_totals.resize(e.m_marker + 1, 0.0);
+            m_marker_totals[e.m_marker] += e.m_end - e.m_start;
+            if (m_frame_data)
+                addToFrame(td, e);
+            if (m_trace_file)
+                writeTraceEvent(i, e);
+        }
+    }   // for i in threads
+}   // processEvents
+
+//-----------------------------------------------------------------------------
+/** Adds the duration of an event to its marker in the frame in which the
+ *  event started.
+ */
+void Profiler::addToFrame(ThreadData* td, const Event& e)
+{
+    if (e.m_marker >= td->m_frame_markers.size())
+        td->m_frame_markers.resize(e.m_marker + 1);
+    std::vector<Marker> &markers = td->m_frame_markers[e.m_marker];
+    if (markers.empty())
+    {
+        markers.resize(m_max_frames);
+        // Ordered headings is used to determine the order in which the
+        // bar graph is drawn. Outer profiling events will be added first,
+        // so they will be drawn first, which gives the proper nested
+        // displayed of events.
+        td->m_ordered_headings.push_back(e.m_marker);
+    }
+    const double frame_start = m_frame_start[e.m_frame];
+    Marker &marker = markers[e.m_frame];
+    marker.setStart(e.m_start - frame_start, e.m_layer);
+    marker.setEnd(e.m_end - frame_start);
+}   // addToFrame
+
 //-----------------------------------------------------------------------------
 /** Saves all data for the current frame, and starts the next frame in the
- *  circular buffer. Any events that are currently active (e.g. in a separate
- *  thread) will be split in two parts: the beginning (till now) in the current
- *  frame, the rest will be added to the next frame.
+ *  circular buffer. Events which are still active (e.g. in a separate
+ *  thread) are added to the frame in which they started once they end.
  */
 void Profiler::synchronizeFrame()
 {
@@ -269,7 +513,8 @@ void Profiler::synchronizeFrame()
     // which would yield different results
     double now = getTimeMilliseconds();
 
-    m_lock.lock();
+    processEvents();
+
     // Set index to next frame
     int next_frame = m_current_frame+1;
     if (next_frame >= m_max_frames)
@@ -278,35 +523,27 @@ void Profiler::synchronizeFrame()
         m_has_wrapped_around = true;
     }
 
-    // First finish all markers that are currently in progress, and add
-    // a new start marker for the next frame. So e.g. if a thread is busy in
-    // one event while the main thread syncs the frame, this event will get
-    // split into two parts in two consecutive frames
-    for (int i = 0; i < m_threads_used; i++)
-    {
-        ThreadData &td = m_all_threads_data[i];
-        for(unsigned int j=0; j<td.m_event_stack.size(); j++)
-        {
-            EventData &ed = td.m_all_event_data[td.m_event_stack[j]];
-            ed.setEnd(m_current_frame, now-m_time_last_sync);
-            ed.setStart(next_frame, 0, j);
-        }   // for j in event stack
-    }   // for i in threads
-
-    if (m_has_wrapped_around)
+    if (m_frame_data)
     {
-        // The new entries for the circular buffer need to be cleared
-        // to make sure the new values are not accumulated on top of
-        // the data from a previous frame.
-        for (int i = 0; i < m_threads_used; i++)
+        if (m_has_wrapped_around)
         {
-            ThreadData &td = m_all_threads_data[i];
-            AllEventData &aed = td.m_all_event_data;
-            AllEventData::iterator k;
-            for (k = aed.begin(); k != aed.end(); ++k)
-                k->second.getMarker(next_frame).clear();
-        }
-    }   // is has wrapped around
+            // The new entries for the circular buffer need to be cleared
+            // to make sure the new values are not accumulated on top of
+            // the data from a previous frame.
+            for (int i = 0; i < getThreadsUsed(); i++)
+            {
+                ThreadData *td = m_all_threads_data[i].load();
+                if (!td)
+                    continue;
+                for (std::vector<Marker> &markers : td->m_frame_markers)
+                {
+                    if (!markers.empty())
+                        markers[next_frame].clear();
+                }
+            }
+        }   // is has wrapped around
+        m_frame_start[next_frame] = now;
+    }
 
     m_current_frame = next_frame;
 
@@ -320,7 +557,19 @@ void Profiler::synchronizeFrame()
     else if(m_freeze_state == WAITING_FOR_UNFREEZE)
         m_freeze_state = UNFROZEN;
 
-    m_lock.unlock();
+    if (m_trace_file)
+    {
+        if (m_trace_end > 0.0 && now >= m_trace_end)
+        {
+            stopTrace();
+        }
+        else if (now - m_trace_last_flush > 1000.0)
+        {
+            // So the trace can be read while the server is running
+            fflush(m_trace_file);
+            m_trace_last_flush = now;
+        }
+    }
 }   // synchronizeFrame
 
 //-----------------------------------------------------------------------------
@@ -328,7 +577,7 @@ void Profiler::synchronizeFrame()
 void Profiler::draw()
 {
 #ifndef SERVER_ONLY
-    if (!m_drawing)
+    if (!m_drawing || !m_frame_data)
         return;
 
     PROFILER_PUSH_CPU_MARKER("ProfilerDraw", 0xFF, 0xFF, 0x00);
@@ -336,10 +585,9 @@ void Profiler::draw()
 
     // Current frame points to the frame in which currently data is
     // being accumulated. Draw the previous (i.e. complete) frame.
-    m_lock.lock();
     int indx = m_current_frame - 1;
     if (indx < 0) indx = m_max_frames - 1;
-    m_lock.unlock();
+    const int threads_used = getThreadsUsed();
 
     drawBackground();
 
@@ -359,18 +607,20 @@ void Profiler::draw()
     double start = 99999.0f;
     double end   = -1.0f;
 
-    // Use this thread to compute start and end time. All other
+    // Use the main thread to compute start and end time. All other
     // threads might have 'unfinished' events, or multiple identical events
     // in this frame (i.e. start time would be incorrect).
-    int thread_id = getThreadID();
-    AllEventData &aed = m_all_threads_data[thread_id].m_all_event_data;
-    AllEventData::iterator j;
-    for (j = aed.begin(); j != aed.end(); ++j)
+    const int thread_id = 0;
+    ThreadData *main_td = m_all_threads_data[thread_id].load();
+    if (main_td)
     {
-        const Marker &marker = j->second.getMarker(indx);
-        start = std::min(start, marker.getStart());
-        end = std::max(end, marker.getEnd());
-    }   // for j in events
+        for (int marker : main_td->m_ordered_headings)
+        {
+            const Marker &m = main_td->m_frame_markers[marker][indx];
+            start = std::min(start, m.getStart());
+            end = std::max(end, m.getEnd());
+        }   // for marker in ordered headings
+    }
 
 
     const double duration = end - start;
@@ -379,21 +629,22 @@ void Profiler::draw()
     // Get the mouse pos
     core::vector2di mouse_pos = GUIEngine::EventHandler::get()->getMousePos();
 
-    std::stack<AllEventData::iterator> hovered_markers;
-    for (int i = 0; i < m_threads_used; i++)
+    std::stack<std::pair<int, const Marker*> > hovered_markers;
+    for (int i = 0; i < threads_used; i++)
     {
-        ThreadData &td = m_all_threads_data[i];
-        AllEventData &aed = td.m_all_event_data;
+        ThreadData *td = m_all_threads_data[i].load();
+        if (!td)
+            continue;
 
         // Thread 1 has 'proper' start and end events (assuming that each
         // event is at most called once). But all other threads might have
         // multiple start and end events, so the recorder start time is only
         // of the last event and so can not be used to draw the bar graph
         double start_xpos = 0;
-        for(int k=0; k<(int)td.m_ordered_headings.size(); k++)
+        for(int k=0; k<(int)td->m_ordered_headings.size(); k++)
         {
-            AllEventData::iterator j = aed.find(td.m_ordered_headings[k]);
-            const Marker &marker = j->second.getMarker(indx);
+            const int marker_id = td->m_ordered_headings[k];
+            const Marker &marker = td->m_frame_markers[marker_id][indx];
             if (i == thread_id)
                 start_xpos = factor*marker.getStart();
             core::rect<s32> pos((s32)(x_offset + start_xpos),
@@ -408,21 +659,21 @@ void Profiler::draw()
             pos.UpperLeftCorner.Y  += 2 * (int)marker.getLayer();
             pos.LowerRightCorner.Y -= 2 * (int)marker.getLayer();
 
-            GL32_draw2DRectangle(j->second.getColour(), pos);
+            GL32_draw2DRectangle(getMarkerColour(marker_id), pos);
             // If the mouse cursor is over the marker, get its information
             if (pos.isPointInside(mouse_pos))
             {
-                hovered_markers.push(j);
+                hovered_markers.emplace(marker_id, &marker);
             }
 
-        }   // for j in AllEventdata
+        }   // for k in ordered headings
     }   // for i in threads
 
 
     // GPU profiler
     QueryPerf hovered_gpu_marker = Q_LAST;
     long hovered_gpu_marker_elapsed = 0;
-    int gpu_y = int(y_offset + m_threads_used*line_height + line_height/2);
+    int gpu_y = int(y_offset + threads_used*line_height + line_height/2);
     float total = 0;
     for (unsigned i = 0; i < Q_LAST; i++)
     {
@@ -473,7 +724,7 @@ void Profiler::draw()
     {
         s32 x_sync = (s32)(x_offset + factor*m_time_between_sync);
         s32 y_up_sync = (s32)(MARGIN_Y*screen_size.Height);
-        s32 y_down_sync = (s32)( (MARGIN_Y + (2+m_threads_used)*LINE_HEIGHT)
+        s32 y_down_sync = (s32)( (MARGIN_Y + (2+threads_used)*LINE_HEIGHT)
                                 * screen_size.Height                         );
 
         GL32_draw2DRectangle(video::SColor(0xFF, 0x00, 0x00, 0x00),
@@ -488,11 +739,11 @@ void Profiler::draw()
         core::stringw text;
         while(!hovered_markers.empty())
         {
-            AllEventData::iterator j = hovered_markers.top();
-            const Marker &marker = j->second.getMarker(indx);
+            const Marker &marker = *hovered_markers.top().second;
             std::ostringstream oss;
             oss.precision(4);
-            oss << j->first << " [" << (marker.getDuration()) << " ms / ";
+            oss << getMarkerName(hovered_markers.top().first) << " ["
+                << (marker.getDuration()) << " ms / ";
             oss.precision(3);
             oss << marker.getDuration()*100.0 / duration << "%]" << std::endl;
             text += oss.str().c_str();
@@ -585,9 +836,14 @@ void Profiler::computeStableFPS()
     //       If not, then additional code to identify the correct
     //       frametime values is needed. Once the vector of frametimes
     //       is produced, the rest of the computations are unchanged.
-    m_lock.lock();
+    ThreadData *td = m_all_threads_data[0].load();
+    if (!m_frame_data || !td || td->m_ordered_headings.empty())
+        return;
 
-    ThreadData &td = m_all_threads_data[0];
+    // The overall duration of a frame is recorded in the outermost
+    // marker event, which is always the 1st event in the list.
+    const std::vector<Marker> &frames =
+        td->m_frame_markers[td->m_ordered_headings[0]];
     int start = m_has_wrapped_around ? m_current_frame + 1 : 0;
     if (start > m_max_frames) start -= m_max_frames;
     // Remove any old data if needed
@@ -596,10 +852,7 @@ void Profiler::computeStableFPS()
 
     while (start != m_current_frame)
     {
-        // The overall duration of a frame is recorded in the outermost
-        // marker event, which is always the 1st event in the list.
-        const EventData &ed = td.m_all_event_data[td.m_ordered_headings[0]];
-        int frame_microseconds = int(ed.getMarker(start).getDuration()*1000);
+        int frame_microseconds = int(frames[start].getDuration()*1000);
         // A spurious instant frame is recorded at the beginning of the recording
         if (frame_microseconds > 0)
             m_frame_times.push_back(frame_microseconds);
@@ -649,8 +902,6 @@ void Profiler::computeStableFPS()
     }
 
     Log::info("Profiler", "Frame count '%i', Time (ms) '%i', Steady FPS '%i', Mostly stable FPS '%i', Typical FPS '%i'", m_total_frames, m_total_frametime/1000, m_fps_metrics_low, m_fps_metrics_mid, m_fps_metrics_high);
-
-    m_lock.unlock();
 } // computeStableFPS
 
 //-----------------------------------------------------------------------------
@@ -662,8 +913,9 @@ void Profiler::writeToFile()
     // Turn the profiler off, and ensure overall performance metrics are computed
     if (UserConfigParams::m_profiler_enabled)
         desactivate();
+    if (!m_frame_data)
+        return;
 
-    m_lock.lock();
     std::string base_name =
                file_manager->getUserConfigFile(file_manager->getStdoutName());
 
@@ -691,27 +943,41 @@ void Profiler::writeToFile()
         f << i << ", " << m_slow_frames[i-1] << ", " << ratio_time_spent << ", " << ratio_time_waited << ",";
         f << std::endl;
     }
+    f << std::endl;
+    f << "Counter, Value,";
+    f << std::endl;
+    for (auto& counter : getCounters())
+    {
+        f << counter.first << ", " << counter.second << ",";
+        f << std::endl;
+    }
     f.close();
 
     // 2: Save per-thread CPU data
-    for (int thread_id = 0; thread_id < m_threads_used; thread_id++)
+    for (int thread_id = 0; thread_id < getThreadsUsed(); thread_id++)
     {
+        ThreadData *td = m_all_threads_data[thread_id].load();
+        if (!td)
+            continue;
         std::ofstream f(FileUtils::getPortableWritingPath(base_name +
             ".profile-" + (Track::getCurrentTrack() != NULL ? Track::getCurrentTrack()->getIdent() : "menu") +
             "-cpu-" + StringUtils::toString(thread_id) + ".csv"));
-        ThreadData &td = m_all_threads_data[thread_id];
         f << "#  ";
-        for (unsigned int i = 0; i < td.m_ordered_headings.size(); i++)
-            f << "\"" << td.m_ordered_headings[i] << "(" << i+1 <<")\",   ";
+        for (unsigned int i = 0; i < td->m_ordered_headings.size(); i++)
+        {
+            f << "\"" << getMarkerName(td->m_ordered_headings[i]) << "("
+              << i+1 <<")\",   ";
+        }
         f << std::endl;
         int start = m_has_wrapped_around ? m_current_frame + 1 : 0;
         if (start > m_max_frames) start -= m_max_frames;
         while (start != m_current_frame)
         {
-            for (unsigned int i = 0; i < td.m_ordered_headings.size(); i++)
+            for (unsigned int i = 0; i < td->m_ordered_headings.size(); i++)
             {
-                const EventData &ed = td.m_all_event_data[td.m_ordered_headings[i]];
-                f << int(ed.getMarker(start).getDuration()*1000) << ", ";
+                const Marker &marker =
+                    td->m_frame_markers[td->m_ordered_headings[i]][start];
+                f << int(marker.getDuration()*1000) << ", ";
             }   // for i i new_headings
             f << std::endl;
             start = (start + 1) % m_max_frames;
@@ -743,6 +1009,161 @@ void Profiler::writeToFile()
         start = (start + 1) % m_max_frames;
     }
     f_gpu.close();
-    m_lock.unlock();
 
 }   // writeFile
+
+//-----------------------------------------------------------------------------
+/** Starts to record all events of all threads in a trace file, in the trace
+ *  event format of Chrome, which can be opened with chrome://tracing or
+ *  Perfetto. This also works without graphics (e.g. on servers).
+ *  \param filename Name of the trace file.
+ *  \param seconds Time after which the trace is stopped, or 0 to record
+ *         till stopTrace is called.
+ *  \return False if the file can't be written.
+ */
+bool Profiler::startTrace(const std::string& filename, float seconds)
+{
+    stopTrace();
+    m_trace_file = FileUtils::fopenU8Path(filename, "wb");
+    if (!m_trace_file)
+    {
+        Log::error("Profiler", "Can't write trace file '%s'.",
+                   filename.c_str());
+        return false;
+    }
+    // The JSON array format is used, which can be read even without the
+    // closing bracket (e.g. if the server was killed)
+    fprintf(m_trace_file, "[\n");
+    m_trace_names.clear();
+    m_trace_first_event = true;
+    m_trace_start       = getTimeMilliseconds();
+    m_trace_end         = seconds > 0.0f ? m_trace_start + seconds * 1000.0
+                                         : 0.0;
+    m_trace_last_flush  = m_trace_start;
+    activate();
+    Log::info("Profiler", "Recording trace '%s'.", filename.c_str());
+    return true;
+}   // startTrace
+
+//-----------------------------------------------------------------------------
+/** Writes the remaining events and closes the trace file. Must be called in
+ *  the main thread.
+ */
+void Profiler::stopTrace()
+{
+    if (!m_trace_file)
+        return;
+    processEvents();
+    fprintf(m_trace_file, "\n]\n");
+    fclose(m_trace_file);
+    m_trace_file = NULL;
+
+    uint32_t dropped = 0;
+    for (int i = 0; i < getThreadsUsed(); i++)
+    {
+        ThreadData *td = m_all_threads_data[i].load();
+        if (td)
+            dropped += td->m_dropped_events.load();
+    }
+    if (dropped > 0)
+    {
+        Log::warn("Profiler", "%u events were lost because the event buffer "
+                  "was full.", dropped);
+    }
+    Log::info("Profiler", "Trace recorded.");
+    desactivate();
+}   // stopTrace
+
+//-----------------------------------------------------------------------------
+/** Returns the total time (in ms) of each marker name since the last reset,
+ *  summed over all threads. Only events completed before the last
+ *  synchronizeFrame are included.
+ */
+std::map<std::string, double> Profiler::getMarkerTotals() const
+{
+    std::map<std::string, double> totals;
+    for (unsigned int i = 0; i < m_marker_totals.size(); i++)
+    {
+        if (m_marker_totals[i] > 0.0)
+            totals[getMarkerName(i)] += m_marker_totals[i];
+    }
+    return totals;
+}   // getMarkerTotals
+
+//-----------------------------------------------------------------------------
+/** Returns the id of a counter, which is created the first time. Returns
+ *  -1 if there are too many counters, which addToCounter ignores.
+ *  \param name Name of the counter.
+ */
+int Profiler::getCounterId(const char* name)
+{
+    std::lock_guard<std::mutex> lock(m_counters_mutex);
+    for (unsigned int i = 0; i < m_counter_names.size(); i++)
+    {
+        if (m_counter_names[i] == name)
+            return i;
+    }
+    if (m_counter_names.size() >= MAX_COUNTERS)
+    {
+        Log::warn("Profiler", "Too many counters, '%s' is ignored.", name);
+        return -1;
+    }
+    m_counter_names.push_back(name);
+    return (int)m_counter_names.size() - 1;
+}   // getCounterId
+
+//-----------------------------------------------------------------------------
+/** Adds a value to a counter. Counters are only changed when the profiler
+ *  is enabled.
+ *  \param id Id of the counter, see getCounterId.
+ *  \param value The value to add.
+ */
+void Profiler::addToCounter(int id, int64_t value)
+{
+    if (!UserConfigParams::m_profiler_enabled || id < 0)
+        return;
+    m_counters[id].fetch_add(value, std::memory_order_relaxed);
+}   // addToCounter
+
+//-----------------------------------------------------------------------------
+/** Returns the value of all counters.
+ */
+std::map<std::string, int64_t> Profiler::getCounters() const
+{
+    std::lock_guard<std::mutex> lock(m_counters_mutex);
+    std::map<std::string, int64_t> counters;
+    for (unsigned int i = 0; i < m_counter_names.size(); i++)
+        counters[m_counter_names[i]] = m_counters[i].load();
+    return counters;
+}   // getCounters
+
+//-----------------------------------------------------------------------------
+/** Writes an event as complete event to the trace file, times are in µs
+ *  since the start of the trace.
+ */
+void Profiler::writeTraceEvent(int thread_id, const Event& e)
+{
+    if (e.m_marker >= m_trace_names.size())
+    {
+        std::lock_guard<std::mutex> lock(m_markers_mutex);
+        for (size_t i = m_trace_names.size(); i < m_marker_names.size(); i++)
+        {
+            std::string name;
+            for (char c : m_marker_names[i])
+            {
+                if (c == '"' || c == '\\')
+                    name += '\\';
+                if ((unsigned char)c >= 0x20)
+                    name += c;
+            }
+            m_trace_names.push_back(name);
+        }
+    }
+    fprintf(m_trace_file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            m_trace_first_event ? "" : ",\n",
+            m_trace_names[e.m_marker].c_str(), thread_id,
+            (e.m_start - m_trace_start) * 1000.0,
+            (e.m_end - e.m_start) * 1000.0);
+    m_trace_first_event = false;
+}   // writeTraceEvent
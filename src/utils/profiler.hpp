@@ -20,11 +20,15 @@
 
 #include "utils/synchronised.hpp"
 
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <list>
 #include <map>
+#include <mutex>
 #include <ostream>
 #include <stack>
 #include <streambuf>
@@ -72,7 +76,18 @@ double getTimeMilliseconds();
 #define ENABLE_PROFILER
 
 #ifdef ENABLE_PROFILER
-    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b) \
+    /** The id of the marker is only looked up the first time, so the name
+     *  must be the same each time (use PROFILER_PUSH_DYNAMIC_CPU_MARKER
+     *  otherwise). */
+    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)                           \
+        do                                                                  \
+        {                                                                   \
+            static const int profiler_marker_id =                           \
+                profiler.getMarkerId(name, video::SColor(0xFF, r, g, b));   \
+            profiler.pushCPUMarker(profiler_marker_id);                     \
+        } while (0)
+
+    #define PROFILER_PUSH_DYNAMIC_CPU_MARKER(name, r, g, b) \
         profiler.pushCPUMarker(name, video::SColor(0xFF, r, g, b))
 
     #define PROFILER_POP_CPU_MARKER()  \
@@ -83,11 +98,23 @@ double getTimeMilliseconds();
 
     #define PROFILER_DRAW() \
         profiler.draw()
+
+    /** Like the marker ids, the index of the counter is only looked up the
+     *  first time, so the name must be the same each time. */
+    #define PROFILER_ADD_TO_COUNTER(name, value)                              \
+        do                                                                  \
+        {                                                                   \
+            static const int profiler_counter_id =                          \
+                profiler.getCounterId(name);                                \
+            profiler.addToCounter(profiler_counter_id, value);              \
+        } while (0)
 #else
     #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)
+    #define PROFILER_PUSH_DYNAMIC_CPU_MARKER(name, r, g, b)
     #define PROFILER_POP_CPU_MARKER()
     #define PROFILER_SYNC_FRAME()
     #define PROFILER_DRAW()
+    #define PROFILER_ADD_TO_COUNTER(name, value)
 #endif
 
 using namespace irr;
@@ -161,86 +188,155 @@ private:
     };   // class Marker
 
     // ========================================================================
-    /** The data for one event. It contains the events colours, all markers
-     * for the buffer period and a stack to detect nesting of markers.
-     */
-    class EventData
+    /** An event which was pushed and popped by a thread. Times are in ms as
+     *  returned by getTimeMilliseconds. */
+    struct Event
     {
-    private:
-        /** Colour to use in the on-screen display */
-        video::SColor m_colour;
-
-        /** Vector of all buffered markers. */
-        std::vector<Marker> m_all_markers;
-
-    public:
-        EventData() {}
-        EventData(video::SColor colour, int max_size)
-        {
-            m_all_markers.resize(max_size);
-            m_colour = colour;
-        }   // EventData
-        // --------------------------------------------------------------------
-        /** Records the start of an event for a given frame. */
-        void setStart(size_t frame, double start, int layer)
-        {
-            assert(frame < m_all_markers.capacity());
-            m_all_markers[frame].setStart(start, layer);
-        }   // setStart
-        // --------------------------------------------------------------------
-        /** Records the end of an event for a given frame. */
-        void setEnd(size_t frame, double end)
-        {
-            assert(frame < m_all_markers.capacity());
-            m_all_markers[frame].setEnd(end);
-        }   // setEnd
-        // --------------------------------------------------------------------
-        const Marker& getMarker(int n) const { return m_all_markers[n]; }
-        Marker& getMarker(int n) { return m_all_markers[n]; }
-        // --------------------------------------------------------------------
-        /** Returns the colour for this event. */
-        video::SColor getColour() const { return m_colour;  }
-        // --------------------------------------------------------------------
-    };   // EventData
+        double   m_start;
+        double   m_end;
+        /** Frame in which the event was pushed. */
+        int      m_frame;
+        uint16_t m_marker;
+        /** Distance of the event from root (for nested events). */
+        uint16_t m_layer;
+    };   // Event
 
     // ========================================================================
-    /** The mapping of event names to the corresponding EventData. */
-    typedef std::map<std::string, EventData> AllEventData;
+    /** An event which was pushed but not popped yet. */
+    struct OpenEvent
+    {
+        double m_start;
+        int    m_frame;
+        int    m_marker;
+    };   // OpenEvent
+
     // ========================================================================
+    /** The events of one thread. A thread adds its completed events to a
+     *  ring buffer without any lock, synchronizeFrame then reads them in
+     *  the main thread. */
     struct ThreadData
     {
-        /** Stack of events to detect nesting. */
-        std::vector< std::string > m_event_stack;
+        /** Stack of events to detect nesting, only used by the thread. */
+        std::vector<OpenEvent> m_event_stack;
+
+        /** Ring buffer of completed events, with EVENT_BUFFER_SIZE
+         *  entries. */
+        std::vector<Event> m_events;
 
-        /** This stores the event names in the order in which they occur.
+        /** Number of events written by the thread. */
+        std::atomic<uint32_t> m_write_index;
+
+        /** Number of events read in the main thread. */
+        std::atomic<uint32_t> m_read_index;
+
+        /** Events lost because the ring buffer was full. */
+        std::atomic<uint32_t> m_dropped_events;
+
+        /** Marker ids of names which are not constant, only used by the
+         *  thread. */
+        std::map<std::string, int> m_dynamic_marker_ids;
+
+        /** The buffered markers of each frame, indexed by marker id and then
+         *  frame. Empty for markers not used by this thread. Only used in
+         *  the main thread, like all data below. */
+        std::vector<std::vector<Marker> > m_frame_markers;
+
+        /** This stores the marker ids in the order in which they occur.
         *  This means that 'outer' events occur here before any child
         *  events. This list is then used to determine the order in which the
         *  bar graphs are drawn, which results in the proper nesting of events.*/
-        std::vector<std::string> m_ordered_headings;
+        std::vector<int> m_ordered_headings;
 
-        AllEventData m_all_event_data;
+        ThreadData();
     };   // class ThreadData
 
     // ========================================================================
 
-    /** Data structure containing all currently buffered markers. The index
-     *  is the thread id. */
-    std::vector< ThreadData> m_all_threads_data;
+    /** Maximum number of profiled threads, any further threads are
+     *  ignored. */
+    static const int MAX_THREADS = 32;
+
+    /** Size of the ring buffer of each thread, must be a power of 2. */
+    static const uint32_t EVENT_BUFFER_SIZE = 16384;
+
+    /** Data of each thread, created by the thread itself when it pushes its
+     *  first marker. The index is the thread id. */
+    std::atomic<ThreadData*> m_all_threads_data[MAX_THREADS];
+
+    /** If a running thread uses the thread id. When a thread exits its id
+     *  is used by the next new thread, with the same ThreadData. */
+    std::atomic<bool> m_thread_id_used[MAX_THREADS];
+
+    /** Set once it was logged that there are too many threads. */
+    std::atomic<bool> m_too_many_threads_logged;
+
+    /** Protects the marker names and colours, which can be added by any
+     *  thread. */
+    mutable std::mutex m_markers_mutex;
+
+    /** Name of each marker, indexed by marker id. */
+    std::vector<std::string> m_marker_names;
+
+    /** Colour of each marker in the on-screen display. */
+    std::vector<video::SColor> m_marker_colours;
+
+    /** The marker id of each name. */
+    std::map<std::string, int> m_marker_ids;
+
+    /** Events read from the threads in synchronizeFrame. */
+    std::vector<Event> m_new_events;
+
+    /** Total time (in ms) of each marker in all threads since the last
+     *  reset, indexed by marker id. Only used in the main thread. */
+    std::vector<double> m_marker_totals;
+
+    /** Maximum number of counters, any further counters are ignored. */
+    static const int MAX_COUNTERS = 64;
+
+    /** Counters (e.g. cache hits) which are not reset, so they include
+     *  events before the profiling started, like loading a track. The
+     *  index is the counter id. */
+    std::atomic<int64_t> m_counters[MAX_COUNTERS];
+
+    /** Names of the counters, indexed by counter id. */
+    std::vector<std::string> m_counter_names;
+
+    /** Protects the counter names, which can be added by any thread. */
+    mutable std::mutex m_counters_mutex;
 
     /** Buffer for the GPU times (in ms). */
     std::vector<int> m_gpu_times;
 
-    /** Counts the threads used. */
+    /** Start time of each frame in the buffer. */
+    std::vector<double> m_frame_start;
+
+    /** The highest thread id used plus one. */
     std::atomic<int> m_threads_used;
 
     /** Index of the current frame in the buffer. */
-    int m_current_frame;
+    std::atomic<int> m_current_frame;
+
+    /** True if the markers of each frame are stored for drawing and the
+     *  reports, see init(). */
+    bool m_frame_data;
+
+    /** The trace file if a trace is recorded, or NULL. */
+    FILE* m_trace_file;
+
+    /** Marker names escaped for the trace file, indexed by marker id. */
+    std::vector<std::string> m_trace_names;
+
+    /** True if no event was written to the trace file yet. */
+    bool m_trace_first_event;
 
-    /** We don't need the bool, but easiest way to get a lock for the whole
-     *  instance (since we need to avoid that a synch is done which changes
-     *  the current frame while another threaded uses this variable, or
-     *  while a new thread is added. */
-    Synchronised<bool> m_lock;
+    /** Time when the trace was started. */
+    double m_trace_start;
+
+    /** Time when the trace is stopped, or 0 to record till stopTrace. */
+    double m_trace_end;
+
+    /** Time when the trace file was last flushed. */
+    double m_trace_last_flush;
 
     /** Stores the frame times (in µs), once FPS metrics are computed. */
     std::vector<int> m_frame_times;
@@ -281,18 +377,12 @@ private:
      *  reallocations. */
     int m_max_frames;
 
-    /** Time of last sync. All start/end times are stored relative
-     *  to this time. */
+    /** Time of last sync, i.e. the start of the current frame. */
     double m_time_last_sync;
 
     /** Time between now and last sync, used to scale the GUI bar. */
     double m_time_between_sync;
 
-    /** List of all event names. This list is sorted to make sure
-     *  if the circular buffer is dumped more than once the order
-     *  of events remains the same. */
-    std::vector<std::string> m_all_event_names;
-
     // Handling freeze/unfreeze by clicking on the display
     enum FreezeState
     {
@@ -302,17 +392,32 @@ private:
         WAITING_FOR_UNFREEZE,
     };
 
-    FreezeState     m_freeze_state;
+    std::atomic<FreezeState> m_freeze_state;
 
 private:
-    int  getThreadID();
+    ThreadData* getThreadData();
+    int acquireThreadId();
+    // ------------------------------------------------------------------------
+    int getThreadsUsed() const
+    {
+        return std::min((int)m_threads_used, (int)MAX_THREADS);
+    }   // getThreadsUsed
+    // ------------------------------------------------------------------------
     void drawBackground();
+    void processEvents();
+    void addToFrame(ThreadData* td, const Event& e);
+    void writeTraceEvent(int thread_id, const Event& e);
+    std::string getMarkerName(int marker) const;
+    video::SColor getMarkerColour(int marker) const;
 
 public:
              Profiler();
     virtual ~Profiler();
     void     init();
     void     reset();
+    int      getMarkerId(const std::string& name,
+                         const video::SColor& colour);
+    void     pushCPUMarker(int marker);
     void     pushCPUMarker(const char* name="N/A",
                            const video::SColor& color=video::SColor());
     void     popCPUMarker();
@@ -323,6 +428,13 @@ public:
     void     onClick(const core::vector2di& mouse_pos);
     void     computeStableFPS();
     void     writeToFile();
+    bool     startTrace(const std::string& filename, float seconds = 0.0f);
+    void     stopTrace();
+    std::map<std::string, double> getMarkerTotals() const;
+    int      getCounterId(const char* name);
+    void     addToCounter(int id, int64_t value);
+    std::map<std::string, int64_t> getCounters() const;
+    void     releaseThreadId(int id);
 
     // ------------------------------------------------------------------------
     bool isFrozen() const { return m_freeze_state == FROZEN; }
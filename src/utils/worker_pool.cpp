@@ -0,0 +1,175 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/worker_pool.hpp"
+
+#include "config/user_config.hpp"
+#include "guiengine/engine.hpp"
+#include "network/network_config.hpp"
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+    std::mutex g_shared_pool_mutex;
+    std::unique_ptr<WorkerPool> g_shared_pool;
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Starts the threads.
+ *  \param num_threads Number of threads running a loop, including the
+ *         thread calling parallelFor. With 1 no thread is started.
+ */
+WorkerPool::WorkerPool(unsigned int num_threads)
+{
+    m_body           = NULL;
+    m_num_iterations = 0;
+    m_next_iteration = 0;
+    m_busy_threads   = 0;
+    m_loop_count     = 0;
+    m_process_type   = PT_MAIN;
+    m_quit           = false;
+    m_in_use         = false;
+    for (unsigned int i = 1; i < num_threads; i++)
+        m_threads.emplace_back(&WorkerPool::threadMain, this);
+}   // WorkerPool
+
+// ----------------------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_start_cv.notify_all();
+    for (std::thread& t : m_threads)
+        t.join();
+}   // ~WorkerPool
+
+// ----------------------------------------------------------------------------
+/** Returns the pool shared by all worlds of this process (including the
+ *  server of a client hosting a game), and creates it at the first call.
+ *  Its threads are only started if more than one simulation thread is
+ *  configured, otherwise parallelFor runs the loops in the calling thread.
+ */
+WorkerPool* WorkerPool::get()
+{
+    std::lock_guard<std::mutex> lock(g_shared_pool_mutex);
+    if (!g_shared_pool)
+    {
+        int num_threads = UserConfigParams::m_simulation_threads;
+        g_shared_pool.reset(new WorkerPool(num_threads > 0 ?
+            (unsigned int)num_threads : getDefaultNumThreads()));
+    }
+    return g_shared_pool.get();
+}   // get
+
+// ----------------------------------------------------------------------------
+/** Stops the threads of the shared pool. Must only be called when no world
+ *  exists anymore.
+ */
+void WorkerPool::destroy()
+{
+    std::lock_guard<std::mutex> lock(g_shared_pool_mutex);
+    g_shared_pool.reset();
+}   // destroy
+
+// ----------------------------------------------------------------------------
+/** Returns the number of threads to use if none is configured: one for each
+ *  core, but not more than 8 since the loops are short. A dedicated server
+ *  often shares its host with other servers, so it only uses its main
+ *  thread unless more are configured.
+ */
+unsigned int WorkerPool::getDefaultNumThreads()
+{
+    if (GUIEngine::isNoGraphics() && NetworkConfig::get()->isServer())
+        return 1;
+    return std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+}   // getDefaultNumThreads
+
+// ----------------------------------------------------------------------------
+void WorkerPool::threadMain()
+{
+    VS::setThreadName("WorkerPool");
+    uint64_t loops_done = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_start_cv.wait(lock, [this, loops_done]()
+            { return m_quit || m_loop_count != loops_done; });
+        if (m_quit)
+            return;
+        loops_done = m_loop_count;
+        STKProcess::init(m_process_type);
+        lock.unlock();
+        runIterations();
+        lock.lock();
+        if (--m_busy_threads == 0)
+            m_done_cv.notify_one();
+    }
+}   // threadMain
+
+// ----------------------------------------------------------------------------
+void WorkerPool::runIterations()
+{
+    for (unsigned int i = m_next_iteration++; i < m_num_iterations;
+         i = m_next_iteration++)
+    {
+        (*m_body)(i);
+    }
+}   // runIterations
+
+// ----------------------------------------------------------------------------
+/** Runs body(i) for each i from 0 to num_iterations-1 in this thread and all
+ *  threads of the pool, and returns when all iterations are done. If the
+ *  pool is running the loop of another thread, e.g. of the server of a
+ *  client hosting a game, the loop runs in the calling thread only.
+ *  \param num_iterations Number of iterations.
+ *  \param body The body of the loop.
+ */
+void WorkerPool::parallelFor(unsigned int num_iterations,
+                             const std::function<void(unsigned int)>& body)
+{
+    bool in_use = false;
+    if (m_threads.empty() || num_iterations < 2 ||
+        !m_in_use.compare_exchange_strong(in_use, true))
+    {
+        for (unsigned int i = 0; i < num_iterations; i++)
+            body(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_body           = &body;
+        m_num_iterations = num_iterations;
+        m_next_iteration = 0;
+        m_busy_threads   = (unsigned int)m_threads.size();
+        m_process_type   = STKProcess::getType();
+        m_loop_count++;
+    }
+    m_start_cv.notify_all();
+    runIterations();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this]() { return m_busy_threads == 0; });
+    m_body = NULL;
+    m_in_use = false;
+}   // parallelFor
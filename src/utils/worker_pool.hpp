@@ -0,0 +1,98 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_WORKER_POOL_HPP
+#define HEADER_WORKER_POOL_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/stk_process.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed set of threads which run the iterations of a loop in parallel
+ *  with the thread calling parallelFor. The threads sleep while there is
+ *  no loop to run. Iterations are taken one by one by any thread, so the
+ *  result of an iteration must not depend on the thread running it or on
+ *  the other iterations of the same loop. One pool is shared by the whole
+ *  process, see get().
+ *  \ingroup utils
+ */
+class WorkerPool : public NoCopy
+{
+private:
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+
+    /** True while the pool runs the loop of a thread. */
+    std::atomic<bool> m_in_use;
+
+    /** Signals the threads that a new loop started or that they must
+     *  stop. */
+    std::condition_variable m_start_cv;
+
+    /** Signals parallelFor that the last thread finished the loop. */
+    std::condition_variable m_done_cv;
+
+    /** The body of the current loop. */
+    const std::function<void(unsigned int)>* m_body;
+
+    /** Number of iterations of the current loop. */
+    unsigned int m_num_iterations;
+
+    /** The next iteration to run. */
+    std::atomic<unsigned int> m_next_iteration;
+
+    /** Number of threads which didn't finish the current loop yet. */
+    unsigned int m_busy_threads;
+
+    /** Increased for each loop, so a thread knows if it ran it already. */
+    uint64_t m_loop_count;
+
+    /** Process of the thread calling parallelFor, which the threads use
+     *  too, so that e.g. World::getWorld() returns the same world. */
+    ProcessType m_process_type;
+
+    bool m_quit;
+
+    void threadMain();
+    void runIterations();
+
+public:
+    WorkerPool(unsigned int num_threads);
+    ~WorkerPool();
+    void parallelFor(unsigned int num_iterations,
+                     const std::function<void(unsigned int)>& body);
+    static WorkerPool* get();
+    static void destroy();
+    static unsigned int getDefaultNumThreads();
+    // ------------------------------------------------------------------------
+    /** Returns the number of threads running a loop, including the thread
+     *  calling parallelFor. */
+    unsigned int getNumThreads() const
+                                  { return (unsigned int)m_threads.size() + 1; }
+
+};   // WorkerPool
+
+#endif